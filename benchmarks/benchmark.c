@@ -0,0 +1,65 @@
+#include "benchmark.h"
+#include "io/io-common.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void benchmark_results_init(benchmark_results *results, const char *suite)
+{
+    results->suite = suite;
+    results->results = json_node_ref(json_array_new());
+    results->failed = false;
+}
+
+bool benchmark_run(benchmark_results *results,
+                   const char        *name,
+                   unsigned           iterations,
+                   benchmark_func     func,
+                   void              *user_data)
+{
+    histogram *times = histogram_new();
+    bool success = func(user_data);
+
+    for (unsigned i = 0; success && i < iterations; i++) {
+        const uint64_t start = io_get_monotonic_time();
+
+        success = func(user_data);
+        histogram_record(times, io_get_monotonic_time() - start);
+    }
+
+    if (success) {
+        json_node *result = json_object_new();
+
+        json_object_set_member(result, "name", json_string_new(name));
+        json_object_set_member(result, "iterations", json_integer_new(iterations));
+        json_object_set_member(result, "minNs", json_integer_new((int64_t)times->min));
+        json_object_set_member(result, "meanNs", json_integer_new((int64_t)histogram_get_mean(times)));
+        json_object_set_member(result, "p50Ns", json_integer_new((int64_t)histogram_get_percentile(times, 50)));
+        json_object_set_member(result, "p90Ns", json_integer_new((int64_t)histogram_get_percentile(times, 90)));
+        json_object_set_member(result, "p99Ns", json_integer_new((int64_t)histogram_get_percentile(times, 99)));
+        json_object_set_member(result, "maxNs", json_integer_new((int64_t)times->max));
+        json_array_add_element(results->results, result);
+    } else {
+        fprintf(stderr, "%s: benchmark `%s` failed\n", results->suite, name);
+        results->failed = true;
+    }
+
+    histogram_destroy(times);
+    return success;
+}
+
+int benchmark_results_finish(benchmark_results *results)
+{
+    json_node *output = json_node_ref(json_object_new());
+
+    json_object_set_member(output, "suite", json_string_new(results->suite));
+    json_object_set_member(output, "results", results->results);
+
+    char *output_str = json_node_to_string(output, true);
+    printf("%s\n", output_str);
+    free(output_str);
+
+    json_node_unref(output);
+    json_node_unref(results->results);
+    results->results = NULL;
+    return results->failed ? 1 : 0;
+}
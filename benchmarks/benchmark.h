@@ -0,0 +1,52 @@
+#pragma once
+
+#include "data-structures/histogram.h"
+#include "json/json.h"
+#include <stdbool.h>
+
+/**
+ * Runs one iteration of a benchmark. Returns false if the iteration failed,
+ * which fails the benchmark.
+ */
+typedef bool (*benchmark_func)(void *user_data);
+
+/**
+ * The results of the benchmarks in one executable.
+ */
+typedef struct {
+    const char *suite;
+    json_node *results;                 // one object for each benchmark
+    bool failed;
+} benchmark_results;
+
+void benchmark_results_init(benchmark_results *results, const char *suite);
+
+/**
+ * Runs [func] once to warm up, and then [iterations] times while timing each
+ * iteration. The distribution of the times is added to [results] under
+ * [name].
+ *
+ * @return whether every iteration succeeded
+ */
+bool benchmark_run(benchmark_results *results,
+                   const char        *name,
+                   unsigned           iterations,
+                   benchmark_func     func,
+                   void              *user_data);
+
+/**
+ * Prints [results] to `stdout` as JSON, for tracking regressions:
+ *
+ * ```
+ * { "suite": "json", "results": [
+ *     { "name": "parse-diagnostics", "iterations": 50, "minNs": 1210343,
+ *       "meanNs": 1268761, "p50Ns": 1253375, "p90Ns": 1318911,
+ *       "p99Ns": 1466367, "maxNs": 1470912 }, ...
+ * ] }
+ * ```
+ *
+ * The times are in nanoseconds.
+ *
+ * @return the exit status of the benchmark executable
+ */
+int benchmark_results_finish(benchmark_results *results);
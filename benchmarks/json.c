@@ -0,0 +1,252 @@
+#include "benchmark.h"
+#include "io/inputstream.h"
+#include "json/json-parser.h"
+#include "json/json.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// parses and serializes messages shaped like the ones that language servers
+// send, and matches patterns with ellipses against them
+
+#define NUM_DIAGNOSTICS 2000
+#define NUM_COMPLETIONS 2000
+
+static json_node *create_position(int64_t line, int64_t character)
+{
+    json_node *position = json_object_new();
+
+    json_object_set_member(position, "line", json_integer_new(line));
+    json_object_set_member(position, "character", json_integer_new(character));
+
+    return position;
+}
+
+static json_node *create_range(int64_t line, int64_t start, int64_t end)
+{
+    json_node *range = json_object_new();
+
+    json_object_set_member(range, "start", create_position(line, start));
+    json_object_set_member(range, "end", create_position(line, end));
+
+    return range;
+}
+
+static json_node *create_notification(const char *method, json_node *params)
+{
+    json_node *notification = json_object_new();
+
+    json_object_set_member(notification, "jsonrpc", json_string_new("2.0"));
+    json_object_set_member(notification, "method", json_string_new(method));
+    json_object_set_member(notification, "params", params);
+
+    return notification;
+}
+
+/**
+ * A `textDocument/publishDiagnostics` notification.
+ */
+static json_node *create_diagnostics_message(void)
+{
+    json_node *params = json_object_new();
+    json_node *diagnostics = json_array_new();
+
+    for (int64_t i = 0; i < NUM_DIAGNOSTICS; i++) {
+        json_node *diagnostic = json_object_new();
+
+        json_object_set_member(diagnostic, "range", create_range(i, 4, 12));
+        json_object_set_member(diagnostic, "severity", json_integer_new(1 + i % 4));
+        // some servers only send a code for some diagnostics
+        if (i % 3 == 0)
+            json_object_set_member(diagnostic, "code", json_string_new("unused-variable"));
+        json_object_set_member(diagnostic, "source", json_string_new("vala"));
+        json_object_set_member(diagnostic, "message",
+                json_string_new(i % 2 ? "unused variable `result'" : "expected `;' before `}'"));
+        json_array_add_element(diagnostics, diagnostic);
+    }
+
+    json_object_set_member(params, "uri", json_string_new("file:///home/user/project/src/main.vala"));
+    json_object_set_member(params, "diagnostics", diagnostics);
+    return create_notification("textDocument/publishDiagnostics", params);
+}
+
+/**
+ * A response to `textDocument/completion`.
+ */
+static json_node *create_completion_message(void)
+{
+    json_node *response = json_object_new();
+    json_node *result = json_object_new();
+    json_node *items = json_array_new();
+
+    for (int64_t i = 0; i < NUM_COMPLETIONS; i++) {
+        json_node *item = json_object_new();
+        json_node *text_edit = json_object_new();
+        char label[32];
+
+        snprintf(label, sizeof label, "get_property_%" PRId64, i);
+        json_object_set_member(item, "label", json_string_new(label));
+        json_object_set_member(item, "kind", json_integer_new(2 + i % 20));
+        json_object_set_member(item, "detail", json_string_new("public unowned string? (int index, bool strict = false)"));
+        json_object_set_member(item, "sortText", json_string_new(label));
+        json_object_set_member(item, "deprecated", json_boolean_new(i % 50 == 0));
+        json_object_set_member(text_edit, "range", create_range(42, 8, 11));
+        json_object_set_member(text_edit, "newText", json_string_new(label));
+        json_object_set_member(item, "textEdit", text_edit);
+        json_array_add_element(items, item);
+    }
+
+    json_object_set_member(result, "isIncomplete", json_boolean_new(false));
+    json_object_set_member(result, "items", items);
+    json_object_set_member(response, "jsonrpc", json_string_new("2.0"));
+    json_object_set_member(response, "id", json_integer_new(7));
+    json_object_set_member(response, "result", result);
+    return response;
+}
+
+/**
+ * Creates `{ params: { diagnostics: [..., d(lines[0]), ..., d(lines[1]), ..., ...] } }`
+ */
+static json_node *create_diagnostics_pattern(const int64_t lines[], unsigned num_lines)
+{
+    json_node *pattern = json_object_pattern_new();
+    json_node *params = json_object_pattern_new();
+    json_node *diagnostics = json_array_pattern_new();
+
+    json_array_add_element(diagnostics, json_ellipsis_new());
+    for (unsigned i = 0; i < num_lines; i++) {
+        json_node *diagnostic = json_object_pattern_new();
+        json_node *range = json_object_pattern_new();
+        json_node *start = json_object_pattern_new();
+
+        json_object_set_member(start, "line", json_integer_new(lines[i]));
+        json_object_set_member(range, "start", start);
+        json_object_set_member(diagnostic, "range", range);
+        json_array_add_element(diagnostics, diagnostic);
+        json_array_add_element(diagnostics, json_ellipsis_new());
+    }
+    json_object_set_member(params, "diagnostics", diagnostics);
+    json_object_set_member(pattern, "params", params);
+
+    return pattern;
+}
+
+typedef struct {
+    json_node *message;
+    char *text;
+    size_t text_length;
+} payload;
+
+static void payload_init(payload *p, json_node *message)
+{
+    p->message = json_node_ref(message);
+    p->text = json_node_to_string(message, false);
+    p->text_length = strlen(p->text);
+}
+
+static void payload_clear(payload *p)
+{
+    json_node_unref(p->message);
+    free(p->text);
+}
+
+static bool parse(void *user_data)
+{
+    const payload *p = user_data;
+    json_node *node = json_parser_parse_string(p->text);
+
+    if (!node)
+        return false;
+    json_node_unref(node);
+    return true;
+}
+
+/**
+ * Parses the way the JSON-RPC server does, with each message in an arena.
+ */
+static bool parse_in_arena(void *user_data)
+{
+    const payload *p = user_data;
+    json_parser *parser = json_parser_create_from_stream(inputstream_new_from_static_buffer(p->text, p->text_length));
+    bool success = false;
+
+    parser->use_arenas = true;
+    json_node *node = json_parser_parse_node(parser);
+    if (node) {
+        success = true;
+        json_node_unref(node);
+    }
+    json_parser_destroy(parser);
+    return success;
+}
+
+static bool serialize(void *user_data)
+{
+    const payload *p = user_data;
+    char *text = json_node_to_string(p->message, false);
+    const bool success = strlen(text) == p->text_length;
+
+    free(text);
+    return success;
+}
+
+typedef struct {
+    json_node *pattern;
+    json_node *message;
+    bool expected;
+} match_case;
+
+static bool match(void *user_data)
+{
+    const match_case *m = user_data;
+
+    return json_node_equal_to(m->pattern, m->message) == m->expected;
+}
+
+static void run_match(benchmark_results *results,
+                      const char        *name,
+                      json_node         *message,
+                      const int64_t      lines[],
+                      unsigned           num_lines,
+                      bool               expected)
+{
+    match_case m = { json_node_ref(create_diagnostics_pattern(lines, num_lines)), message, expected };
+
+    benchmark_run(results, name, 50, match, &m);
+    json_node_unref(m.pattern);
+}
+
+int main(void)
+{
+    benchmark_results results;
+    payload diagnostics, completion;
+
+    benchmark_results_init(&results, "json");
+    payload_init(&diagnostics, create_diagnostics_message());
+    payload_init(&completion, create_completion_message());
+
+    benchmark_run(&results, "parse-diagnostics", 50, parse, &diagnostics);
+    benchmark_run(&results, "parse-diagnostics-arena", 50, parse_in_arena, &diagnostics);
+    benchmark_run(&results, "serialize-diagnostics", 50, serialize, &diagnostics);
+    benchmark_run(&results, "parse-completion", 50, parse, &completion);
+    benchmark_run(&results, "parse-completion-arena", 50, parse_in_arena, &completion);
+    benchmark_run(&results, "serialize-completion", 50, serialize, &completion);
+
+    const int64_t in_order[] = { 10, NUM_DIAGNOSTICS / 2, NUM_DIAGNOSTICS - 10 };
+    const int64_t out_of_order[] = { NUM_DIAGNOSTICS / 2, 10, NUM_DIAGNOSTICS - 10 };
+    const int64_t missing[] = { 10, NUM_DIAGNOSTICS / 2, NUM_DIAGNOSTICS };
+    const int64_t many[] = { 1, 2, 3, 200, 400, 600, 800, 1000, 1200, NUM_DIAGNOSTICS - 1 };
+
+    run_match(&results, "match-1-ellipsis", diagnostics.message, in_order, 0, true);
+    run_match(&results, "match-4-ellipses", diagnostics.message, in_order, 3, true);
+    run_match(&results, "match-4-ellipses-out-of-order", diagnostics.message, out_of_order, 3, false);
+    run_match(&results, "match-4-ellipses-missing", diagnostics.message, missing, 3, false);
+    run_match(&results, "match-11-ellipses", diagnostics.message, many, 10, true);
+
+    payload_clear(&diagnostics);
+    payload_clear(&completion);
+    return benchmark_results_finish(&results);
+}
@@ -0,0 +1,141 @@
+#include "benchmark.h"
+#include "io/event.h"
+#include "io/inputstream.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "jsonrpc/jsonrpc-server.h"
+#include "json/json.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// makes calls to an echo server over a pipe and waits for the responses. the
+// echo server is this same program, started with `--serve`
+
+#define NUM_PIPELINED_CALLS 100
+
+static void echo(jsonrpc_server *server,
+                 const char     *method,
+                 json_node      *id,
+                 json_node      *parameters,
+                 void           *user_data)
+{
+    (void) method;
+    (void) user_data;
+    jsonrpc_server_reply_to_remote(server, id, parameters ? parameters : json_null_new());
+}
+
+static int serve(void)
+{
+    jsonrpc_server *server = jsonrpc_server_new(inputstream_new_from_fd(0, false), outputstream_new_from_fd(1, false));
+    eventloop *loop = eventloop_new();
+
+    jsonrpc_server_handle_call(server, "echo", echo, NULL, NULL);
+    jsonrpc_server_listen(server, loop);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    const int error_code = (int) server->error_code;
+    jsonrpc_server_destroy(server);
+    eventloop_destroy(loop);
+    return error_code;
+}
+
+typedef struct {
+    jsonrpc_server *server;
+    eventloop *loop;
+    json_node *parameters;
+    unsigned num_responses;
+    bool failed;
+} client;
+
+static void echo_cb(const event *ev, void *user_data)
+{
+    client *c = user_data;
+    int error = 0;
+    json_node *result = jsonrpc_server_call_remote_finish(ev, &error);
+
+    if (!result || !json_node_equal_to(result, c->parameters)) {
+        fprintf(stderr, "failed to get an echo: %s\n", error ? strerror(error) : "wrong result");
+        c->failed = true;
+    }
+    if (result)
+        json_node_unref(result);
+    c->num_responses++;
+}
+
+/**
+ * Makes [num_calls] calls at once and waits for all of the responses.
+ */
+static bool call(client *c, unsigned num_calls)
+{
+    c->num_responses = 0;
+    for (unsigned i = 0; i < num_calls; i++)
+        jsonrpc_server_call_remote_async(c->server, "echo", c->parameters, c->loop, echo_cb, c);
+    while (c->num_responses < num_calls && eventloop_process(c->loop, false, NULL))
+        ;
+    return c->num_responses == num_calls && !c->failed;
+}
+
+static bool round_trip(void *user_data)
+{
+    return call(user_data, 1);
+}
+
+static bool pipelined_round_trips(void *user_data)
+{
+    return call(user_data, NUM_PIPELINED_CALLS);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 2 && strcmp(argv[1], "--serve") == 0)
+        return serve();
+
+    outputstream *remote_stdin = NULL;
+    inputstream *remote_stdout = NULL;
+    io_process process = {0};
+
+    if (!io_communicate(argv[0], (const char *[]){argv[0], "--serve", NULL}, &remote_stdin,
+                        &remote_stdout, NULL, &process)) {
+        fprintf(stderr, "failed to launch echo server: %s\n", strerror(errno));
+        return 1;
+    }
+
+    benchmark_results results;
+    client c = {
+        .server = jsonrpc_server_new(remote_stdout, remote_stdin),
+        .loop = eventloop_new()
+    };
+
+    // a small request, like a hover or a definition
+    c.parameters = json_node_ref(json_object_new());
+    json_node *text_document = json_object_new();
+    json_node *position = json_object_new();
+    json_object_set_member(text_document, "uri", json_string_new("file:///home/user/project/src/main.vala"));
+    json_object_set_member(position, "line", json_integer_new(42));
+    json_object_set_member(position, "character", json_integer_new(17));
+    json_object_set_member(c.parameters, "textDocument", text_document);
+    json_object_set_member(c.parameters, "position", position);
+
+    benchmark_results_init(&results, "jsonrpc");
+    jsonrpc_server_listen(c.server, c.loop);
+
+    benchmark_run(&results, "round-trip", 1000, round_trip, &c);
+    benchmark_run(&results, "pipelined-round-trips", 50, pipelined_round_trips, &c);
+
+    // once the echo server exits, the client stops listening
+    json_node_unref(c.parameters);
+    if (io_terminate(process)) {
+        while (eventloop_process(c.loop, false, NULL))
+            ;
+    } else {
+        fprintf(stderr, "failed to terminate echo server: %s\n", strerror(errno));
+        results.failed = true;
+    }
+    jsonrpc_server_destroy(c.server);
+    eventloop_destroy(c.loop);
+
+    return benchmark_results_finish(&results);
+}
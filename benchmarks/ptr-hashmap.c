@@ -0,0 +1,117 @@
+#include "benchmark.h"
+#include "data-structures/collection.h"
+#include "data-structures/ptr-hashmap.h"
+#include "data-structures/ptr-list.h"
+#include "util.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// inserts and looks up string keys, such as the member names of JSON objects
+// and method names, and pointer keys, such as code addresses
+
+#define NUM_KEYS 100000
+
+typedef struct {
+    char *keys[NUM_KEYS];
+    char *missing_keys[NUM_KEYS];       // none of these are in the map
+    ptr_hashmap *map;
+} string_keys;
+
+static bool insert_strings(void *user_data)
+{
+    string_keys *s = user_data;
+    ptr_hashmap *map = ptr_hashmap_new((collection_item_hash_func) strhash, NULL, NULL,
+                                       (collection_item_equality_func) strequal, NULL, NULL);
+
+    for (unsigned i = 0; i < NUM_KEYS; i++)
+        ptr_hashmap_insert(map, s->keys[i], s->keys[i]);
+
+    const bool success = map->entries_list->length == NUM_KEYS;
+    ptr_hashmap_destroy(map);
+    return success;
+}
+
+static bool lookup_strings(void *user_data)
+{
+    const string_keys *s = user_data;
+
+    for (unsigned i = 0; i < NUM_KEYS; i++) {
+        const ptr_hashmap_entry *entry = ptr_hashmap_get(s->map, s->keys[i]);
+
+        if (!entry || entry->value != s->keys[i])
+            return false;
+    }
+
+    return true;
+}
+
+static bool lookup_missing_strings(void *user_data)
+{
+    const string_keys *s = user_data;
+
+    for (unsigned i = 0; i < NUM_KEYS; i++)
+        if (ptr_hashmap_get(s->map, s->missing_keys[i]))
+            return false;
+
+    return true;
+}
+
+static bool insert_and_lookup_pointers(void *user_data)
+{
+    (void) user_data;
+    ptr_hashmap *map = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, NULL);
+    bool success = true;
+
+    // keys spaced like the addresses of instructions
+    for (uintptr_t i = 0; i < NUM_KEYS; i++)
+        ptr_hashmap_insert(map, (void *)(0x1000 + i * 9), (void *)i);
+    for (uintptr_t i = 0; success && i < NUM_KEYS; i++) {
+        const ptr_hashmap_entry *entry = ptr_hashmap_get(map, (void *)(0x1000 + i * 9));
+
+        success = entry && entry->value == (void *)i;
+    }
+
+    ptr_hashmap_destroy(map);
+    return success;
+}
+
+int main(void)
+{
+    benchmark_results results;
+    string_keys *s = calloc(1, sizeof *s);
+
+    if (!s) {
+        perror("failed to create keys");
+        return 1;
+    }
+
+    benchmark_results_init(&results, "ptr-hashmap");
+
+    s->map = ptr_hashmap_new((collection_item_hash_func) strhash, NULL, NULL,
+                             (collection_item_equality_func) strequal, NULL, NULL);
+    for (unsigned i = 0; i < NUM_KEYS; i++) {
+        char key[32];
+
+        snprintf(key, sizeof key, "textDocument/member%u", i);
+        s->keys[i] = strdup(key);
+        snprintf(key, sizeof key, "textDocument/missing%u", i);
+        s->missing_keys[i] = strdup(key);
+        ptr_hashmap_insert(s->map, s->keys[i], s->keys[i]);
+    }
+
+    benchmark_run(&results, "insert-strings", 20, insert_strings, s);
+    benchmark_run(&results, "lookup-strings", 20, lookup_strings, s);
+    benchmark_run(&results, "lookup-missing-strings", 20, lookup_missing_strings, s);
+    benchmark_run(&results, "insert-and-lookup-pointers", 20, insert_and_lookup_pointers, NULL);
+
+    ptr_hashmap_destroy(s->map);
+    for (unsigned i = 0; i < NUM_KEYS; i++) {
+        free(s->keys[i]);
+        free(s->missing_keys[i]);
+    }
+    free(s);
+    return benchmark_results_finish(&results);
+}
@@ -0,0 +1,316 @@
+#include "benchmark.h"
+#include "bytecode/lstf-bc-function.h"
+#include "bytecode/lstf-bc-instruction.h"
+#include "bytecode/lstf-bc-program.h"
+#include "bytecode/lstf-bc-serialize.h"
+#include "compiler/lstf-codegenerator.h"
+#include "compiler/lstf-file.h"
+#include "compiler/lstf-parser.h"
+#include "compiler/lstf-semanticanalyzer.h"
+#include "compiler/lstf-symbolresolver.h"
+#include "io/outputstream.h"
+#include "vm/lstf-virtualmachine.h"
+#include "vm/lstf-vm-loader.h"
+#include "vm/lstf-vm-program.h"
+#include "vm/lstf-vm-status.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// runs programs in the virtual machine from start to finish. `--loop` and
+// `--member-access` are loops in hand-written bytecode, since scripts cannot
+// loop except by recursion. the other arguments are scripts
+
+#define LOOP_ITERATIONS 1000000
+#define NUM_DIAGNOSTICS 10000
+#define NUM_PASSES      20
+
+static lstf_vm_program *load_program(lstf_bc_program *program, const char *name)
+{
+    outputstream *ostream = outputstream_new_from_buffer(NULL, 0, true);
+    lstf_vm_program *vm_program = NULL;
+
+    if (!lstf_bc_program_serialize_to_binary(program, ostream))
+        fprintf(stderr, "failed to assemble %s: %s\n", name, strerror(errno));
+    else if (!(vm_program = lstf_vm_loader_load_from_buffer(ostream->buffer, ostream->buffer_offset, NULL)))
+        fprintf(stderr, "failed to load %s\n", name);
+
+    lstf_bc_program_destroy(program);
+    outputstream_unref(ostream);
+    return vm_program;
+}
+
+static lstf_vm_program *assemble_loop(void)
+{
+    /**
+     * --- code ---
+     * main:
+     *          load 0                     # frame(0): i
+     * <loop>:  load frame(0)
+     *          load LOOP_ITERATIONS
+     *          lessthan
+     *          else <end>
+     *          load frame(0)
+     *          load 1
+     *          add
+     *          store frame(0)
+     *          jump <loop>
+     * <end>:   exit 0
+     */
+    lstf_bc_program *program = lstf_bc_program_new(NULL);
+    lstf_bc_function *main_fun = lstf_bc_function_new("main");
+
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_expression_new(json_integer_new(0)));
+    lstf_bc_instruction *loop = lstf_bc_function_add_instruction(main_fun,
+            lstf_bc_instruction_load_frameoffset_new(0));
+    lstf_bc_function_add_instruction(main_fun,
+            lstf_bc_instruction_load_expression_new(json_integer_new(LOOP_ITERATIONS)));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_lessthan_new());
+    lstf_bc_instruction *else_end = lstf_bc_function_add_instruction(main_fun,
+            lstf_bc_instruction_else_new(NULL));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_frameoffset_new(0));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_expression_new(json_integer_new(1)));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_add_new());
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_store_new(0));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_jump_new(loop));
+    lstf_bc_instruction_resolve_jump(else_end,
+            lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_exit_new(0)));
+
+    lstf_bc_program_add_function(program, main_fun);
+    return load_program(program, "loop");
+}
+
+static json_node *create_position(int64_t line, int64_t character)
+{
+    json_node *position = json_object_new();
+
+    json_object_set_member(position, "line", json_integer_new(line));
+    json_object_set_member(position, "character", json_integer_new(character));
+
+    return position;
+}
+
+static json_node *create_diagnostics(void)
+{
+    json_node *diagnostics = json_array_new();
+
+    for (int64_t i = 0; i < NUM_DIAGNOSTICS; i++) {
+        json_node *diagnostic = json_object_new();
+        json_node *range = json_object_new();
+
+        json_object_set_member(range, "start", create_position(i, 4));
+        json_object_set_member(range, "end", create_position(i, 12));
+        json_object_set_member(diagnostic, "range", range);
+        json_object_set_member(diagnostic, "severity", json_integer_new(1 + i % 4));
+        // some servers only send a code for some diagnostics
+        if (i % 3 == 0)
+            json_object_set_member(diagnostic, "code", json_string_new("unused-variable"));
+        json_object_set_member(diagnostic, "message", json_string_new("unused variable"));
+        json_array_add_element(diagnostics, diagnostic);
+    }
+
+    return diagnostics;
+}
+
+static void add_load(lstf_bc_function *fn, json_node *expression)
+{
+    lstf_bc_function_add_instruction(fn, lstf_bc_instruction_load_expression_new(expression));
+}
+
+/**
+ * Walks a large array of diagnostics, reading `range.start.line` from each one
+ * and summing the result.
+ */
+static lstf_vm_program *assemble_member_access(void)
+{
+    /**
+     * --- code ---
+     * main:
+     *          load [diagnostics...]      # frame(0)
+     *          load 0                     # frame(1): i
+     *          load 0                     # frame(2): sum
+     * <loop>:  load frame(1)
+     *          load NUM_DIAGNOSTICS * NUM_PASSES
+     *          lessthan
+     *          else <end>
+     *          load frame(2)
+     *          load frame(0)
+     *          load frame(1)
+     *          load NUM_DIAGNOSTICS
+     *          mod
+     *          get
+     *          load "range"
+     *          get
+     *          load "start"
+     *          get
+     *          load "line"
+     *          get
+     *          add
+     *          store frame(2)
+     *          load frame(1)
+     *          load 1
+     *          add
+     *          store frame(1)
+     *          jump <loop>
+     * <end>:   load frame(2)
+     *          print
+     *          exit 0
+     */
+    lstf_bc_program *program = lstf_bc_program_new(NULL);
+    lstf_bc_function *main_fun = lstf_bc_function_new("main");
+
+    add_load(main_fun, create_diagnostics());
+    add_load(main_fun, json_integer_new(0));
+    add_load(main_fun, json_integer_new(0));
+    lstf_bc_instruction *loop = lstf_bc_function_add_instruction(main_fun,
+            lstf_bc_instruction_load_frameoffset_new(1));
+    add_load(main_fun, json_integer_new(NUM_DIAGNOSTICS * NUM_PASSES));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_lessthan_new());
+    lstf_bc_instruction *else_end = lstf_bc_function_add_instruction(main_fun,
+            lstf_bc_instruction_else_new(NULL));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_frameoffset_new(2));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_frameoffset_new(0));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_frameoffset_new(1));
+    add_load(main_fun, json_integer_new(NUM_DIAGNOSTICS));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_mod_new());
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_get_new());
+    add_load(main_fun, json_string_new("range"));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_get_new());
+    add_load(main_fun, json_string_new("start"));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_get_new());
+    add_load(main_fun, json_string_new("line"));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_get_new());
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_add_new());
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_store_new(2));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_load_frameoffset_new(1));
+    add_load(main_fun, json_integer_new(1));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_add_new());
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_store_new(1));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_jump_new(loop));
+    lstf_bc_instruction_resolve_jump(else_end,
+            lstf_bc_function_add_instruction(main_fun,
+                lstf_bc_instruction_load_frameoffset_new(2)));
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_print_new());
+    lstf_bc_function_add_instruction(main_fun, lstf_bc_instruction_exit_new(0));
+
+    lstf_bc_program_add_function(program, main_fun);
+    return load_program(program, "member-access");
+}
+
+static lstf_vm_program *compile_script(const char *filename)
+{
+    lstf_file *script = lstf_file_load(filename);
+    lstf_vm_program *program = NULL;
+
+    if (!script) {
+        fprintf(stderr, "failed to load %s: %s\n", filename, strerror(errno));
+        return NULL;
+    }
+
+    lstf_parser *parser = lstf_parser_new(script);
+    lstf_parser_parse(parser);
+    lstf_symbolresolver *resolver = lstf_symbolresolver_new(script);
+    lstf_symbolresolver_resolve(resolver);
+    lstf_semanticanalyzer *analyzer = lstf_semanticanalyzer_new(script);
+    analyzer->encountered_server_path_assignment = true;
+    analyzer->encountered_project_files_assignment = true;
+    lstf_semanticanalyzer_analyze(analyzer);
+    lstf_codegenerator *generator = lstf_codegenerator_new(script);
+    lstf_codegenerator_compile(generator);
+
+    size_t bytecode_length = 0;
+    const uint8_t *bytecode = lstf_codegenerator_get_compiled_bytecode(generator, &bytecode_length);
+    if (!bytecode)
+        fprintf(stderr, "failed to compile %s\n", filename);
+    else if (!(program = lstf_vm_loader_load_from_buffer(bytecode, bytecode_length, NULL)))
+        fprintf(stderr, "failed to load the bytecode for %s\n", filename);
+
+    lstf_parser_unref(parser);
+    lstf_symbolresolver_unref(resolver);
+    lstf_semanticanalyzer_unref(analyzer);
+    lstf_codegenerator_unref(generator);
+    return program;
+}
+
+typedef struct {
+    lstf_vm_program *program;
+    const char *expected_output;        // NULL if the output isn't checked
+} program_case;
+
+static bool run_program(void *user_data)
+{
+    const program_case *c = user_data;
+    lstf_virtualmachine *vm = lstf_virtualmachine_new(c->program, outputstream_new_from_buffer(NULL, 0, true), false);
+    bool success = true;
+
+    if (lstf_virtualmachine_run(vm) || vm->last_status != lstf_vm_status_exited) {
+        fprintf(stderr, "VM encountered a fatal error: %s.\n", lstf_vm_status_to_string(vm->last_status));
+        success = false;
+    } else if (c->expected_output &&
+            (vm->ostream->buffer_offset != strlen(c->expected_output) ||
+             memcmp(vm->ostream->buffer, c->expected_output, vm->ostream->buffer_offset) != 0)) {
+        fprintf(stderr, "---expected output:\n%s---actual output:\n%.*s",
+                c->expected_output, (int)vm->ostream->buffer_offset, (char *)vm->ostream->buffer);
+        success = false;
+    }
+
+    lstf_virtualmachine_destroy(vm);
+    return success;
+}
+
+/**
+ * Gets the name of the script at [filename], without its directory and
+ * extension.
+ */
+static char *get_script_name(const char *filename)
+{
+    const char *basename = strrchr(filename, '/');
+    char *name = strdup(basename ? basename + 1 : filename);
+    char *extension = strrchr(name, '.');
+
+    if (extension)
+        *extension = '\0';
+    return name;
+}
+
+int main(int argc, char *argv[])
+{
+    benchmark_results results;
+    char member_access_output[64];
+
+    benchmark_results_init(&results, "vm");
+    snprintf(member_access_output, sizeof member_access_output, "%" PRId64 "\n",
+            (int64_t)NUM_PASSES * NUM_DIAGNOSTICS * (NUM_DIAGNOSTICS - 1) / 2);
+
+    for (int i = 1; i < argc; i++) {
+        program_case c = {0};
+        char *name;
+
+        if (strcmp(argv[i], "--loop") == 0) {
+            c.program = assemble_loop();
+            name = strdup("loop");
+        } else if (strcmp(argv[i], "--member-access") == 0) {
+            c.program = assemble_member_access();
+            c.expected_output = member_access_output;
+            name = strdup("member-access");
+        } else {
+            c.program = compile_script(argv[i]);
+            name = get_script_name(argv[i]);
+        }
+
+        if (c.program) {
+            c.program = lstf_vm_program_ref(c.program);
+            benchmark_run(&results, name, 20, run_program, &c);
+            lstf_vm_program_unref(c.program);
+        } else {
+            results.failed = true;
+        }
+        free(name);
+    }
+
+    return benchmark_results_finish(&results);
+}
@@ -0,0 +1,88 @@
+#include "lstf-bc-cache.h"
+#include "data-structures/string-builder.h"
+#include "io/io-common.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *lstf_bc_cache_get_directory(void)
+{
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    string *directory = string_new();
+
+    if (cache_home && *cache_home) {
+        string_appendf(directory, "%s/lstf", cache_home);
+    } else {
+#if defined(_WIN32) || defined(_WIN64)
+        const char *home = getenv("LOCALAPPDATA");
+#else
+        const char *home = getenv("HOME");
+#endif
+        if (!home || !*home) {
+            free(string_destroy(directory));
+            return NULL;
+        }
+#if defined(_WIN32) || defined(_WIN64)
+        string_appendf(directory, "%s/lstf/cache", home);
+#else
+        string_appendf(directory, "%s/.cache/lstf", home);
+#endif
+    }
+
+    return string_destroy(directory);
+}
+
+/**
+ * 64-bit FNV-1a, continuing from [hash]
+ */
+static uint64_t lstf_bc_cache_hash(uint64_t hash, const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+
+    return hash;
+}
+
+char *lstf_bc_cache_get_path(const char *directory,
+                             const char *salt,
+                             const char *source,
+                             size_t      source_length)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    string *path = string_new();
+
+    // include the terminator so that the salt and the source can't run together
+    hash = lstf_bc_cache_hash(hash, salt, strlen(salt) + 1);
+    hash = lstf_bc_cache_hash(hash, source, source_length);
+
+    // the length makes a collision even less likely
+    string_appendf(path, "%s/%016" PRIx64 "-%zx.lstfc", directory, hash, source_length);
+
+    return string_destroy(path);
+}
+
+bool lstf_bc_cache_store(const char    *path,
+                         const uint8_t *bytecode,
+                         size_t         bytecode_length)
+{
+    char *directory = strdup(path);
+    char *last_separator = NULL;
+    bool success = true;
+
+    if (!directory) {
+        perror("failed to store bytecode");
+        abort();
+    }
+
+    if ((last_separator = strrchr(directory, '/'))) {
+        *last_separator = '\0';
+        success = io_create_directories(directory);
+    }
+    free(directory);
+
+    return success && io_write_file_atomically(path, bytecode, bytecode_length);
+}
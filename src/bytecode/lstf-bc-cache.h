@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Gets the directory where compiled scripts are cached. This is
+ * `$XDG_CACHE_HOME/lstf`, or `$HOME/.cache/lstf` if `XDG_CACHE_HOME` is not
+ * set.
+ *
+ * @return a new string, or `NULL` if there is nowhere to cache scripts
+ */
+char *lstf_bc_cache_get_directory(void);
+
+/**
+ * Gets the path in [directory] where the bytecode compiled from [source] is
+ * cached. The path is made from a hash of [salt] and [source], where [salt]
+ * identifies everything besides the source that the bytecode depends on,
+ * such as the compiler version and the compiler options.
+ *
+ * The bytecode at the path can be loaded with `lstf_vm_loader_load_from_path()`.
+ *
+ * @return a new string
+ */
+char *lstf_bc_cache_get_path(const char *directory,
+                             const char *salt,
+                             const char *source,
+                             size_t      source_length);
+
+/**
+ * Stores [bytecode] at [path], which was returned by `lstf_bc_cache_get_path()`.
+ * The cache directory is created if it does not exist yet, and the bytecode
+ * is written atomically, so that scripts being compiled at the same time can
+ * share the cache.
+ *
+ * @return whether the bytecode was stored, with errno set on failure
+ */
+bool lstf_bc_cache_store(const char    *path,
+                         const uint8_t *bytecode,
+                         size_t         bytecode_length);
@@ -98,6 +98,14 @@ struct _lstf_bc_instruction {
          * - `lstf_vm_op_upset`
          */
         uint8_t upvalue_id;
+
+        /**
+         * Used by: `lstf_vm_op_match`
+         */
+        struct {
+            uint8_t *program;
+            uint64_t program_size;
+        } match;
     };
 };
 
@@ -526,6 +534,27 @@ static inline lstf_bc_instruction lstf_bc_instruction_assert_new(void)
     };
 }
 
+/**
+ * Creates a `match` instruction with a copy of a program created by
+ * `json_matcher_compile()`.
+ */
+static inline lstf_bc_instruction lstf_bc_instruction_match_new(const uint8_t *program, size_t program_size)
+{
+    uint8_t *program_copied = malloc(program_size);
+
+    if (!program_copied) {
+        perror("failed to create match program");
+        abort();
+    }
+
+    memcpy(program_copied, program, program_size);
+
+    return (lstf_bc_instruction) {
+        .opcode = lstf_vm_op_match,
+        .match = { program_copied, program_size }
+    };
+}
+
 static inline size_t lstf_bc_instruction_compute_size(lstf_bc_instruction *instruction)
 {
     switch (instruction->opcode) {
@@ -626,6 +655,8 @@ static inline size_t lstf_bc_instruction_compute_size(lstf_bc_instruction *instr
         return sizeof(uint8_t) + sizeof(uint8_t);
     case lstf_vm_op_assert:
         return sizeof(uint8_t);
+    case lstf_vm_op_match:
+        return sizeof(uint8_t) + sizeof(uint64_t) + instruction->match.program_size;
     case lstf_vm_op_N:
         break;
     }
@@ -694,6 +725,10 @@ static inline void lstf_bc_instruction_clear(lstf_bc_instruction *instruction)
     case lstf_vm_op_exit:
     case lstf_vm_op_assert:
         break;
+    case lstf_vm_op_match:
+        free(instruction->match.program);
+        instruction->match.program = NULL;
+        break;
     case lstf_vm_op_N:
         fprintf(stderr, "%s: unreachable code: unexpected VM opcode `%u'\n", __func__, instruction->opcode);
         abort();
@@ -19,7 +19,7 @@ lstf_bc_program *lstf_bc_program_new(const char *source_filename)
 
     program->source_filename = source_filename ? strdup(source_filename) : NULL;
     program->debug_sourcemap = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, (collection_item_unref_func) ptr_hashmap_destroy);
-    program->debug_symbols = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, free);
+    program->debug_symbols = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, (collection_item_unref_func) ptr_hashmap_destroy);
 
     program->comments = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, (collection_item_unref_func) ptr_hashmap_destroy);
 
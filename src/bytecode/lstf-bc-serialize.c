@@ -24,6 +24,27 @@ lstf_bc_program_get_instruction_offset(lstf_bc_program     *program,
     return offsets[instruction - function->instructions];
 }
 
+/**
+ * Returns [size] rounded up to the alignment of the debug entries, which the
+ * loader expects the filename and each symbol name to be padded to.
+ */
+static uint64_t
+lstf_bc_program_get_padded_debuginfo_size(uint64_t size)
+{
+    static_assert(alignof(lstf_vm_debugentry) == alignof(lstf_vm_debugsym),
+            "debug entries and symbols must have the same alignment");
+    return (size + alignof(lstf_vm_debugentry) - 1) / alignof(lstf_vm_debugentry) * alignof(lstf_vm_debugentry);
+}
+
+static bool
+lstf_bc_program_write_padding(outputstream *ostream, uint64_t unpadded_size)
+{
+    for (uint64_t i = unpadded_size; i < lstf_bc_program_get_padded_debuginfo_size(unpadded_size); i++)
+        if (!outputstream_write_byte(ostream, '\0'))
+            return false;
+    return true;
+}
+
 static uint64_t
 lstf_bc_program_compute_debuginfo_size(lstf_bc_program *program)
 {
@@ -32,19 +53,13 @@ lstf_bc_program_compute_debuginfo_size(lstf_bc_program *program)
     if (!program->source_filename)
         return current_offset;
 
-    current_offset += strlen(program->source_filename) + 1;
+    current_offset += lstf_bc_program_get_padded_debuginfo_size(strlen(program->source_filename) + 1);
     current_offset += sizeof(uint64_t);
     for (iterator it = ptr_hashmap_iterator_create(program->debug_sourcemap); it.has_next; it = iterator_next(it)) {
         const ptr_hashmap_entry *entry = iterator_get_item(it);
         ptr_hashmap *function_sourcemap = entry->value;
 
-        for (iterator it2 = ptr_hashmap_iterator_create(function_sourcemap); it2.has_next; it2 = iterator_next(it2)) {
-            lstf_bc_debugentry *debug_entry = ((ptr_hashmap_entry *)iterator_get_item(it2))->value;
-
-            current_offset += sizeof(uint64_t);
-            current_offset += sizeof debug_entry->line;
-            current_offset += sizeof debug_entry->column;
-        }
+        current_offset += ptr_hashmap_num_elements(function_sourcemap) * sizeof(lstf_vm_debugentry);
     }
 
     current_offset += sizeof(uint64_t);
@@ -56,7 +71,7 @@ lstf_bc_program_compute_debuginfo_size(lstf_bc_program *program)
             char *symbol_name = ((ptr_hashmap_entry *)iterator_get_item(it2))->value;
 
             current_offset += sizeof(uint64_t);
-            current_offset += strlen(symbol_name) + 1;
+            current_offset += lstf_bc_program_get_padded_debuginfo_size(strlen(symbol_name) + 1);
         }
     }
 
@@ -168,16 +183,12 @@ bool lstf_bc_program_serialize_to_binary(lstf_bc_program *program, outputstream
 
     // debuginfo section
     if (debuginfo_size > 0) {
-        size_t filename_sz = 0;
-        if (!(filename_sz = outputstream_write_string(ostream, program->source_filename)) ||
-                !(filename_sz = outputstream_write_byte(ostream, '\0')))
+        if (!outputstream_write_string(ostream, program->source_filename) ||
+                !outputstream_write_byte(ostream, '\0'))
+            return false;
+        // pad to N-byte boundary (alignment of lstf_vm_debugentry)
+        if (!lstf_bc_program_write_padding(ostream, strlen(program->source_filename) + 1))
             return false;
-        // pad to N-byte boundary (alignment of lstf_bc_debugentry)
-        if (filename_sz % alignof(lstf_bc_debugentry) > 0)
-            for (filename_sz = alignof(lstf_bc_debugentry) - filename_sz % alignof(lstf_bc_debugentry);
-                    filename_sz > 0; filename_sz--)
-                if (!outputstream_write_byte(ostream, '\0'))
-                return false;
         // n_debug_entries
         uint64_t n_debug_entries = 0;
         for (iterator it = ptr_hashmap_iterator_create(program->debug_sourcemap); it.has_next; it = iterator_next(it))
@@ -207,12 +218,11 @@ bool lstf_bc_program_serialize_to_binary(lstf_bc_program *program, outputstream
             }
         }
 
-        // XXX: support debugging
-        // uint64_t n_debug_symbols = 0;
-        // for (iterator it = ptr_hashmap_iterator_create(program->debug_symbols); it.has_next; it = iterator_next(it))
-        //     n_debug_symbols += ptr_hashmap_num_elements(((ptr_hashmap_entry *)iterator_get_item(it))->value);
+        uint64_t n_debug_symbols = 0;
+        for (iterator it = ptr_hashmap_iterator_create(program->debug_symbols); it.has_next; it = iterator_next(it))
+            n_debug_symbols += ptr_hashmap_num_elements(((ptr_hashmap_entry *)iterator_get_item(it))->value);
 
-        if (!outputstream_write_uint64(ostream, n_debug_entries))
+        if (!outputstream_write_uint64(ostream, n_debug_symbols))
             return false;
         // debug symbols
         for (iterator it = ptr_hashmap_iterator_create(program->debug_symbols); it.has_next; it = iterator_next(it)) {
@@ -228,17 +238,13 @@ bool lstf_bc_program_serialize_to_binary(lstf_bc_program *program, outputstream
                 if (!outputstream_write_uint64(ostream, instruction_offset))
                     return false;
 
-                size_t symbol_name_sz = 0;
-                if (!(symbol_name_sz = outputstream_write_string(ostream, symbol_name)) ||
-                        !(symbol_name_sz = outputstream_write_byte(ostream, '\0')))
+                if (!outputstream_write_string(ostream, symbol_name) ||
+                        !outputstream_write_byte(ostream, '\0'))
                     return false;
 
                 // pad the symbol name to `lstf_vm_debugsym` boundary
-                if (symbol_name_sz % alignof(lstf_vm_debugsym) > 0)
-                    for (symbol_name_sz = alignof(lstf_vm_debugsym) - symbol_name_sz % alignof(lstf_vm_debugsym);
-                            symbol_name_sz > 0; symbol_name_sz--)
-                        if (!outputstream_write_byte(ostream, '\0'))
-                            return false;
+                if (!lstf_bc_program_write_padding(ostream, strlen(symbol_name) + 1))
+                    return false;
             }
         }
     }
@@ -409,6 +415,13 @@ bool lstf_bc_program_serialize_to_binary(lstf_bc_program *program, outputstream
                 if (!outputstream_write_byte(ostream, instruction->exit_code))
                     return false;
                 break;
+            case lstf_vm_op_match:
+                if (!outputstream_write_uint64(ostream, instruction->match.program_size))
+                    return false;
+                if (instruction->match.program_size &&
+                        !outputstream_write(ostream, instruction->match.program, instruction->match.program_size))
+                    return false;
+                break;
             case lstf_vm_op_N:
                 fprintf(stderr, "%s: unreachable code: unexpected VM opcode `%u'\n", __func__, instruction->opcode);
                 abort();
@@ -12,6 +12,7 @@
 #include "lstf-codenode.h"
 #include "lstf-symbol.h"
 #include "lstf-functiontype.h"
+#include "lstf-futuretype.h"
 #include "lstf-report.h"
 #include "lstf-codevisitor.h"
 #include "io/outputstream.h"
@@ -29,6 +30,7 @@
 #include "util.h"
 #include "vm/lstf-vm-opcodes.h"
 #include "json/json.h"
+#include "json/json-matcher.h"
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
@@ -260,6 +262,19 @@ lstf_codegenerator_set_alloc_for_local(lstf_codegenerator  *generator,
     ptr_hashmap_insert(generator->local_allocs, local, alloc_inst);
 }
 
+/**
+ * Creates a string constant with the canonical (camelCase) spelling of a
+ * member name.
+ */
+static json_node *lstf_codegenerator_member_name_new(const char *member_name)
+{
+    char *canonical_member_name = json_member_name_canonicalize(member_name);
+    json_node *node = json_string_new(canonical_member_name);
+
+    free(canonical_member_name);
+    return node;
+}
+
 /**
  * Gets the up-value ID of the symbol referred to by `access` or return -1 if
  * it is not captured.
@@ -552,7 +567,7 @@ lstf_codegenerator_visit_assignment(lstf_codevisitor *visitor, lstf_assignment *
             lstf_ir_instruction *lhs_temp = lstf_codegenerator_get_temp_for_expression(generator, maccess->inner);
 
             lstf_ir_instruction *index_inst =
-                lstf_ir_constantinstruction_new(lstf_codenode_cast(maccess), json_string_new(maccess->member_name));
+                lstf_ir_constantinstruction_new(lstf_codenode_cast(maccess), lstf_codegenerator_member_name_new(maccess->member_name));
             lstf_ir_basicblock_add_instruction(
                     lstf_codegenerator_get_current_basicblock_for_scope(generator, current_scope), index_inst);
 
@@ -690,9 +705,63 @@ lstf_codegenerator_visit_assignment(lstf_codevisitor *visitor, lstf_assignment *
     }
 }
 
+/**
+ * Returns the JSON form of [expr] if it is an array or object that can be
+ * compiled into a match program, or `NULL` otherwise.
+ */
+static json_node *
+lstf_codegenerator_get_constant_pattern(lstf_expression *expr)
+{
+    if (expr->expr_type != lstf_expression_type_array && expr->expr_type != lstf_expression_type_object)
+        return NULL;
+    return lstf_expression_to_json(expr);
+}
+
+/**
+ * Generates code for `a <=> b` when one side is a constant array or object,
+ * which is compiled into a match program instead of being loaded and compared
+ * with the other side at runtime.
+ *
+ * Returns `false` if neither side is constant.
+ */
+static bool
+lstf_codegenerator_visit_pattern_match(lstf_codevisitor *visitor, lstf_binaryexpression *expr)
+{
+    lstf_codegenerator *generator = (lstf_codegenerator *)visitor;
+    lstf_expression *candidate = NULL;
+    json_node *pattern_json = NULL;
+
+    // patterns are usually written on the right-hand side
+    if ((pattern_json = lstf_codegenerator_get_constant_pattern(expr->right)))
+        candidate = expr->left;
+    else if ((pattern_json = lstf_codegenerator_get_constant_pattern(expr->left)))
+        candidate = expr->right;
+    else
+        return false;
+
+    size_t program_size = 0;
+    uint8_t *program = json_matcher_compile(json_node_ref(pattern_json), &program_size);
+    json_node_unref(pattern_json);
+
+    lstf_codenode_accept(candidate, visitor);
+    lstf_ir_instruction *candidate_temp = lstf_codegenerator_get_temp_for_expression(generator, candidate);
+
+    lstf_scope *current_scope = lstf_codenode_get_containing_scope(lstf_codenode_cast(expr));
+    lstf_ir_basicblock *block = lstf_codegenerator_get_current_basicblock_for_scope(generator, current_scope);
+    lstf_ir_instruction *match_temp =
+        lstf_ir_matchinstruction_new(lstf_codenode_cast(expr), candidate_temp, program, program_size);
+
+    lstf_ir_basicblock_add_instruction(block, match_temp);
+    lstf_codegenerator_set_temp_for_expression(generator, lstf_expression_cast(expr), match_temp);
+    return true;
+}
+
 static void
 lstf_codegenerator_visit_binary_expression(lstf_codevisitor *visitor, lstf_binaryexpression *expr)
 {
+    if (expr->op == lstf_binaryoperator_equivalent && lstf_codegenerator_visit_pattern_match(visitor, expr))
+        return;
+
     lstf_codenode_accept(expr->left, visitor);
 
     lstf_codegenerator *generator = (lstf_codegenerator *)visitor;
@@ -1056,9 +1125,14 @@ lstf_codegenerator_visit_function(lstf_codevisitor *visitor, lstf_function *func
 
     if (lstf_symbol_cast(function)->is_builtin) {
         if (lstf_vm_opcode_can_cast(function->vm_opcode)) {
+            lstf_datatype *result_type = function->return_type;
+
+            // an awaited VM call returning future<void> leaves nothing on the stack
+            if (result_type->datatype_type == lstf_datatype_type_future)
+                result_type = lstf_futuretype_cast(result_type)->wrapped_type;
             fn = lstf_ir_function_new_for_instruction(lstf_symbol_cast(function)->name,
                     function->parameters->length,
-                    function->return_type->datatype_type != lstf_datatype_type_voidtype,
+                    result_type->datatype_type != lstf_datatype_type_voidtype,
                     !(function->vm_opcode == lstf_vm_op_exit),
                     function->vm_opcode,
                     function->vm_callcode);
@@ -1169,14 +1243,19 @@ lstf_codegenerator_visit_lambda_expression(lstf_codevisitor *visitor, lstf_lambd
     
     lstf_codegenerator *generator = (lstf_codegenerator *)visitor;
     string *lambda_name = string_newf("__lambda.%u", expr->id);
+    lstf_datatype *return_type = lstf_functiontype_cast(lstf_expression_cast(expr)->value_type)->return_type;
+
+    // like async functions, an async lambda returns its result to the
+    // awaiting coroutine and not as a `future<T>`
+    if (expr->is_async)
+        return_type = lstf_futuretype_cast(return_type)->wrapped_type;
 
     // (1) generate function code
     lstf_ir_function *lambda_fn =
         lstf_ir_function_new_for_userfn(lambda_name->const_buffer,
             expr->parameters->length,
             ptr_hashset_num_elements(expr->captured_locals),
-            lstf_functiontype_cast(
-                lstf_expression_cast(expr)->value_type)->return_type->datatype_type != lstf_datatype_type_voidtype);
+            return_type->datatype_type != lstf_datatype_type_voidtype);
     lstf_ir_program_add_function(generator->ir, lambda_fn);
 
     ptr_list_append(generator->ir_functions, lambda_fn);
@@ -1197,6 +1276,15 @@ lstf_codegenerator_visit_lambda_expression(lstf_codevisitor *visitor, lstf_lambd
         lstf_ir_basicblock_add_instruction(block,
                 lstf_ir_returninstruction_new(lstf_codenode_cast(expr->expression_body), t_expression));
         block->successors[0] = lambda_fn->exit_block;
+    } else if (!lambda_fn->has_result) {
+        // a block body may run off its end without returning, so it needs an
+        // implicit return like any other user-defined function
+        lstf_ir_basicblock *block =
+            lstf_codegenerator_get_current_basicblock_for_scope(generator, expr->statements_body->scope);
+
+        lstf_ir_basicblock_add_instruction(block,
+                lstf_ir_returninstruction_new(lstf_codenode_cast(expr->statements_body), NULL));
+        block->successors[0] = lambda_fn->exit_block;
     }
     ptr_list_remove_last_link(generator->ir_functions);
     string_unref(lambda_name);
@@ -1305,7 +1393,7 @@ lstf_codegenerator_visit_member_access(lstf_codevisitor *visitor, lstf_memberacc
         } else {
             lstf_ir_instruction *t_container = lstf_codegenerator_get_temp_for_expression(generator, access->inner);
             lstf_ir_instruction *t_member =
-                lstf_ir_constantinstruction_new(lstf_codenode_cast(access), json_string_new(access->member_name));
+                lstf_ir_constantinstruction_new(lstf_codenode_cast(access), lstf_codegenerator_member_name_new(access->member_name));
             lstf_ir_instruction *gei =
                 lstf_ir_getelementinstruction_new(lstf_codenode_cast(access), t_container, t_member);
 
@@ -1422,7 +1510,7 @@ lstf_codegenerator_visit_object(lstf_codevisitor *visitor, lstf_object *object)
 
             lstf_ir_instruction *index_temp =
                 lstf_ir_constantinstruction_new(lstf_codenode_cast(property),
-                        json_string_new(lstf_symbol_cast(property)->name));
+                        lstf_codegenerator_member_name_new(lstf_symbol_cast(property)->name));
             lstf_ir_basicblock_add_instruction(block, index_temp);
 
             if ((property_value_json = lstf_expression_to_json(property->value))) {
@@ -1665,7 +1753,7 @@ void lstf_codegenerator_compile(lstf_codegenerator *generator)
         generator->num_errors = lstf_ir_program_analyze(generator->ir);
 
     if (generator->num_errors == 0) {
-        lstf_bc_program *bc = lstf_ir_program_assemble(generator->ir);
+        lstf_bc_program *bc = lstf_ir_program_assemble(generator->ir, generator->file->filename);
         bool status = lstf_bc_program_serialize_to_binary(bc, generator->output);
         lstf_bc_program_destroy(bc);
 
@@ -121,7 +121,8 @@ json_node *lstf_expression_to_json(lstf_expression *expression)
                     return NULL;
                 }
 
-                property_value_json->optional = property->is_nullable;
+                if (property->is_nullable)
+                    property_value_json = json_node_set_optional(property_value_json);
                 node->is_pattern |= property_value_json->is_pattern;
                 json_object_set_member(node, lstf_symbol_cast(property)->name, property_value_json);
             }
@@ -14,6 +14,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <threads.h>
 
 static void lstf_interfaceproperty_accept(lstf_codenode *node, lstf_codevisitor *visitor)
 {
@@ -115,7 +116,8 @@ static const lstf_codenode_vtable interface_vtable = {
     lstf_interface_destruct
 };
 
-static unsigned num_interfaces_created = 0;
+// anonymous interfaces are only numbered within a script, like lambdas
+static thread_local unsigned num_interfaces_created = 0;
 
 static char *lstf_interface_anonymous_name_new(void)
 {
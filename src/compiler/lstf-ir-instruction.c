@@ -37,12 +37,14 @@ lstf_ir_instruction_destruct(lstf_ir_node *node)
         case lstf_ir_instruction_type_phi:
             ptr_list_destroy(((lstf_ir_phiinstruction *)inst)->arguments);
             break;
+        case lstf_ir_instruction_type_match:
+            free(((lstf_ir_matchinstruction *)inst)->program);
+            break;
         case lstf_ir_instruction_type_setelement:
         case lstf_ir_instruction_type_getelement:
         case lstf_ir_instruction_type_append:
         case lstf_ir_instruction_type_binary:
         case lstf_ir_instruction_type_branch:
-        case lstf_ir_instruction_type_match:
         case lstf_ir_instruction_type_return:
         case lstf_ir_instruction_type_getupvalue:
         case lstf_ir_instruction_type_setupvalue:
@@ -460,8 +462,9 @@ lstf_ir_instruction *lstf_ir_appendinstruction_new(lstf_codenode       *code_nod
 }
 
 lstf_ir_instruction *lstf_ir_matchinstruction_new(lstf_codenode       *code_node,
-                                                  lstf_ir_instruction *pattern,
-                                                  lstf_ir_instruction *expression)
+                                                  lstf_ir_instruction *expression,
+                                                  uint8_t             *program,
+                                                  size_t               program_size)
 {
     lstf_ir_matchinstruction *match_inst = calloc(1, sizeof *match_inst);
 
@@ -474,8 +477,9 @@ lstf_ir_instruction *lstf_ir_matchinstruction_new(lstf_codenode       *code_node
             (lstf_ir_instruction *)match_inst,
             lstf_ir_instruction_type_match);
 
-    match_inst->pattern = pattern;
     match_inst->expression = expression;
+    match_inst->program = program;
+    match_inst->program_size = program_size;
 
     return (lstf_ir_instruction *)match_inst;
 }
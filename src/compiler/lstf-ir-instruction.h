@@ -390,16 +390,28 @@ lstf_ir_instruction *lstf_ir_appendinstruction_new(lstf_codenode       *code_nod
                                                    lstf_ir_instruction *container,
                                                    lstf_ir_instruction *value);
 
+/**
+ * Matches an expression against a constant pattern.
+ */
 struct _lstf_ir_matchinstruction {
     lstf_ir_instruction parent_struct;
-    lstf_ir_instruction *pattern;
     lstf_ir_instruction *expression;
+
+    /**
+     * The pattern, compiled with `json_matcher_compile()`
+     */
+    uint8_t *program;
+    size_t program_size;
 };
 typedef struct _lstf_ir_matchinstruction lstf_ir_matchinstruction;
 
+/**
+ * @param program       (transfer full) a program created by `json_matcher_compile()`
+ */
 lstf_ir_instruction *lstf_ir_matchinstruction_new(lstf_codenode       *code_node,
-                                                  lstf_ir_instruction *pattern,
-                                                  lstf_ir_instruction *expression);
+                                                  lstf_ir_instruction *expression,
+                                                  uint8_t             *program,
+                                                  size_t               program_size);
 
 struct _lstf_ir_assertinstruction {
     lstf_ir_instruction parent_struct;
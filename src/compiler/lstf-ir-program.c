@@ -11,6 +11,8 @@
 #include "data-structures/ptr-hashmap.h"
 #include "data-structures/ptr-list.h"
 #include "data-structures/intset.h"
+#include "json/json-matcher.h"
+#include "data-structures/array.h"
 #include "util.h"
 #include <assert.h>
 #include <limits.h>
@@ -400,6 +402,19 @@ static void lstf_ir_program_add_deallocations_for_basic_block(lstf_ir_basicblock
     bb->variables_killed = 0;
 }
 
+/**
+ * Where in the source a bytecode instruction came from. The instruction is
+ * saved by its index, since the instruction buffer of a function can move
+ * while the function is being serialized.
+ */
+typedef struct {
+    unsigned long instruction_index;
+    uint32_t line;
+    uint32_t column;
+} lstf_ir_sourcemap_entry;
+
+typedef array(lstf_ir_sourcemap_entry) lstf_ir_sourcemap;
+
 static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
                                                   lstf_ir_basicblock *bb,
                                                   lstf_ir_function   *ir_fn,
@@ -408,6 +423,7 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
                                                   ptr_hashmap        *ir_target_to_bc_branches,
                                                   ptr_hashmap        *bbs_ir_to_bcinsn,
                                                   ptr_hashmap        *fns_ir_to_bc,
+                                                  lstf_ir_sourcemap  *sourcemap,
                                                   int                 frame_offset)
 {
     if (bb->serialized || bb == ir_fn->exit_block)
@@ -418,6 +434,7 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
     for (unsigned i = 0; i < bb->instructions_length; i++) {
         lstf_ir_instruction *inst = bb->instructions[i];
         lstf_bc_instruction *bc_inst = NULL;
+        const unsigned long first_bc_index = bc_fn->instructions_length;
 
         if (bb->variables_killed &&
                 (inst->insn_type == lstf_ir_instruction_type_branch ||
@@ -591,6 +608,7 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
             case lstf_vm_op_getopt:
             case lstf_vm_op_exit:
             case lstf_vm_op_assert:
+            case lstf_vm_op_match:
             case lstf_vm_op_N:
                 fprintf(stderr, "%s: unreachable code: unexpected op `%u' for binary IR instruction\n",
                         __func__, binst->opcode);
@@ -661,6 +679,7 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
                 case lstf_vm_op_vmcall:
                 case lstf_vm_op_xor:
                 case lstf_vm_op_assert:
+                case lstf_vm_op_match:
                 case lstf_vm_op_getopt:
                 case lstf_vm_op_N:
                     fprintf(stderr, "%s: unreachable code: unexpected op `%u' for unary IR instruction\n",
@@ -822,9 +841,12 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
 
         case lstf_ir_instruction_type_match:
         {
-            frame_offset -= 2;
+            lstf_ir_matchinstruction *match_inst = (lstf_ir_matchinstruction *)inst;
+
+            frame_offset--;
             inst->frame_offset = frame_offset++;
-            bc_inst = lstf_bc_function_add_instruction(bc_fn, lstf_bc_instruction_equal_new());
+            bc_inst = lstf_bc_function_add_instruction(bc_fn,
+                    lstf_bc_instruction_match_new(match_inst->program, match_inst->program_size));
         }   break;
 
         case lstf_ir_instruction_type_loadfunction:
@@ -852,6 +874,15 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
             break;
         }
 
+        // a code offset is mapped back to the nearest entry before it, so
+        // only the first instruction of each line needs an entry
+        if (sourcemap && inst->code_node && bc_fn->instructions_length > first_bc_index) {
+            const lstf_sourceloc begin = inst->code_node->source_reference.begin;
+
+            if (sourcemap->length == 0 || sourcemap->elements[sourcemap->length - 1].line != begin.line)
+                array_add(sourcemap, ((lstf_ir_sourcemap_entry) { first_bc_index, begin.line, begin.column }));
+        }
+
         // map this basic block to the first bytecode instruction that was
         // serialized for this basic block
         if (bc_inst && !ptr_hashmap_get(bbs_ir_to_bcinsn, bb)) {
@@ -886,10 +917,10 @@ static void lstf_ir_program_serialize_basic_block(lstf_ir_program    *ir,
     // visit the successors
     if (bb->successors[0])
         lstf_ir_program_serialize_basic_block(ir, bb->successors[0], ir_fn, bc, bc_fn,
-                ir_target_to_bc_branches, bbs_ir_to_bcinsn, fns_ir_to_bc, frame_offset);
+                ir_target_to_bc_branches, bbs_ir_to_bcinsn, fns_ir_to_bc, sourcemap, frame_offset);
     if (bb->successors[1])
         lstf_ir_program_serialize_basic_block(ir, bb->successors[1], ir_fn, bc, bc_fn,
-                ir_target_to_bc_branches, bbs_ir_to_bcinsn, fns_ir_to_bc, frame_offset);
+                ir_target_to_bc_branches, bbs_ir_to_bcinsn, fns_ir_to_bc, sourcemap, frame_offset);
 }
 
 static void lstf_ir_program_serialize_function(lstf_ir_program  *ir,
@@ -906,18 +937,30 @@ static void lstf_ir_program_serialize_function(lstf_ir_program  *ir,
             NULL, NULL, (collection_item_unref_func) ptr_list_destroy);
     // maps (lstf_ir_basicblock *) -> (first bytecode instruction: lstf_bc_instruction *)
     ptr_hashmap *bbs_ir_to_bcinsn = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, NULL);
+    lstf_ir_sourcemap sourcemap;
 
+    array_init(&sourcemap);
     lstf_bc_function_add_instruction(bc_fn, lstf_bc_instruction_params_new(ir_fn->parameters));
     lstf_ir_program_serialize_basic_block(ir, ir_fn->entry_block->successors[0], ir_fn, bc, bc_fn,
-            ir_target_to_bc_branches, bbs_ir_to_bcinsn, fns_ir_to_bc, 0);
+            ir_target_to_bc_branches, bbs_ir_to_bcinsn, fns_ir_to_bc,
+            bc->source_filename ? &sourcemap : NULL, 0);
+
+    // the function is complete, so its instructions won't move anymore
+    if (bc->source_filename) {
+        lstf_bc_program_add_symbol(bc, bc_fn, &bc_fn->instructions[0], ir_fn->name);
+        for (size_t i = 0; i < sourcemap.length; i++)
+            lstf_bc_program_add_sourcemap(bc, bc_fn, &bc_fn->instructions[sourcemap.elements[i].instruction_index],
+                    sourcemap.elements[i].line, sourcemap.elements[i].column);
+    }
 
+    array_destroy(&sourcemap);
     ptr_hashmap_destroy(ir_target_to_bc_branches);
     ptr_hashmap_destroy(bbs_ir_to_bcinsn);
 }
 
-lstf_bc_program *lstf_ir_program_assemble(lstf_ir_program *program)
+lstf_bc_program *lstf_ir_program_assemble(lstf_ir_program *program, const char *source_filename)
 {
-    lstf_bc_program *bc = lstf_bc_program_new(NULL);
+    lstf_bc_program *bc = lstf_bc_program_new(source_filename);
     ptr_hashmap *fns_ir_to_bc = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, NULL);
 
     // create the bytecode functions first so that call instructions can
@@ -1177,10 +1220,14 @@ bool lstf_ir_program_visualize(const lstf_ir_program *program, const char *path)
                         {
                             lstf_ir_matchinstruction *match_inst = (lstf_ir_matchinstruction *)bb->instructions[i];
 
-                            string_appendf(bb_insns_buffer, "%%%lu = match %%%lu, %%%lu\\n",
+                            char *pattern_escaped = json_string_escape(
+                                    json_matcher_program_get_pattern_string(match_inst->program, match_inst->program_size));
+
+                            string_appendf(bb_insns_buffer, "%%%lu = match %%%lu, %s\\n",
                                     num_instructions,
-                                    (unsigned long)(uintptr_t)ptr_hashmap_get(insn_result_ids, match_inst->pattern)->value,
-                                    (unsigned long)(uintptr_t)ptr_hashmap_get(insn_result_ids, match_inst->expression)->value);
+                                    (unsigned long)(uintptr_t)ptr_hashmap_get(insn_result_ids, match_inst->expression)->value,
+                                    pattern_escaped);
+                            free(pattern_escaped);
                         }   break;
 
                         case lstf_ir_instruction_type_phi:
@@ -32,8 +32,12 @@ unsigned lstf_ir_program_analyze(lstf_ir_program *program);
 /**
  * Assemble the IR into abstract bytecode. To serialize the bytecode, see
  * `lstf_bc_program_serialize_to_binary()`.
+ *
+ * @param source_filename if set, the bytecode gets debug info mapping each
+ *                        function to its name and each line of [source_filename]
+ *                        to the code generated for it. Can be NULL.
  */
-lstf_bc_program *lstf_ir_program_assemble(lstf_ir_program *program);
+lstf_bc_program *lstf_ir_program_assemble(lstf_ir_program *program, const char *source_filename);
 
 /**
  * Outputs a Graphviz file.
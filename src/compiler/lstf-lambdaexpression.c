@@ -8,8 +8,11 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
-static unsigned next_lambda_id = 1;
+// lambdas are only numbered within a script, and scripts may be compiled
+// on different threads
+static thread_local unsigned next_lambda_id = 1;
 
 static void lstf_lambdaexpression_accept(lstf_codenode *node, lstf_codevisitor *visitor)
 {
@@ -1,6 +1,9 @@
 #include "lstf-constant.h"
 #include "lstf-enum.h"
 #include "lstf-enumtype.h"
+#include "lstf-booleantype.h"
+#include "lstf-doubletype.h"
+#include "lstf-functiontype.h"
 #include "lstf-futuretype.h"
 #include "lstf-interfacetype.h"
 #include "lstf-literal.h"
@@ -149,6 +152,187 @@ void lstf_file_create_builtins(lstf_file *file)
     lstf_function_add_statement(file->main_function,
             lstf_declaration_new_from_function(&src, diagnostics));
 
+    // interface TextDocumentContentChangeEvent {
+    //  range?: Range;
+    //  text: string;
+    // }
+    lstf_interface *changeevent_iface = lstf_interface_new(&src, "TextDocumentContentChangeEvent", false, true);
+    lstf_interface_add_member(changeevent_iface, lstf_interfaceproperty_new(&src, "range", true, lstf_interfacetype_new(&src, range_iface), true));
+    lstf_interface_add_member(changeevent_iface, lstf_interfaceproperty_new(&src, "text", false, lstf_stringtype_new(&src), true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_interface(&src, changeevent_iface));
+
+    // async fun change(file: DocumentUri, changes: TextDocumentContentChangeEvent[]): future<void>
+    lstf_function *change_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src,
+                "change",
+                lstf_futuretype_new(&src, lstf_voidtype_new(&src)),
+                true,
+                lstf_vm_op_vmcall,
+                lstf_vm_vmcall_change);
+    lstf_function_add_parameter(change_fn, (lstf_variable *)
+            lstf_variable_new(&src, "file",
+                lstf_unresolvedtype_new(&src, "DocumentUri"),
+                NULL, true));
+    lstf_function_add_parameter(change_fn, (lstf_variable *)
+            lstf_variable_new(&src, "changes",
+                lstf_arraytype_new(&src, lstf_interfacetype_new(&src, changeevent_iface)),
+                NULL, true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, change_fn));
+
+    // interface CompletionItem {
+    //  label: string;
+    //  kind?: int;
+    //  detail?: string;
+    // }
+    lstf_interface *completionitem_iface = lstf_interface_new(&src, "CompletionItem", false, true);
+    lstf_interface_add_member(completionitem_iface, lstf_interfaceproperty_new(&src, "label", false, lstf_stringtype_new(&src), true));
+    lstf_interface_add_member(completionitem_iface, lstf_interfaceproperty_new(&src, "kind", true, lstf_integertype_new(&src), true));
+    lstf_interface_add_member(completionitem_iface, lstf_interfaceproperty_new(&src, "detail", true, lstf_stringtype_new(&src), true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_interface(&src, completionitem_iface));
+
+    // interface CompletionResult {
+    //  isIncomplete: bool;
+    //  items: CompletionItem[];
+    //  partialResults: int;
+    //  timeToFirstItem: double;
+    //  timeToComplete: double;
+    // }
+    lstf_interface *completionresult_iface = lstf_interface_new(&src, "CompletionResult", false, true);
+    lstf_interface_add_member(completionresult_iface, lstf_interfaceproperty_new(&src, "isIncomplete", false, lstf_booleantype_new(&src), true));
+    lstf_interface_add_member(completionresult_iface, lstf_interfaceproperty_new(&src, "items", false,
+                lstf_arraytype_new(&src, lstf_interfacetype_new(&src, completionitem_iface)), true));
+    lstf_interface_add_member(completionresult_iface, lstf_interfaceproperty_new(&src, "partialResults", false, lstf_integertype_new(&src), true));
+    lstf_interface_add_member(completionresult_iface, lstf_interfaceproperty_new(&src, "timeToFirstItem", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(completionresult_iface, lstf_interfaceproperty_new(&src, "timeToComplete", false, lstf_doubletype_new(&src), true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_interface(&src, completionresult_iface));
+
+    // async fun completion(file: DocumentUri, line: int, char: int,
+    //                      on_items: (items: CompletionItem[]) => void): future<CompletionResult>
+    lstf_function *completion_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src,
+                "completion",
+                lstf_futuretype_new(&src, lstf_interfacetype_new(&src, completionresult_iface)),
+                true,
+                lstf_vm_op_vmcall,
+                lstf_vm_vmcall_completion);
+    lstf_function_add_parameter(completion_fn, (lstf_variable *)
+            lstf_variable_new(&src, "file",
+                lstf_unresolvedtype_new(&src, "DocumentUri"),
+                NULL, true));
+    lstf_function_add_parameter(completion_fn, (lstf_variable *)
+            lstf_variable_new(&src, "line", lstf_integertype_new(&src), NULL, true));
+    lstf_function_add_parameter(completion_fn, (lstf_variable *)
+            lstf_variable_new(&src, "char", lstf_integertype_new(&src), NULL, true));
+    lstf_functiontype *on_items_type = (lstf_functiontype *)
+        lstf_functiontype_new(&src, lstf_voidtype_new(&src), false);
+    lstf_functiontype_add_parameter(on_items_type, "items",
+            lstf_arraytype_new(&src, lstf_interfacetype_new(&src, completionitem_iface)));
+    lstf_function_add_parameter(completion_fn, (lstf_variable *)
+            lstf_variable_new(&src, "on_items", lstf_datatype_cast(on_items_type), NULL, true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, completion_fn));
+
+    // interface Response {
+    //  result: any;
+    //  sent: double;
+    //  received: double;
+    //  latency: double;
+    // }
+    lstf_interface *response_iface = lstf_interface_new(&src, "Response", false, true);
+    lstf_interface_add_member(response_iface, lstf_interfaceproperty_new(&src, "result", false, lstf_anytype_new(&src), true));
+    lstf_interface_add_member(response_iface, lstf_interfaceproperty_new(&src, "sent", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(response_iface, lstf_interfaceproperty_new(&src, "received", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(response_iface, lstf_interfaceproperty_new(&src, "latency", false, lstf_doubletype_new(&src), true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_interface(&src, response_iface));
+
+    // async fun request(method: string, params: any): future<Response>
+    lstf_function *request_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src,
+                "request",
+                lstf_futuretype_new(&src, lstf_interfacetype_new(&src, response_iface)),
+                true,
+                lstf_vm_op_vmcall,
+                lstf_vm_vmcall_request);
+    lstf_function_add_parameter(request_fn, (lstf_variable *)
+            lstf_variable_new(&src, "method", lstf_stringtype_new(&src), NULL, true));
+    lstf_function_add_parameter(request_fn, (lstf_variable *)
+            lstf_variable_new(&src, "params", lstf_anytype_new(&src), NULL, true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, request_fn));
+
+    // async fun notify(method: string, params: any): future<void>
+    lstf_function *notify_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src,
+                "notify",
+                lstf_futuretype_new(&src, lstf_voidtype_new(&src)),
+                true,
+                lstf_vm_op_vmcall,
+                lstf_vm_vmcall_notify);
+    lstf_function_add_parameter(notify_fn, (lstf_variable *)
+            lstf_variable_new(&src, "method", lstf_stringtype_new(&src), NULL, true));
+    lstf_function_add_parameter(notify_fn, (lstf_variable *)
+            lstf_variable_new(&src, "params", lstf_anytype_new(&src), NULL, true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, notify_fn));
+
+    // fun now(): double
+    lstf_function *now_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src, "now", lstf_doubletype_new(&src), false,
+                lstf_vm_op_vmcall, lstf_vm_vmcall_now);
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, now_fn));
+
+    // fun elapsed(start: double): double
+    lstf_function *elapsed_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src, "elapsed", lstf_doubletype_new(&src), false,
+                lstf_vm_op_vmcall, lstf_vm_vmcall_elapsed);
+    lstf_function_add_parameter(elapsed_fn, (lstf_variable *)
+            lstf_variable_new(&src, "start", lstf_doubletype_new(&src), NULL, true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, elapsed_fn));
+
+    // interface BenchResult {
+    //  iterations: int;
+    //  min: double;
+    //  mean: double;
+    //  p50: double;
+    //  p90: double;
+    //  p99: double;
+    //  max: double;
+    // }
+    lstf_interface *benchresult_iface = lstf_interface_new(&src, "BenchResult", false, true);
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "iterations", false, lstf_integertype_new(&src), true));
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "min", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "mean", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "p50", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "p90", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "p99", false, lstf_doubletype_new(&src), true));
+    lstf_interface_add_member(benchresult_iface, lstf_interfaceproperty_new(&src, "max", false, lstf_doubletype_new(&src), true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_interface(&src, benchresult_iface));
+
+    // async fun bench(n: int, fn: async () => future<void>): future<BenchResult>
+    lstf_function *bench_fn = (lstf_function *)
+        lstf_function_new_for_opcode(&src,
+                "bench",
+                lstf_futuretype_new(&src, lstf_interfacetype_new(&src, benchresult_iface)),
+                true,
+                lstf_vm_op_vmcall,
+                lstf_vm_vmcall_bench);
+    lstf_function_add_parameter(bench_fn, (lstf_variable *)
+            lstf_variable_new(&src, "n", lstf_integertype_new(&src), NULL, true));
+    lstf_function_add_parameter(bench_fn, (lstf_variable *)
+            lstf_variable_new(&src, "fn",
+                lstf_functiontype_new(&src, lstf_futuretype_new(&src, lstf_voidtype_new(&src)), true),
+                NULL, true));
+    lstf_function_add_statement(file->main_function,
+            lstf_declaration_new_from_function(&src, bench_fn));
+
     // print(args: any)
     lstf_function *print_fn = (lstf_function *)
         lstf_function_new_for_opcode(&src, "print", lstf_voidtype_new(&src), false, lstf_vm_op_print, 0);
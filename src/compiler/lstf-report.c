@@ -5,7 +5,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "lstf-report.h"
+#include "data-structures/string-builder.h"
 #include "io/io-common.h"
+#include <threads.h>
+
+/**
+ * Where reports made from this thread go, or `NULL` for stderr.
+ */
+static thread_local outputstream *lstf_report_output;
 
 static const char *lstf_report_domain_to_string(lstf_report_domain domain)
 {
@@ -30,11 +37,20 @@ static inline unsigned max(unsigned a, unsigned b)
     return a > b ? a : b;
 }
 
+void lstf_report_set_output(outputstream *stream)
+{
+    outputstream_ref(stream);
+    outputstream_unref(lstf_report_output);
+    lstf_report_output = stream;
+}
+
 void lstf_report(const lstf_sourceref *source_ref, lstf_report_domain domain, const char *message, ...)
 {
     // TODO: print colorized, formatted output if this is a terminal
     va_list args;
-    bool stderr_is_terminal = is_ascii_terminal(stderr);
+    // reports are only colorized when they go to a terminal
+    bool stderr_is_terminal = !lstf_report_output && is_ascii_terminal(stderr);
+    string *report = string_new();
 
     va_start(args, message);
 
@@ -68,15 +84,15 @@ void lstf_report(const lstf_sourceref *source_ref, lstf_report_domain domain, co
 
         // print context and arrows for errors across a single line
         if (source_ref->begin.line && source_ref->begin.line == source_ref->end.line) {
-            fprintf(stderr, "%s%s:%u.%u-%u.%u: %s%s:%s ", bold_begin,
+            string_appendf(report, "%s%s:%u.%u-%u.%u: %s%s:%s ", bold_begin,
                     source_ref->file->filename,
                     source_ref->begin.line, source_ref->begin.column,
                     source_ref->end.line, source_ref->end.column,
                     color_begin,
                     lstf_report_domain_to_string(domain),
                     normal_end);
-            vfprintf(stderr, message, args);
-            fprintf(stderr, "\n");
+            string_append_va(report, message, args);
+            string_appendf(report, "\n");
 
             const char *line_begin = source_ref->begin.pos;
             const char *line_end = source_ref->end.pos;
@@ -92,58 +108,64 @@ void lstf_report(const lstf_sourceref *source_ref, lstf_report_domain domain, co
                 line_end++;
 
             // print the context
-            fprintf(stderr, " %*u | ", lines_log10, source_ref->begin.line);
+            string_appendf(report, " %*u | ", lines_log10, source_ref->begin.line);
 
-            fwrite(line_begin, source_ref->begin.pos - line_begin, 1, stderr);
-            fprintf(stderr, "%s%s", bold_begin, color_begin);
+            string_appendf(report, "%.*s", (int)(source_ref->begin.pos - line_begin), line_begin);
+            string_appendf(report, "%s%s", bold_begin, color_begin);
             if (source_ref->end.pos + 1 < line_end) {
-                fwrite(source_ref->begin.pos, (source_ref->end.pos + 1) - source_ref->begin.pos, 1, stderr);
-                fprintf(stderr, "%s", normal_end);
-                fwrite(source_ref->end.pos + 1, line_end - (source_ref->end.pos + 1), 1, stderr);
+                string_appendf(report, "%.*s", (int)((source_ref->end.pos + 1) - source_ref->begin.pos), source_ref->begin.pos);
+                string_appendf(report, "%s", normal_end);
+                string_appendf(report, "%.*s", (int)(line_end - (source_ref->end.pos + 1)), source_ref->end.pos + 1);
             } else {
-                fwrite(source_ref->begin.pos, source_ref->end.pos - source_ref->begin.pos, 1, stderr);
-                fprintf(stderr, "%s", normal_end);
-                fwrite(source_ref->end.pos, line_end - source_ref->end.pos, 1, stderr);
+                string_appendf(report, "%.*s", (int)(source_ref->end.pos - source_ref->begin.pos), source_ref->begin.pos);
+                string_appendf(report, "%s", normal_end);
+                string_appendf(report, "%.*s", (int)(line_end - source_ref->end.pos), source_ref->end.pos);
             }
-            fputc('\n', stderr);
+            string_appendf(report, "\n");
 
             // write the underline
-            fprintf(stderr, " %*s | ", lines_log10, " "); 
+            string_appendf(report, " %*s | ", lines_log10, " "); 
 
-            fprintf(stderr, "%s%s", bold_begin, color_begin);
+            string_appendf(report, "%s%s", bold_begin, color_begin);
             for (unsigned pos = 1; pos <= source_ref->end.column; pos++)
-                fputc(source_ref->begin.column <= pos && pos <= source_ref->end.column ? 
-                        (pos == source_ref->begin.column ? '^' : '~') : ' ', stderr);
-            fprintf(stderr, "%s", normal_end);
-            fputc('\n', stderr);
+                string_appendf(report, "%c", source_ref->begin.column <= pos && pos <= source_ref->end.column ?
+                        (pos == source_ref->begin.column ? '^' : '~') : ' ');
+            string_appendf(report, "%s", normal_end);
+            string_appendf(report, "\n");
         } else if (!source_ref->begin.line) {
             // when the report pertains to the whole file
-            fprintf(stderr, "%s%s: %s%s:%s ", bold_begin,
+            string_appendf(report, "%s%s: %s%s:%s ", bold_begin,
                     source_ref->file->filename,
                     color_begin,
                     lstf_report_domain_to_string(domain),
                     normal_end);
-            vfprintf(stderr, message, args);
-            fprintf(stderr, "\n");
+            string_append_va(report, message, args);
+            string_appendf(report, "\n");
         } else {
             // TODO: print context for errors across multiple lines
-            fprintf(stderr, "%s%s:%u.%u-%u.%u: %s%s:%s ", bold_begin,
+            string_appendf(report, "%s%s:%u.%u-%u.%u: %s%s:%s ", bold_begin,
                     source_ref->file->filename,
                     source_ref->begin.line, source_ref->begin.column,
                     source_ref->end.line, source_ref->end.column,
                     color_begin,
                     lstf_report_domain_to_string(domain),
                     normal_end);
-            vfprintf(stderr, message, args);
-            fprintf(stderr, "\n");
+            string_append_va(report, message, args);
+            string_appendf(report, "\n");
         }
     } else {
-        fprintf(stderr, "%slstf: %s%s:%s ", 
+        string_appendf(report, "%slstf: %s%s:%s ", 
                 bold_begin, color_begin, lstf_report_domain_to_string(domain), normal_end);
-        vfprintf(stderr, message, args);
-        fprintf(stderr, "\n");
+        string_append_va(report, message, args);
+        string_appendf(report, "\n");
     }
 
     va_end(args);
+
+    if (lstf_report_output)
+        outputstream_write_string(lstf_report_output, report->buffer);
+    else
+        fputs(report->buffer, stderr);
+    string_unref(report);
 }
 
@@ -2,6 +2,7 @@
 
 #include "lstf-common.h"
 #include "lstf-sourceref.h"
+#include "io/outputstream.h"
 
 enum _lstf_report_domain {
     lstf_report_domain_error,
@@ -13,6 +14,12 @@ typedef enum _lstf_report_domain lstf_report_domain;
 void lstf_report(const lstf_sourceref *source_ref, lstf_report_domain domain, const char *message, ...)
     __attribute__((format (printf, 3, 4)));
 
+/**
+ * Sends the reports made from the calling thread to [stream] instead of
+ * stderr, or back to stderr if [stream] is `NULL`.
+ */
+void lstf_report_set_output(outputstream *stream);
+
 #define lstf_report_error(source_ref, ...) lstf_report(source_ref, lstf_report_domain_error, __VA_ARGS__)
 
 #define lstf_report_warning(source_ref, ...) lstf_report(source_ref, lstf_report_domain_warning, __VA_ARGS__)
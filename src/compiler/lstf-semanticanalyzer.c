@@ -710,13 +710,11 @@ lstf_semanticanalyzer_visit_element_access(lstf_codevisitor *visitor, lstf_eleme
                     for (iterator it = ptr_hashmap_iterator_create(interface_sym->members);
                             !found_member && it.has_next; it = iterator_next(it)) {
                         const ptr_hashmap_entry *entry = iterator_get_item(it);
-                        const char *other_property_name = entry->key;
-                        char *other_canon_property_name = json_member_name_canonicalize(other_property_name);
+                        char *other_property_name = json_member_name_canonicalize(entry->key);
 
-                        if (strcmp(canon_property_name, other_canon_property_name) == 0)
+                        if (strcmp(other_property_name, canon_property_name) == 0)
                             found_member = entry->value;
-
-                        free(other_canon_property_name);
+                        free(other_property_name);
                     }
 
                     for (iterator it = ptr_list_iterator_create(lstf_interface_cast(interface_sym)->extends_types);
@@ -741,10 +739,11 @@ lstf_semanticanalyzer_visit_element_access(lstf_codevisitor *visitor, lstf_eleme
                     analyzer->num_errors++;
 
                     free(dt_string);
-                    ptr_list_destroy(interfaces_to_check);
                     free(canon_property_name);
+                    ptr_list_destroy(interfaces_to_check);
                     return;
                 }
+                free(canon_property_name);
 
                 // otherwise, set the type of this expression to the found member
                 switch (found_member->symbol_type) {
@@ -764,7 +763,6 @@ lstf_semanticanalyzer_visit_element_access(lstf_codevisitor *visitor, lstf_eleme
                 }
 
                 ptr_list_destroy(interfaces_to_check);
-                free(canon_property_name);
             }
         } else {
             lstf_report_error(&lstf_codenode_cast(access)->source_reference,
@@ -1504,7 +1502,13 @@ lstf_semanticanalyzer_visit_return_statement(lstf_codevisitor *visitor, lstf_ret
     lstf_semanticanalyzer *analyzer = (lstf_semanticanalyzer *)visitor;
 
     lstf_function *current_function = lstf_semanticanalyzer_get_current_function(analyzer);
-    current_function->has_return_statement = true;
+    lstf_codenode *parent = lstf_codenode_cast(stmt)->parent_node;
+
+    // a return statement inside of a lambda returns from the lambda
+    while (parent && parent != lstf_codenode_cast(current_function) && !lstf_lambdaexpression_cast(parent))
+        parent = parent->parent_node;
+    if (!parent || parent == lstf_codenode_cast(current_function))
+        current_function->has_return_statement = true;
 
     lstf_datatype *expression_rt = NULL;
     if (!ptr_list_is_empty(analyzer->expected_return_types))
@@ -0,0 +1,107 @@
+#include "histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define HISTOGRAM_HALF_SUB_BUCKETS (HISTOGRAM_SUB_BUCKETS / 2)
+
+histogram *histogram_new(void)
+{
+    histogram *hist = calloc(1, sizeof *hist);
+
+    if (!hist) {
+        perror("failed to create histogram");
+        abort();
+    }
+
+    hist->min = UINT64_MAX;
+    return hist;
+}
+
+/**
+ * Gets the position of the highest set bit in [value], which must not be 0.
+ */
+static unsigned histogram_get_highest_bit(uint64_t value)
+{
+    unsigned bit = 0;
+
+    for (unsigned shift = 32; shift > 0; shift /= 2) {
+        if (value >> shift) {
+            value >>= shift;
+            bit += shift;
+        }
+    }
+
+    return bit;
+}
+
+static unsigned histogram_get_index(uint64_t value)
+{
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return (unsigned) value;
+
+    // every bucket after the first only uses the upper half of its sub-buckets,
+    // since the lower half is covered by the previous bucket
+    unsigned bucket = histogram_get_highest_bit(value) - 7;
+    return bucket * HISTOGRAM_HALF_SUB_BUCKETS + (unsigned)(value >> bucket);
+}
+
+uint64_t histogram_get_value_at(unsigned index)
+{
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    unsigned bucket = index / HISTOGRAM_HALF_SUB_BUCKETS - 1;
+    uint64_t sub_bucket = index - bucket * HISTOGRAM_HALF_SUB_BUCKETS;
+    return ((sub_bucket + 1) << bucket) - 1;
+}
+
+void histogram_record(histogram *hist, uint64_t value)
+{
+    hist->counts[histogram_get_index(value)]++;
+    hist->total_count++;
+    if (value < hist->min)
+        hist->min = value;
+    if (value > hist->max)
+        hist->max = value;
+    hist->sum += (double) value;
+}
+
+void histogram_add(histogram *hist, const histogram *other)
+{
+    for (unsigned i = 0; i < HISTOGRAM_COUNTERS; i++)
+        hist->counts[i] += other->counts[i];
+    hist->total_count += other->total_count;
+    if (other->min < hist->min)
+        hist->min = other->min;
+    if (other->max > hist->max)
+        hist->max = other->max;
+    hist->sum += other->sum;
+}
+
+uint64_t histogram_get_percentile(const histogram *hist, double percentile)
+{
+    if (hist->total_count == 0)
+        return 0;
+
+    if (percentile > 100)
+        percentile = 100;
+    uint64_t rank = (uint64_t)(percentile / 100 * (double)hist->total_count + 0.5);
+    if (rank == 0)
+        rank = 1;
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HISTOGRAM_COUNTERS; i++) {
+        seen += hist->counts[i];
+        if (seen >= rank) {
+            uint64_t value = histogram_get_value_at(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+
+    return hist->max;
+}
+
+void histogram_destroy(histogram *hist)
+{
+    free(hist);
+}
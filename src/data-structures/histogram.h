@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Values below this are counted exactly. Above it, each power of two is split
+ * into `HISTOGRAM_SUB_BUCKETS / 2` buckets, so that a recorded value is off by
+ * less than 1% from the value that was counted.
+ */
+#define HISTOGRAM_SUB_BUCKETS 256
+
+/**
+ * The number of counters needed to cover every `uint64_t`.
+ */
+#define HISTOGRAM_COUNTERS ((64 - 8 + 2) * (HISTOGRAM_SUB_BUCKETS / 2))
+
+/**
+ * Counts non-negative integers (such as latencies in nanoseconds) with a
+ * fixed relative precision, in the manner of an HDR histogram. Recording a
+ * value is `O(1)` and never allocates.
+ */
+typedef struct {
+    uint64_t counts[HISTOGRAM_COUNTERS];
+    uint64_t total_count;
+    uint64_t min;
+    uint64_t max;
+    /**
+     * The sum of all recorded values, for computing the mean.
+     */
+    double sum;
+} histogram;
+
+histogram *histogram_new(void);
+
+void histogram_record(histogram *hist, uint64_t value);
+
+/**
+ * Gets the largest value that is counted in `counts[index]`.
+ */
+uint64_t histogram_get_value_at(unsigned index);
+
+/**
+ * Adds the counts from [other] into [hist].
+ */
+void histogram_add(histogram *hist, const histogram *other);
+
+/**
+ * Gets the smallest recorded value that at least [percentile] percent of the
+ * recorded values are less than or equal to, within the precision of the
+ * histogram. Returns 0 if nothing was recorded.
+ */
+uint64_t histogram_get_percentile(const histogram *hist, double percentile);
+
+static inline double histogram_get_mean(const histogram *hist)
+{
+    return hist->total_count ? hist->sum / (double)hist->total_count : 0;
+}
+
+void histogram_destroy(histogram *hist);
@@ -0,0 +1,335 @@
+#include "piece-table.h"
+#include "data-structures/array.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void piece_table_buffer_append(piece_table_buffer *buffer, const char *text, size_t length)
+{
+    if (buffer->length + length + 1 > buffer->bufsiz) {
+        size_t new_bufsiz = buffer->bufsiz ? buffer->bufsiz : 64;
+
+        while (buffer->length + length + 1 > new_bufsiz)
+            new_bufsiz *= 2;
+        char *new_data = realloc(buffer->data, new_bufsiz);
+        if (!new_data) {
+            perror("could not resize piece table buffer");
+            abort();
+        }
+        buffer->data = new_data;
+        buffer->bufsiz = new_bufsiz;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '\n') {
+            size_t newline_offset = buffer->length + i;
+            array_add(&buffer->newlines, newline_offset);
+        }
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+}
+
+/**
+ * Finds the index of the first newline in [buffer] at or after [offset].
+ */
+static size_t piece_table_buffer_find_newline(const piece_table_buffer *buffer, size_t offset)
+{
+    size_t low = 0;
+    size_t high = buffer->newlines.length;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (buffer->newlines.elements[mid] < offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+static const piece_table_buffer *piece_table_node_get_buffer(const piece_table      *table,
+                                                             const piece_table_node *node)
+{
+    return node->added ? &table->added : &table->original;
+}
+
+static void piece_table_node_update(piece_table_node *node)
+{
+    node->subtree_length = node->length;
+    node->subtree_newlines = node->newlines;
+    if (node->left) {
+        node->subtree_length += node->left->subtree_length;
+        node->subtree_newlines += node->left->subtree_newlines;
+    }
+    if (node->right) {
+        node->subtree_length += node->right->subtree_length;
+        node->subtree_newlines += node->right->subtree_newlines;
+    }
+}
+
+/**
+ * Updates the length of the piece and recounts its newlines.
+ */
+static void piece_table_node_set_length(const piece_table *table, piece_table_node *node, size_t length)
+{
+    const piece_table_buffer *buffer = piece_table_node_get_buffer(table, node);
+
+    node->length = length;
+    node->newlines = piece_table_buffer_find_newline(buffer, node->start + length) -
+        piece_table_buffer_find_newline(buffer, node->start);
+}
+
+static piece_table_node *piece_table_node_new(piece_table *table, bool added, size_t start, size_t length)
+{
+    piece_table_node *node = calloc(1, sizeof *node);
+
+    if (!node) {
+        perror("could not allocate piece table node");
+        abort();
+    }
+
+    // xorshift32
+    table->seed ^= table->seed << 13;
+    table->seed ^= table->seed >> 17;
+    table->seed ^= table->seed << 5;
+    node->priority = table->seed;
+    node->added = added;
+    node->start = start;
+    piece_table_node_set_length(table, node, length);
+    piece_table_node_update(node);
+
+    return node;
+}
+
+static void piece_table_node_destroy(piece_table_node *node)
+{
+    if (!node)
+        return;
+    piece_table_node_destroy(node->left);
+    piece_table_node_destroy(node->right);
+    free(node);
+}
+
+static piece_table_node *piece_table_node_merge(piece_table_node *left, piece_table_node *right)
+{
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    if (left->priority >= right->priority) {
+        left->right = piece_table_node_merge(left->right, right);
+        piece_table_node_update(left);
+        return left;
+    }
+
+    right->left = piece_table_node_merge(left, right->left);
+    piece_table_node_update(right);
+    return right;
+}
+
+/**
+ * Splits the subtree at [node] into the pieces before [offset] and the pieces
+ * after it, splitting the piece that [offset] falls inside of.
+ */
+static void piece_table_node_split(piece_table       *table,
+                                   piece_table_node  *node,
+                                   size_t             offset,
+                                   piece_table_node **left,
+                                   piece_table_node **right)
+{
+    if (!node) {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+
+    size_t left_length = node->left ? node->left->subtree_length : 0;
+
+    if (offset <= left_length) {
+        piece_table_node_split(table, node->left, offset, left, &node->left);
+        piece_table_node_update(node);
+        *right = node;
+    } else if (offset >= left_length + node->length) {
+        piece_table_node_split(table, node->right, offset - left_length - node->length, &node->right, right);
+        piece_table_node_update(node);
+        *left = node;
+    } else {
+        size_t split_point = offset - left_length;
+        piece_table_node *tail = piece_table_node_new(table, node->added,
+                node->start + split_point, node->length - split_point);
+
+        // the tail replaces [node] under its parent in the right-hand tree,
+        // so it can't have a higher priority than [node] had
+        tail->priority = node->priority;
+        piece_table_node_set_length(table, node, split_point);
+        *right = piece_table_node_merge(tail, node->right);
+        node->right = NULL;
+        piece_table_node_update(node);
+        *left = node;
+    }
+}
+
+/**
+ * Extends the last piece of the subtree if it ends where text was just
+ * appended to the buffer of inserted text. This keeps consecutive insertions,
+ * like typing, from creating a piece for every insertion.
+ */
+static bool piece_table_node_extend_last(const piece_table *table,
+                                         piece_table_node  *node,
+                                         size_t             added_start,
+                                         size_t             added_length)
+{
+    if (!node)
+        return false;
+
+    bool extended = false;
+
+    if (node->right)
+        extended = piece_table_node_extend_last(table, node->right, added_start, added_length);
+    else if (node->added && node->start + node->length == added_start) {
+        piece_table_node_set_length(table, node, node->length + added_length);
+        extended = true;
+    }
+
+    if (extended)
+        piece_table_node_update(node);
+    return extended;
+}
+
+/**
+ * Finds the offset of the [n]th newline in the subtree, counting from 1.
+ */
+static size_t piece_table_node_find_newline(const piece_table      *table,
+                                            const piece_table_node *node,
+                                            size_t                  n)
+{
+    size_t offset = 0;
+
+    while (node) {
+        size_t left_newlines = node->left ? node->left->subtree_newlines : 0;
+        size_t left_length = node->left ? node->left->subtree_length : 0;
+
+        if (n <= left_newlines) {
+            node = node->left;
+        } else if (n <= left_newlines + node->newlines) {
+            const piece_table_buffer *buffer = piece_table_node_get_buffer(table, node);
+            size_t index = piece_table_buffer_find_newline(buffer, node->start) + (n - left_newlines - 1);
+
+            return offset + left_length + (buffer->newlines.elements[index] - node->start);
+        } else {
+            n -= left_newlines + node->newlines;
+            offset += left_length + node->length;
+            node = node->right;
+        }
+    }
+
+    assert(false && "newline not found in piece table");
+    return offset;
+}
+
+static char *piece_table_node_copy_text(const piece_table      *table,
+                                        const piece_table_node *node,
+                                        char                   *dest)
+{
+    if (!node)
+        return dest;
+
+    dest = piece_table_node_copy_text(table, node->left, dest);
+    memcpy(dest, piece_table_node_get_buffer(table, node)->data + node->start, node->length);
+    dest += node->length;
+    return piece_table_node_copy_text(table, node->right, dest);
+}
+
+piece_table *piece_table_new(const char *text, size_t length)
+{
+    piece_table *table = calloc(1, sizeof *table);
+
+    if (!table) {
+        perror("could not allocate piece table");
+        abort();
+    }
+
+    array_init(&table->original.newlines);
+    array_init(&table->added.newlines);
+    table->seed = 2463534242u;
+    piece_table_buffer_append(&table->original, text, length);
+    if (length > 0)
+        table->root = piece_table_node_new(table, false, 0, length);
+
+    return table;
+}
+
+void piece_table_destroy(piece_table *table)
+{
+    piece_table_node_destroy(table->root);
+    free(table->original.data);
+    array_destroy(&table->original.newlines);
+    free(table->added.data);
+    array_destroy(&table->added.newlines);
+    free(table);
+}
+
+size_t piece_table_get_offset(const piece_table *table, size_t line, size_t character)
+{
+    size_t line_count = piece_table_get_line_count(table);
+    size_t text_length = piece_table_get_length(table);
+
+    if (line >= line_count)
+        return text_length;
+
+    size_t line_start = line == 0 ? 0 : piece_table_node_find_newline(table, table->root, line) + 1;
+    size_t line_end = line + 1 < line_count ? piece_table_node_find_newline(table, table->root, line + 1) : text_length;
+
+    return line_start + (character < line_end - line_start ? character : line_end - line_start);
+}
+
+void piece_table_replace(piece_table *table,
+                         size_t       offset,
+                         size_t       length,
+                         const char  *text,
+                         size_t       text_length)
+{
+    size_t total_length = piece_table_get_length(table);
+    piece_table_node *before = NULL;
+    piece_table_node *removed = NULL;
+    piece_table_node *after = NULL;
+
+    if (offset > total_length)
+        offset = total_length;
+    if (length > total_length - offset)
+        length = total_length - offset;
+
+    piece_table_node_split(table, table->root, offset, &before, &after);
+    piece_table_node_split(table, after, length, &removed, &after);
+    piece_table_node_destroy(removed);
+
+    if (text_length > 0) {
+        size_t added_start = table->added.length;
+
+        piece_table_buffer_append(&table->added, text, text_length);
+        if (!piece_table_node_extend_last(table, before, added_start, text_length))
+            before = piece_table_node_merge(before,
+                    piece_table_node_new(table, true, added_start, text_length));
+    }
+
+    table->root = piece_table_node_merge(before, after);
+}
+
+char *piece_table_get_text(const piece_table *table)
+{
+    size_t length = piece_table_get_length(table);
+    char *text = malloc(length + 1);
+
+    if (!text) {
+        perror("could not allocate text of piece table");
+        abort();
+    }
+
+    piece_table_node_copy_text(table, table->root, text)[0] = '\0';
+    return text;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "data-structures/array.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A buffer that text is only ever appended to, along with the offsets of the
+ * newlines in it.
+ */
+typedef struct {
+    char *data;
+    size_t length;
+    size_t bufsiz;
+
+    /**
+     * The offsets of every `'\n'` in the buffer, in increasing order.
+     */
+    array(size_t) newlines;
+} piece_table_buffer;
+
+typedef struct _piece_table_node piece_table_node;
+
+/**
+ * A piece of text from one of the buffers, and the root of a subtree of
+ * pieces. The pieces of the whole document are found with an in-order
+ * traversal of the tree.
+ */
+struct _piece_table_node {
+    piece_table_node *left;
+    piece_table_node *right;
+
+    /**
+     * The tree is kept balanced as a treap, with the parent of any node having
+     * a priority at least as high.
+     */
+    uint32_t priority;
+
+    /**
+     * Whether this piece refers to the append-only buffer of inserted text
+     * instead of the original text.
+     */
+    bool added;
+    size_t start;
+    size_t length;
+    size_t newlines;
+
+    size_t subtree_length;
+    size_t subtree_newlines;
+};
+
+/**
+ * A text document, stored as a sequence of pieces from the original text and
+ * from text that was inserted afterwards. Replacing a range of the text and
+ * looking up the offset of a line are both `O(log n)` in the number of edits.
+ */
+typedef struct {
+    piece_table_buffer original;
+    piece_table_buffer added;
+    piece_table_node *root;
+    uint32_t seed;
+} piece_table;
+
+/**
+ * Creates a new piece table from a copy of the first [length] bytes of [text].
+ */
+piece_table *piece_table_new(const char *text, size_t length);
+
+void piece_table_destroy(piece_table *table);
+
+static inline size_t piece_table_get_length(const piece_table *table)
+{
+    return table->root ? table->root->subtree_length : 0;
+}
+
+/**
+ * Gets the number of lines in the text, which is always at least one.
+ */
+static inline size_t piece_table_get_line_count(const piece_table *table)
+{
+    return (table->root ? table->root->subtree_newlines : 0) + 1;
+}
+
+/**
+ * Converts a line and a character on that line into an offset in the text.
+ * Lines are terminated by `'\n'` and characters are counted in bytes. A
+ * character past the end of the line is clamped to the end of the line, and
+ * a line past the end of the text is clamped to the end of the text.
+ */
+size_t piece_table_get_offset(const piece_table *table, size_t line, size_t character);
+
+/**
+ * Replaces the [length] bytes of text at [offset] with the first
+ * [text_length] bytes of [text]. The range is clamped to the end of the text.
+ */
+void piece_table_replace(piece_table *table,
+                         size_t       offset,
+                         size_t       length,
+                         const char  *text,
+                         size_t       text_length);
+
+/**
+ * Gets a copy of the whole text. You must `free()` this when done.
+ */
+char *piece_table_get_text(const piece_table *table);
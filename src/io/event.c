@@ -1,4 +1,6 @@
 #include "event.h"
+#include "io-trace.h"
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -149,6 +151,8 @@ eventloop *eventloop_new(void)
     }
 
     mtx_init(&loop->monitoring_lock, mtx_plain);
+    cnd_init(&loop->monitoring_cond);
+    array_init(&loop->processes);
 #endif
 
     return loop;
@@ -274,71 +278,47 @@ static int eventloop_monitor_subprocesses(void *user_data)
 {
     eventloop *loop = user_data;
 
-    // TODO: We want a way to monitor only exactly those processes that are part
-    // of the event loop, without busy-waiting, conforming to POSIX. Is this
-    // possible? Or maybe we have to busy-wait? Or perhaps we have to drop POSIX?
+    // TODO: We want a way to monitor the processes that are part of the event
+    // loop without busy-waiting, conforming to POSIX. Is this possible? Or
+    // perhaps we have to drop POSIX? For now, we check on each of our
+    // processes every .2 s. We can't wait() for any child, since other event
+    // loops may be monitoring their own children.
+    mtx_lock(&loop->monitoring_lock);
     while (loop->monitoring_thread_running) {
-        // first, look in our queue for previously unmanaged processes
-        mtx_lock(&loop->monitoring_lock);
-        for (unsigned i = 0; i < loop->ready_processes.length; ) {
-            io_procstat *proc =
-                &loop->ready_processes
-                     .elements[loop->ready_processes.length - 1];
-            bool removed = false;
-            eventloop_pending_events_foreach(loop, pending, prev, {
-                (void)prev;
-                if (pending->type == event_type_subprocess && pending->process == proc->process) {
-                    event_return(pending, (void *)(intptr_t)proc->status);
-                    eventloop_signal(loop);
-                    // TODO: use linked list instead of array?
-                    array_remove(&loop->ready_processes, i);
-                    removed = true;
-                }
-            });
-            if (!removed)
+        for (unsigned i = 0; i < loop->processes.length; ) {
+            int   child_status = 0;
+            pid_t child_pid    = waitpid(loop->processes.elements[i], &child_status, WNOHANG);
+
+            if (child_pid == 0 || (child_pid == (pid_t)-1 && errno == EINTR)) {
+                // still running
                 ++i;
-        }
-        mtx_unlock(&loop->monitoring_lock);
-
-        // wait for a process...
-        int   child_status = 0;
-        pid_t child_pid    = -1;
-        while ((child_pid = wait(&child_status)) == (pid_t)-1) {
-            if (errno == ECHILD) {
-                // no child processes. wait for .2 s.
-                thrd_sleep(&(struct timespec){.tv_nsec = 200000000}, NULL);
-                break;
+                continue;
             }
-            if (errno != EAGAIN) {
-                fprintf(stderr, "%s: unhandled error with wait(): %s\n",
-                        __func__, strerror(errno));
-                abort();
-            }
-        }
-
-        if (child_pid != -1) {
-            bool is_monitored = false;
 
-            // check if this child is a managed process
-            eventloop_pending_events_foreach(loop, pending, prev, {
-                (void)prev;
+            for (event *pending = loop->pending_events; pending; pending = pending->next) {
                 if (pending->type == event_type_subprocess &&
-                    pending->process == child_pid) {
-                    event_return(pending, (void *)(intptr_t)child_status);
+                    pending->process == loop->processes.elements[i]) {
+                    if (child_pid == (pid_t)-1)
+                        event_cancel_with_errno(pending, errno);
+                    else
+                        event_return(pending, (void *)(intptr_t)child_status);
                     eventloop_signal(loop);
-                    is_monitored = true;
                 }
-            });
-
-            if (!is_monitored) {
-                // child not managed. save the process for a later event
-                mtx_lock(&loop->monitoring_lock);
-                array_add(&loop->ready_processes,
-                          ((io_procstat){child_pid, child_status}));
-                mtx_unlock(&loop->monitoring_lock);
             }
+            array_remove(&loop->processes, i);
         }
+
+        // wait for .2 s, or until the event loop is destroyed
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_nsec += 200000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        cnd_timedwait(&loop->monitoring_cond, &loop->monitoring_lock, &deadline);
     }
+    mtx_unlock(&loop->monitoring_lock);
 
     return 0;
 }
@@ -366,13 +346,13 @@ event *eventloop_add_subprocess(eventloop     *loop,
         loop->monitoring_thread_running = true;
         if (thrd_create(&loop->monitoring_thread,
                         eventloop_monitor_subprocesses, loop) != thrd_success) {
+            loop->monitoring_thread_running = false;
             mtx_unlock(&loop->monitoring_lock);
             eventloop_remove(loop, ev, prev);
             free(ev);
             return NULL;
         }
     }
-    thrd_detach(loop->monitoring_thread);
 #endif
     mtx_unlock(&loop->monitoring_lock);
 
@@ -444,13 +424,13 @@ static int eventloop_poll_thread(void *user_data)
 #endif
 
 /**
- * Wait for an event to happen. This will block if there are no events that
- * have already completed (when *ready_events != NULL) and force_nonblocking is
- * false. Otherwise this will return immediately.
+ * Wait for an event to happen. This will block for up to [timeout_ms]
+ * milliseconds, or indefinitely if it is negative, unless there are events
+ * that have already completed (when *ready_events != NULL).
  */
 static void eventloop_poll(eventloop *loop,
                            event    **ready_events,
-                           bool       force_nonblocking,
+                           int        timeout_ms,
                            unsigned   num_io_pending,
                            bool       have_non_io_tasks)
 
@@ -460,7 +440,10 @@ static void eventloop_poll(eventloop *loop,
 
 #if defined(_WIN32) || defined(_WIN64)
     // Windows
-    int timeout_ms = (*ready_events && !force_nonblocking) ? 0 : INFINITE;
+    if (*ready_events)
+        timeout_ms = 0;
+    else if (timeout_ms < 0)
+        timeout_ms = INFINITE;
 
     // because of limitations with WaitForMultipleObjectsEx(), we must split the
     // waiting across multiple threads
@@ -560,8 +543,8 @@ static void eventloop_poll(eventloop *loop,
     }
 
     // poll without waiting (0) if there are other ready tasks
-    // otherwise, poll with an indefinite wait (-1)
-    int timeout_ms = (*ready_events && !force_nonblocking) ? 0 : -1;
+    if (*ready_events)
+        timeout_ms = 0;
 
     while (poll(pollfds, num_io_pending + have_non_io_tasks, timeout_ms) == -1 &&
             (errno == EAGAIN || errno == EINTR))
@@ -608,9 +591,13 @@ static void eventloop_poll(eventloop *loop,
 }
 
 
-bool eventloop_process(eventloop *loop, 
-                       bool       force_nonblocking,
-                       unsigned  *num_processed)
+/**
+ * Processes all ready events, waiting up to [timeout_ms] for one if there are
+ * none, or indefinitely if [timeout_ms] is negative.
+ */
+static bool eventloop_process_events(eventloop *loop,
+                                     int        timeout_ms,
+                                     unsigned  *num_processed)
 {
     event *ready_events = NULL;
 
@@ -632,7 +619,12 @@ bool eventloop_process(eventloop *loop,
     });
 
     // wait for events
-    eventloop_poll(loop, &ready_events, force_nonblocking, num_io_pending, have_non_io_tasks);
+    const bool may_wait = timeout_ms != 0 && !ready_events && num_io_pending + have_non_io_tasks > 0;
+    const uint64_t wait_start = may_wait && io_trace_is_enabled() ? io_get_monotonic_time() : 0;
+    eventloop_poll(loop, &ready_events, timeout_ms, num_io_pending, have_non_io_tasks);
+    if (wait_start)
+        io_trace_complete("io", "eventloop wait", wait_start, io_get_monotonic_time(),
+                          "pending", num_io_pending + have_non_io_tasks);
 
     while (ready_events) {
         event *ev = ready_events;
@@ -655,15 +647,41 @@ bool eventloop_process(eventloop *loop,
     return loop->is_running && loop->pending_events;
 }
 
+bool eventloop_process(eventloop *loop, 
+                       bool       force_nonblocking,
+                       unsigned  *num_processed)
+{
+    return eventloop_process_events(loop, force_nonblocking ? 0 : -1, num_processed);
+}
+
+bool eventloop_process_timeout(eventloop *loop,
+                               uint64_t   timeout,
+                               unsigned  *num_processed)
+{
+    // round up, so that the wait isn't cut short
+    const uint64_t timeout_ms = (timeout + 999999) / 1000000;
+
+    return eventloop_process_events(loop, timeout_ms > INT_MAX ? INT_MAX : (int)timeout_ms, num_processed);
+}
+
 void eventloop_quit(eventloop *loop)
 {
     loop->is_running = false;
-    loop->monitoring_thread_running = false;
 }
 
 void eventloop_destroy(eventloop *loop)
 {
     loop->is_running = false;
+#if !(defined(_WIN32) || defined(_WIN64))
+    // the monitor must not outlive the event loop
+    mtx_lock(&loop->monitoring_lock);
+    bool was_monitoring = loop->monitoring_thread_running;
+    loop->monitoring_thread_running = false;
+    cnd_signal(&loop->monitoring_cond);
+    mtx_unlock(&loop->monitoring_lock);
+    if (was_monitoring)
+        thrd_join(loop->monitoring_thread, NULL);
+#endif
     while (loop->pending_events) {
         event *ev = loop->pending_events;
         event_cancel(ev);
@@ -677,6 +695,8 @@ void eventloop_destroy(eventloop *loop)
 #else
     close(loop->bg_eventfd);
     close(loop->bg_signalfd);
+    array_destroy(&loop->processes);
+    cnd_destroy(&loop->monitoring_cond);
     mtx_destroy(&loop->monitoring_lock);
 #endif
 
@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <stdbool.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <threads.h>
 
 typedef struct _event event;
@@ -190,13 +191,13 @@ struct _eventloop {
     thrd_t monitoring_thread;
 
     mtx_t monitoring_lock;
-#endif
 
     /**
-     * Background processes that are ready but may not yet be associated with an
-     * event.
+     * Signaled to wake up the monitoring thread when the event loop is
+     * destroyed.
      */
-    array(io_procstat) ready_processes;
+    cnd_t monitoring_cond;
+#endif
 
     /**
      * Background processes that are not ready. We need to keep track of exactly
@@ -280,6 +281,16 @@ bool eventloop_process(eventloop *loop,
                        bool       force_nonblocking,
                        unsigned  *num_processed);
 
+/**
+ * Like `eventloop_process()`, but waits at most [timeout] nanoseconds for an
+ * event if none are ready.
+ *
+ * @param num_processed (optional)
+ */
+bool eventloop_process_timeout(eventloop *loop,
+                               uint64_t   timeout,
+                               unsigned  *num_processed);
+
 void eventloop_quit(eventloop *loop);
 
 void eventloop_destroy(eventloop *loop);
@@ -42,11 +42,13 @@ static void inputstream_free(inputstream *stream)
             break;
         case inputstream_type_fd:
             close(stream->fd);
-            free(stream->fdbuffer);
             break;
         }
     }
 
+    // the buffer for reading from the file descriptor is always our own
+    if (stream->stream_type == inputstream_type_fd)
+        free(stream->fdbuffer);
     free(stream);
 }
 
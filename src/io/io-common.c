@@ -6,6 +6,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <threads.h>
 
@@ -43,11 +44,74 @@ bool is_ascii_terminal(FILE *file) {
     return false;
 }
 
+uint64_t io_get_monotonic_time(void)
+{
+    LARGE_INTEGER frequency, counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000 +
+        (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000 / (uint64_t)frequency.QuadPart;
+}
+
+bool io_create_directories(const char *path)
+{
+    char *directory = _strdup(path);
+    bool success = true;
+
+    if (!directory) {
+        perror("failed to create directories");
+        abort();
+    }
+
+    for (char *p = directory; success; p++) {
+        if (*p && *p != '/' && *p != '\\')
+            continue;
+        char separator = *p;
+        *p = '\0';
+        if (p > directory && p[-1] != ':' && !CreateDirectoryA(directory, NULL) &&
+                GetLastError() != ERROR_ALREADY_EXISTS) {
+            errno = GetLastError() == ERROR_ACCESS_DENIED ? EACCES : ENOENT;
+            success = false;
+        }
+        if (!(*p = separator))
+            break;
+    }
+
+    free(directory);
+    return success;
+}
+
+bool io_write_file_atomically(const char *path, const void *data, size_t length)
+{
+    string *temp_path = string_new();
+    string_appendf(temp_path, "%s.%lu.%lu.tmp", path,
+            (unsigned long) GetCurrentProcessId(), (unsigned long) GetCurrentThreadId());
+    FILE *file = fopen(temp_path->buffer, "wb");
+    bool success = file != NULL;
+
+    if (file) {
+        success = fwrite(data, 1, length, file) == length;
+        success &= fclose(file) == 0;
+        if (success && !MoveFileExA(temp_path->buffer, path, MOVEFILE_REPLACE_EXISTING)) {
+            errno = EACCES;
+            success = false;
+        }
+        if (!success)
+            remove(temp_path->buffer);
+    }
+
+    free(string_destroy(temp_path));
+    return success;
+}
+
 #else
 /* UNIX */
 #include <unistd.h>
 #include <limits.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <time.h>
 
 char *io_get_filename_from_fd(int fd)
 {
@@ -72,10 +136,76 @@ bool is_ascii_terminal(FILE *file) {
     return isatty(fileno(file));
 }
 
+uint64_t io_get_monotonic_time(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + (uint64_t)now.tv_nsec;
+}
+
 const char *io_get_current_dir(void)
 {
     static thread_local char buffer[8192 /* should be good enough */];
     assert(getcwd(buffer, sizeof(buffer)-1) && "path is too long! increase buffer size!");
     return buffer;
 }
+
+bool io_create_directories(const char *path)
+{
+    char *directory = strdup(path);
+    bool success = true;
+
+    if (!directory) {
+        perror("failed to create directories");
+        abort();
+    }
+
+    for (char *p = directory; success; p++) {
+        if (*p && *p != '/')
+            continue;
+        char separator = *p;
+        *p = '\0';
+        if (p > directory && mkdir(directory, 0777) != 0 && errno != EEXIST)
+            success = false;
+        if (!(*p = separator))
+            break;
+    }
+
+    free(directory);
+    return success;
+}
+
+bool io_write_file_atomically(const char *path, const void *data, size_t length)
+{
+    string *temp_path = string_new();
+    string_appendf(temp_path, "%s.XXXXXX", path);
+    int fd = mkstemp(temp_path->buffer);
+    bool success = fd != -1;
+
+    if (fd != -1) {
+        const uint8_t *remaining = data;
+        while (success && length > 0) {
+            ssize_t written = write(fd, remaining, length);
+            if (written == -1 && errno == EINTR)
+                continue;
+            if (written == -1) {
+                success = false;
+            } else {
+                remaining += written;
+                length -= (size_t) written;
+            }
+        }
+        success &= close(fd) == 0;
+        success = success && rename(temp_path->buffer, path) == 0;
+        if (!success) {
+            int saved_errno = errno;
+            unlink(temp_path->buffer);
+            errno = saved_errno;
+        }
+    }
+
+    free(string_destroy(temp_path));
+    return success;
+}
 #endif
@@ -2,6 +2,8 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /**
  * Returns a new string that is the filename for the file descriptor, or NULL
@@ -18,3 +20,26 @@ bool is_ascii_terminal(FILE *file);
  * Gets the current working directory
  */
 const char *io_get_current_dir(void);
+
+/**
+ * Gets the time in nanoseconds since some unspecified point in the past. This
+ * is not affected by changes to the system time, so it is suitable for
+ * measuring intervals.
+ */
+uint64_t io_get_monotonic_time(void);
+
+/**
+ * Creates the directory at [path] along with any missing parent directories.
+ * It is not an error if the directory already exists.
+ */
+bool io_create_directories(const char *path);
+
+/**
+ * Writes [length] bytes of [data] to the file at [path], replacing it.
+ * The data goes to a new file, which is then renamed over [path]. Readers
+ * see either the old file or the complete new one, even when several
+ * processes or threads write the same file at once.
+ *
+ * @return whether the file was written, with errno set on failure
+ */
+bool io_write_file_atomically(const char *path, const void *data, size_t length);
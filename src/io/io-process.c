@@ -1,3 +1,7 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // for pipe2()
+#endif
+
 #include "io/io-process.h"
 #include "io/inputstream.h"
 #include "io/outputstream.h"
@@ -234,6 +238,16 @@ const char *io_get_current_dir(void)
     assert((result && result <= sizeof buffer) && "path may be too long! increase buffer!");
     return buffer;
 }
+
+bool io_terminate(io_process process)
+{
+    return TerminateProcess(process, 1);
+}
+
+bool io_kill(io_process process)
+{
+    return TerminateProcess(process, 1);
+}
 #else
 /* UNIX */
 #include <unistd.h>
@@ -246,6 +260,65 @@ const char *io_get_current_dir(void)
 #include <errno.h>
 #include <stdlib.h>
 
+#ifdef __linux__
+// both ends are created with FD_CLOEXEC already set, so a child that another
+// thread forks at the same time never inherits them
+#define io_pipe_cloexec(fds) pipe2(fds, O_CLOEXEC)
+#define io_fork_lock() ((void)0)
+#define io_fork_unlock() ((void)0)
+#else
+#include <threads.h>
+
+// without pipe2(), a child that another thread forks between pipe() and
+// fcntl() inherits the pipe, which then never reaches EOF. pipes are
+// created and processes forked while holding this lock
+static mtx_t io_fork_mutex;
+
+static void io_fork_mutex_init(void)
+{
+    if (mtx_init(&io_fork_mutex, mtx_plain) == thrd_error) {
+        fprintf(stderr, "error: failed to initialize mutex for fork(): %s\n",
+                strerror(errno));
+        abort();
+    }
+}
+
+static void io_fork_lock(void)
+{
+    static once_flag flag = ONCE_FLAG_INIT;
+    call_once(&flag, io_fork_mutex_init);
+
+    if (mtx_lock(&io_fork_mutex) == thrd_error) {
+        fprintf(stderr, "%s: failed to acquire mutex: %s\n", __func__, strerror(errno));
+        abort();
+    }
+}
+
+static void io_fork_unlock(void)
+{
+    if (mtx_unlock(&io_fork_mutex) == thrd_error) {
+        fprintf(stderr, "%s: failed to release mutex: %s\n", __func__, strerror(errno));
+        abort();
+    }
+}
+
+static int io_pipe_cloexec(int fds[2])
+{
+    if (pipe(fds) != 0)
+        return -1;
+    if (fcntl(fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
+            fcntl(fds[1], F_SETFD, FD_CLOEXEC) != 0) {
+        int saved_errno = errno;
+        close(fds[0]);
+        close(fds[1]);
+        fds[0] = fds[1] = -1;
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
 bool io_communicate(const char    *path,
                     const char   **args,
                     outputstream **in_stream,
@@ -268,30 +341,27 @@ bool io_communicate(const char    *path,
     union pipe_info stderr_pipe = {.fds = {-1, -1}};
     union pipe_info communicate_pipe = {.fds = {-1, -1}};
     pid_t child_pid = -1;
-    if (in_stream)
-        if (pipe(stdin_pipe.fds) != 0 ||
-                fcntl(stdin_pipe.fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
-                fcntl(stdin_pipe.fds[1], F_SETFD, FD_CLOEXEC) != 0)
-            goto cleanup_on_error;
-    if (out_stream)
-        if (pipe(stdout_pipe.fds) != 0 ||
-                fcntl(stdout_pipe.fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
-                fcntl(stdout_pipe.fds[1], F_SETFD, FD_CLOEXEC) != 0)
-            goto cleanup_on_error;
-    if (err_stream)
-        if (pipe(stderr_pipe.fds) != 0 ||
-                fcntl(stderr_pipe.fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
-                fcntl(stderr_pipe.fds[1], F_SETFD, FD_CLOEXEC) != 0)
-            goto cleanup_on_error;
+    bool holding_fork_lock = true;
+
+    io_fork_lock();
+    if (in_stream && io_pipe_cloexec(stdin_pipe.fds) != 0)
+        goto cleanup_on_error;
+    if (out_stream && io_pipe_cloexec(stdout_pipe.fds) != 0)
+        goto cleanup_on_error;
+    if (err_stream && io_pipe_cloexec(stderr_pipe.fds) != 0)
+        goto cleanup_on_error;
 
     // create another pipe for communicating child exec() status
-    if (pipe(communicate_pipe.fds) != 0 ||
-            fcntl(communicate_pipe.fds[0], F_SETFD, FD_CLOEXEC) != 0 ||
-            fcntl(communicate_pipe.fds[1], F_SETFD, FD_CLOEXEC) != 0)
+    if (io_pipe_cloexec(communicate_pipe.fds) != 0)
         goto cleanup_on_error;
 
     // fork
-    if ((child_pid = fork()) == -1) {
+    child_pid = fork();
+    if (child_pid != 0) {
+        io_fork_unlock();
+        holding_fork_lock = false;
+    }
+    if (child_pid == -1) {
         goto cleanup_on_error;
     } else if (child_pid == 0) {
         // --- child ---
@@ -342,26 +412,39 @@ bool io_communicate(const char    *path,
     } else {
         // --- parent ---
 
-        // close the ends of the pipes we opened for the child
+        // close the ends of the pipes we opened for the child. each fd is
+        // forgotten once it is closed or owned by a stream (which the caller
+        // may still read from on failure), so that the cleanup doesn't close
+        // a descriptor that another thread has since been given
         if (in_stream && close(stdin_pipe.read_fd) != 0)
             goto cleanup_on_error;
+        stdin_pipe.read_fd = -1;
         if (out_stream && close(stdout_pipe.write_fd) != 0)
             goto cleanup_on_error;
+        stdout_pipe.write_fd = -1;
         if (err_stream && close(stderr_pipe.write_fd) != 0)
             goto cleanup_on_error;
+        stderr_pipe.write_fd = -1;
         if (close(communicate_pipe.write_fd) != 0)
             goto cleanup_on_error;
+        communicate_pipe.write_fd = -1;
 
         // setup streams
-        if (in_stream &&
-            !(*in_stream = outputstream_new_from_fd(stdin_pipe.write_fd, true)))
-            goto cleanup_on_error;
-        if (out_stream &&
-            !(*out_stream = inputstream_new_from_fd(stdout_pipe.read_fd, true)))
-            goto cleanup_on_error;
-        if (err_stream &&
-            !(*err_stream = inputstream_new_from_fd(stderr_pipe.read_fd, true)))
-            goto cleanup_on_error;
+        if (in_stream) {
+            if (!(*in_stream = outputstream_new_from_fd(stdin_pipe.write_fd, true)))
+                goto cleanup_on_error;
+            stdin_pipe.write_fd = -1;
+        }
+        if (out_stream) {
+            if (!(*out_stream = inputstream_new_from_fd(stdout_pipe.read_fd, true)))
+                goto cleanup_on_error;
+            stdout_pipe.read_fd = -1;
+        }
+        if (err_stream) {
+            if (!(*err_stream = inputstream_new_from_fd(stderr_pipe.read_fd, true)))
+                goto cleanup_on_error;
+            stderr_pipe.read_fd = -1;
+        }
 
         // if child failed to exec(), we will receive a message here
         int child_errno;
@@ -384,14 +467,18 @@ bool io_communicate(const char    *path,
 
 cleanup_on_error:
     saved_errno = errno;
-    close(stdin_pipe.read_fd);
-    close(stdin_pipe.write_fd);
-    close(stdout_pipe.read_fd);
-    close(stdout_pipe.write_fd);
-    close(stderr_pipe.read_fd);
-    close(stderr_pipe.write_fd);
-    close(communicate_pipe.read_fd);
-    close(communicate_pipe.write_fd);
+    if (holding_fork_lock)
+        io_fork_unlock();
+    for (unsigned i = 0; i < 2; i++) {
+        if (stdin_pipe.fds[i] != -1)
+            close(stdin_pipe.fds[i]);
+        if (stdout_pipe.fds[i] != -1)
+            close(stdout_pipe.fds[i]);
+        if (stderr_pipe.fds[i] != -1)
+            close(stderr_pipe.fds[i]);
+        if (communicate_pipe.fds[i] != -1)
+            close(communicate_pipe.fds[i]);
+    }
     if (child_pid != -1) {
         // end child process
         if (kill(child_pid, SIGTERM) == -1) {
@@ -425,4 +512,14 @@ cleanup_on_error:
     errno = saved_errno;
     return false;
 }
+
+bool io_terminate(io_process process)
+{
+    return kill(process, SIGTERM) == 0;
+}
+
+bool io_kill(io_process process)
+{
+    return kill(process, SIGKILL) == 0;
+}
 #endif  // defined(_WIN32) || defined(_WIN64)
@@ -51,3 +51,18 @@ bool io_communicate(const char    *path,
                     inputstream  **err_stream,
                     io_process    *subprocess)
     __attribute__((nonnull(1, 2), warn_unused_result));
+
+/**
+ * Asks [process] to terminate, without waiting for it to exit.
+ *
+ * @return true on success. false on error, with errno set
+ */
+bool io_terminate(io_process process);
+
+/**
+ * Forces [process] to exit, for when it did not exit after `io_terminate()`.
+ * Does not wait for it to exit.
+ *
+ * @return true on success. false on error, with errno set
+ */
+bool io_kill(io_process process);
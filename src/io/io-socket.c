@@ -0,0 +1,211 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // for struct ucred
+#endif
+
+#include "io/io-socket.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+/* WINDOWS */
+
+int io_socket_listen(const char *path)
+{
+    (void) path;
+    errno = ENOSYS;
+    return -1;
+}
+
+int io_socket_accept(int listen_fd)
+{
+    (void) listen_fd;
+    errno = ENOSYS;
+    return -1;
+}
+
+int io_socket_connect(const char *path)
+{
+    (void) path;
+    errno = ENOSYS;
+    return -1;
+}
+
+bool io_socket_get_peer_uid(int fd, unsigned *uid)
+{
+    (void) fd;
+    (void) uid;
+    errno = ENOSYS;
+    return false;
+}
+
+bool io_socket_shutdown_write(int fd)
+{
+    (void) fd;
+    errno = ENOSYS;
+    return false;
+}
+
+bool io_socket_set_timeout(int fd, uint64_t timeout)
+{
+    (void) fd;
+    (void) timeout;
+    errno = ENOSYS;
+    return false;
+}
+#else
+/* UNIX */
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Fills in the address for [path]. Returns false if [path] is too long.
+ */
+static bool io_socket_address_init(struct sockaddr_un *address, const char *path)
+{
+    memset(address, 0, sizeof *address);
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof address->sun_path) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+static int io_socket_new(void)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    return fd;
+}
+
+int io_socket_listen(const char *path)
+{
+    struct sockaddr_un address;
+    int fd = -1;
+
+    if (!io_socket_address_init(&address, path) || (fd = io_socket_new()) == -1)
+        return -1;
+
+    // connecting requires write permission, so a socket that only we can
+    // write to keeps other users out. the mode has to be set when the socket
+    // is created, or there would be a window in which anyone could connect
+    mode_t old_mask = umask(077);
+    bool bound = bind(fd, (struct sockaddr *)&address, sizeof address) == 0;
+
+    if (!bound) {
+        // replace the socket if nobody is listening on it anymore
+        int probe_fd = errno == EADDRINUSE ? io_socket_connect(path) : -1;
+        if (probe_fd != -1 || errno != ECONNREFUSED || unlink(path) != 0 ||
+                bind(fd, (struct sockaddr *)&address, sizeof address) != 0) {
+            int saved_errno = probe_fd != -1 ? EADDRINUSE : errno;
+            if (probe_fd != -1)
+                close(probe_fd);
+            close(fd);
+            umask(old_mask);
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    umask(old_mask);
+
+    if (listen(fd, SOMAXCONN) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        unlink(path);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
+int io_socket_accept(int listen_fd)
+{
+    int fd;
+
+    while ((fd = accept(listen_fd, NULL, NULL)) == -1 && errno == EINTR)
+        ;
+    if (fd != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    return fd;
+}
+
+int io_socket_connect(const char *path)
+{
+    struct sockaddr_un address;
+    int fd = -1;
+
+    if (!io_socket_address_init(&address, path) || (fd = io_socket_new()) == -1)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&address, sizeof address) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return fd;
+}
+
+bool io_socket_get_peer_uid(int fd, unsigned *uid)
+{
+#if defined(SO_PEERCRED)
+    struct ucred credentials;
+    socklen_t length = sizeof credentials;
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0)
+        return false;
+    *uid = (unsigned) credentials.uid;
+    return true;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+    uid_t peer_uid;
+    gid_t peer_gid;
+
+    if (getpeereid(fd, &peer_uid, &peer_gid) != 0)
+        return false;
+    *uid = (unsigned) peer_uid;
+    return true;
+#else
+    (void) fd;
+    (void) uid;
+    errno = ENOSYS;
+    return false;
+#endif
+}
+
+bool io_socket_shutdown_write(int fd)
+{
+    return shutdown(fd, SHUT_WR) == 0;
+}
+
+bool io_socket_set_timeout(int fd, uint64_t timeout)
+{
+    struct timeval tv = {
+        .tv_sec = (time_t)(timeout / 1000000000),
+        .tv_usec = (suseconds_t)(timeout % 1000000000 / 1000)
+    };
+
+    // a timeout that rounds down to 0 would mean no timeout at all
+    if (timeout > 0 && tv.tv_sec == 0 && tv.tv_usec == 0)
+        tv.tv_usec = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv) == 0 &&
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv) == 0;
+}
+#endif  // defined(_WIN32) || defined(_WIN64)
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Creates a local (Unix domain) socket at [path] and listens on it for
+ * connections. Only this user can connect to the socket. A stale socket left
+ * at [path] by a process that is gone is replaced.
+ *
+ * @return the file descriptor of the socket, or -1 on error, with errno set
+ */
+int io_socket_listen(const char *path);
+
+/**
+ * Accepts a connection on a socket created with `io_socket_listen()`.
+ *
+ * @return the file descriptor of the connection, or -1 on error, with errno set
+ */
+int io_socket_accept(int listen_fd);
+
+/**
+ * Connects to the local socket at [path].
+ *
+ * @return the file descriptor of the connection, or -1 on error, with errno set
+ */
+int io_socket_connect(const char *path);
+
+/**
+ * Gets the ID of the user running the process on the other end of the
+ * connection [fd].
+ *
+ * @return whether the ID was found, with errno set if not
+ */
+bool io_socket_get_peer_uid(int fd, unsigned *uid);
+
+/**
+ * Tells the other end of the connection that nothing more will be written,
+ * while still allowing reading.
+ */
+bool io_socket_shutdown_write(int fd);
+
+/**
+ * Makes reads from and writes to [fd] fail with `EAGAIN` if they wait for
+ * longer than [timeout] nanoseconds. A [timeout] of 0 waits forever.
+ */
+bool io_socket_set_timeout(int fd, uint64_t timeout);
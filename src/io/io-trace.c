@@ -0,0 +1,251 @@
+#include "io-trace.h"
+#include "io-common.h"
+#include "data-structures/string-builder.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+bool io_trace_enabled;
+
+/**
+ * The events recorded by one thread. Only that thread writes to the buffer, so
+ * recording an event only has to publish the new count.
+ */
+typedef struct io_trace_buffer io_trace_buffer;
+struct io_trace_buffer {
+    io_trace_buffer *next;              // the buffer of a thread that started recording earlier
+    unsigned thread_id;
+    atomic_uint_fast64_t num_recorded;  // the next event goes at `num_recorded % IO_TRACE_BUFFER_EVENTS`
+    io_trace_event events[IO_TRACE_BUFFER_EVENTS];
+};
+
+static _Atomic(io_trace_buffer *) trace_buffers;
+static thread_local io_trace_buffer *thread_buffer;
+static atomic_uint trace_next_thread_id = 1;
+static atomic_uint_fast64_t trace_next_id = 1;
+static uint64_t trace_start_time;
+static outputstream *trace_stream;
+
+static void io_trace_write_at_exit(void)
+{
+    if (!io_trace_write(trace_stream))
+        fprintf(stderr, "failed to write trace: %s\n", strerror(errno));
+    outputstream_unref(trace_stream);
+    trace_stream = NULL;
+}
+
+bool io_trace_start(const char *filename)
+{
+    if (filename) {
+        outputstream *stream = outputstream_new_from_path(filename, "w");
+
+        if (!stream)
+            return false;
+        trace_stream = outputstream_ref(stream);
+        atexit(io_trace_write_at_exit);
+    }
+
+    trace_start_time = io_get_monotonic_time();
+    io_trace_enabled = true;
+    return true;
+}
+
+static io_trace_buffer *io_trace_get_thread_buffer(void)
+{
+    io_trace_buffer *buffer = thread_buffer;
+
+    if (buffer)
+        return buffer;
+
+    if (!(buffer = calloc(1, sizeof *buffer))) {
+        perror("failed to create trace buffer");
+        abort();
+    }
+    buffer->thread_id = atomic_fetch_add_explicit(&trace_next_thread_id, 1, memory_order_relaxed);
+
+    // the buffer stays on the list after the thread exits, so that its events
+    // are still written
+    buffer->next = atomic_load_explicit(&trace_buffers, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&trace_buffers, &buffer->next, buffer,
+                                                  memory_order_release, memory_order_relaxed))
+        ;
+
+    return thread_buffer = buffer;
+}
+
+void io_trace_record(const io_trace_event *event)
+{
+    if (!io_trace_enabled)
+        return;
+
+    io_trace_buffer *buffer = io_trace_get_thread_buffer();
+    const uint_fast64_t n = atomic_load_explicit(&buffer->num_recorded, memory_order_relaxed);
+
+    buffer->events[n % IO_TRACE_BUFFER_EVENTS] = *event;
+    atomic_store_explicit(&buffer->num_recorded, n + 1, memory_order_release);
+}
+
+static void io_trace_set_name(io_trace_event *event, const char *name)
+{
+    size_t length = strlen(name);
+
+    if (length >= sizeof event->name) {
+        length = sizeof event->name - 1;
+        // don't cut a UTF-8 sequence in half
+        while (length > 0 && ((unsigned char)name[length] & 0xC0) == 0x80)
+            length--;
+    }
+    memcpy(event->name, name, length);
+    event->name[length] = '\0';
+}
+
+void io_trace_complete(const char *category,
+                       const char *name,
+                       uint64_t    start,
+                       uint64_t    end,
+                       const char *arg_name,
+                       uint64_t    arg)
+{
+    io_trace_event event = {
+        .category = category,
+        .phase = io_trace_phase_complete,
+        .timestamp = start,
+        .duration = end > start ? end - start : 0,
+        .arg_name = arg_name,
+        .arg = arg
+    };
+
+    io_trace_set_name(&event, name);
+    io_trace_record(&event);
+}
+
+void io_trace_instant(const char *category, const char *name, const char *arg_name, uint64_t arg)
+{
+    io_trace_event event = {
+        .category = category,
+        .phase = io_trace_phase_instant,
+        .timestamp = io_get_monotonic_time(),
+        .arg_name = arg_name,
+        .arg = arg
+    };
+
+    io_trace_set_name(&event, name);
+    io_trace_record(&event);
+}
+
+static void io_trace_async(io_trace_phase phase, const char *category, const char *name, uint64_t id)
+{
+    io_trace_event event = {
+        .category = category,
+        .phase = phase,
+        .timestamp = io_get_monotonic_time(),
+        .id = id
+    };
+
+    io_trace_set_name(&event, name);
+    io_trace_record(&event);
+}
+
+void io_trace_async_begin(const char *category, const char *name, uint64_t id)
+{
+    io_trace_async(io_trace_phase_async_begin, category, name, id);
+}
+
+void io_trace_async_end(const char *category, const char *name, uint64_t id)
+{
+    io_trace_async(io_trace_phase_async_end, category, name, id);
+}
+
+uint64_t io_trace_new_id(void)
+{
+    return atomic_fetch_add_explicit(&trace_next_id, 1, memory_order_relaxed);
+}
+
+static void io_trace_append_escaped(string *sb, const char *str)
+{
+    for (const char *c = str; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            string_appendf(sb, "\\%c", *c);
+        else if ((unsigned char)*c < 0x20)
+            string_appendf(sb, "\\u%04x", (unsigned)*c);
+        else
+            string_appendf(sb, "%c", *c);
+    }
+}
+
+/**
+ * Appends [nanoseconds] as microseconds, which is the unit of the format.
+ */
+static void io_trace_append_time(string *sb, uint64_t nanoseconds)
+{
+    string_appendf(sb, "%" PRIu64 ".%03" PRIu64, nanoseconds / 1000, nanoseconds % 1000);
+}
+
+static string *io_trace_event_to_string(const io_trace_event *event, unsigned thread_id)
+{
+    string *sb = string_new();
+
+    string_appendf(sb, "{\"name\":\"");
+    io_trace_append_escaped(sb, event->name);
+    string_appendf(sb, "\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":", event->category, (char)event->phase);
+    io_trace_append_time(sb, event->timestamp > trace_start_time ? event->timestamp - trace_start_time : 0);
+
+    switch (event->phase) {
+    case io_trace_phase_complete:
+        string_appendf(sb, ",\"dur\":");
+        io_trace_append_time(sb, event->duration);
+        break;
+    case io_trace_phase_instant:
+        string_appendf(sb, ",\"s\":\"t\"");
+        break;
+    case io_trace_phase_async_begin:
+    case io_trace_phase_async_end:
+        string_appendf(sb, ",\"id\":\"0x%" PRIx64 "\"", event->id);
+        break;
+    }
+
+    string_appendf(sb, ",\"pid\":1,\"tid\":%u", thread_id);
+    if (event->arg_name)
+        string_appendf(sb, ",\"args\":{\"%s\":%" PRIu64 "}", event->arg_name, event->arg);
+
+    return string_appendf(sb, "}");
+}
+
+bool io_trace_write(outputstream *ostream)
+{
+    bool success = true;
+    uint64_t num_dropped = 0;
+    const char *separator = "\n";
+
+    success = outputstream_write_string(ostream, "{\"traceEvents\":[") == sizeof "{\"traceEvents\":[" - 1;
+
+    for (io_trace_buffer *buffer = atomic_load_explicit(&trace_buffers, memory_order_acquire);
+            success && buffer; buffer = buffer->next) {
+        const uint_fast64_t num_recorded = atomic_load_explicit(&buffer->num_recorded, memory_order_acquire);
+        const uint_fast64_t first = num_recorded > IO_TRACE_BUFFER_EVENTS ? num_recorded - IO_TRACE_BUFFER_EVENTS : 0;
+
+        num_dropped += first;
+        for (uint_fast64_t i = first; success && i < num_recorded; i++) {
+            string *line = io_trace_event_to_string(&buffer->events[i % IO_TRACE_BUFFER_EVENTS], buffer->thread_id);
+
+            success = outputstream_write_string(ostream, separator) == strlen(separator) &&
+                outputstream_write_string(ostream, line->buffer) == line->length;
+            separator = ",\n";
+            string_unref(line);
+        }
+    }
+
+    if (success) {
+        string *trailer = string_newf("\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_events\":\"%" PRIu64 "\"}}\n",
+                                      num_dropped);
+
+        success = outputstream_write_string(ostream, trailer->buffer) == trailer->length;
+        string_unref(trailer);
+    }
+
+    return success;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "outputstream.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The longest event name that is kept. Longer names are truncated.
+ */
+#define IO_TRACE_NAME_MAX 48
+
+/**
+ * The number of events that each thread keeps. Once a thread's buffer is
+ * full, its oldest events are overwritten.
+ */
+#define IO_TRACE_BUFFER_EVENTS 65536
+
+/**
+ * The kinds of event, named by their `ph` in the Chrome trace event format.
+ */
+typedef enum {
+    io_trace_phase_complete = 'X',      // a slice of time on one thread
+    io_trace_phase_instant = 'i',       // a point in time on one thread
+    io_trace_phase_async_begin = 'b',   // the start of a span that may end on another thread
+    io_trace_phase_async_end = 'e'      // the end of the span with the same category and ID
+} io_trace_phase;
+
+typedef struct {
+    char name[IO_TRACE_NAME_MAX];
+    const char *category;               // must be a string literal
+    io_trace_phase phase;
+    uint64_t timestamp;                 // from io_get_monotonic_time()
+    uint64_t duration;                  // for a complete event, in nanoseconds
+    uint64_t id;                        // for an async event, from io_trace_new_id()
+    const char *arg_name;               // must be a string literal, or NULL if there is no argument
+    uint64_t arg;
+} io_trace_event;
+
+/**
+ * Whether events are being recorded. Only set by `io_trace_start()`.
+ */
+extern bool io_trace_enabled;
+
+/**
+ * Whether events are being recorded. Callers should check this before reading
+ * the clock for an event, so that tracing costs nothing when it is off.
+ */
+static inline bool io_trace_is_enabled(void)
+{
+    return io_trace_enabled;
+}
+
+/**
+ * Starts recording events, and writes them to [filename] in the Chrome trace
+ * event format when the process exits. The file can be opened with Perfetto
+ * or `chrome://tracing`. This must be called before any other threads are
+ * started.
+ *
+ * @return whether [filename] could be opened, with errno set on failure
+ */
+bool io_trace_start(const char *filename);
+
+/**
+ * Records [event] in the current thread's buffer. Recording never blocks and
+ * never takes a lock, since each thread only writes to its own buffer.
+ */
+void io_trace_record(const io_trace_event *event);
+
+/**
+ * Records a slice of the current thread's time from [start] to [end].
+ */
+void io_trace_complete(const char *category,
+                       const char *name,
+                       uint64_t    start,
+                       uint64_t    end,
+                       const char *arg_name,
+                       uint64_t    arg);
+
+/**
+ * Records that something happened on the current thread.
+ */
+void io_trace_instant(const char *category, const char *name, const char *arg_name, uint64_t arg);
+
+/**
+ * Records the start of a span, such as a request that is waiting for a reply.
+ * The span is identified by [category] and [id].
+ */
+void io_trace_async_begin(const char *category, const char *name, uint64_t id);
+
+/**
+ * Records the end of the span started by `io_trace_async_begin()`.
+ */
+void io_trace_async_end(const char *category, const char *name, uint64_t id);
+
+/**
+ * Gets an ID for an async span that is unique within the process.
+ */
+uint64_t io_trace_new_id(void);
+
+/**
+ * Writes the events recorded so far in every thread as a JSON trace. The
+ * threads that recorded them should not be recording at the same time.
+ */
+bool io_trace_write(outputstream *ostream);
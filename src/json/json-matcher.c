@@ -0,0 +1,951 @@
+#include "json-matcher.h"
+#include "json-parser.h"
+#include "data-structures/array.h"
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The instructions of a match program. Every instruction checks the current
+ * node, which starts as the candidate. `member` and `element` descend into a
+ * child of the current node, and the matching `up` returns to the parent.
+ *
+ * Integer immediates are stored most-significant byte first.
+ */
+enum _json_matcher_opcode {
+    /**
+     * `object <exact: u8> <num_members: u32>` - the current node must be an
+     * object. If `exact` is set, it must have exactly `num_members` members.
+     * Ends with `end`.
+     */
+    json_matcher_op_object = 0x01,
+
+    /**
+     * `array <num_elements: u32>` - the current node must be an array with
+     * exactly `num_elements` elements. Ends with `end`.
+     */
+    json_matcher_op_array,
+
+    /**
+     * `end` - marks the end of the checks for an object or array.
+     */
+    json_matcher_op_end,
+
+    /**
+     * `member <optional: u8> <name: string>` - descends into a member of the
+     * current object. If the member is missing, the match fails, unless the
+     * member is optional, in which case the checks up to the matching `up`
+     * are skipped.
+     */
+    json_matcher_op_member,
+
+    /**
+     * `hasmember <name: string>` - the current object must have the member,
+     * with any value.
+     */
+    json_matcher_op_hasmember,
+
+    /**
+     * `element <index: u32>` - descends into an element of the current array.
+     */
+    json_matcher_op_element,
+
+    /**
+     * `up` - returns to the parent of the current node.
+     */
+    json_matcher_op_up,
+
+    json_matcher_op_null,
+
+    /**
+     * `integer <value: i64>`
+     */
+    json_matcher_op_integer,
+
+    /**
+     * `double <value: u64>` - the value is the bit pattern of the double
+     */
+    json_matcher_op_double,
+
+    /**
+     * `boolean <value: u8>`
+     */
+    json_matcher_op_boolean,
+
+    /**
+     * `string <value: string>` - strings are NUL-terminated
+     */
+    json_matcher_op_string,
+
+    /**
+     * `pattern` - compares the current node with the corresponding part of
+     * the pattern using `json_node_equal_to()`. Used for the parts of a
+     * pattern that have no specialized instructions, such as those nested
+     * deeper than `JSON_MATCHER_MAX_DEPTH`.
+     */
+    json_matcher_op_pattern,
+
+    /**
+     * `scan <num_elements: u32>` - the current node must be an array that
+     * matches a pattern of `num_elements` elements, some of which are
+     * ellipses. Contains an `element` for each element that is not an
+     * ellipsis, in order, and ends with `end`.
+     *
+     * Each run of elements between ellipses is a segment, which is matched
+     * at the earliest position in the array after the previous segment. The
+     * first segment is anchored to the start of the array unless the pattern
+     * begins with an ellipsis, and the last segment is anchored to the end
+     * unless the pattern ends with one.
+     */
+    json_matcher_op_scan
+};
+typedef enum _json_matcher_opcode json_matcher_opcode;
+
+typedef array(uint8_t) json_matcher_buffer;
+
+static void json_matcher_emit_byte(json_matcher_buffer *buffer, uint8_t byte)
+{
+    array_add(buffer, byte);
+}
+
+static void json_matcher_emit_integer(json_matcher_buffer *buffer, uint64_t integer, unsigned size)
+{
+    for (unsigned i = 0; i < size; i++)
+        json_matcher_emit_byte(buffer, (uint8_t)(integer >> ((size - 1 - i) * CHAR_BIT)));
+}
+
+static void json_matcher_emit_string(json_matcher_buffer *buffer, const char *str)
+{
+    for (const char *p = str; *p; p++)
+        json_matcher_emit_byte(buffer, (uint8_t)*p);
+    json_matcher_emit_byte(buffer, '\0');
+}
+
+static bool json_node_is_scalar(const json_node *node)
+{
+    switch (node->node_type) {
+    case json_node_type_null:
+    case json_node_type_integer:
+    case json_node_type_double:
+    case json_node_type_boolean:
+    case json_node_type_string:
+        return true;
+    case json_node_type_array:
+    case json_node_type_object:
+    case json_node_type_ellipsis:
+    case json_node_type_pointer:
+        return false;
+    }
+
+    return false;
+}
+
+static void json_matcher_compile_node(json_matcher_buffer *buffer, json_node *node, unsigned depth);
+
+static void json_matcher_compile_array(json_matcher_buffer *buffer, json_array *array, unsigned depth)
+{
+    json_matcher_emit_byte(buffer, json_matcher_op_array);
+    json_matcher_emit_integer(buffer, array->num_elements, sizeof(uint32_t));
+
+    // compare scalars before descending into nested arrays and objects
+    for (unsigned pass = 0; pass < 2; pass++) {
+        for (unsigned i = 0; i < array->num_elements; i++) {
+            json_node *element = array->elements[i];
+
+            if (json_node_is_scalar(element) != (pass == 0))
+                continue;
+            json_matcher_emit_byte(buffer, json_matcher_op_element);
+            json_matcher_emit_integer(buffer, i, sizeof(uint32_t));
+            json_matcher_compile_node(buffer, element, depth + 1);
+            json_matcher_emit_byte(buffer, json_matcher_op_up);
+        }
+    }
+
+    json_matcher_emit_byte(buffer, json_matcher_op_end);
+}
+
+static void json_matcher_compile_scan(json_matcher_buffer *buffer, json_array *array, unsigned depth)
+{
+    json_matcher_emit_byte(buffer, json_matcher_op_scan);
+    json_matcher_emit_integer(buffer, array->num_elements, sizeof(uint32_t));
+
+    // the elements of a segment are compared in order, since each position
+    // of the segment is tried in turn
+    for (unsigned i = 0; i < array->num_elements; i++) {
+        json_node *element = array->elements[i];
+
+        if (element->node_type == json_node_type_ellipsis)
+            continue;
+        json_matcher_emit_byte(buffer, json_matcher_op_element);
+        json_matcher_emit_integer(buffer, i, sizeof(uint32_t));
+        json_matcher_compile_node(buffer, element, depth + 1);
+        json_matcher_emit_byte(buffer, json_matcher_op_up);
+    }
+
+    json_matcher_emit_byte(buffer, json_matcher_op_end);
+}
+
+static void json_matcher_compile_object(json_matcher_buffer *buffer, json_node *object, unsigned depth)
+{
+    const bool is_pattern = object->is_pattern;
+
+    json_matcher_emit_byte(buffer, json_matcher_op_object);
+    json_matcher_emit_byte(buffer, !is_pattern);
+    json_matcher_emit_integer(buffer, ptr_hashmap_num_elements(((json_object *)object)->members), sizeof(uint32_t));
+
+    // check for the presence of members whose values can be anything
+    if (is_pattern) {
+        json_object_foreach(object, member, {
+            if (member_value->node_type == json_node_type_ellipsis && !member_value->optional) {
+                json_matcher_emit_byte(buffer, json_matcher_op_hasmember);
+                json_matcher_emit_string(buffer, member_name);
+            }
+        });
+    }
+
+    // then compare scalars before descending into nested arrays and objects
+    for (unsigned pass = 0; pass < 2; pass++) {
+        json_object_foreach(object, member, {
+            if (is_pattern && member_value->node_type == json_node_type_ellipsis)
+                continue;
+            if (json_node_is_scalar(member_value) != (pass == 0))
+                continue;
+            json_matcher_emit_byte(buffer, json_matcher_op_member);
+            // in an exact object, every member is compared
+            json_matcher_emit_byte(buffer, is_pattern && member_value->optional);
+            json_matcher_emit_string(buffer, member_name);
+            json_matcher_compile_node(buffer, member_value, depth + 1);
+            json_matcher_emit_byte(buffer, json_matcher_op_up);
+        });
+    }
+
+    json_matcher_emit_byte(buffer, json_matcher_op_end);
+}
+
+static void json_matcher_compile_node(json_matcher_buffer *buffer, json_node *node, unsigned depth)
+{
+    if (depth >= JSON_MATCHER_MAX_DEPTH) {
+        json_matcher_emit_byte(buffer, json_matcher_op_pattern);
+        return;
+    }
+
+    switch (node->node_type) {
+    case json_node_type_null:
+        json_matcher_emit_byte(buffer, json_matcher_op_null);
+        break;
+    case json_node_type_integer:
+        json_matcher_emit_byte(buffer, json_matcher_op_integer);
+        json_matcher_emit_integer(buffer, (uint64_t)((json_integer *)node)->value, sizeof(uint64_t));
+        break;
+    case json_node_type_double:
+    {
+        uint64_t bits;
+
+        memcpy(&bits, &((json_double *)node)->value, sizeof bits);
+        json_matcher_emit_byte(buffer, json_matcher_op_double);
+        json_matcher_emit_integer(buffer, bits, sizeof(uint64_t));
+    }   break;
+    case json_node_type_boolean:
+        json_matcher_emit_byte(buffer, json_matcher_op_boolean);
+        json_matcher_emit_byte(buffer, ((json_boolean *)node)->value);
+        break;
+    case json_node_type_string:
+        json_matcher_emit_byte(buffer, json_matcher_op_string);
+        json_matcher_emit_string(buffer, ((json_string *)node)->value);
+        break;
+    case json_node_type_array:
+    {
+        bool has_ellipsis = false;
+
+        json_array_foreach(node, element, {
+            if (element->node_type == json_node_type_ellipsis)
+                has_ellipsis = true;
+        });
+
+        // an ellipsis can match any number of elements, so the elements
+        // cannot be checked by position
+        if (has_ellipsis)
+            json_matcher_compile_scan(buffer, (json_array *)node, depth);
+        else
+            json_matcher_compile_array(buffer, (json_array *)node, depth);
+    }   break;
+    case json_node_type_object:
+        json_matcher_compile_object(buffer, node, depth);
+        break;
+    case json_node_type_ellipsis:
+    case json_node_type_pointer:
+        json_matcher_emit_byte(buffer, json_matcher_op_pattern);
+        break;
+    }
+}
+
+uint8_t *json_matcher_compile(json_node *pattern, size_t *program_size)
+{
+    json_matcher_buffer buffer;
+    char *pattern_string = json_node_to_string(pattern, false);
+    // compile the pattern as json_matcher_new() will parse it, since a tree
+    // built in memory may mark different nested nodes as patterns
+    json_node *parsed_pattern = json_node_ref(json_parser_parse_string(pattern_string));
+
+    array_init(&buffer);
+    json_matcher_emit_string(&buffer, pattern_string);
+    free(pattern_string);
+    json_matcher_compile_node(&buffer, parsed_pattern ? parsed_pattern : pattern, 0);
+    json_node_unref(parsed_pattern);
+
+    *program_size = buffer.length;
+    return buffer.elements;
+}
+
+const char *json_matcher_program_get_pattern_string(const uint8_t *program, size_t program_size)
+{
+    if (!memchr(program, '\0', program_size))
+        return NULL;
+    return (const char *)program;
+}
+
+// --- loading and running match programs
+
+typedef struct {
+    json_matcher_opcode opcode;
+
+    /**
+     * For `object`, `array`, `scan`, `member`, and `element`, the index of
+     * the instruction after the matching `end` or `up`, where execution
+     * continues when the checks in between are skipped.
+     */
+    unsigned next;
+
+    /**
+     * The part of the pattern checked by this instruction. For `member`,
+     * `hasmember`, and `element`, this is the enclosing object or array.
+     */
+    json_node *pattern;
+
+    union {
+        struct {
+            bool exact;
+            unsigned num_members;
+        } object;
+        unsigned num_elements;
+        struct {
+            bool optional;
+            const char *name;           // interned
+        } member;
+        unsigned index;
+        int64_t integer;
+        double double_value;
+        bool boolean;
+        const char *string;             // points into the pattern
+    };
+} json_matcher_instruction;
+
+struct _json_matcher {
+    json_node *pattern;
+    json_matcher_instruction *instructions;
+    unsigned num_instructions;
+};
+
+typedef struct {
+    const uint8_t *program;
+    size_t size;
+    size_t offset;
+} json_matcher_reader;
+
+static bool json_matcher_read_byte(json_matcher_reader *reader, uint8_t *byte)
+{
+    if (reader->offset >= reader->size)
+        return false;
+    *byte = reader->program[reader->offset++];
+    return true;
+}
+
+static bool json_matcher_read_integer(json_matcher_reader *reader, unsigned size, uint64_t *integer)
+{
+    uint64_t value = 0;
+
+    for (unsigned i = 0; i < size; i++) {
+        uint8_t byte;
+        if (!json_matcher_read_byte(reader, &byte))
+            return false;
+        value = (value << CHAR_BIT) | byte;
+    }
+
+    *integer = value;
+    return true;
+}
+
+static bool json_matcher_read_string(json_matcher_reader *reader, const char **str)
+{
+    const uint8_t *start = reader->program + reader->offset;
+    const uint8_t *terminator = memchr(start, '\0', reader->size - reader->offset);
+
+    if (!terminator)
+        return false;
+    *str = (const char *)start;
+    reader->offset += (size_t)(terminator - start) + 1;
+    return true;
+}
+
+/**
+ * Checks that the instructions of a `scan` that are in
+ * `instructions[scan + 1 .. end - 1]` are an `element` for each element of
+ * `pattern` that is not an ellipsis, in order.
+ */
+static bool json_matcher_scan_is_valid(const json_matcher_instruction *instructions,
+                                       unsigned                        scan,
+                                       unsigned                        end,
+                                       json_array                     *pattern)
+{
+    unsigned expected = 0;
+
+    for (unsigned i = 0; i < pattern->num_elements; i++) {
+        if (pattern->elements[i]->node_type != json_node_type_ellipsis)
+            expected++;
+    }
+
+    unsigned num_elements = 0;
+    unsigned previous_index = 0;
+    unsigned pc = scan + 1;
+
+    while (pc < end) {
+        const json_matcher_instruction *insn = &instructions[pc];
+
+        if (insn->opcode != json_matcher_op_element ||
+                pattern->elements[insn->index]->node_type == json_node_type_ellipsis ||
+                (num_elements > 0 && insn->index <= previous_index))
+            return false;
+        previous_index = insn->index;
+        num_elements++;
+        pc = insn->next;
+    }
+
+    return pc == end && num_elements == expected;
+}
+
+json_matcher *json_matcher_new(const uint8_t *program, size_t program_size)
+{
+    json_matcher_reader reader = { program, program_size, 0 };
+    const char *pattern_string = NULL;
+    json_node *pattern = NULL;
+
+    if (!json_matcher_read_string(&reader, &pattern_string) ||
+            !(pattern = json_parser_parse_string(pattern_string)))
+        return NULL;
+
+    json_matcher *matcher = calloc(1, sizeof *matcher);
+
+    if (!matcher) {
+        perror("failed to create JSON matcher");
+        abort();
+    }
+
+    matcher->pattern = json_node_ref(pattern);
+
+    array(json_matcher_instruction) instructions;
+    array_init(&instructions);
+
+    // the part of the pattern at each level, and the instructions that
+    // opened each level
+    json_node *nodes[JSON_MATCHER_MAX_DEPTH + 1] = { pattern };
+    unsigned openers[2 * (JSON_MATCHER_MAX_DEPTH + 1)];
+    unsigned depth = 0;
+    unsigned num_openers = 0;
+    bool valid = true;
+
+    // whether the innermost open level was checked by an instruction of type
+    // `level_opcode`, such that its members or elements can be accessed
+#define json_matcher_level_is(level_opcode) \
+    (num_openers > 0 && instructions.elements[openers[num_openers - 1]].opcode == (level_opcode))
+
+    while (valid && reader.offset < reader.size) {
+        json_matcher_instruction insn = { 0 };
+        json_node *node = nodes[depth];
+        uint8_t byte = 0;
+        uint64_t integer = 0;
+
+        json_matcher_read_byte(&reader, &byte);
+        insn.opcode = byte;
+        insn.pattern = node;
+        switch (insn.opcode) {
+        case json_matcher_op_object:
+            valid = node->node_type == json_node_type_object &&
+                json_matcher_read_byte(&reader, &byte) &&
+                json_matcher_read_integer(&reader, sizeof(uint32_t), &integer) &&
+                num_openers < sizeof openers / sizeof openers[0];
+            insn.object.exact = byte;
+            insn.object.num_members = (unsigned)integer;
+            if (valid)
+                openers[num_openers++] = instructions.length;
+            break;
+        case json_matcher_op_array:
+            valid = node->node_type == json_node_type_array &&
+                json_matcher_read_integer(&reader, sizeof(uint32_t), &integer) &&
+                integer == ((json_array *)node)->num_elements &&
+                num_openers < sizeof openers / sizeof openers[0];
+            insn.num_elements = (unsigned)integer;
+            if (valid)
+                openers[num_openers++] = instructions.length;
+            break;
+        case json_matcher_op_scan:
+            valid = node->node_type == json_node_type_array &&
+                json_matcher_read_integer(&reader, sizeof(uint32_t), &integer) &&
+                integer == ((json_array *)node)->num_elements &&
+                num_openers < sizeof openers / sizeof openers[0];
+            insn.num_elements = (unsigned)integer;
+            if (valid)
+                openers[num_openers++] = instructions.length;
+            break;
+        case json_matcher_op_end:
+            valid = num_openers > 0;
+            if (valid) {
+                const unsigned opener_index = openers[--num_openers];
+                json_matcher_instruction *opener = &instructions.elements[opener_index];
+
+                valid = opener->opcode == json_matcher_op_object || opener->opcode == json_matcher_op_array ||
+                    (opener->opcode == json_matcher_op_scan &&
+                     json_matcher_scan_is_valid(instructions.elements, opener_index, instructions.length,
+                                                (json_array *)opener->pattern));
+                opener->next = instructions.length + 1;
+            }
+            break;
+        case json_matcher_op_member:
+        {
+            const char *name = NULL;
+            json_node *member = NULL;
+
+            valid = json_matcher_level_is(json_matcher_op_object) &&
+                json_matcher_read_byte(&reader, &byte) &&
+                json_matcher_read_string(&reader, &name) &&
+                (member = json_object_get_member(node, name)) &&
+                depth < JSON_MATCHER_MAX_DEPTH &&
+                num_openers < sizeof openers / sizeof openers[0];
+            if (valid) {
+                // use the name in the pattern, which outlives the program
+                insn.member.optional = byte;
+                insn.member.name = json_member_name_lookup(name);
+                nodes[++depth] = member;
+                openers[num_openers++] = instructions.length;
+            }
+        }   break;
+        case json_matcher_op_hasmember:
+        {
+            const char *name = NULL;
+
+            valid = json_matcher_level_is(json_matcher_op_object) &&
+                json_matcher_read_string(&reader, &name) &&
+                json_object_get_member(node, name);
+            if (valid)
+                insn.member.name = json_member_name_lookup(name);
+        }   break;
+        case json_matcher_op_element:
+            valid = (json_matcher_level_is(json_matcher_op_array) || json_matcher_level_is(json_matcher_op_scan)) &&
+                json_matcher_read_integer(&reader, sizeof(uint32_t), &integer) &&
+                integer < ((json_array *)node)->num_elements &&
+                depth < JSON_MATCHER_MAX_DEPTH &&
+                num_openers < sizeof openers / sizeof openers[0];
+            if (valid) {
+                insn.index = (unsigned)integer;
+                nodes[++depth] = ((json_array *)node)->elements[integer];
+                openers[num_openers++] = instructions.length;
+            }
+            break;
+        case json_matcher_op_up:
+            valid = depth > 0 && num_openers > 0;
+            if (valid) {
+                json_matcher_instruction *opener = &instructions.elements[openers[--num_openers]];
+                valid = opener->opcode == json_matcher_op_member || opener->opcode == json_matcher_op_element;
+                opener->next = instructions.length + 1;
+                depth--;
+            }
+            break;
+        case json_matcher_op_null:
+            break;
+        case json_matcher_op_integer:
+            valid = json_matcher_read_integer(&reader, sizeof(uint64_t), &integer);
+            insn.integer = (int64_t)integer;
+            break;
+        case json_matcher_op_double:
+            valid = json_matcher_read_integer(&reader, sizeof(uint64_t), &integer);
+            memcpy(&insn.double_value, &integer, sizeof insn.double_value);
+            break;
+        case json_matcher_op_boolean:
+            valid = json_matcher_read_byte(&reader, &byte);
+            insn.boolean = byte;
+            break;
+        case json_matcher_op_string:
+            // use the string in the pattern, which outlives the program
+            valid = node->node_type == json_node_type_string &&
+                json_matcher_read_string(&reader, &insn.string);
+            if (valid)
+                insn.string = ((json_string *)node)->value;
+            break;
+        case json_matcher_op_pattern:
+            break;
+        default:
+            valid = false;
+            break;
+        }
+
+        if (valid)
+            array_add(&instructions, insn);
+    }
+
+#undef json_matcher_level_is
+
+    if (!valid || depth != 0 || num_openers != 0 || instructions.length == 0) {
+        array_destroy(&instructions);
+        json_node_unref(matcher->pattern);
+        free(matcher);
+        return NULL;
+    }
+
+    matcher->instructions = instructions.elements;
+    matcher->num_instructions = instructions.length;
+    return matcher;
+}
+
+void json_matcher_destroy(json_matcher *matcher)
+{
+    if (!matcher)
+        return;
+
+    json_node_unref(matcher->pattern);
+    free(matcher->instructions);
+    free(matcher);
+}
+
+json_node *json_matcher_get_pattern(const json_matcher *matcher)
+{
+    return matcher->pattern;
+}
+
+__attribute__ ((format (printf, 2, 3)))
+static void json_matcher_trace_append(json_matcher_trace *trace, const char *format, ...)
+{
+    const size_t available = sizeof trace->message - trace->length;
+    va_list args;
+    int written;
+
+    if (available <= 1)
+        return;
+
+    va_start(args, format);
+    written = vsnprintf(trace->message + trace->length, available, format, args);
+    va_end(args);
+
+    if (written < 0)
+        return;
+
+    if ((size_t)written >= available) {
+        // mark the message as truncated
+        trace->length = sizeof trace->message - 1;
+        memcpy(trace->message + trace->length - 3, "...", 3);
+    } else {
+        trace->length += (size_t)written;
+    }
+}
+
+/**
+ * Appends the JSON text of `node`, or just its type if `node` is an object or
+ * an array and `verbatim` is not set.
+ */
+static void json_matcher_trace_append_node(json_matcher_trace *trace, json_node *node, bool verbatim)
+{
+    if (!verbatim && node->node_type == json_node_type_object) {
+        json_matcher_trace_append(trace, "an object");
+    } else if (!verbatim && node->node_type == json_node_type_array) {
+        json_matcher_trace_append(trace, "an array");
+    } else {
+        char *node_string = json_node_to_string(node, false);
+
+        json_matcher_trace_append(trace, "%s", node_string);
+        free(node_string);
+    }
+}
+
+/**
+ * Describes why `insn` failed on `node` in `trace`. This is only called once a
+ * match has failed, so successful matches never pay for it.
+ *
+ * @param descents the `member` and `element` instructions that led to `node`
+ *
+ * @return `false`
+ */
+static bool json_matcher_trace_mismatch(const json_matcher             *matcher,
+                                        json_matcher_trace             *trace,
+                                        const unsigned                  descents[],
+                                        unsigned                        depth,
+                                        json_node                      *node,
+                                        const json_matcher_instruction *insn)
+{
+    if (!trace)
+        return false;
+
+    trace->length = 0;
+    trace->message[0] = '\0';
+
+    json_matcher_trace_append(trace, "$");
+    for (unsigned i = 0; i < depth; i++) {
+        const json_matcher_instruction *descent = &matcher->instructions[descents[i]];
+
+        if (descent->opcode == json_matcher_op_member)
+            json_matcher_trace_append(trace, ".%s", descent->member.name);
+        else
+            json_matcher_trace_append(trace, "[%u]", descent->index);
+    }
+    json_matcher_trace_append(trace, ": ");
+
+    switch (insn->opcode) {
+    case json_matcher_op_object:
+    case json_matcher_op_array:
+    case json_matcher_op_scan:
+    {
+        const bool is_object = insn->opcode == json_matcher_op_object;
+
+        if (node->node_type != insn->pattern->node_type) {
+            json_matcher_trace_append(trace, "expected %s, got ", is_object ? "an object" : "an array");
+            json_matcher_trace_append_node(trace, node, false);
+        } else if (node->is_pattern || insn->opcode == json_matcher_op_scan) {
+            json_matcher_trace_append(trace, "expected ");
+            json_matcher_trace_append_node(trace, insn->pattern, true);
+            json_matcher_trace_append(trace, ", got ");
+            json_matcher_trace_append_node(trace, node, true);
+        } else if (is_object) {
+            json_matcher_trace_append(trace, "expected %u members, got %lu",
+                    insn->object.num_members, ptr_hashmap_num_elements(((json_object *)node)->members));
+        } else {
+            json_matcher_trace_append(trace, "expected %u elements, got %u",
+                    insn->num_elements, ((json_array *)node)->num_elements);
+        }
+    }   break;
+    case json_matcher_op_member:
+    case json_matcher_op_hasmember:
+        json_matcher_trace_append(trace, "missing member \"%s\"", insn->member.name);
+        break;
+    case json_matcher_op_null:
+    case json_matcher_op_integer:
+    case json_matcher_op_double:
+    case json_matcher_op_boolean:
+    case json_matcher_op_string:
+        json_matcher_trace_append(trace, "expected ");
+        json_matcher_trace_append_node(trace, insn->pattern, false);
+        json_matcher_trace_append(trace, ", got ");
+        json_matcher_trace_append_node(trace, node, false);
+        break;
+    case json_matcher_op_pattern:
+        json_matcher_trace_append(trace, "expected ");
+        json_matcher_trace_append_node(trace, insn->pattern, true);
+        json_matcher_trace_append(trace, ", got ");
+        json_matcher_trace_append_node(trace, node, true);
+        break;
+    case json_matcher_op_end:
+    case json_matcher_op_element:
+    case json_matcher_op_up:
+        break;
+    }
+
+    return false;
+}
+
+static bool json_matcher_run(const json_matcher *matcher,
+                             unsigned            start,
+                             unsigned            end,
+                             json_node          *candidate,
+                             json_matcher_trace *trace);
+
+/**
+ * Returns whether the elements of the segment that begins with the `element`
+ * instruction at `pc` and ends before `segment_end` match the elements of
+ * `array` from `position`.
+ */
+static bool json_matcher_scan_segment(const json_matcher *matcher,
+                                      unsigned            pc,
+                                      unsigned            segment_end,
+                                      json_array         *array,
+                                      unsigned            position)
+{
+    const unsigned first_index = matcher->instructions[pc].index;
+
+    for (; pc < segment_end; pc = matcher->instructions[pc].next) {
+        const json_matcher_instruction *insn = &matcher->instructions[pc];
+
+        // run the checks between `element` and `up`
+        if (!json_matcher_run(matcher, pc + 1, insn->next - 1,
+                    array->elements[position + insn->index - first_index], NULL))
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * Runs the `scan` instruction at `pc` on `array`, which is not a pattern.
+ * Each segment is placed at the earliest position where it matches, which
+ * leaves the most room for the segments after it.
+ */
+static bool json_matcher_scan(const json_matcher *matcher, unsigned pc, json_array *array)
+{
+    const json_matcher_instruction *scan = &matcher->instructions[pc];
+    const unsigned end = scan->next - 1;
+    // the elements before this have been matched by a segment
+    unsigned position = 0;
+
+    for (unsigned segment = pc + 1; segment < end; ) {
+        const unsigned first_index = matcher->instructions[segment].index;
+        unsigned segment_end = segment;
+        unsigned length = 0;
+
+        // a segment ends where the indices skip over an ellipsis
+        while (segment_end < end && matcher->instructions[segment_end].index == first_index + length) {
+            segment_end = matcher->instructions[segment_end].next;
+            length++;
+        }
+
+        if (length > array->num_elements - position)
+            return false;
+
+        unsigned first_position = position;
+        unsigned last_position = array->num_elements - length;
+
+        if (first_index + length == scan->num_elements)
+            first_position = last_position;
+        if (first_index == 0)
+            last_position = position;
+
+        while (first_position <= last_position &&
+                !json_matcher_scan_segment(matcher, segment, segment_end, array, first_position))
+            first_position++;
+
+        if (first_position > last_position)
+            return false;
+        position = first_position + length;
+        segment = segment_end;
+    }
+
+    return true;
+}
+
+/**
+ * Runs the instructions from `start` up to `end` on `candidate`.
+ */
+static bool json_matcher_run(const json_matcher *matcher,
+                             unsigned            start,
+                             unsigned            end,
+                             json_node          *candidate,
+                             json_matcher_trace *trace)
+{
+    json_node *parents[JSON_MATCHER_MAX_DEPTH];
+    unsigned descents[JSON_MATCHER_MAX_DEPTH];
+    unsigned depth = 0;
+    json_node *node = candidate;
+
+    for (unsigned pc = start; pc < end; ) {
+        const json_matcher_instruction *insn = &matcher->instructions[pc];
+
+        switch (insn->opcode) {
+        case json_matcher_op_object:
+            if (node->node_type != json_node_type_object)
+                goto mismatch;
+            if (node->is_pattern) {
+                // the candidate may have ellipses and optional members of
+                // its own
+                if (!json_node_equal_to(node, insn->pattern))
+                    goto mismatch;
+                pc = insn->next;
+                continue;
+            }
+            if (insn->object.exact &&
+                    ptr_hashmap_num_elements(((json_object *)node)->members) != insn->object.num_members)
+                goto mismatch;
+            break;
+        case json_matcher_op_array:
+            if (node->node_type != json_node_type_array)
+                goto mismatch;
+            if (node->is_pattern) {
+                if (!json_node_equal_to(node, insn->pattern))
+                    goto mismatch;
+                pc = insn->next;
+                continue;
+            }
+            if (((json_array *)node)->num_elements != insn->num_elements)
+                goto mismatch;
+            break;
+        case json_matcher_op_scan:
+            if (node->node_type != json_node_type_array)
+                goto mismatch;
+            if (node->is_pattern ? !json_node_equal_to(node, insn->pattern) :
+                    !json_matcher_scan(matcher, pc, (json_array *)node))
+                goto mismatch;
+            pc = insn->next;
+            continue;
+        case json_matcher_op_end:
+            break;
+        case json_matcher_op_member:
+        {
+            json_node *member = json_object_get_interned_member(node, insn->member.name);
+
+            if (!member) {
+                if (!insn->member.optional)
+                    goto mismatch;
+                pc = insn->next;
+                continue;
+            }
+            parents[depth] = node;
+            descents[depth++] = pc;
+            node = member;
+        }   break;
+        case json_matcher_op_hasmember:
+            if (!json_object_get_interned_member(node, insn->member.name))
+                goto mismatch;
+            break;
+        case json_matcher_op_element:
+            parents[depth] = node;
+            descents[depth++] = pc;
+            node = ((json_array *)node)->elements[insn->index];
+            break;
+        case json_matcher_op_up:
+            node = parents[--depth];
+            break;
+        case json_matcher_op_null:
+            if (node->node_type != json_node_type_null)
+                goto mismatch;
+            break;
+        case json_matcher_op_integer:
+            if (node->node_type != json_node_type_integer || ((json_integer *)node)->value != insn->integer)
+                goto mismatch;
+            break;
+        case json_matcher_op_double:
+            if (node->node_type != json_node_type_double || ((json_double *)node)->value != insn->double_value)
+                goto mismatch;
+            break;
+        case json_matcher_op_boolean:
+            if (node->node_type != json_node_type_boolean || ((json_boolean *)node)->value != insn->boolean)
+                goto mismatch;
+            break;
+        case json_matcher_op_string:
+            if (node->node_type != json_node_type_string || strcmp(((json_string *)node)->value, insn->string) != 0)
+                goto mismatch;
+            break;
+        case json_matcher_op_pattern:
+            if (!json_node_equal_to(node, insn->pattern))
+                goto mismatch;
+            break;
+        }
+
+        pc++;
+        continue;
+
+mismatch:
+        return json_matcher_trace_mismatch(matcher, trace, descents, depth, node, insn);
+    }
+
+    return true;
+}
+
+bool json_matcher_match(const json_matcher *matcher, json_node *candidate, json_matcher_trace *trace)
+{
+    return json_matcher_run(matcher, 0, matcher->num_instructions, candidate, trace);
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "json.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The deepest level of a pattern that is compiled into match instructions.
+ * Anything nested more deeply than this is compared with
+ * `json_node_equal_to()`.
+ */
+#define JSON_MATCHER_MAX_DEPTH 32
+
+/**
+ * A match program that has been loaded and is ready to run.
+ *
+ * A match program checks whether a JSON node matches a constant pattern the
+ * same way that `json_node_equal_to()` does, but instead of walking the
+ * pattern recursively, it runs a flat list of instructions that were generated
+ * ahead of time. At each level of the pattern, the checks that are cheapest to
+ * perform (the number of members, the presence of required members, and
+ * literal values) are done before descending into nested objects and arrays,
+ * so that most mismatches are found early.
+ *
+ * The candidate is assumed not to contain ellipses unless it is itself a
+ * pattern, in which case it is compared with `json_node_equal_to()`.
+ */
+struct _json_matcher;
+typedef struct _json_matcher json_matcher;
+
+/**
+ * The size of the buffer that describes a failed match.
+ */
+#define JSON_MATCHER_TRACE_SIZE 256
+
+/**
+ * Describes where a candidate first stopped matching the pattern, such as
+ * `$.range.start.line: expected 3, got 4`. The path begins at the candidate
+ * (`$`). A trace is written only when a match fails, so it can be reused
+ * across matches.
+ */
+typedef struct {
+    char message[JSON_MATCHER_TRACE_SIZE];
+    size_t length;
+} json_matcher_trace;
+
+/**
+ * Compiles `pattern` into a match program. The program begins with the
+ * NUL-terminated JSON text of the pattern, which is followed by the match
+ * instructions.
+ *
+ * Returns a buffer that must be free()'d, and writes its size to
+ * `program_size`.
+ */
+uint8_t *json_matcher_compile(json_node *pattern, size_t *program_size);
+
+/**
+ * Returns the JSON text of the pattern that the program was compiled from,
+ * or `NULL` if `program` does not begin with a NUL-terminated string.
+ */
+const char *json_matcher_program_get_pattern_string(const uint8_t *program, size_t program_size);
+
+/**
+ * Loads a match program created by `json_matcher_compile()`. This interns
+ * member names and parses the pattern, so that running the program doesn't
+ * need to allocate.
+ *
+ * Returns `NULL` if the program is malformed.
+ */
+json_matcher *json_matcher_new(const uint8_t *program, size_t program_size);
+
+void json_matcher_destroy(json_matcher *matcher);
+
+/**
+ * Returns the pattern that the matcher was compiled from.
+ */
+json_node *json_matcher_get_pattern(const json_matcher *matcher);
+
+/**
+ * Returns whether `candidate` matches the pattern. This gives the same result
+ * as `json_node_equal_to()` with the pattern.
+ *
+ * @param trace if non-`NULL` and the match fails, receives a description of
+ *              the first mismatch. The message is truncated if it doesn't fit.
+ */
+bool json_matcher_match(const json_matcher *matcher, json_node *candidate, json_matcher_trace *trace);
@@ -42,7 +42,7 @@ json_parser *json_parser_create_from_stream(inputstream *stream)
     return parser;
 }
 
-json_node *json_parser_parse_node(json_parser *parser)
+static json_node *json_parser_parse_node_internal(json_parser *parser, json_arena *arena)
 {
     if (parser->error) {
         ptr_list_clear(parser->messages);
@@ -57,6 +57,7 @@ json_node *json_parser_parse_node(json_parser *parser)
         // scanner should have error
         return NULL;
     case json_token_colon:
+    case json_token_pattern_questionmark:
     case json_token_comma:
     case json_token_closebrace:
     case json_token_closebracket:
@@ -73,27 +74,27 @@ json_node *json_parser_parse_node(json_parser *parser)
         return NULL;
     }
     case json_token_keyword_null:
-        return json_null_new();
+        return json_null_new_in_arena(arena);
     case json_token_keyword_true:
     case json_token_keyword_false:
-        return json_boolean_new(token == json_token_keyword_true);
+        return json_boolean_new_in_arena(arena, token == json_token_keyword_true);
     case json_token_string:
-        return json_string_new(parser->scanner->last_token_buffer);
+        return json_string_new_in_arena(arena, parser->scanner->last_token_buffer);
     case json_token_integer:
     {
         int64_t value;
         sscanf(parser->scanner->last_token_buffer, "%"PRId64, &value);
-        return json_integer_new(value);
+        return json_integer_new_in_arena(arena, value);
     }
     case json_token_double:
-        return json_double_new(atof(parser->scanner->last_token_buffer));
+        return json_double_new_in_arena(arena, atof(parser->scanner->last_token_buffer));
     case json_token_openbracket:
     {   // parse array
-        json_node *array = json_array_new();
+        json_node *array = json_array_new_in_arena(arena);
         json_node *element = NULL;
         json_sourceloc last_sourceloc = parser->scanner->source_location;
 
-        while ((element = json_parser_parse_node(parser)) != NULL) {
+        while ((element = json_parser_parse_node_internal(parser, arena)) != NULL) {
             array->is_pattern |= element->is_pattern;
             json_array_add_element(array, element);
             // expect either a ',' or ']'
@@ -138,20 +139,34 @@ json_node *json_parser_parse_node(json_parser *parser)
         }
 
         // convert to patterned JSON if parsed
-        if (array->is_pattern)
-            json_array_foreach(array, array_element, array_element->is_pattern = true);
+        if (array->is_pattern) {
+            json_array_foreach(array, array_element, {
+                // shared nodes cannot be modified, so they are converted to copies
+                if (array_element->immutable)
+                    json_array_set_element(array, iterator_of(array_element), json_node_copy(array_element));
+                else
+                    array_element->is_pattern = true;
+            });
+        }
 
         return array;
     }
     case json_token_openbrace:
     {   // parse object
-        json_node *object = json_object_new();
+        json_node *object = json_object_new_in_arena(arena);
         json_sourceloc last_sourceloc = parser->scanner->source_location;
 
         while (json_scanner_next(parser->scanner) == json_token_string) {
             char *member_name = strdup(parser->scanner->last_token_buffer);
+            bool is_optional = false;
 
-            if (json_scanner_next(parser->scanner) != json_token_colon) {
+            // an optional member of a pattern, like `"name"?: value`
+            if ((token = json_scanner_next(parser->scanner)) == json_token_pattern_questionmark) {
+                is_optional = true;
+                token = json_scanner_next(parser->scanner);
+            }
+
+            if (token != json_token_colon) {
                 string *sb = string_new();
                 string_appendf(sb, "%s:%u:%u: error: expected colon",
                         parser->scanner->filename,
@@ -163,7 +178,7 @@ json_node *json_parser_parse_node(json_parser *parser)
                 return NULL;
             }
 
-            json_node *member_value = json_parser_parse_node(parser);
+            json_node *member_value = json_parser_parse_node_internal(parser, arena);
             if (!member_value) {
                 string *sb = string_new();
                 string_appendf(sb, "%s:%u:%u: error: expected JSON value for property `%s'",
@@ -177,6 +192,8 @@ json_node *json_parser_parse_node(json_parser *parser)
                 return NULL;
             }
 
+            if (is_optional)
+                member_value = json_node_set_optional(member_value);
             object->is_pattern |= member_value->is_pattern;
             json_object_set_member(object, member_name, member_value);
 
@@ -227,6 +244,10 @@ json_node *json_parser_parse_node(json_parser *parser)
         if (object->is_pattern) {
             json_object_foreach(object, member, {
                 (void)member_name;
+                if (member_value->immutable) {
+                    member_value = json_node_copy(member_value);
+                    ptr_hashmap_entry_set_value(((json_object *)object)->members, member, member_value);
+                }
                 member_value->is_pattern = true;
             });
         }
@@ -234,15 +255,37 @@ json_node *json_parser_parse_node(json_parser *parser)
         return object;
     }
     case json_token_pattern_ellipsis:
-        return json_ellipsis_new();
+        return json_ellipsis_new_in_arena(arena);
     }
 
     fprintf(stderr, "invalid JSON token `%u'", token);
     abort();
 }
 
+json_node *json_parser_parse_node(json_parser *parser)
+{
+    // the nodes keep the arena alive after this
+    json_arena *arena = parser->use_arenas ? json_arena_new() : NULL;
+    json_node *node = json_parser_parse_node_internal(parser, arena);
+
+    json_arena_unref(arena);
+    return node;
+}
+
+/**
+ * Parses a node asynchronously, allocating it from `arena`. If `arena` is
+ * `NULL`, this is a top-level node and gets an arena of its own if the parser
+ * uses arenas.
+ */
+static void json_parser_parse_node_async_internal(json_parser   *parser,
+                                                  json_arena    *arena,
+                                                  eventloop     *loop,
+                                                  async_callback callback,
+                                                  void          *user_data);
+
 struct parse_array_ctx {
     json_parser *parser;
+    json_arena *arena;          // (unowned) kept alive by the array
     json_node *array;
     event *node_parsed_ev;
 };
@@ -264,7 +307,7 @@ static void json_parse_array_element_scanner_next_cb(const event *ev, void *user
         free(ctx);
     } else if (token == json_token_comma) {
         // continue parsing the next element
-        json_parser_parse_node_async(parser, node_parsed_ev->loop, json_parser_parse_array_element_cb, ctx);
+        json_parser_parse_node_async_internal(parser, ctx->arena, node_parsed_ev->loop, json_parser_parse_array_element_cb, ctx);
     } else {
         string *sb = string_new();
         string_appendf(sb, "%s:%u:%u: error: expected comma or close bracket", 
@@ -313,9 +356,11 @@ static void json_parser_parse_array_element_cb(const event *ev, void *user_data)
 
 struct parse_object_entry_ctx {
     json_parser *parser;
+    json_arena *arena;          // (unowned) kept alive by the object
     json_node *object;
     event *node_parsed_ev;
     char *member_name;          // nullable
+    bool is_optional;           // whether the member name was followed by `?`
     bool has_colon;
     bool has_member_value;
     bool has_trailing_comma;
@@ -345,6 +390,8 @@ static void json_parser_parse_object_entry_value_cb(const event *ev, void *user_
         return;
     }
 
+    if (ctx->is_optional)
+        member_value = json_node_set_optional(member_value);
     json_object_set_member(object, ctx->member_name, member_value);
 
     // save this for the state machine
@@ -372,15 +419,19 @@ static void json_parser_parse_object_entry_cb(const event *ev, void *user_data)
         ctx->has_trailing_comma = false;
         ctx->member_name = strdup(parser->scanner->last_token_buffer);
         json_scanner_next_async(parser->scanner, node_parsed_ev->loop, json_parser_parse_object_entry_cb, ctx);
+    } else if (token == json_token_pattern_questionmark && ctx->member_name && !ctx->is_optional && !ctx->has_colon) {
+        ctx->is_optional = true;
+        json_scanner_next_async(parser->scanner, node_parsed_ev->loop, json_parser_parse_object_entry_cb, ctx);
     } else if (token == json_token_colon && ctx->member_name && !ctx->has_colon) {
         ctx->has_colon = true;
-        json_parser_parse_node_async(parser, node_parsed_ev->loop, json_parser_parse_object_entry_value_cb, ctx);
+        json_parser_parse_node_async_internal(parser, ctx->arena, node_parsed_ev->loop, json_parser_parse_object_entry_value_cb, ctx);
     } else if (token == json_token_comma && ctx->member_name && ctx->has_colon && ctx->has_member_value) {
         // we want to parse another object entry
 
         // reset our context for reuse
         free(ctx->member_name);
         ctx->member_name = NULL;
+        ctx->is_optional = false;
         ctx->has_colon = false;
         ctx->has_member_value = false;
         ctx->has_trailing_comma = true;
@@ -410,6 +461,7 @@ static void json_parser_parse_object_entry_cb(const event *ev, void *user_data)
 
 struct next_token_ctx {
     json_parser *parser;
+    json_arena *arena;          // (unowned) the arena of the parent node, or NULL
     event *node_parsed_ev;
 };
 
@@ -417,6 +469,7 @@ static void json_parser_scanner_next_cb(const event *ev, void *user_data)
 {
     struct next_token_ctx *ctx = user_data;
     json_parser *parser = ctx->parser;
+    json_arena *arena = ctx->arena;
     event *node_parsed_ev = ctx->node_parsed_ev;
     int errnum = 0;
     json_token token = json_scanner_next_finish(ev, &errnum);
@@ -428,6 +481,11 @@ static void json_parser_scanner_next_cb(const event *ev, void *user_data)
         return;
     }
 
+    // a top-level node gets a new arena, which its nodes keep alive after this
+    json_arena *new_arena = NULL;
+    if (!arena && parser->use_arenas)
+        arena = new_arena = json_arena_new();
+
     switch (token) {
     case json_token_error:
         event_cancel_with_errno(node_parsed_ev, EPROTO);
@@ -435,6 +493,7 @@ static void json_parser_scanner_next_cb(const event *ev, void *user_data)
 
     case json_token_eof:
     case json_token_colon:
+    case json_token_pattern_questionmark:
     case json_token_comma:
     case json_token_closebrace:
     case json_token_closebracket:
@@ -452,60 +511,63 @@ static void json_parser_scanner_next_cb(const event *ev, void *user_data)
     }   break;
 
     case json_token_keyword_null:
-        event_return(node_parsed_ev, json_null_new());
+        event_return(node_parsed_ev, json_null_new_in_arena(arena));
         break;
 
     case json_token_keyword_true:
     case json_token_keyword_false:
-        event_return(node_parsed_ev, json_boolean_new(token == json_token_keyword_true));
+        event_return(node_parsed_ev, json_boolean_new_in_arena(arena, token == json_token_keyword_true));
         break;
 
     case json_token_string:
-        event_return(node_parsed_ev, json_string_new(parser->scanner->last_token_buffer));
+        event_return(node_parsed_ev, json_string_new_in_arena(arena, parser->scanner->last_token_buffer));
         break;
 
     case json_token_integer:
     {
         int64_t value;
         sscanf(parser->scanner->last_token_buffer, "%"PRId64, &value);
-        event_return(node_parsed_ev, json_integer_new(value));
+        event_return(node_parsed_ev, json_integer_new_in_arena(arena, value));
     }   break;
 
     case json_token_double:
-        event_return(node_parsed_ev, json_double_new(atof(parser->scanner->last_token_buffer)));
+        event_return(node_parsed_ev, json_double_new_in_arena(arena, atof(parser->scanner->last_token_buffer)));
         break;
 
     case json_token_openbracket:
     {   // parse array
-        json_node *array = json_array_new();
+        json_node *array = json_array_new_in_arena(arena);
 
         struct parse_array_ctx *parse_array_ctx;
-        box(struct parse_array_ctx, parse_array_ctx, parser, array,
+        box(struct parse_array_ctx, parse_array_ctx, parser, arena, array,
             node_parsed_ev);
-        json_parser_parse_node_async(parser, node_parsed_ev->loop, json_parser_parse_array_element_cb, parse_array_ctx);
+        json_parser_parse_node_async_internal(parser, arena, node_parsed_ev->loop, json_parser_parse_array_element_cb, parse_array_ctx);
     }   break;
 
     case json_token_openbrace:
     {   // parse object
-        json_node *object = json_object_new();
+        json_node *object = json_object_new_in_arena(arena);
 
         struct parse_object_entry_ctx *parse_ctx;
-        box(struct parse_object_entry_ctx, parse_ctx, parser, object,
-            node_parsed_ev, .member_name = NULL, .has_colon = false,
+        box(struct parse_object_entry_ctx, parse_ctx, parser, arena, object,
+            node_parsed_ev, .member_name = NULL, .is_optional = false, .has_colon = false,
             .has_member_value = false, .has_trailing_comma = false);
         json_scanner_next_async(parser->scanner, node_parsed_ev->loop, json_parser_parse_object_entry_cb, parse_ctx);
     }   break;
 
     case json_token_pattern_ellipsis:
-        event_return(node_parsed_ev, json_ellipsis_new());
+        event_return(node_parsed_ev, json_ellipsis_new_in_arena(arena));
         break;
     }
+
+    json_arena_unref(new_arena);
 }
 
-void json_parser_parse_node_async(json_parser   *parser,
-                                  eventloop     *loop,
-                                  async_callback callback,
-                                  void          *user_data)
+static void json_parser_parse_node_async_internal(json_parser   *parser,
+                                                  json_arena    *arena,
+                                                  eventloop     *loop,
+                                                  async_callback callback,
+                                                  void          *user_data)
 {
     if (parser->error) {
         ptr_list_clear(parser->messages);
@@ -515,10 +577,18 @@ void json_parser_parse_node_async(json_parser   *parser,
     event *node_parsed_ev = eventloop_add(loop, callback, user_data);
 
     struct next_token_ctx *ctx;
-    box(struct next_token_ctx, ctx, parser, node_parsed_ev);
+    box(struct next_token_ctx, ctx, parser, arena, node_parsed_ev);
     json_scanner_next_async(parser->scanner, loop, json_parser_scanner_next_cb, ctx);
 }
 
+void json_parser_parse_node_async(json_parser   *parser,
+                                  eventloop     *loop,
+                                  async_callback callback,
+                                  void          *user_data)
+{
+    json_parser_parse_node_async_internal(parser, NULL, loop, callback, user_data);
+}
+
 json_node *json_parser_parse_node_finish(const event *ev, int *error)
 {
     void *result = NULL;
@@ -30,6 +30,13 @@ struct _json_parser {
      * if there is a scanner error. Use json_parser_get_message().
      */
     ptr_list *messages;
+
+    /**
+     * Whether each node parsed at the top level is allocated, along with all
+     * of its children, from its own `json_arena`. This is cheaper than
+     * allocating every node separately when parsing many messages.
+     */
+    bool use_arenas;
 };
 typedef struct _json_parser json_parser;
 
@@ -45,6 +45,8 @@ const char *json_token_to_string(json_token token)
         return "null keyword";
     case json_token_pattern_ellipsis:
         return "ellipsis";
+    case json_token_pattern_questionmark:
+        return "question mark";
     }
 
     fprintf(stderr, "%s: unexpected value `%u' for json_token\n", __func__, token);
@@ -204,6 +206,9 @@ json_token json_scanner_next(json_scanner *scanner)
     case ':':
         json_scanner_save_char(scanner, current_char);
         return scanner->last_token = json_token_colon;
+    case '?':
+        json_scanner_save_char(scanner, current_char);
+        return scanner->last_token = json_token_pattern_questionmark;
     case ',':
         json_scanner_save_char(scanner, current_char);
         return scanner->last_token = json_token_comma;
@@ -412,6 +417,7 @@ struct token_read_ctx {
         token_read_state_skip_spaces,
         token_read_state_begin,
 
+        token_read_state_sign,                  // reading after a leading '-'
         token_read_state_number,
         token_read_state_fraction,
         token_read_state_exponent_begin,        // reading after 'E' or 'e'
@@ -503,6 +509,12 @@ static void json_scanner_stream_ready_cb(const event *ev, void *user_data)
                     free(ctx);
                     break;
 
+                case '?':
+                    json_scanner_save_char(scanner, read_character);
+                    event_return(token_read_ev, (void *)(scanner->last_token = json_token_pattern_questionmark));
+                    free(ctx);
+                    break;
+
                 case ',':
                     json_scanner_save_char(scanner, read_character);
                     event_return(token_read_ev, (void *)(scanner->last_token = json_token_comma));
@@ -534,6 +546,14 @@ static void json_scanner_stream_ready_cb(const event *ev, void *user_data)
                     json_scanner_stream_wait_async(scanner, token_read_ev->loop, json_scanner_stream_ready_cb, ctx);
                     break;
 
+                case '-':
+                    ctx->state = token_read_state_sign;
+                    json_scanner_save_char(scanner, read_character);
+                    if (inputstream_ready(scanner->stream))
+                        continue;
+                    json_scanner_stream_wait_async(scanner, token_read_ev->loop, json_scanner_stream_ready_cb, ctx);
+                    break;
+
                 case '"':
                     ctx->state = token_read_state_string;
                     if (inputstream_ready(scanner->stream))
@@ -579,6 +599,24 @@ static void json_scanner_stream_ready_cb(const event *ev, void *user_data)
                 }
             }   break;
 
+            case token_read_state_sign:
+            {
+                if (isdigit(read_character)) {
+                    ctx->state = token_read_state_number;
+                    json_scanner_save_char(scanner, read_character);
+                    if (inputstream_ready(scanner->stream))
+                        continue;
+                    json_scanner_stream_wait_async(scanner, token_read_ev->loop, json_scanner_stream_ready_cb, ctx);
+                } else {
+                    // unexpected character (where we wanted a number)
+                    json_scanner_report_message(scanner, scanner->source_location,
+                            "expected digit after `-'");
+                    event_cancel_with_errno(token_read_ev, EPROTO);
+                    free(ctx);
+                    return;
+                }
+            }   break;
+
             case token_read_state_number:
             {
                 switch (read_character) {
@@ -694,7 +732,6 @@ static void json_scanner_stream_ready_cb(const event *ev, void *user_data)
             {
                 if (read_character == '\\') {
                     ctx->state = token_read_state_string_escaped;
-                    json_scanner_save_char(scanner, read_character);
                 } else if (read_character == '"') {
                     event_return(token_read_ev, (void *)(scanner->last_token = json_token_string));
                     free(ctx);
@@ -711,7 +748,33 @@ static void json_scanner_stream_ready_cb(const event *ev, void *user_data)
             case token_read_state_string_escaped:
             {   // accept the character and transition back to previous state
                 ctx->state = token_read_state_string;
-                json_scanner_save_char(scanner, read_character);
+                switch (read_character) {
+                case '"':
+                case '\\':
+                case '/':
+                    json_scanner_save_char(scanner, read_character);
+                    break;
+                case 'b':
+                    json_scanner_save_char(scanner, '\b');
+                    break;
+                case 'f':
+                    json_scanner_save_char(scanner, '\f');
+                    break;
+                case 'n':
+                    json_scanner_save_char(scanner, '\n');
+                    break;
+                case 'r':
+                    json_scanner_save_char(scanner, '\r');
+                    break;
+                case 't':
+                    json_scanner_save_char(scanner, '\t');
+                    break;
+                default:
+                    // keep other escapes, like '\uXXXX', as they are
+                    json_scanner_save_char(scanner, '\\');
+                    json_scanner_save_char(scanner, read_character);
+                    break;
+                }
                 if (inputstream_ready(scanner->stream))
                     continue;
                 json_scanner_stream_wait_async(scanner, token_read_ev->loop, json_scanner_stream_ready_cb, ctx);
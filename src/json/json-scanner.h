@@ -20,7 +20,8 @@ enum _json_token {
     json_token_keyword_true,
     json_token_keyword_false,
     json_token_keyword_null,
-    json_token_pattern_ellipsis
+    json_token_pattern_ellipsis,
+    json_token_pattern_questionmark     // after the name of an optional member
 };
 typedef enum _json_token json_token;
 
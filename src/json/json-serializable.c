@@ -21,11 +21,11 @@ json_serialization_status json_deserialize_from_node(const json_serializable_vta
         if (node->node_type != json_node_type_object)
             return json_serialization_status_invalid_type;
         foreach (vtable->list_properties(), property_name, const char *, {
-            json_node *property_node =
-                json_object_get_member(node, property_name);
             bool is_optional = property_name[0] == '?';
             if (is_optional)
                 property_name++;
+            json_node *property_node =
+                json_object_get_member(node, property_name);
 
             if (!property_node) {
                 if (is_optional)
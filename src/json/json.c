@@ -6,10 +6,12 @@
 #include "data-structures/string-builder.h"
 #include "util.h"
 #include <ctype.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <assert.h>
 
 static json_node *json_internal_convert_node_to_pattern(json_node *node)
@@ -51,9 +53,143 @@ static json_node *json_internal_convert_node_to_pattern(json_node *node)
     return node;
 }
 
+// --- arenas
+
+/**
+ * The size of the chunks that small allocations are carved out of. Larger
+ * allocations get a chunk of their own.
+ */
+#define JSON_ARENA_CHUNK_SIZE 8192
+
+typedef struct _json_arena_chunk json_arena_chunk;
+struct _json_arena_chunk {
+    json_arena_chunk *next;
+    max_align_t data[];
+};
+
+struct _json_arena {
+    unsigned refcount;
+    size_t size;                        // bytes handed out so far
+    json_arena_chunk *chunks;           // the first chunk is the one being filled
+    char *next;                         // next free byte in the first chunk
+    char *end;                          // end of the first chunk
+};
+
+/**
+ * Precedes each node allocated from an arena.
+ */
+typedef struct {
+    alignas(8) json_arena *arena;
+} json_arena_header;
+
+json_arena *json_arena_new(void)
+{
+    json_arena *arena = calloc(1, sizeof *arena);
+
+    if (!arena) {
+        perror("failed to create JSON arena");
+        abort();
+    }
+
+    arena->refcount = 1;
+
+    return arena;
+}
+
+json_arena *json_arena_ref(json_arena *arena)
+{
+    if (arena)
+        arena->refcount++;
+    return arena;
+}
+
+void json_arena_unref(json_arena *arena)
+{
+    if (!arena)
+        return;
+    assert(arena->refcount > 0);
+    if (--arena->refcount == 0) {
+        for (json_arena_chunk *chunk = arena->chunks, *next_chunk = NULL; chunk; chunk = next_chunk) {
+            next_chunk = chunk->next;
+            free(chunk);
+        }
+        free(arena);
+    }
+}
+
+size_t json_arena_get_size(const json_arena *arena)
+{
+    return arena->size;
+}
+
+static void *json_arena_alloc(json_arena *arena, size_t size)
+{
+    // keep every allocation 8-byte aligned
+    size = (size + 7) & ~(size_t)7;
+    arena->size += size;
+
+    if ((size_t)(arena->end - arena->next) >= size) {
+        void *memory = arena->next;
+        arena->next += size;
+        return memory;
+    }
+
+    bool is_large = size > JSON_ARENA_CHUNK_SIZE / 4;
+    json_arena_chunk *chunk = malloc(sizeof *chunk + (is_large ? size : JSON_ARENA_CHUNK_SIZE));
+
+    if (!chunk) {
+        perror("failed to allocate JSON arena chunk");
+        abort();
+    }
+
+    if (is_large && arena->chunks) {
+        // insert behind the chunk being filled, so that its space isn't wasted
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+        return chunk->data;
+    }
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = (char *)chunk->data + size;
+    arena->end = (char *)chunk->data + (is_large ? size : JSON_ARENA_CHUNK_SIZE);
+
+    return chunk->data;
+}
+
+/**
+ * Allocates a zeroed node of `size` bytes, from `arena` if it is non-null.
+ */
+static void *json_node_alloc(json_arena *arena, size_t size)
+{
+    json_node *node = NULL;
+
+    if (arena) {
+        json_arena_header *header = json_arena_alloc(arena, sizeof *header + size);
+
+        header->arena = json_arena_ref(arena);
+        node = (json_node *)(header + 1);
+        memset(node, 0, size);
+        node->in_arena = true;
+    } else if (!(node = calloc(1, size))) {
+        perror("failed to create JSON node");
+        abort();
+    }
+
+    return node;
+}
+
+static void json_node_free(json_node *node)
+{
+    if (node->in_arena)
+        json_arena_unref(((json_arena_header *)node - 1)->arena);
+    else
+        free(node);
+}
+
 json_node *json_node_ref(json_node *node)
 {
-    if (node) {
+    if (node && !node->immutable) {
         if (node->floating) {
             node->floating = false;
             node->refcount = 1;
@@ -63,21 +199,42 @@ json_node *json_node_ref(json_node *node)
     return node;
 }
 
+// --- cycle collection
+
+static thread_local const json_collector_hooks *json_collector;
+
+const json_collector_hooks *json_set_collector_hooks(const json_collector_hooks *hooks)
+{
+    const json_collector_hooks *previous_hooks = json_collector;
+
+    json_collector = hooks;
+    return previous_hooks;
+}
+
 static void json_node_destroy(json_node *node)
 {
     if (!node || node->visiting)
         return;
     assert(node->floating || node->refcount == 0);
 
+    if (node->gc_buffered && json_collector)
+        json_collector->destroyed(node);
+
     node->visiting = true;
     if (node->node_type == json_node_type_string) {
         json_string *string_node = (json_string *)node;
-        free(string_node->value);
+        if (!node->in_arena)
+            free(string_node->value);
         string_node->value = NULL;
     } else if (node->node_type == json_node_type_object) {
         json_object *object = (json_object *)node;
         ptr_hashmap_destroy(object->members);
         object->members = NULL;
+        free(object->slots);
+        object->slots = NULL;
+        if (object->shape)
+            json_shape_unref(object->shape);
+        object->shape = NULL;
     } else if (node->node_type == json_node_type_array) {
         json_array *array = (json_array *)node;
 
@@ -90,19 +247,27 @@ static void json_node_destroy(json_node *node)
         free(array->elements);
         array->elements = NULL;
         array->buffer_size = 0;
+    } else if (node->node_type == json_node_type_pointer) {
+        json_pointer *pointer = (json_pointer *)node;
+
+        if (pointer->unref_func && pointer->value)
+            pointer->unref_func(pointer->value);
+        pointer->value = NULL;
     }
 
     node->visiting = false;
-    free(node);
+    json_node_free(node);
 }
 
 void json_node_unref(json_node *node)
 {
-    if (!node || node->visiting)
+    if (!node || node->visiting || node->immutable)
         return;
     assert(node->floating || node->refcount > 0);
     if (node->floating || --node->refcount == 0)
         json_node_destroy(node);
+    else if (json_collector && json_node_is_container(node))
+        json_collector->possible_root(node);
 }
 
 char *json_string_escape(const char *unescaped)
@@ -152,7 +317,11 @@ static void json_node_build_string(json_node *root_node,
                                    unsigned tabulation,
                                    string *sb)
 {
-    if (node->visiting) {
+    // only containers can form cycles. scalars may be shared immutable nodes
+    // that other threads are printing, so don't mark them
+    const bool container = json_node_is_container(node);
+
+    if (container && node->visiting) {
         if (node == root_node)
             string_appendf(sb, "[Circular *1]");
         else
@@ -160,7 +329,8 @@ static void json_node_build_string(json_node *root_node,
         return;
     }
 
-    node->visiting = true;
+    if (container)
+        node->visiting = true;
     switch (node->node_type) {
     case json_node_type_null:
         string_appendf(sb, "null");
@@ -227,14 +397,15 @@ static void json_node_build_string(json_node *root_node,
         string_appendf(sb, "...");
         break;
     case json_node_type_pointer:
-        string_appendf(sb, "[Pointer @ 0x%p]", ((json_pointer *)node)->value);
+        string_appendf(sb, "[Pointer @ %p]", ((json_pointer *)node)->value);
         break;
     default:
         fprintf(stderr, "%s: invalid node type `%u'\n", __func__, node->node_type);
         abort();
         break;
     }
-    node->visiting = false;
+    if (container)
+        node->visiting = false;
 }
 
 char *json_node_to_string(json_node *node, bool pretty)
@@ -257,6 +428,89 @@ size_t json_node_to_string_length(json_node *node, bool pretty)
     return length;
 }
 
+/**
+ * Compares two arrays, either of which may contain the ellipsis node `...`.
+ *
+ * This is NFA-style matching over states (i, j), where element i of array1 is
+ * compared with element j of array2. Each state is visited at most once, so
+ * each pair of elements is compared at most once, and the comparison takes at
+ * most n*m element comparisons.
+ */
+static bool json_array_pattern_equal_to(json_array *array1, json_array *array2)
+{
+    const unsigned n = array1->num_elements;
+    const unsigned m = array2->num_elements;
+
+    // the positions from which there are only ellipses left, which can match
+    // nothing at the end of the array
+    unsigned tail1 = n;
+    unsigned tail2 = m;
+
+    while (tail1 > 0 && array1->elements[tail1 - 1]->node_type == json_node_type_ellipsis)
+        tail1--;
+    while (tail2 > 0 && array2->elements[tail2 - 1]->node_type == json_node_type_ellipsis)
+        tail2--;
+
+    if (n == 0 || m == 0)
+        return tail1 == 0 && tail2 == 0;
+
+    struct state {
+        unsigned i;
+        unsigned j;
+    };
+    array(struct state) states;
+    array_init(&states);
+
+    // a bitmap of the states that have been queued
+    uint8_t *visited = calloc(((size_t)n * m + CHAR_BIT - 1) / CHAR_BIT, 1);
+
+    if (!visited) {
+        perror("failed to allocate states for JSON array comparison");
+        abort();
+    }
+
+#define json_array_pattern_visit(state_i, state_j)                             \
+    do {                                                                       \
+        const size_t index = (size_t)(state_i) * m + (state_j);                \
+        if (!(visited[index / CHAR_BIT] & (1u << (index % CHAR_BIT)))) {       \
+            visited[index / CHAR_BIT] |= (uint8_t)(1u << (index % CHAR_BIT));  \
+            array_add(&states, ((struct state){(state_i), (state_j)}));        \
+        }                                                                      \
+    } while (0)
+
+    bool matched = false;
+
+    json_array_pattern_visit(0, 0);
+    for (size_t k = 0; k < states.length && !matched; ++k) {
+        // must copy `s` as [elements] may be resized later
+        struct state s = states.elements[k];
+        json_node *element1 = array1->elements[s.i];
+        json_node *element2 = array2->elements[s.j];
+        bool has_ellipsis = element1->node_type == json_node_type_ellipsis ||
+            element2->node_type == json_node_type_ellipsis;
+
+        if (has_ellipsis) {
+            // the ellipsis matches one more element on the other side
+            if (s.i + 1 < n)
+                json_array_pattern_visit(s.i + 1, s.j);
+            if (s.j + 1 < m)
+                json_array_pattern_visit(s.i, s.j + 1);
+        }
+
+        if (has_ellipsis || json_node_equal_to(element1, element2)) {
+            if (s.i + 1 < n && s.j + 1 < m)
+                json_array_pattern_visit(s.i + 1, s.j + 1);
+            matched = s.i + 1 >= tail1 && s.j + 1 >= tail2;
+        }
+    }
+
+#undef json_array_pattern_visit
+
+    free(visited);
+    array_destroy(&states);
+    return matched;
+}
+
 bool json_node_equal_to(json_node *node1, json_node *node2)
 {
     if (node1->node_type != node2->node_type)
@@ -265,11 +519,14 @@ bool json_node_equal_to(json_node *node1, json_node *node2)
     if (node1 == node2)
         return true;
 
-    if (node1->visiting && node2->visiting)
-        return true;
+    // only containers are marked as visited (see json_node_build_string())
+    if (json_node_is_container(node1)) {
+        if (node1->visiting && node2->visiting)
+            return true;
 
-    if (node1->visiting || node2->visiting)
-        return false;
+        if (node1->visiting || node2->visiting)
+            return false;
+    }
 
     switch (node1->node_type) {
     case json_node_type_null:
@@ -290,51 +547,11 @@ bool json_node_equal_to(json_node *node1, json_node *node2)
         node1->visiting = true;
         node2->visiting = true;
         if (node1->is_pattern || node2->is_pattern) {
-            struct state {
-                unsigned i;
-                unsigned j;
-            };
-            array(struct state) states;
-            array_init(&states);
-
-            // initial state of (0, 0)
-            array_add(&states, ((struct state){0, 0}));
-
-            bool reached_end1 = false;
-            bool reached_end2 = false;
-
-            // NFA-style matching of arrays that may contain the ellipsis
-            // node '...'. The comparison should terminate in a finite number
-            // of steps.
-            for (unsigned n = 0; n < states.length && !(reached_end1 && reached_end2); ++n) {
-                // must copy `s` as [elements] may be resized later
-                struct state s = states.elements[n];
-
-                reached_end1 = false;
-                reached_end2 = false;
-                if (array1->elements[s.i]->node_type == json_node_type_ellipsis ||
-                    array2->elements[s.j]->node_type == json_node_type_ellipsis) {
-                    if (s.i + 1 < array1->num_elements)
-                        array_add(&states, ((struct state){s.i + 1, s.j}));
-                    if (s.j + 1 < array2->num_elements)
-                        array_add(&states, ((struct state){s.i, s.j + 1}));
-                }
-
-                if (json_node_equal_to(array1->elements[s.i],
-                                       array2->elements[s.j]) ||
-                    array1->elements[s.i]->node_type == json_node_type_ellipsis ||
-                    array2->elements[s.j]->node_type == json_node_type_ellipsis) {
-                    if (s.i + 1 < array1->num_elements && s.j + 1 < array2->num_elements)
-                        array_add(&states, ((struct state){s.i + 1, s.j + 1}));
-                    reached_end1 = s.i == array1->num_elements - 1;
-                    reached_end2 = s.j == array2->num_elements - 1;
-                }
-            }
+            bool matched = json_array_pattern_equal_to(array1, array2);
 
             node1->visiting = false;
             node2->visiting = false;
-            array_destroy(&states);
-            return reached_end1 && reached_end2;
+            return matched;
         } else {
             if (array1->num_elements != array2->num_elements) {
                 node1->visiting = false;
@@ -366,7 +583,7 @@ bool json_node_equal_to(json_node *node1, json_node *node2)
         if (node1->is_pattern || node2->is_pattern) {
             // check whether each member in object1 is present in object2
             json_object_foreach(object1, object1_member, {
-                json_node *object2_member_value = json_object_get_member(node2, object1_member_name);
+                json_node *object2_member_value = json_object_get_interned_member(node2, object1_member_name);
 
                 if (!object2_member_value) {
                     // if the object1 member is optional or object2 is a
@@ -395,7 +612,7 @@ bool json_node_equal_to(json_node *node1, json_node *node2)
             // aren't present in object 1 (assuming object 1 is not a pattern)
             if (!node1->is_pattern) {
                 json_object_foreach(object2, object2_member, {
-                    if (!json_object_get_member(node1, object2_member_name)) {
+                    if (!json_object_get_interned_member(node1, object2_member_name)) {
                         if (object2_member_value->optional)
                             continue;
                         node1->visiting = false;
@@ -415,7 +632,7 @@ bool json_node_equal_to(json_node *node1, json_node *node2)
             }
 
             json_object_foreach(object1, member, {
-                json_node *object2_member_value = json_object_get_member(node2, member_name);
+                json_node *object2_member_value = json_object_get_interned_member(node2, member_name);
 
                 if (!object2_member_value) {
                     node1->visiting = false;
@@ -445,12 +662,94 @@ bool json_node_equal_to(json_node *node1, json_node *node2)
     abort();
 }
 
+/**
+ * Mixes the bits of a 64-bit value into a hash.
+ */
+static unsigned json_hash_mix(uint64_t value)
+{
+    value ^= value >> 33;
+    value *= UINT64_C(0xff51afd7ed558ccd);
+    value ^= value >> 33;
+    value *= UINT64_C(0xc4ceb9fe1a85ec53);
+    value ^= value >> 33;
+    return (unsigned)value;
+}
+
+unsigned json_node_hash(json_node *node)
+{
+    // a node we're already hashing is part of a cycle. all such nodes hash
+    // the same since json_node_equal_to() treats them as equal
+    if (json_node_is_container(node) && node->visiting)
+        return 0x9e3779b9u;
+
+    // patterns can match nodes of different sizes
+    if (node->is_pattern)
+        return json_hash_mix(node->node_type);
+
+    switch (node->node_type) {
+    case json_node_type_null:
+        return json_hash_mix(json_node_type_null);
+    case json_node_type_integer:
+        return json_hash_mix((uint64_t)((json_integer *)node)->value);
+    case json_node_type_double:
+    {
+        double value = ((json_double *)node)->value;
+        uint64_t bits = 0;
+
+        // -0.0 == 0.0
+        if (value == 0)
+            value = 0;
+        memcpy(&bits, &value, sizeof bits);
+        return json_hash_mix(bits ^ json_node_type_double);
+    }
+    case json_node_type_boolean:
+        return json_hash_mix(((json_boolean *)node)->value ? 2 : 1);
+    case json_node_type_string:
+        return strhash(((json_string *)node)->value);
+    case json_node_type_array:
+    {
+        unsigned hash = json_hash_mix(json_node_type_array);
+
+        node->visiting = true;
+        json_array_foreach(node, element, {
+            hash = hash * 31 + json_node_hash(element);
+        });
+        node->visiting = false;
+        return hash;
+    }
+    case json_node_type_object:
+    {
+        unsigned hash = json_hash_mix(json_node_type_object);
+
+        // members may be in any order, so combine them commutatively
+        node->visiting = true;
+        json_object_foreach(node, member, {
+            hash += json_hash_mix((uint64_t)strhash(member_name) << 32 | json_node_hash(member_value));
+        });
+        node->visiting = false;
+        return hash;
+    }
+    case json_node_type_ellipsis:
+        return json_hash_mix(json_node_type_ellipsis);
+    case json_node_type_pointer:
+        return json_hash_mix((uintptr_t)((json_pointer *)node)->value);
+    }
+
+    fprintf(stderr, "%s: invalid node type `%u'\n", __func__, node->node_type);
+    abort();
+}
+
 static void json_node_internal_copy_flags(json_node *source_node, json_node *destination_node)
 {
     destination_node->optional = source_node->optional;
     destination_node->is_pattern = source_node->is_pattern;
 }
 
+// these always allocate a new node, which the public constructors don't
+static json_node *json_null_alloc(json_arena *arena);
+static json_node *json_integer_alloc(json_arena *arena, int64_t value);
+static json_node *json_boolean_alloc(json_arena *arena, bool value);
+
 static json_node *json_node_internal_copy(json_node *node, ptr_hashmap *seen_nodes)
 {
     const ptr_hashmap_entry *node_copy_entry = ptr_hashmap_get(seen_nodes, node);
@@ -462,11 +761,11 @@ static json_node *json_node_internal_copy(json_node *node, ptr_hashmap *seen_nod
 
     switch (node->node_type) {
     case json_node_type_null:
-        new_node = json_null_new();
+        new_node = json_null_alloc(NULL);
         json_node_internal_copy_flags(node, new_node);
         break;
     case json_node_type_integer:
-        new_node = json_integer_new(((json_integer *)node)->value);
+        new_node = json_integer_alloc(NULL, ((json_integer *)node)->value);
         json_node_internal_copy_flags(node, new_node);
         break;
     case json_node_type_double:
@@ -474,7 +773,7 @@ static json_node *json_node_internal_copy(json_node *node, ptr_hashmap *seen_nod
         json_node_internal_copy_flags(node, new_node);
         break;
     case json_node_type_boolean:
-        new_node = json_boolean_new(((json_boolean *)node)->value);
+        new_node = json_boolean_alloc(NULL, ((json_boolean *)node)->value);
         json_node_internal_copy_flags(node, new_node);
         break;
     case json_node_type_string:
@@ -485,14 +784,14 @@ static json_node *json_node_internal_copy(json_node *node, ptr_hashmap *seen_nod
         new_node = json_array_new();
         json_node_internal_copy_flags(node, new_node);
         json_array_foreach(node, element, {
-            json_array_add_element(new_node, json_node_copy(element));
+            json_array_add_element(new_node, json_node_internal_copy(element, seen_nodes));
         });
         break;
     case json_node_type_object:
         new_node = json_object_new();
         json_node_internal_copy_flags(node, new_node);
         json_object_foreach(node, member, {
-            json_object_set_member(new_node, member_name, json_node_copy(member_value));
+            json_object_set_member(new_node, member_name, json_node_internal_copy(member_value, seen_nodes));
         });
         break;
     case json_node_type_ellipsis:
@@ -512,16 +811,55 @@ static json_node *json_node_internal_copy(json_node *node, ptr_hashmap *seen_nod
 
 json_node *json_node_copy(json_node *node)
 {
-    ptr_hashmap *seen_nodes = ptr_hashmap_new(NULL, NULL, NULL, NULL, NULL, NULL);
+    ptr_hashmap *seen_nodes = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, NULL);
     json_node *new_node = json_node_internal_copy(node, seen_nodes);
 
     ptr_hashmap_destroy(seen_nodes);
     return new_node;
 }
 
-json_node *json_null_new(void)
+// --- shared immutable nodes
+
+static json_node json_null_node = {
+    .node_type = json_node_type_null,
+    .immutable = true
+};
+
+static json_boolean json_true_node = {
+    .parent_struct = { .node_type = json_node_type_boolean, .immutable = true },
+    .value = true
+};
+
+static json_boolean json_false_node = {
+    .parent_struct = { .node_type = json_node_type_boolean, .immutable = true },
+    .value = false
+};
+
+static json_integer json_small_integers[JSON_SMALL_INTEGER_MAX - JSON_SMALL_INTEGER_MIN + 1];
+static once_flag json_small_integers_initialized = ONCE_FLAG_INIT;
+
+static void json_small_integers_init(void)
+{
+    for (unsigned i = 0; i < sizeof json_small_integers / sizeof json_small_integers[0]; i++) {
+        json_small_integers[i] = (json_integer) {
+            .parent_struct = { .node_type = json_node_type_integer, .immutable = true },
+            .value = JSON_SMALL_INTEGER_MIN + (int64_t)i
+        };
+    }
+}
+
+static json_node *json_small_integer_get(int64_t value)
+{
+    call_once(&json_small_integers_initialized, json_small_integers_init);
+
+    return (json_node *)&json_small_integers[value - JSON_SMALL_INTEGER_MIN];
+}
+
+// --- creating new nodes
+
+static json_node *json_null_alloc(json_arena *arena)
 {
-    json_node *node = calloc(1, sizeof *node);
+    json_node *node = json_node_alloc(arena, sizeof *node);
 
     node->node_type = json_node_type_null;
     node->floating = true;
@@ -529,9 +867,20 @@ json_node *json_null_new(void)
     return node;
 }
 
-json_node *json_integer_new(int64_t value)
+json_node *json_null_new_in_arena(json_arena *arena)
+{
+    (void) arena;
+    return &json_null_node;
+}
+
+json_node *json_null_new(void)
+{
+    return &json_null_node;
+}
+
+static json_node *json_integer_alloc(json_arena *arena, int64_t value)
 {
-    json_integer *node = calloc(1, sizeof *node);
+    json_integer *node = json_node_alloc(arena, sizeof *node);
 
     ((json_node *)node)->node_type = json_node_type_integer;
     ((json_node *)node)->floating = true;
@@ -540,9 +889,21 @@ json_node *json_integer_new(int64_t value)
     return (json_node *)node;
 }
 
-json_node *json_double_new(double value)
+json_node *json_integer_new_in_arena(json_arena *arena, int64_t value)
 {
-    json_double *node = calloc(1, sizeof *node);
+    if (value >= JSON_SMALL_INTEGER_MIN && value <= JSON_SMALL_INTEGER_MAX)
+        return json_small_integer_get(value);
+    return json_integer_alloc(arena, value);
+}
+
+json_node *json_integer_new(int64_t value)
+{
+    return json_integer_new_in_arena(NULL, value);
+}
+
+json_node *json_double_new_in_arena(json_arena *arena, double value)
+{
+    json_double *node = json_node_alloc(arena, sizeof *node);
 
     ((json_node *)node)->node_type = json_node_type_double;
     ((json_node *)node)->floating = true;
@@ -551,9 +912,14 @@ json_node *json_double_new(double value)
     return (json_node *)node;
 }
 
-json_node *json_boolean_new(bool value)
+json_node *json_double_new(double value)
 {
-    json_boolean *node = calloc(1, sizeof *node);
+    return json_double_new_in_arena(NULL, value);
+}
+
+static json_node *json_boolean_alloc(json_arena *arena, bool value)
+{
+    json_boolean *node = json_node_alloc(arena, sizeof *node);
 
     ((json_node *)node)->node_type = json_node_type_boolean;
     ((json_node *)node)->floating = true;
@@ -562,30 +928,61 @@ json_node *json_boolean_new(bool value)
     return (json_node *)node;
 }
 
-json_node *json_string_new(const char *value)
+json_node *json_boolean_new_in_arena(json_arena *arena, bool value)
+{
+    (void) arena;
+    return value ? (json_node *)&json_true_node : (json_node *)&json_false_node;
+}
+
+json_node *json_boolean_new(bool value)
+{
+    return json_boolean_new_in_arena(NULL, value);
+}
+
+json_node *json_string_new_in_arena(json_arena *arena, const char *value)
 {
     assert(value && "JSON string requires a non-null value");
-    json_string *node = calloc(1, sizeof *node);
+    json_string *node = json_node_alloc(arena, sizeof *node);
 
     ((json_node *)node)->node_type = json_node_type_string;
     ((json_node *)node)->floating = true;
-    node->value = strdup(value);
+    if (arena) {
+        size_t length = strlen(value);
+
+        node->value = json_arena_alloc(arena, length + 1);
+        memcpy(node->value, value, length + 1);
+    } else {
+        node->value = strdup(value);
+    }
 
     return (json_node *)node;
 }
 
-json_node *json_array_new(void)
+json_node *json_string_new(const char *value)
 {
-    json_array *node = calloc(1, sizeof *node);
+    return json_string_new_in_arena(NULL, value);
+}
+
+json_node *json_array_new_in_arena(json_arena *arena)
+{
+    json_array *node = json_node_alloc(arena, sizeof *node);
 
     ((json_node *)node)->node_type = json_node_type_array;
     ((json_node *)node)->floating = true;
     node->buffer_size = 64;
     node->elements = calloc(node->buffer_size, sizeof *node->elements);
 
+    if (json_collector)
+        json_collector->allocated((json_node *)node);
+
     return (json_node *)node;
 }
 
+json_node *json_array_new(void)
+{
+    return json_array_new_in_arena(NULL);
+}
+
 json_node *json_array_pattern_new(void)
 {
     json_node *array = json_array_new();
@@ -628,7 +1025,9 @@ json_node *json_array_set_element(json_node *node, unsigned index, json_node *el
     if (!element->is_pattern && node->is_pattern)
         element = json_internal_convert_node_to_pattern(element);
 
+    json_node *old_element = array->elements[index];
     array->elements[index] = json_node_ref(element);
+    json_node_unref(old_element);
 
     return element;
 }
@@ -685,7 +1084,7 @@ char *json_member_name_canonicalize(const char *member_name)
         }
 
         // convert from kebab-case or snake_case
-        if (*p == '-' || *p == '_') {
+        if ((*p == '-' || *p == '_') && p[1]) {
             ++p;
             cmember_name[cmember_length++] = isalnum(*p) ? toupper(*p) : *p;
         } else {
@@ -697,30 +1096,308 @@ char *json_member_name_canonicalize(const char *member_name)
     return cmember_name;
 }
 
-json_node *json_object_new(void)
+/**
+ * An interned member name. Interned names are compared by address, so they
+ * are handed out as pointers to [name].
+ */
+typedef struct {
+    /**
+     * The number of object members, shapes and other holders using this name.
+     * The name is removed from the table when this drops to 0.
+     */
+    unsigned long refcount;
+
+    /**
+     * Other spellings (kebab-case, snake_case) that map to this name in the
+     * table, or `NULL`.
+     * type: `ptr_list<char *>`
+     */
+    ptr_list *aliases;
+
+    char name[];
+} json_member_name;
+
+/**
+ * The table of interned member names.
+ * type: `ptr_hashmap<const char *, const char *>`
+ * Maps (member name) -> (interned canonical member name)
+ *
+ * Canonical names map to themselves. Other spellings of the same name map to
+ * the canonical name, and are owned by its `json_member_name`.
+ *
+ * Each thread has its own table, so that threads don't have to take a lock to
+ * create objects. Interned names must not be shared between threads. The
+ * table only holds names that are in use, and is freed when it is empty.
+ */
+static thread_local ptr_hashmap *json_member_names;
+
+static json_member_name *json_member_name_get(const char *interned_member_name)
 {
-    json_object *node = calloc(1, sizeof *node);
+    return (json_member_name *)((uintptr_t)interned_member_name - offsetof(json_member_name, name));
+}
 
-    if (!node) {
-        perror("failed to create JSON object");
+const char *json_member_name_ref(const char *interned_member_name)
+{
+    json_member_name_get(interned_member_name)->refcount++;
+    return interned_member_name;
+}
+
+void json_member_name_unref(const char *interned_member_name)
+{
+    json_member_name *name = json_member_name_get(interned_member_name);
+
+    assert(name->refcount > 0);
+    if (--name->refcount > 0)
+        return;
+
+    if (name->aliases) {
+        ptr_list_foreach(name->aliases, alias, char *, {
+            ptr_hashmap_delete(json_member_names, alias);
+        });
+        ptr_list_destroy(name->aliases);
+    }
+    ptr_hashmap_delete(json_member_names, name->name);
+    free(name);
+
+    if (ptr_hashmap_is_empty(json_member_names)) {
+        ptr_hashmap_destroy(json_member_names);
+        json_member_names = NULL;
+    }
+}
+
+const char *json_member_name_lookup(const char *member_name)
+{
+    ptr_hashmap_entry *entry = NULL;
+
+    if (!json_member_names)
+        return NULL;
+
+    if ((entry = ptr_hashmap_get(json_member_names, member_name)))
+        return entry->value;
+
+    // only kebab-case and snake_case names have another spelling
+    if (!strpbrk(member_name, "-_"))
+        return NULL;
+
+    char *canonicalized_member_name = json_member_name_canonicalize(member_name);
+    entry = ptr_hashmap_get(json_member_names, canonicalized_member_name);
+    free(canonicalized_member_name);
+
+    return entry ? entry->value : NULL;
+}
+
+const char *json_member_name_intern(const char *member_name)
+{
+    ptr_hashmap_entry *entry = NULL;
+
+    if (!json_member_names)
+        json_member_names = ptr_hashmap_new((collection_item_hash_func) strhash,
+                NULL,
+                NULL,
+                (collection_item_equality_func) strequal,
+                NULL,
+                NULL);
+
+    if ((entry = ptr_hashmap_get(json_member_names, member_name)))
+        return json_member_name_ref(entry->value);
+
+    char *canonicalized_member_name = json_member_name_canonicalize(member_name);
+    const char *interned_member_name = NULL;
+
+    if ((entry = ptr_hashmap_get(json_member_names, canonicalized_member_name))) {
+        interned_member_name = entry->value;
+    } else {
+        const size_t length = strlen(canonicalized_member_name);
+        json_member_name *name = calloc(1, sizeof *name + length + 1);
+
+        if (!name) {
+            perror("failed to intern JSON member name");
+            abort();
+        }
+        memcpy(name->name, canonicalized_member_name, length + 1);
+        ptr_hashmap_insert(json_member_names, name->name, name->name);
+        interned_member_name = name->name;
+    }
+    free(canonicalized_member_name);
+
+    // remember this spelling so that we don't canonicalize it again
+    if (strcmp(member_name, interned_member_name) != 0) {
+        json_member_name *name = json_member_name_get(interned_member_name);
+        char *alias = strdup(member_name);
+
+        if (!alias) {
+            perror("failed to intern JSON member name");
+            abort();
+        }
+        if (!name->aliases)
+            name->aliases = ptr_list_new(NULL, (collection_item_unref_func) free);
+        ptr_list_append(name->aliases, alias);
+        ptr_hashmap_insert(json_member_names, alias, (void *)(uintptr_t)interned_member_name);
+    }
+
+    return json_member_name_ref(interned_member_name);
+}
+
+/**
+ * Hashes an interned member name by its address. The low bits of heap
+ * addresses are mostly zero, so mix them before bucketing.
+ */
+static unsigned json_member_name_hash(const void *interned_member_name)
+{
+    uintptr_t address = (uintptr_t)interned_member_name;
+
+    return (unsigned)((address ^ (address >> 4) ^ (address >> 16)) * 2654435761u);
+}
+
+struct _json_shape {
+    /**
+     * The number of objects and shapes derived from this one that use it.
+     * The shape is freed when this drops to 0, except for the empty shape.
+     */
+    unsigned long refcount;
+
+    /**
+     * (ref) The shape this was derived from, by adding [member_name]
+     */
+    json_shape *parent;
+
+    /**
+     * (ref) The interned name of the last member, or `NULL` for the empty
+     * shape
+     */
+    const char *member_name;
+
+    /**
+     * The number of members in this shape
+     */
+    unsigned num_members;
+
+    /**
+     * Shapes derived from this one by adding a member, or `NULL` if there are
+     * none.
+     * type: `ptr_hashmap<const char *, json_shape *>`
+     * Maps (interned member name) -> (shape)
+     */
+    ptr_hashmap *transitions;
+};
+
+/**
+ * The shape of all empty objects. Like the interned member names, shapes
+ * belong to one thread.
+ */
+static thread_local json_shape json_shape_empty;
+
+const json_shape *json_shape_ref(const json_shape *shape)
+{
+    // the empty shape lives as long as the thread
+    if (shape->parent)
+        ((json_shape *)(uintptr_t)shape)->refcount++;
+    return shape;
+}
+
+void json_shape_unref(const json_shape *const_shape)
+{
+    json_shape *shape = (json_shape *)(uintptr_t)const_shape;
+    json_shape *parent = shape->parent;
+
+    if (!parent)
+        return;
+    assert(shape->refcount > 0);
+    if (--shape->refcount > 0)
+        return;
+
+    // every shape derived from this one holds a reference to it, so there
+    // are no transitions left
+    assert(!shape->transitions);
+    ptr_hashmap_delete(parent->transitions, (void *)(uintptr_t)shape->member_name);
+    if (ptr_hashmap_is_empty(parent->transitions)) {
+        ptr_hashmap_destroy(parent->transitions);
+        parent->transitions = NULL;
+    }
+    json_member_name_unref(shape->member_name);
+    free(shape);
+    json_shape_unref(parent);
+}
+
+/**
+ * Returns (a new reference to) the shape derived from [shape] by adding a
+ * member.
+ */
+static json_shape *json_shape_add_member(json_shape *shape, const char *interned_member_name)
+{
+    ptr_hashmap_entry *entry = NULL;
+
+    if (!shape->transitions)
+        shape->transitions = ptr_hashmap_new(json_member_name_hash, NULL, NULL, NULL, NULL, NULL);
+    else if ((entry = ptr_hashmap_get(shape->transitions, interned_member_name)))
+        return (json_shape *)(uintptr_t)json_shape_ref(entry->value);
+
+    json_shape *new_shape = calloc(1, sizeof *new_shape);
+
+    if (!new_shape) {
+        perror("failed to create JSON object shape");
         abort();
     }
 
+    new_shape->refcount = 1;
+    new_shape->parent = (json_shape *)(uintptr_t)json_shape_ref(shape);
+    new_shape->member_name = json_member_name_ref(interned_member_name);
+    new_shape->num_members = shape->num_members + 1;
+    ptr_hashmap_insert(shape->transitions, (void *)(uintptr_t)interned_member_name, new_shape);
+
+    return new_shape;
+}
+
+int json_shape_find_member(const json_shape *shape, const char *interned_member_name)
+{
+    for (; shape && shape->member_name; shape = shape->parent) {
+        if (shape->member_name == interned_member_name)
+            return (int)shape->num_members - 1;
+    }
+
+    return -1;
+}
+
+/**
+ * Gives up on tracking the layout of the object.
+ */
+static void json_object_drop_shape(json_object *object)
+{
+    if (object->shape)
+        json_shape_unref(object->shape);
+    object->shape = NULL;
+    free(object->slots);
+    object->slots = NULL;
+}
+
+json_node *json_object_new_in_arena(json_arena *arena)
+{
+    json_object *node = json_node_alloc(arena, sizeof *node);
+
     ((json_node *)node)->node_type = json_node_type_object;
     ((json_node *)node)->floating = true;
     node->members = ptr_hashmap_new(
-            /* keys */
-            (collection_item_hash_func) strhash, 
-            (collection_item_ref_func) strdup, 
-            (collection_item_unref_func) free,
-            (collection_item_equality_func) strequal,
+            /* keys: interned member names, compared by address */
+            json_member_name_hash,
+            (collection_item_ref_func) json_member_name_ref,
+            (collection_item_unref_func) json_member_name_unref,
+            NULL,
             /* values */
             (collection_item_ref_func) json_node_ref,
             (collection_item_unref_func) json_node_unref);
+    node->shape = &json_shape_empty;
+
+    if (json_collector)
+        json_collector->allocated((json_node *)node);
 
     return (json_node *)node;
 }
 
+json_node *json_object_new(void)
+{
+    return json_object_new_in_arena(NULL);
+}
+
 json_node *json_object_pattern_new(void)
 {
     json_node *object = json_object_new();
@@ -736,14 +1413,38 @@ json_node *json_object_set_member(json_node *node, const char *member_name, json
     assert((node->is_pattern || !member_value->is_pattern) && "cannot add JSON pattern to non-pattern");
 
     json_object *object = (json_object *)node;
-    char *canonicalized_member_name = json_member_name_canonicalize(member_name);
+    const char *interned_member_name = json_member_name_intern(member_name);
 
     if (!member_value->is_pattern && node->is_pattern)
         member_value = json_internal_convert_node_to_pattern(member_value);
 
-    ptr_hashmap_insert(object->members, canonicalized_member_name, member_value);
-    free(canonicalized_member_name);
+    unsigned long num_members = ptr_hashmap_num_elements(object->members);
+    ptr_hashmap_entry *entry =
+        ptr_hashmap_insert(object->members, (void *)(uintptr_t)interned_member_name, member_value);
 
+    if (object->shape && ptr_hashmap_num_elements(object->members) > num_members) {
+        // a member was added, so the object transitions to a new shape
+        if (num_members >= JSON_SHAPE_MAX_MEMBERS) {
+            json_object_drop_shape(object);
+        } else {
+            // grow the slots array in powers of 2
+            if ((num_members & (num_members - 1)) == 0) {
+                ptr_hashmap_entry **slots =
+                    realloc(object->slots, (num_members ? num_members * 2 : 1) * sizeof *slots);
+                if (!slots) {
+                    perror("failed to resize JSON object slots");
+                    abort();
+                }
+                object->slots = slots;
+            }
+            object->slots[num_members] = entry;
+            json_shape *new_shape = json_shape_add_member(object->shape, interned_member_name);
+            json_shape_unref(object->shape);
+            object->shape = new_shape;
+        }
+    }
+
+    json_member_name_unref(interned_member_name);
     return member_value;
 }
 
@@ -752,10 +1453,13 @@ json_node *json_object_get_member(json_node *node, const char *member_name)
     assert(node->node_type == json_node_type_object);
 
     json_object *object = (json_object *)node;
-    char *canonicalized_member_name = json_member_name_canonicalize(member_name);
+    const char *interned_member_name = json_member_name_lookup(member_name);
 
-    ptr_hashmap_entry *entry = ptr_hashmap_get(object->members, canonicalized_member_name);
-    free(canonicalized_member_name);
+    // if the name isn't interned, then no object has this member
+    if (!interned_member_name)
+        return NULL;
+
+    ptr_hashmap_entry *entry = ptr_hashmap_get(object->members, interned_member_name);
 
     return entry ? entry->value : NULL;
 }
@@ -765,20 +1469,38 @@ void json_object_delete_member(json_node *node, const char *member_name)
     assert(node->node_type == json_node_type_object);
 
     json_object *object = (json_object *)node;
-    char *canonicalized_member_name = json_member_name_canonicalize(member_name);
+    const char *interned_member_name = json_member_name_lookup(member_name);
 
-    ptr_hashmap_delete(object->members, canonicalized_member_name);
-    free(canonicalized_member_name);
+    if (!interned_member_name)
+        return;
+
+    ptr_hashmap_delete(object->members, (void *)(uintptr_t)interned_member_name);
+    json_object_drop_shape(object);
 }
 
-json_node *json_ellipsis_new(void)
+json_node *json_object_set_member_at(json_node *node, unsigned slot, json_node *member_value)
 {
-    json_node *node = calloc(1, sizeof *node);
+    assert(json_object_get_shape(node) && "JSON object does not have a shape");
+    assert(slot < json_object_get_shape(node)->num_members && "slot out of range");
+    assert((node->is_pattern || !member_value->is_pattern) && "cannot add JSON pattern to non-pattern");
 
-    if (!node) {
-        perror("failed to create JSON ellipsis node");
-        abort();
-    }
+    json_object *object = (json_object *)node;
+
+    if (!member_value->is_pattern && node->is_pattern)
+        member_value = json_internal_convert_node_to_pattern(member_value);
+
+    ptr_hashmap_entry *entry = object->slots[slot];
+    json_node *old_value = entry->value;
+
+    entry->value = json_node_ref(member_value);
+    json_node_unref(old_value);
+
+    return member_value;
+}
+
+json_node *json_ellipsis_new_in_arena(json_arena *arena)
+{
+    json_node *node = json_node_alloc(arena, sizeof *node);
 
     node->node_type = json_node_type_ellipsis;
     node->floating = true;
@@ -787,6 +1509,11 @@ json_node *json_ellipsis_new(void)
     return node;
 }
 
+json_node *json_ellipsis_new(void)
+{
+    return json_ellipsis_new_in_arena(NULL);
+}
+
 json_node *json_pointer_new(void *value, collection_item_ref_func ref_func, collection_item_unref_func unref_func)
 {
     json_pointer *node = calloc(1, sizeof *node);
@@ -802,5 +1529,44 @@ json_node *json_pointer_new(void *value, collection_item_ref_func ref_func, coll
     node->ref_func = ref_func;
     node->unref_func = unref_func;
 
+    if (json_collector)
+        json_collector->allocated((json_node *)node);
+
     return (json_node *)node;
 }
+
+void json_node_clear(json_node *node)
+{
+    switch (node->node_type) {
+    case json_node_type_array:
+    {
+        json_array *array = (json_array *)node;
+
+        for (unsigned i = 0; i < array->num_elements; i++) {
+            json_node_unref(array->elements[i]);
+            array->elements[i] = NULL;
+        }
+        array->num_elements = 0;
+    }   break;
+    case json_node_type_object:
+        json_object_drop_shape((json_object *)node);
+        ptr_hashmap_clear(((json_object *)node)->members);
+        break;
+    case json_node_type_pointer:
+    {
+        json_pointer *pointer = (json_pointer *)node;
+        void *value = pointer->value;
+
+        pointer->value = NULL;
+        if (pointer->unref_func && value)
+            pointer->unref_func(value);
+    }   break;
+    case json_node_type_null:
+    case json_node_type_integer:
+    case json_node_type_double:
+    case json_node_type_boolean:
+    case json_node_type_string:
+    case json_node_type_ellipsis:
+        break;
+    }
+}
@@ -25,7 +25,7 @@ typedef enum _json_node_type json_node_type;
 
 struct _json_node {
     alignas(8) json_node_type node_type;
-    unsigned refcount : sizeof(unsigned)*CHAR_BIT - (1 + 1 + 1 + 1);
+    unsigned refcount : sizeof(unsigned)*CHAR_BIT - (1 + 1 + 1 + 1 + 1 + 1 + 2 + 1);
 
     /**
      * Whether this node is a floating reference.
@@ -34,7 +34,8 @@ struct _json_node {
 
     /**
      * Used in recursive routines to handle cases where a JSON node circularly
-     * refers to itself.
+     * refers to itself. Only set on containers, so that shared immutable
+     * nodes are never written to.
      */
     bool visiting : 1;
 
@@ -54,6 +55,34 @@ struct _json_node {
      * ```
      */
     bool optional : 1;
+
+    /**
+     * Whether this node was allocated from a `json_arena`.
+     */
+    bool in_arena : 1;
+
+    /**
+     * Whether this is a statically-allocated node that is shared by everyone
+     * and must never be modified, such as `null`. Referencing and
+     * unreferencing such a node does nothing.
+     */
+    bool immutable : 1;
+
+    /**
+     * The color of this node in a cycle collection. Only meaningful to the
+     * cycle collector.
+     *
+     * @see json_collector_hooks
+     */
+    unsigned gc_color : 2;
+
+    /**
+     * Whether the cycle collector remembers this node as a possible root of
+     * a cycle.
+     *
+     * @see json_collector_hooks
+     */
+    bool gc_buffered : 1;
 };
 typedef struct _json_node json_node;
 
@@ -92,9 +121,37 @@ typedef struct _json_array json_array;
 struct _ptr_list; // see ptr-list.h
 typedef struct _ptr_list ptr_list;
 
+/**
+ * The layout of a JSON object: the names of its members, in the order they
+ * were added. Objects that gained the same members in the same order share
+ * the same shape, so the position of a member can be cached per shape.
+ *
+ * Shapes are freed once no object has them or any shape derived from them.
+ */
+struct _json_shape;
+typedef struct _json_shape json_shape;
+
+/**
+ * The maximum number of members an object can have and still have a shape.
+ */
+#define JSON_SHAPE_MAX_MEMBERS 64
+
 struct _json_object {
     json_node parent_struct;
     ptr_hashmap *members;
+
+    /**
+     * (ref) The layout of this object, or `NULL` if the object has no fixed
+     * layout because it has too many members or has had members deleted.
+     */
+    json_shape *shape;
+
+    /**
+     * When [shape] is non-null, the member entries in the order they were
+     * added, such that `slots[i]` is the entry at position `i` in the shape.
+     * type: `ptr_hashmap_entry *[]`
+     */
+    ptr_hashmap_entry **slots;
 };
 typedef struct _json_object json_object;
 
@@ -171,34 +228,97 @@ size_t json_node_to_string_length(json_node *node, bool pretty);
  */
 bool json_node_equal_to(json_node *node1, json_node *node2);
 
+/**
+ * Computes a structural hash of a JSON node without allocating. Nodes that
+ * are equal according to `json_node_equal_to()` have the same hash, except
+ * for patterns, which can match nodes with a different structure and should
+ * not be used as keys. Safe to call on nodes that contain cycles.
+ */
+unsigned json_node_hash(json_node *node);
+
 /**
  * Deep copies a JSON node.
  */
 json_node *json_node_copy(json_node *node);
 
 /**
- * Returns `node` with optional set to true
+ * Returns `node` with optional set to true, or a copy of `node` with optional
+ * set if `node` is immutable.
  */
 static inline json_node *json_node_set_optional(json_node *node)
 {
+    if (node->immutable)
+        node = json_node_copy(node);
     node->optional = true;
     return node;
 }
 
+// --- arenas
+
+/**
+ * A bump allocator for JSON nodes that are created together, such as all of
+ * the nodes of a parsed message. Each node allocated from the arena holds a
+ * reference to it, and the memory of the arena is released all at once when
+ * the last node is destroyed. Nodes that outlive the rest of the message
+ * (because they were stored somewhere else) keep the whole arena alive. Use
+ * `json_node_copy()` to move a node out of its arena.
+ *
+ * Only the nodes and string data live in the arena. The element buffers of
+ * arrays and the member tables of objects are still allocated separately.
+ */
+struct _json_arena;
+typedef struct _json_arena json_arena;
+
+/**
+ * Creates a new arena with a reference count of 1.
+ */
+json_arena *json_arena_new(void);
+
+json_arena *json_arena_ref(json_arena *arena);
+
+void json_arena_unref(json_arena *arena);
+
+/**
+ * Returns the number of bytes allocated from the arena so far.
+ */
+size_t json_arena_get_size(const json_arena *arena);
+
 // --- creating new JSON nodes
+//
+// The `_in_arena()` variants allocate the node from `arena` if it is non-null.
+//
+// `null`, `true`, `false`, and integers in the range
+// [JSON_SMALL_INTEGER_MIN, JSON_SMALL_INTEGER_MAX] are not allocated. Instead,
+// a shared immutable node is returned. Use `json_node_copy()` to get a node
+// that can be modified.
+
+#define JSON_SMALL_INTEGER_MIN (-128)
+#define JSON_SMALL_INTEGER_MAX 1023
 
 json_node *json_null_new(void);
 
+json_node *json_null_new_in_arena(json_arena *arena);
+
 json_node *json_integer_new(int64_t value);
 
+json_node *json_integer_new_in_arena(json_arena *arena, int64_t value);
+
 json_node *json_double_new(double value);
 
+json_node *json_double_new_in_arena(json_arena *arena, double value);
+
 json_node *json_boolean_new(bool value);
 
+json_node *json_boolean_new_in_arena(json_arena *arena, bool value);
+
 json_node *json_string_new(const char *value);
 
+json_node *json_string_new_in_arena(json_arena *arena, const char *value);
+
 json_node *json_array_new(void);
 
+json_node *json_array_new_in_arena(json_arena *arena);
+
 /**
  * Like `json_array_new()`, but allows this array to contain the non-standard
  * JSON ellipsis node, for pattern matching.
@@ -229,8 +349,36 @@ void json_array_delete_element(json_node *node, unsigned index);
  */
 char *json_member_name_canonicalize(const char *member_name);
 
+/**
+ * Returns the canonicalized (camelCase) form of `member_name` from a
+ * per-thread table of member names. Two member names canonicalize to the same
+ * name if and only if their interned forms are the same pointer.
+ *
+ * Object members are keyed by interned names, so a member name is only
+ * canonicalized the first time it is seen. The table only keeps the names
+ * that are in use, so names from messages are freed along with the objects
+ * that have them.
+ *
+ * @return a new reference to the interned name, which must be released with
+ *         `json_member_name_unref()`
+ */
+const char *json_member_name_intern(const char *member_name);
+
+/**
+ * Returns the interned form of `member_name` without interning it, or `NULL`
+ * if no object or other holder is using the name. The result is only valid
+ * while something holds a reference to it.
+ */
+const char *json_member_name_lookup(const char *member_name);
+
+const char *json_member_name_ref(const char *interned_member_name);
+
+void json_member_name_unref(const char *interned_member_name);
+
 json_node *json_object_new(void);
 
+json_node *json_object_new_in_arena(json_arena *arena);
+
 json_node *json_object_pattern_new(void);
 
 /**
@@ -243,8 +391,68 @@ json_node *json_object_set_member(json_node *node, const char *member_name, json
  */
 json_node *json_object_get_member(json_node *node, const char *member_name);
 
+/**
+ * Like `json_object_get_member()`, but skips canonicalizing the name. Use this
+ * with a name that has already been interned, such as one obtained by
+ * iterating over another object.
+ *
+ * @param interned_member_name  a name returned by `json_member_name_intern()`
+ */
+static inline json_node *json_object_get_interned_member(json_node *node, const char *interned_member_name)
+{
+    assert(node->node_type == json_node_type_object);
+    ptr_hashmap_entry *entry = ptr_hashmap_get(((json_object *)node)->members, interned_member_name);
+
+    return entry ? entry->value : NULL;
+}
+
 void json_object_delete_member(json_node *node, const char *member_name);
 
+/**
+ * Returns the shape of the object, or `NULL` if it has none.
+ */
+static inline const json_shape *json_object_get_shape(json_node *node)
+{
+    assert(node->node_type == json_node_type_object);
+    return ((json_object *)node)->shape;
+}
+
+/**
+ * Returns the position of a member in objects that have this shape, or -1 if
+ * there is no such member.
+ *
+ * @param interned_member_name  a name returned by `json_member_name_intern()`
+ */
+int json_shape_find_member(const json_shape *shape, const char *interned_member_name);
+
+/**
+ * Keeps [shape] alive. Shapes are freed when no object has them, after which
+ * another shape could have the same address, so a cache that compares shapes
+ * by address must hold a reference to each one.
+ */
+const json_shape *json_shape_ref(const json_shape *shape);
+
+void json_shape_unref(const json_shape *shape);
+
+/**
+ * Returns the member at position `slot` of the object's shape.
+ *
+ * @see json_shape_find_member
+ */
+static inline json_node *json_object_get_member_at(json_node *node, unsigned slot)
+{
+    assert(json_object_get_shape(node) && "JSON object does not have a shape");
+    return ((json_object *)node)->slots[slot]->value;
+}
+
+/**
+ * Replaces the member at position `slot` of the object's shape. Returns
+ * `member_value`.
+ *
+ * @see json_shape_find_member
+ */
+json_node *json_object_set_member_at(json_node *node, unsigned slot, json_node *member_value);
+
 /**
  * Creates a non-standard JSON ellipsis node, used for pattern matching in
  * `json_node_equal_to()`.  See `json_array_pattern_new()` and
@@ -253,6 +461,8 @@ void json_object_delete_member(json_node *node, const char *member_name);
  */
 json_node *json_ellipsis_new(void);
 
+json_node *json_ellipsis_new_in_arena(json_arena *arena);
+
 /**
  * Creates a non-standard JSON node wrapping a raw pointer.
  *
@@ -261,3 +471,56 @@ json_node *json_ellipsis_new(void);
  * @param unref_func    an operation to release a reference to the object, or `NULL`
  */
 json_node *json_pointer_new(void *value, collection_item_ref_func ref_func, collection_item_unref_func unref_func);
+
+// --- cycle collection
+
+/**
+ * Reference counting cannot free arrays and objects that refer to each other
+ * in a cycle. These hooks let a cycle collector keep track of the nodes that
+ * can be part of a cycle, which are arrays, objects, and pointer nodes.
+ *
+ * Hooks are installed per thread.
+ */
+typedef struct {
+    /**
+     * Called when an array, object, or pointer node is created.
+     */
+    void (*allocated)(json_node *node);
+
+    /**
+     * Called when a reference to an array, object, or pointer node is released
+     * but the node is still referenced, which means that it may now only be
+     * referenced by a cycle.
+     */
+    void (*possible_root)(json_node *node);
+
+    /**
+     * Called when a node with `gc_buffered` set is destroyed.
+     */
+    void (*destroyed)(json_node *node);
+} json_collector_hooks;
+
+/**
+ * Installs cycle collector hooks for the current thread, or removes them if
+ * `hooks` is `NULL`. Returns the previous hooks.
+ */
+const json_collector_hooks *json_set_collector_hooks(const json_collector_hooks *hooks);
+
+/**
+ * Whether `node` can hold references to other nodes, and can therefore be
+ * part of a cycle.
+ */
+static inline bool json_node_is_container(const json_node *node)
+{
+    return node->node_type == json_node_type_array ||
+        node->node_type == json_node_type_object ||
+        node->node_type == json_node_type_pointer;
+}
+
+/**
+ * Releases the elements of an array, the members of an object, or the
+ * pointer wrapped by a pointer node, leaving the node empty. A cycle collector
+ * uses this to break a cycle of nodes that are no longer reachable. The
+ * caller must hold a reference to `node`.
+ */
+void json_node_clear(json_node *node);
@@ -7,6 +7,8 @@
 #include "json/json-parser.h"
 #include "data-structures/string-builder.h"
 #include "io/event.h"
+#include "io/io-common.h"
+#include "io/io-trace.h"
 #include "io/outputstream.h"
 #include "util.h"
 #include "json/json-scanner.h"
@@ -17,6 +19,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #ifndef JSONRPC_DEBUG
 #define jsonrpc_debug(stmts) 
@@ -35,32 +38,49 @@
 #endif
 
 /**
- * Hash an ID for a response or request.
+ * Hash a request ID issued by this server. IDs are allocated sequentially, so
+ * they can be used directly.
  */
-static unsigned jsonrpc_id_hash(json_node *id) 
+static unsigned jsonrpc_id_hash(const void *id)
 {
-    switch (id->node_type) {
-    case json_node_type_null:
-        return 0;
-    case json_node_type_integer:
-        return (uint64_t)json_node_cast(id, integer)->value;
-    case json_node_type_double: 
-    {
-        char *representation = json_node_to_string(id, false);
-        unsigned hash = strhash(representation);
-        free(representation);
-        return hash;
-    }
-    case json_node_type_string:
-        return strhash(json_node_cast(id, string)->value);
-    default:
-        fprintf(stderr,
-                "%s: ID for request object must be a string, integer, double, "
-                "or null\n",
-                __func__);
-        abort();
-        break;
-    }
+    return (unsigned)(uintptr_t)id;
+}
+
+/**
+ * Gets the key for a response ID in `received_responses` and
+ * `response_events`. Returns false if the ID could not have been issued by
+ * this server.
+ */
+static bool jsonrpc_server_response_id_to_key(const jsonrpc_server *server,
+                                              json_node            *id,
+                                              void                **key)
+{
+    json_integer *integer_id = NULL;
+
+    if (!id || !(integer_id = json_node_cast(id, integer)))
+        return false;
+
+    if (integer_id->value < 0 || (uint64_t)integer_id->value >= server->next_request_id)
+        return false;
+
+    *key = (void *)(uintptr_t)integer_id->value;
+    return true;
+}
+
+/**
+ * A call to the remote whose response is being timed.
+ */
+typedef struct {
+    jsonrpc_call_timing *timing;        // where to save the times
+    jsonrpc_call_timing own_timing;     // used when the caller did not ask for the times
+    char *method;
+    uint64_t trace_id;                  // the call's span in the trace, or 0 if it is not traced
+} jsonrpc_timed_call;
+
+static void jsonrpc_timed_call_destroy(jsonrpc_timed_call *call)
+{
+    free(call->method);
+    free(call);
 }
 
 void jsonrpc_server_init(jsonrpc_server *server,
@@ -68,6 +88,8 @@ void jsonrpc_server_init(jsonrpc_server *server,
                          outputstream   *output_stream)
 {
     server->parser = json_parser_create_from_stream(input_stream);
+    if (server->parser)     // allocate and free each message in one piece
+        server->parser->use_arenas = true;
     server->output_stream = outputstream_ref(output_stream);
 
     server->call_handlers = ptr_hashmap_new((collection_item_hash_func) strhash,
@@ -88,18 +110,16 @@ void jsonrpc_server_init(jsonrpc_server *server,
                                              (collection_item_unref_func) json_node_unref);
 
     server->received_responses =
-        ptr_hashmap_new((collection_item_hash_func)jsonrpc_id_hash,
-                        (collection_item_ref_func)json_node_ref,
-                        (collection_item_unref_func)json_node_unref,
-                        (collection_item_equality_func)json_node_equal_to,
+        ptr_hashmap_new(jsonrpc_id_hash, NULL, NULL, NULL,
                         (collection_item_ref_func)json_node_ref,
                         (collection_item_unref_func)json_node_unref);
 
-    server->response_events = ptr_hashmap_new(
-        (collection_item_hash_func)jsonrpc_id_hash,
-        (collection_item_ref_func)json_node_ref,
-        (collection_item_unref_func)json_node_unref,
-        (collection_item_equality_func)json_node_equal_to, NULL, NULL);
+    server->response_events =
+        ptr_hashmap_new(jsonrpc_id_hash, NULL, NULL, NULL, NULL, NULL);
+
+    server->response_timings =
+        ptr_hashmap_new(jsonrpc_id_hash, NULL, NULL, NULL, NULL,
+                        (collection_item_unref_func)jsonrpc_timed_call_destroy);
 }
 
 jsonrpc_server *jsonrpc_server_new(inputstream *input_stream,
@@ -140,15 +160,47 @@ void jsonrpc_server_handle_notification(jsonrpc_server              *server,
 }
 
 /**
- * Sends a message synchronously. Returns success or failure.
+ * Writes a message to the capture stream, if the server is capturing.
+ *
+ * @param direction     `'>'` for a sent message, or `'<'` for a received one
+ * @param message       the serialized message, or `NULL` to serialize [node]
  */
-static bool jsonrpc_server_send_message(jsonrpc_server *server, json_node *node)
+static void jsonrpc_server_capture_message(jsonrpc_server *server,
+                                           char            direction,
+                                           uint64_t        time,
+                                           const char     *message,
+                                           json_node      *node)
 {
-    bool success = false;
+    char *serialized_message = NULL;
+
+    if (!server->capture_stream)
+        return;
+
+    if (!message)
+        message = serialized_message = json_node_to_string(node, false);
+    outputstream_printf(server->capture_stream, "%c %" PRIu64 " %zu\n%s\n",
+                        direction, time - server->capture_start_time, strlen(message), message);
+    free(serialized_message);
+}
+
+/**
+ * Sends a message synchronously. Returns the number of bytes written, or 0 on
+ * failure.
+ */
+static size_t jsonrpc_server_send_message(jsonrpc_server *server, json_node *node)
+{
+    size_t bytes_written = 0;
+    const uint64_t serialize_start = io_trace_is_enabled() ? io_get_monotonic_time() : 0;
     char *serialized_message = json_node_to_string(node, false);
+    if (serialize_start)
+        io_trace_complete("json", "serialize", serialize_start, io_get_monotonic_time(),
+                          "bytes", strlen(serialized_message));
     char *content_length_header = string_destroy(
         string_newf("Content-Length: %zu\r\n", strlen(serialized_message) + 2));
 
+    if (server->capture_stream)
+        jsonrpc_server_capture_message(server, '>', io_get_monotonic_time(), serialized_message, NULL);
+
     // header field
     if (outputstream_write_string(server->output_stream, content_length_header) != strlen(content_length_header))
         goto cleanup;
@@ -164,18 +216,55 @@ static bool jsonrpc_server_send_message(jsonrpc_server *server, json_node *node)
         goto cleanup;
     jsonrpc_debug(fprintf(stderr, "wrote: %s\\r\\n\n", serialized_message));
 
-    success = true;
+    bytes_written = strlen(content_length_header) + 2 + strlen(serialized_message) + 2;
 
 cleanup:
     free(serialized_message);
     free(content_length_header);
-    return success;
+    return bytes_written;
+}
+
+struct pending_event_ctx {
+    jsonrpc_server *server;
+    async_callback callback;
+    void *callback_data;
+};
+
+static void jsonrpc_server_pending_event_cb(const event *ev, void *user_data)
+{
+    struct pending_event_ctx *ctx = user_data;
+    async_callback callback = ctx->callback;
+    void *callback_data = ctx->callback_data;
+
+    // the callback may destroy the server
+    ctx->server->pending_events--;
+    free(ctx);
+    callback(ev, callback_data);
+}
+
+/**
+ * Adds an event to [loop] that is counted in `pending_events` until its
+ * callback runs.
+ */
+static event *jsonrpc_server_add_pending_event(jsonrpc_server *server,
+                                               eventloop      *loop,
+                                               async_callback  callback,
+                                               void           *callback_data)
+{
+    struct pending_event_ctx *ctx;
+
+    box(struct pending_event_ctx, ctx, server, callback, callback_data);
+    server->pending_events++;
+    return eventloop_add(loop, jsonrpc_server_pending_event_cb, ctx);
 }
 
 struct ostream_ready_ctx {
     jsonrpc_server *server;
     json_node *message;
     event *send_message_ev;
+    uint64_t *sent_time;
+    jsonrpc_method_stats *stats;
+    uint64_t queued_time;
 };
 
 static void
@@ -192,11 +281,23 @@ jsonrpc_server_send_message_outputstream_ready_cb(const event *ready_ev,
         // TODO: write partial output
         jsonrpc_debug(
             fprintf(stderr, "outputstream ready, will send message\n"));
-        if (!jsonrpc_server_send_message(ctx->server, ctx->message)) {
+        size_t bytes_written = jsonrpc_server_send_message(ctx->server, ctx->message);
+        if (!bytes_written) {
             // an error occurred
             event_cancel_with_errno(ctx->send_message_ev, errno);
         } else {
             // success
+            if (ctx->sent_time || ctx->stats) {
+                uint64_t sent_time = io_get_monotonic_time();
+
+                if (ctx->sent_time)
+                    *ctx->sent_time = sent_time;
+                if (ctx->stats) {
+                    ctx->stats->messages_sent++;
+                    ctx->stats->bytes_sent += bytes_written;
+                    histogram_record(ctx->stats->queueing_delays, sent_time - ctx->queued_time);
+                }
+            }
             event_return(ctx->send_message_ev, NULL);
         }
     }
@@ -207,18 +308,29 @@ jsonrpc_server_send_message_outputstream_ready_cb(const event *ready_ev,
 
 /**
  * Sends a request (a call or notification) asynchronously.
+ *
+ * @param method        the method to count the message under if the server
+ *                      is keeping statistics, or `NULL`
+ * @param sent_time     where to save the time that the message was written,
+ *                      or `NULL`
  */
 static void jsonrpc_server_send_message_async(jsonrpc_server *server,
                                               json_node      *message,
+                                              const char     *method,
+                                              uint64_t       *sent_time,
                                               eventloop      *loop,
                                               async_callback  callback,
                                               void           *user_data)
 {
-    event *send_message_ev = eventloop_add(loop, callback, user_data);
+    event *send_message_ev = jsonrpc_server_add_pending_event(server, loop, callback, user_data);
+    jsonrpc_method_stats *stats = NULL;
+
+    if (server->stats && method)
+        stats = jsonrpc_stats_get_method(server->stats, method);
 
     struct ostream_ready_ctx *ctx = NULL;
     box(struct ostream_ready_ctx, ctx, server, json_node_ref(message),
-        send_message_ev);
+        send_message_ev, sent_time, stats, stats ? io_get_monotonic_time() : 0);
 
     // TODO: handle outputstream backed by a buffer
     jsonrpc_debug({
@@ -287,9 +399,9 @@ void jsonrpc_server_reply_to_remote_async(jsonrpc_server *server,
 {
     json_node *response_object = jsonrpc_server_create_response(id, result);
 
-    event *replied_ev = eventloop_add(loop, callback, user_data);
+    event *replied_ev = jsonrpc_server_add_pending_event(server, loop, callback, user_data);
 
-    jsonrpc_server_send_message_async(server, response_object, loop,
+    jsonrpc_server_send_message_async(server, response_object, NULL, NULL, loop,
                                       jsonrpc_server_reply_sent_cb, replied_ev);
 }
 
@@ -444,7 +556,8 @@ jsonrpc_verify_is_response_object(json_node         *node,
 }
 
 /**
- * Creates a call or a notification request.
+ * Creates a call or a notification request. Calls are always given an
+ * integer ID.
  *
  * @param request_id        leave `NULL` if this is a notification
  */
@@ -461,7 +574,7 @@ jsonrpc_server_create_request(jsonrpc_server   *server,
     json_object_set_member(request_object, "params", parameters);
     if (request_id) {
         *request_id = json_object_set_member(
-            request_object, "id", json_integer_new(server->next_request_id));
+            request_object, "id", json_integer_new((int64_t)server->next_request_id));
         server->next_request_id++;
     }
 
@@ -475,6 +588,7 @@ json_node *jsonrpc_server_call_remote(jsonrpc_server *server,
     json_node *response_node = NULL;
     json_node *request_id = NULL;
     json_node *request_object = jsonrpc_server_create_request(server, method, parameters, &request_id);
+    const uint64_t call_start = io_trace_is_enabled() ? io_get_monotonic_time() : 0;
 
     if (jsonrpc_server_send_message(server, request_object) == 0) {
         fprintf(stderr, "%s: output error: %s\n", __func__, strerror(errno));
@@ -485,6 +599,9 @@ json_node *jsonrpc_server_call_remote(jsonrpc_server *server,
     // listen for response
     while ((response_node = json_parser_parse_node(server->parser))) {
         const char *verification_failed_why = NULL;
+
+        if (server->capture_stream)
+            jsonrpc_server_capture_message(server, '<', io_get_monotonic_time(), NULL, response_node);
         if (jsonrpc_verify_is_response_object(response_node, &verification_failed_why)) {
             // check if this is the response for our request
             if (json_node_equal_to(json_object_get_member(response_node, "id"), request_id))
@@ -517,6 +634,9 @@ json_node *jsonrpc_server_call_remote(jsonrpc_server *server,
 
     json_node_unref(request_object);
 
+    if (call_start)
+        io_trace_complete("jsonrpc", method, call_start, io_get_monotonic_time(), NULL, 0);
+
     return response_node;
 }
 
@@ -549,6 +669,7 @@ static bool jsonrpc_server_wait_stream_finish(const event *ev, int *error) {
 struct parse_content_length_ctx {
     jsonrpc_server *server;
     event *header_parsed_ev;
+    uint64_t received_time;
     enum {
         parse_content_length_state_skipping_spaces,
         parse_content_length_state_skipping_text,
@@ -610,6 +731,9 @@ static void jsonrpc_server_parse_content_length_cb(const event *ev,
         switch (ctx->state) {
         case parse_content_length_state_skipping_spaces:
             if (!isspace(read_character)) {
+                // the message arrived once we could read the first byte of
+                // its header. spaces may be left over from the last message.
+                ctx->received_time = io_get_monotonic_time();
                 ctx->state = parse_content_length_state_skipping_text;
                 __attribute__((fallthrough));
             } else {
@@ -667,6 +791,9 @@ static void jsonrpc_server_parse_content_length_cb(const event *ev,
                 jsonrpc_debug(fprintf(
                     stderr, "done reading 'Content-Length: '; size = %zu\n",
                     content_length));
+                ctx->server->message_received_time = ctx->received_time;
+                // the header is followed by an empty line
+                ctx->server->message_size = sizeof(header_begin) - 1 + ctx->i + 4 + content_length;
                 event_return(ctx->header_parsed_ev,
                              (void *)(uintptr_t)content_length);
                 free(ctx);
@@ -710,6 +837,19 @@ static size_t jsonrpc_server_parse_header_finish(const event *ev,
     return (uintptr_t)result;
 }
 
+/**
+ * Ends the loop started by `jsonrpc_server_listen()`. Calls that are waiting
+ * for a response are canceled with [error], since no response will come.
+ */
+static void jsonrpc_server_stop_reading(jsonrpc_server *server, int error)
+{
+    server->is_listening = false;
+    server->is_reading = false;
+    for (iterator it = ptr_hashmap_iterator_create(server->response_events); it.has_next; it = iterator_next(it))
+        event_cancel_with_errno(((ptr_hashmap_entry *)iterator_get_item(it))->value, error);
+    ptr_hashmap_clear(server->response_events);
+}
+
 /**
  * (private API)
  *
@@ -724,7 +864,7 @@ static void jsonrpc_server_parse_header_async(jsonrpc_server *server,
                                               void           *user_data)
 {
     if (!server->is_listening) {
-        // TODO: create and cancel the event for (callback, user_data)
+        jsonrpc_server_stop_reading(server, ECONNRESET);
         return;
     }
 
@@ -746,7 +886,7 @@ static void jsonrpc_server_parse_header_async(jsonrpc_server *server,
 
 struct send_request_ctx {
     jsonrpc_server *server;
-    json_node *request_id;
+    uint64_t request_id;
     event *response_ev;
 };
 
@@ -755,42 +895,34 @@ static void jsonrpc_server_call_remote_send_message_cb(const event *send_request
 {
     struct send_request_ctx *ctx = user_data;
     jsonrpc_server *server = ctx->server;
-    json_node *request_id = ctx->request_id;
+    void *request_key = (void *)(uintptr_t)ctx->request_id;
     event *response_ev = ctx->response_ev;
 
     if (!jsonrpc_server_send_message_finish(send_request_ev, NULL)) {
         // failed to send message
-        jsonrpc_debug({
-          char *id_str = json_node_to_string(request_id, false);
-          fprintf(stderr,
-                  "[id: %s]: failed to send request: %s\n",
-                  id_str, strerror(event_get_errno(send_request_ev)));
-          free(id_str);
-        });
+        jsonrpc_debug(fprintf(stderr,
+                              "[id: %" PRIu64 "]: failed to send request: %s\n",
+                              ctx->request_id,
+                              strerror(event_get_errno(send_request_ev))));
         event_cancel_with_errno(response_ev, event_get_errno(send_request_ev));
     } else {
         // success - now get the response
-        jsonrpc_debug({
-          char *id_str = json_node_to_string(request_id, false);
-          fprintf(stderr,
-                  "[id: %s]: await jsonrpc_server_handle_response_async();\n"
-                  "callback: => jsonrpc_server_handle_response_cb();\n",
-                  id_str);
-          free(id_str);
-        });
+        jsonrpc_debug(fprintf(stderr,
+                              "[id: %" PRIu64 "]: await jsonrpc_server_handle_response_async();\n"
+                              "callback: => jsonrpc_server_handle_response_cb();\n",
+                              ctx->request_id));
 
-        ptr_hashmap_entry *query = ptr_hashmap_get(server->received_responses, request_id);
+        ptr_hashmap_entry *query = ptr_hashmap_get(server->received_responses, request_key);
         if (query) {
             // we received a response already (XXX: how?)
-            event_return(response_ev, json_node_ref(query->value));
-            ptr_hashmap_delete(server->received_responses, query->key);
+            event_return(response_ev, json_node_ref(json_object_get_member(query->value, "result")));
+            ptr_hashmap_delete(server->received_responses, request_key);
         } else {
             // no response yet exists. wait for one
-            ptr_hashmap_insert(server->response_events, request_id, response_ev);
+            ptr_hashmap_insert(server->response_events, request_key, response_ev);
         }
     }
 
-    json_node_unref(ctx->request_id);
     free(ctx);
 }
 
@@ -800,6 +932,18 @@ void jsonrpc_server_call_remote_async(jsonrpc_server *server,
                                       eventloop      *loop,
                                       async_callback  callback,
                                       void           *user_data)
+{
+    jsonrpc_server_call_remote_timed_async(server, method, parameters, NULL,
+                                           loop, callback, user_data);
+}
+
+void jsonrpc_server_call_remote_timed_async(jsonrpc_server      *server,
+                                            const char          *method,
+                                            json_node           *parameters,
+                                            jsonrpc_call_timing *timing,
+                                            eventloop           *loop,
+                                            async_callback       callback,
+                                            void                *user_data)
 {
     json_node *request_id = NULL;
     json_node *request_object =
@@ -814,11 +958,11 @@ void jsonrpc_server_call_remote_async(jsonrpc_server *server,
       free(req_obj_str);
     });
 
-    event *response_ev = eventloop_add(loop, callback, user_data);
+    event *response_ev = jsonrpc_server_add_pending_event(server, loop, callback, user_data);
 
     struct send_request_ctx *ctx;
-    box(struct send_request_ctx, ctx, server, json_node_ref(request_id),
-        response_ev);
+    box(struct send_request_ctx, ctx, server,
+        (uint64_t)json_node_cast(request_id, integer)->value, response_ev);
 
     jsonrpc_debug({
       fprintf(
@@ -826,7 +970,24 @@ void jsonrpc_server_call_remote_async(jsonrpc_server *server,
           "await jsonrpc_server_send_message_async();\n"
           "callback: => jsonrpc_server_send_request_cb();\n");
     });
-    jsonrpc_server_send_message_async(server, request_object, loop,
+    // the response may arrive before we get to wait for it, so the timing
+    // is registered before the request is sent
+    jsonrpc_timed_call *timed_call = NULL;
+    if (timing || server->stats || io_trace_is_enabled()) {
+        if (!(timed_call = calloc(1, sizeof *timed_call))) {
+            perror("failed to time JSON-RPC call");
+            abort();
+        }
+        timed_call->timing = timing ? timing : &timed_call->own_timing;
+        timed_call->method = strdup(method);
+        if (io_trace_is_enabled()) {
+            timed_call->trace_id = io_trace_new_id();
+            io_trace_async_begin("jsonrpc", method, timed_call->trace_id);
+        }
+        ptr_hashmap_insert(server->response_timings, (void *)(uintptr_t)ctx->request_id, timed_call);
+    }
+    jsonrpc_server_send_message_async(server, request_object, method,
+                                      timed_call ? &timed_call->timing->sent_time : NULL, loop,
                                       jsonrpc_server_call_remote_send_message_cb, ctx);
 }
 
@@ -876,8 +1037,10 @@ void jsonrpc_server_notify_remote_async(jsonrpc_server *server,
 {
     json_node *request_object =
         jsonrpc_server_create_request(server, method, parameters, NULL);
-    event *notify_remove_ev = eventloop_add(loop, callback, user_data);
-    jsonrpc_server_send_message_async(server, request_object, loop,
+    event *notify_remove_ev = jsonrpc_server_add_pending_event(server, loop, callback, user_data);
+    if (io_trace_is_enabled())
+        io_trace_instant("jsonrpc", method, NULL, 0);
+    jsonrpc_server_send_message_async(server, request_object, method, NULL, loop,
                                       jsonrpc_server_notify_remote_cb,
                                       notify_remove_ev);
 }
@@ -904,6 +1067,9 @@ static void jsonrpc_server_handle_request(jsonrpc_server *server,
     json_node *id = json_object_get_member(parsed_node, "id");
     json_node *params = json_object_get_member(parsed_node, "params");
     ptr_hashmap_entry *handler_entry = NULL;
+
+    if (io_trace_is_enabled())
+        io_trace_instant("jsonrpc", method_name, NULL, 0);
     if (id &&
         (handler_entry = ptr_hashmap_get(server->call_handlers, method_name))) {
         closure *cl = handler_entry->value;
@@ -927,6 +1093,23 @@ static void jsonrpc_server_handle_request(jsonrpc_server *server,
     }
 }
 
+/**
+ * Counts the message that was just parsed under [method], if the server is
+ * keeping statistics.
+ */
+static jsonrpc_method_stats *jsonrpc_server_count_received(jsonrpc_server *server,
+                                                           const char     *method)
+{
+    if (!server->stats)
+        return NULL;
+
+    jsonrpc_method_stats *stats = jsonrpc_stats_get_method(server->stats, method);
+    stats->messages_received++;
+    stats->bytes_received += server->message_size;
+    histogram_record(stats->parse_times, io_get_monotonic_time() - server->message_received_time);
+    return stats;
+}
+
 static void
 jsonrpc_server_listen_parse_node_after_header_cb(const event *node_parsed_ev,
                                                  void        *user_data) 
@@ -942,25 +1125,56 @@ jsonrpc_server_listen_parse_node_after_header_cb(const event *node_parsed_ev,
             fprintf(stderr, "finished parsing node:\n---\n%s\n---\n", node_str);
             free(node_str);
         });
+        jsonrpc_server_capture_message(server, '<', server->message_received_time, NULL, parsed_node);
+        if (io_trace_is_enabled())
+            io_trace_complete("json", "parse", server->message_received_time, io_get_monotonic_time(),
+                              "bytes", server->message_size);
         // is this a request object, a response object, or a batch of requests?
         const char *reason = NULL;
         if (jsonrpc_verify_is_request_object(parsed_node, &reason)) {
+            jsonrpc_server_count_received(server,
+                    json_node_cast(json_object_get_member(parsed_node, "method"), string)->value);
             jsonrpc_server_handle_request(server, parsed_node);
         } else if (jsonrpc_verify_is_response_object(parsed_node, &reason)) {
             // first, check if there is an event waiting on completion of this method
             json_node *id = json_object_get_member(parsed_node, "id");
             json_node *result = json_object_get_member(parsed_node, "result");
-            ptr_hashmap_entry *response_ev_entry = ptr_hashmap_get(server->response_events, id);
-            if (response_ev_entry) {
-                // complete the event by returning the parsed response
-                event *response_ev = response_ev_entry->value;
-                event_return(response_ev, json_node_ref(result));
-            } else {
-                // XXX: if there is no event, then we have a "response" without
-                //      a corresponding request?
+            void *response_key = NULL;
+            ptr_hashmap_entry *response_ev_entry = NULL;
+            ptr_hashmap_entry *timing_entry = NULL;
+            if (!jsonrpc_server_response_id_to_key(server, id, &response_key)) {
+                // we only issue integer IDs
                 jsonrpc_debug(fprintf(
-                    stderr, "received response before request. saving...\n"));
-                ptr_hashmap_insert(server->received_responses, id, parsed_node);
+                    stderr, "received response for unknown request. ignoring...\n"));
+            } else {
+                if ((timing_entry = ptr_hashmap_get(server->response_timings, response_key))) {
+                    jsonrpc_timed_call *timed_call = timing_entry->value;
+
+                    jsonrpc_method_stats *stats = NULL;
+
+                    timed_call->timing->received_time = server->message_received_time;
+                    if ((stats = jsonrpc_server_count_received(server, timed_call->method)) &&
+                            timed_call->timing->sent_time)
+                        histogram_record(stats->latencies,
+                                         timed_call->timing->received_time -
+                                         timed_call->timing->sent_time);
+                    if (timed_call->trace_id)
+                        io_trace_async_end("jsonrpc", timed_call->method, timed_call->trace_id);
+                    ptr_hashmap_delete(server->response_timings, response_key);
+                }
+
+                if ((response_ev_entry = ptr_hashmap_get(server->response_events, response_key))) {
+                    // complete the event by returning the parsed response
+                    event *response_ev = response_ev_entry->value;
+                    ptr_hashmap_delete(server->response_events, response_key);
+                    event_return(response_ev, json_node_ref(result));
+                } else {
+                    // XXX: if there is no event, then we have a "response" without
+                    //      a corresponding request?
+                    jsonrpc_debug(fprintf(
+                        stderr, "received response before request. saving...\n"));
+                    ptr_hashmap_insert(server->received_responses, response_key, parsed_node);
+                }
             }
         } else if (parsed_node->node_type == json_node_type_array) {
             // possible batched requests...
@@ -976,6 +1190,7 @@ jsonrpc_server_listen_parse_node_after_header_cb(const event *node_parsed_ev,
                         __func__, reason, representation);
                 free(representation);
                 json_node_unref(parsed_node);
+                jsonrpc_server_stop_reading(server, EPROTO);
                 return;
               }
             });
@@ -988,6 +1203,7 @@ jsonrpc_server_listen_parse_node_after_header_cb(const event *node_parsed_ev,
                     __func__, reason, representation);
             free(representation);
             json_node_unref(parsed_node);
+            jsonrpc_server_stop_reading(server, EPROTO);
             return;
         }
 
@@ -1007,6 +1223,7 @@ jsonrpc_server_listen_parse_node_after_header_cb(const event *node_parsed_ev,
                 fprintf(stderr, "parser/scanner error messages:\n");
             fprintf(stderr, " %2lu. %s\n", index + 1, msg);
         });
+        jsonrpc_server_stop_reading(server, error ? error : EPROTO);
     }
 }
 
@@ -1027,7 +1244,7 @@ jsonrpc_server_listen_parse_header_cb(const event *header_parsed_ev,
         json_parser_parse_node_async(server->parser, loop,
             jsonrpc_server_listen_parse_node_after_header_cb, server);
     } else {
-        server->is_listening = false;
+        jsonrpc_server_stop_reading(server, error ? error : ECONNRESET);
         // only report errors. no errors are EOF
         if ((server->error_code = error)) {
             fprintf(stderr, "%s: JSON-RPC server failed to listen: %s\n",
@@ -1036,6 +1253,13 @@ jsonrpc_server_listen_parse_header_cb(const event *header_parsed_ev,
     }
 }
 
+void jsonrpc_server_capture(jsonrpc_server *server, outputstream *stream)
+{
+    outputstream_unref(server->capture_stream);
+    server->capture_stream = outputstream_ref(stream);
+    server->capture_start_time = io_get_monotonic_time();
+}
+
 void jsonrpc_server_listen(jsonrpc_server *server, eventloop *loop)
 {
     assert(!jsonrpc_server_is_listening(server) && "JSON-RPC server already listening");
@@ -1043,6 +1267,7 @@ void jsonrpc_server_listen(jsonrpc_server *server, eventloop *loop)
                           "await jsonrpc_server_parse_response_header_async();\n"
                           "callback: => jsonrpc_server_listen_parse_response_header_cb()\n"));
     server->is_listening = true;
+    server->is_reading = true;
     jsonrpc_server_parse_header_async(server, loop,
                                       jsonrpc_server_listen_parse_header_cb, server);
 }
@@ -1069,5 +1294,11 @@ void jsonrpc_server_destroy(jsonrpc_server *server)
     ptr_hashmap_destroy(server->response_events);
     server->response_events = NULL;
 
+    ptr_hashmap_destroy(server->response_timings);
+    server->response_timings = NULL;
+
+    outputstream_unref(server->capture_stream);
+    server->capture_stream = NULL;
+
     free(server);
 }
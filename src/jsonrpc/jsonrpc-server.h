@@ -7,6 +7,7 @@
 #include "io/event.h"
 #include "json/json-parser.h"
 #include "json/json.h"
+#include "jsonrpc/jsonrpc-stats.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdbool.h>
@@ -21,6 +22,18 @@ enum _jsonrpc_error {
 };
 typedef enum _jsonrpc_error jsonrpc_error;
 
+/**
+ * When a call was sent to the remote and when its response arrived, from
+ * `io_get_monotonic_time()`. Both are taken at the I/O layer: the call is
+ * sent once it has been written to the output stream, and the response
+ * arrives once the first byte of its header could be read. This leaves out
+ * the time that messages spend waiting in the event loop and being parsed.
+ */
+typedef struct {
+    uint64_t sent_time;
+    uint64_t received_time;
+} jsonrpc_call_timing;
+
 struct _jsonrpc_server {
     json_parser *parser;
 
@@ -43,13 +56,25 @@ struct _jsonrpc_server {
     /**
      * The next ID that will be used when generating a request message.
      */
-    uint64_t next_request_id : sizeof(uint64_t) * CHAR_BIT - 1;
+    uint64_t next_request_id : sizeof(uint64_t) * CHAR_BIT - 2;
 
     /**
      * Whether the server is actively listening.
      */
     bool is_listening : 1;
 
+    /**
+     * Whether a message is being read. This stays set after listening stops
+     * until the read in progress finishes.
+     */
+    bool is_reading : 1;
+
+    /**
+     * The number of events for sends and calls whose callbacks have not run
+     * yet. The event loop refers to the server until they have.
+     */
+    unsigned pending_events;
+
     /**
      * The error code (see man errno(3)) of the server.
      */
@@ -62,18 +87,56 @@ struct _jsonrpc_server {
     ptr_list *received_requests;
 
     /**
-     * Received responses to JSON-RPC requests.
-     * type: `ptr_hashmap<json_node *, json_node *>`
+     * Received responses to JSON-RPC requests. Since we only issue integer
+     * IDs, the keys are the integers themselves.
+     * type: `ptr_hashmap<uint64_t, json_node *>`
      * Maps (ID) -> (response object)
      */
     ptr_hashmap *received_responses;
 
     /**
      * Events to be triggered by received responses.
-     * type: `ptr_hashmap<json_node *, event *>`
+     * type: `ptr_hashmap<uint64_t, event *>`
      * Maps (ID) -> (event)
      */
     ptr_hashmap *response_events;
+
+    /**
+     * Calls that are being timed, either because the caller asked for the
+     * times or because `stats` is set.
+     * type: `ptr_hashmap<uint64_t, jsonrpc_timed_call *>`
+     * Maps (ID) -> (timed call)
+     */
+    ptr_hashmap *response_timings;
+
+    /**
+     * If set, the messages that are sent and received asynchronously are
+     * counted here under the name of their method. Replies to the remote are
+     * not counted. Not owned by the server, so that it can be shared between
+     * servers.
+     */
+    jsonrpc_stats *stats;
+
+    /**
+     * When the first byte of the message being read arrived.
+     */
+    uint64_t message_received_time;
+
+    /**
+     * The size of the message being read, including its header.
+     */
+    size_t message_size;
+
+    /**
+     * If set, every message that is sent or received is written here. See
+     * `jsonrpc_server_capture()`.
+     */
+    outputstream *capture_stream;
+
+    /**
+     * When capturing began, from `io_get_monotonic_time()`.
+     */
+    uint64_t capture_start_time;
 };
 typedef struct _jsonrpc_server jsonrpc_server;
 
@@ -164,6 +227,19 @@ void jsonrpc_server_call_remote_async(jsonrpc_server *server,
                                       async_callback  callback,
                                       void           *user_data);
 
+/**
+ * Like `jsonrpc_server_call_remote_async()`, but also saves when the call was
+ * sent and when the response arrived to [timing], which must stay valid until
+ * `callback` is executed.
+ */
+void jsonrpc_server_call_remote_timed_async(jsonrpc_server      *server,
+                                            const char          *method,
+                                            json_node           *parameters,
+                                            jsonrpc_call_timing *timing,
+                                            eventloop           *loop,
+                                            async_callback       callback,
+                                            void                *user_data);
+
 /**
  * Completes an asynchronous remote procedure call and returns the response.
  *
@@ -200,6 +276,23 @@ void jsonrpc_server_notify_remote_async(jsonrpc_server *server,
  */
 bool jsonrpc_server_notify_remote_finish(const event *ev, int *error);
 
+/**
+ * Writes every message that is sent to or received from the remote to
+ * [stream] from now on, so that the session can be replayed later.
+ *
+ * Each message is written as a line with the direction (`>` for sent and `<`
+ * for received), the nanoseconds since capturing began, and the length of the
+ * message, followed by a line with the content of the message:
+ *
+ * ```
+ * > 1520 58
+ * {"jsonrpc":"2.0","id":0,"method":"initialize","params":{}}
+ * < 9071562 41
+ * {"jsonrpc":"2.0","id":0,"result":{}}
+ * ```
+ */
+void jsonrpc_server_capture(jsonrpc_server *server, outputstream *stream);
+
 /**
  * Begin the asynchronous handling of incoming messages. Use `eventloop_loop()`
  * after calling this function.
@@ -212,6 +305,16 @@ static inline bool jsonrpc_server_is_listening(const jsonrpc_server *server) {
     return server->is_listening;
 }
 
+/**
+ * Whether the event loop still has callbacks that refer to [server], for a
+ * message that is being read or sent or for a call that hasn't finished.
+ * Calls that are waiting for a response are canceled once the server stops
+ * listening, since no response will come.
+ */
+static inline bool jsonrpc_server_has_outstanding_io(const jsonrpc_server *server) {
+    return server->is_reading || server->pending_events > 0;
+}
+
 /**
  * Destroys the server, including any outstanding received requests.
  */
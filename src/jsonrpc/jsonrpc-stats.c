@@ -0,0 +1,110 @@
+#include "jsonrpc-stats.h"
+#include "data-structures/collection.h"
+#include "data-structures/iterator.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void jsonrpc_method_stats_destroy(jsonrpc_method_stats *method_stats)
+{
+    histogram_destroy(method_stats->latencies);
+    histogram_destroy(method_stats->parse_times);
+    histogram_destroy(method_stats->queueing_delays);
+    free(method_stats);
+}
+
+jsonrpc_stats *jsonrpc_stats_new(void)
+{
+    jsonrpc_stats *stats = calloc(1, sizeof *stats);
+
+    if (!stats) {
+        perror("failed to create JSON-RPC statistics");
+        abort();
+    }
+
+    stats->methods = ptr_hashmap_new((collection_item_hash_func) strhash,
+            NULL,
+            (collection_item_unref_func) free,
+            (collection_item_equality_func) strequal,
+            NULL,
+            (collection_item_unref_func) jsonrpc_method_stats_destroy);
+
+    return stats;
+}
+
+jsonrpc_method_stats *jsonrpc_stats_get_method(jsonrpc_stats *stats, const char *method)
+{
+    ptr_hashmap_entry *entry = ptr_hashmap_get(stats->methods, method);
+
+    if (entry)
+        return entry->value;
+
+    jsonrpc_method_stats *method_stats = calloc(1, sizeof *method_stats);
+    if (!method_stats) {
+        perror("failed to create JSON-RPC method statistics");
+        abort();
+    }
+    method_stats->latencies = histogram_new();
+    method_stats->parse_times = histogram_new();
+    method_stats->queueing_delays = histogram_new();
+    ptr_hashmap_insert(stats->methods, strdup(method), method_stats);
+
+    return method_stats;
+}
+
+static json_node *jsonrpc_stats_histogram_to_json(const histogram *hist)
+{
+    json_node *object = json_object_new();
+    json_node *buckets = json_array_new();
+
+    json_object_set_member(object, "count", json_integer_new((int64_t)hist->total_count));
+    json_object_set_member(object, "min", json_integer_new(hist->total_count ? (int64_t)hist->min : 0));
+    json_object_set_member(object, "mean", json_double_new(histogram_get_mean(hist)));
+    json_object_set_member(object, "p50", json_integer_new((int64_t)histogram_get_percentile(hist, 50)));
+    json_object_set_member(object, "p90", json_integer_new((int64_t)histogram_get_percentile(hist, 90)));
+    json_object_set_member(object, "p99", json_integer_new((int64_t)histogram_get_percentile(hist, 99)));
+    json_object_set_member(object, "max", json_integer_new((int64_t)hist->max));
+
+    for (unsigned i = 0; i < HISTOGRAM_COUNTERS; i++) {
+        if (!hist->counts[i])
+            continue;
+        json_node *bucket = json_array_new();
+        json_array_add_element(bucket, json_integer_new((int64_t)histogram_get_value_at(i)));
+        json_array_add_element(bucket, json_integer_new((int64_t)hist->counts[i]));
+        json_array_add_element(buckets, bucket);
+    }
+    json_object_set_member(object, "buckets", buckets);
+
+    return object;
+}
+
+json_node *jsonrpc_stats_to_json(const jsonrpc_stats *stats)
+{
+    json_node *methods = json_object_new();
+
+    for (iterator it = ptr_hashmap_iterator_create(stats->methods); it.has_next; it = iterator_next(it)) {
+        const ptr_hashmap_entry *entry = iterator_get_item(it);
+        const jsonrpc_method_stats *method_stats = entry->value;
+        json_node *object = json_object_new();
+
+        json_object_set_member(object, "messagesSent", json_integer_new((int64_t)method_stats->messages_sent));
+        json_object_set_member(object, "messagesReceived", json_integer_new((int64_t)method_stats->messages_received));
+        json_object_set_member(object, "bytesSent", json_integer_new((int64_t)method_stats->bytes_sent));
+        json_object_set_member(object, "bytesReceived", json_integer_new((int64_t)method_stats->bytes_received));
+        json_object_set_member(object, "latency", jsonrpc_stats_histogram_to_json(method_stats->latencies));
+        json_object_set_member(object, "parseTime", jsonrpc_stats_histogram_to_json(method_stats->parse_times));
+        json_object_set_member(object, "queueingDelay", jsonrpc_stats_histogram_to_json(method_stats->queueing_delays));
+        json_object_set_member(methods, entry->key, object);
+    }
+
+    return methods;
+}
+
+void jsonrpc_stats_destroy(jsonrpc_stats *stats)
+{
+    if (!stats)
+        return;
+    ptr_hashmap_destroy(stats->methods);
+    free(stats);
+}
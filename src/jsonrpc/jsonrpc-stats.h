@@ -0,0 +1,59 @@
+#pragma once
+
+#include "data-structures/histogram.h"
+#include "data-structures/ptr-hashmap.h"
+#include "json/json.h"
+#include <stdint.h>
+
+/**
+ * What was sent and received for one method. All times are in nanoseconds.
+ */
+typedef struct {
+    uint64_t messages_sent;
+    uint64_t messages_received;
+    uint64_t bytes_sent;
+    uint64_t bytes_received;
+
+    /**
+     * From a call being sent to its response arriving.
+     */
+    histogram *latencies;
+
+    /**
+     * From the first byte of a received message to the message being parsed.
+     * For a response, this is counted under the method of the call.
+     */
+    histogram *parse_times;
+
+    /**
+     * From a message being queued to it being written to the output stream.
+     */
+    histogram *queueing_delays;
+} jsonrpc_method_stats;
+
+/**
+ * Statistics kept by JSON-RPC servers, which can be shared between servers.
+ */
+typedef struct {
+    /**
+     * type: `ptr_hashmap<char *, jsonrpc_method_stats *>`
+     * Maps (method name) -> (statistics)
+     */
+    ptr_hashmap *methods;
+} jsonrpc_stats;
+
+jsonrpc_stats *jsonrpc_stats_new(void);
+
+/**
+ * Gets the statistics for [method], creating them if there are none yet.
+ */
+jsonrpc_method_stats *jsonrpc_stats_get_method(jsonrpc_stats *stats, const char *method);
+
+/**
+ * Converts the statistics to a JSON object with a member for each method.
+ * Histograms are given as a summary along with the count in each non-empty
+ * bucket, as `[highest value in the bucket, count]` pairs.
+ */
+json_node *jsonrpc_stats_to_json(const jsonrpc_stats *stats);
+
+void jsonrpc_stats_destroy(jsonrpc_stats *stats);
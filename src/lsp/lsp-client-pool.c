@@ -0,0 +1,161 @@
+#include "lsp-client-pool.h"
+#include "io/io-common.h"
+#include "jsonrpc/jsonrpc-server.h"
+#include "lstf-common.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+lsp_client_pool *lsp_client_pool_new(void)
+{
+    lsp_client_pool *pool = calloc(1, sizeof *pool);
+
+    if (!pool) {
+        perror("failed to create LSP client pool");
+        abort();
+    }
+
+    pool->loop = eventloop_new();
+    array_init(&pool->entries);
+
+    return pool;
+}
+
+static lsp_client_pool_entry *
+lsp_client_pool_find(lsp_client_pool *pool, const lsp_client *client)
+{
+    for (size_t i = 0; i < pool->entries.length; i++)
+        if (pool->entries.elements[i].client == client)
+            return &pool->entries.elements[i];
+    return NULL;
+}
+
+static void lsp_client_pool_entry_retire(lsp_client_pool_entry *entry)
+{
+    entry->in_use = false;
+    entry->retired = true;
+    entry->retired_time = io_get_monotonic_time();
+    if (!io_terminate(entry->process) && errno != ESRCH)
+        fprintf(stderr, "warning: failed to terminate server `%s': %s\n",
+                entry->server_path, strerror(errno));
+}
+
+lsp_client *lsp_client_pool_take(lsp_client_pool *pool,
+                                 const char      *server_path,
+                                 const char      *project_root)
+{
+    for (size_t i = 0; i < pool->entries.length; i++) {
+        lsp_client_pool_entry *entry = &pool->entries.elements[i];
+
+        if (entry->in_use || entry->retired ||
+                strcmp(entry->server_path, server_path) != 0 ||
+                strcmp(entry->project_root, project_root) != 0)
+            continue;
+
+        // the server may have exited while it was waiting in the pool
+        if (!jsonrpc_server_is_listening(super(entry->client))) {
+            lsp_client_pool_entry_retire(entry);
+            continue;
+        }
+
+        entry->in_use = true;
+        return entry->client;
+    }
+
+    return NULL;
+}
+
+void lsp_client_pool_add(lsp_client_pool *pool,
+                         const char      *server_path,
+                         const char      *project_root,
+                         lsp_client      *client,
+                         io_process       process)
+{
+    lsp_client_pool_entry entry = {
+        .server_path = strdup(server_path),
+        .project_root = strdup(project_root),
+        .client = client,
+        .process = process,
+        .in_use = true
+    };
+
+    if (!entry.server_path || !entry.project_root) {
+        perror("failed to add LSP client to pool");
+        abort();
+    }
+    array_add(&pool->entries, entry);
+}
+
+void lsp_client_pool_release(lsp_client_pool *pool, lsp_client *client)
+{
+    lsp_client_pool_entry *entry = lsp_client_pool_find(pool, client);
+
+    assert(entry && entry->in_use && "releasing a client that was not taken from the pool");
+    if (lsp_client_reset(client))
+        entry->in_use = false;
+    else
+        lsp_client_pool_entry_retire(entry);
+}
+
+void lsp_client_pool_retire(lsp_client_pool *pool, lsp_client *client)
+{
+    lsp_client_pool_entry *entry = lsp_client_pool_find(pool, client);
+
+    assert(entry && entry->in_use && "retiring a client that was not taken from the pool");
+    super(client)->stats = NULL;
+    lsp_client_pool_entry_retire(entry);
+}
+
+static void lsp_client_pool_entry_destroy(lsp_client_pool_entry *entry)
+{
+    lsp_client_destroy(entry->client);
+    free(entry->server_path);
+    free(entry->project_root);
+}
+
+bool lsp_client_pool_collect(lsp_client_pool *pool)
+{
+    const uint64_t now = io_get_monotonic_time();
+    bool has_retired = false;
+
+    for (size_t i = 0; i < pool->entries.length; ) {
+        lsp_client_pool_entry *entry = &pool->entries.elements[i];
+
+        if (!entry->retired) {
+            i++;
+            continue;
+        }
+
+        if (!entry->client->server_exited && !entry->killed &&
+                now - entry->retired_time >= LSP_CLIENT_POOL_KILL_TIMEOUT) {
+            // the event loop reaps the server once it exits
+            if (!io_kill(entry->process) && errno != ESRCH)
+                fprintf(stderr, "warning: failed to kill server `%s': %s\n",
+                        entry->server_path, strerror(errno));
+            entry->killed = true;
+        }
+
+        if (lsp_client_has_outstanding_io(entry->client)) {
+            has_retired = true;
+            i++;
+            continue;
+        }
+
+        lsp_client_pool_entry_destroy(entry);
+        array_remove(&pool->entries, i);
+    }
+
+    return has_retired;
+}
+
+void lsp_client_pool_destroy(lsp_client_pool *pool)
+{
+    // the event loop refers to the clients, so it goes first
+    eventloop_destroy(pool->loop);
+    for (size_t i = 0; i < pool->entries.length; i++)
+        lsp_client_pool_entry_destroy(&pool->entries.elements[i]);
+    array_destroy(&pool->entries);
+    free(pool);
+}
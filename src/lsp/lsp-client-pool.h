@@ -0,0 +1,105 @@
+#pragma once
+
+#include "data-structures/array.h"
+#include "io/event.h"
+#include "io/io-process.h"
+#include "lsp-client.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * A language server that was started by the pool.
+ */
+typedef struct {
+    char *server_path;
+    char *project_root;
+    lsp_client *client;
+    io_process process;
+
+    /**
+     * Whether the client has been taken from the pool and not released yet.
+     */
+    bool in_use;
+
+    /**
+     * Whether the server has gone away or was terminated. The client is kept
+     * until the event loop no longer refers to it, and then freed by
+     * `lsp_client_pool_collect()`.
+     */
+    bool retired;
+
+    /**
+     * Whether the server was killed after not exiting in time.
+     */
+    bool killed;
+
+    /**
+     * When the server was retired, from `io_get_monotonic_time()`.
+     */
+    uint64_t retired_time;
+} lsp_client_pool_entry;
+
+/**
+ * How long a retired server has to exit after being asked to before it is
+ * killed, in nanoseconds.
+ */
+#define LSP_CLIENT_POOL_KILL_TIMEOUT 5000000000
+
+/**
+ * Keeps initialized language servers running between sessions, so that a
+ * session can reuse a server instead of starting and initializing a new one.
+ * Servers are told apart by their path and the project root they were
+ * initialized with.
+ *
+ * Clients in the pool must run on the pool's event loop.
+ */
+typedef struct {
+    eventloop *loop;
+    array(lsp_client_pool_entry) entries;
+} lsp_client_pool;
+
+lsp_client_pool *lsp_client_pool_new(void);
+
+/**
+ * Takes a client for an initialized server at [server_path] that was started
+ * for [project_root], or returns `NULL` if there is none that is not in use.
+ */
+lsp_client *lsp_client_pool_take(lsp_client_pool *pool,
+                                 const char      *server_path,
+                                 const char      *project_root);
+
+/**
+ * Adds a new client to the pool, taken. [client] must have been created on
+ * the pool's event loop.
+ */
+void lsp_client_pool_add(lsp_client_pool *pool,
+                         const char      *server_path,
+                         const char      *project_root,
+                         lsp_client      *client,
+                         io_process       process);
+
+/**
+ * Gives a taken client back to the pool after resetting it with
+ * `lsp_client_reset()`. If the client cannot be reset, it is retired.
+ */
+void lsp_client_pool_release(lsp_client_pool *pool, lsp_client *client);
+
+/**
+ * Terminates the server of a taken client and never hands it out again.
+ */
+void lsp_client_pool_retire(lsp_client_pool *pool, lsp_client *client);
+
+/**
+ * Kills retired servers that haven't exited in time, and frees the clients of
+ * retired servers that have exited once nothing on the event loop refers to
+ * them. This should be called regularly while the event loop runs.
+ *
+ * @return whether there are retired clients left to free
+ */
+bool lsp_client_pool_collect(lsp_client_pool *pool);
+
+/**
+ * Destroys the event loop and every client, which also makes the servers
+ * exit.
+ */
+void lsp_client_pool_destroy(lsp_client_pool *pool);
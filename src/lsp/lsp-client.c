@@ -3,10 +3,12 @@
 #include "io/event.h"
 #include "io/io-common.h"
 #include "jsonrpc/jsonrpc-server.h"
+#include "util.h"
 #include "version.h"
 #include "json/json-serializable.h"
 #include "json/json.h"
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -90,6 +92,37 @@ lsp_publishdiagnosticsparams_serialize_property(const lsp_publishdiagnosticspara
     abort();
 }
 
+/**
+ * Whether diagnostics published for [version] of a document satisfy a waiter.
+ * Either may be `-1` if there is no version.
+ */
+static bool lsp_client_diagnostics_version_matches(int64_t waiter_version,
+                                                   int64_t version)
+{
+    return waiter_version < 0 || version < 0 || version >= waiter_version;
+}
+
+/**
+ * Gets the document version from `PublishDiagnosticsParams`, or `-1`.
+ */
+static int64_t lsp_client_diagnostics_get_version(json_node *parameters)
+{
+    json_node *version = json_object_get_member(parameters, "version");
+
+    if (version && version->node_type == json_node_type_integer)
+        return ((json_integer *)version)->value;
+    return -1;
+}
+
+static void lsp_diagnostics_waiter_destroy(lsp_diagnostics_waiter *waiter)
+{
+    while (waiter) {
+        lsp_diagnostics_waiter *next = waiter->next;
+        free(waiter);
+        waiter = next;
+    }
+}
+
 static void 
 lsp_client_handle_publish_diagnostics(jsonrpc_server *server,
                                       const char     *method,
@@ -100,17 +133,81 @@ lsp_client_handle_publish_diagnostics(jsonrpc_server *server,
     (void) method;
 
     lsp_client *client = (lsp_client *)server;
+    json_node *uri = parameters ? json_object_get_member(parameters, "uri") : NULL;
+
+    if (!uri || uri->node_type != json_node_type_string) {
+        fprintf(stderr, "%s: ignoring diagnostics without a URI\n", __func__);
+        return;
+    }
 
-    if (client->diagnostics_waiters.length > 0) {
-        for (size_t i = client->diagnostics_waiters.length; i > 0; --i) {
-            event *ev = client->diagnostics_waiters.elements[i-1];
-            event_return(ev, json_node_ref(parameters));
-            array_remove(&client->diagnostics_waiters, i-1);
+    const char *uri_str = ((json_string *)uri)->value;
+    int64_t version = lsp_client_diagnostics_get_version(parameters);
+    ptr_hashmap_entry *waiters_entry = ptr_hashmap_get(client->diagnostics_waiters, uri_str);
+    bool delivered = false;
+
+    if (waiters_entry) {
+        // wake up only the waiters for this document (and version)
+        lsp_diagnostics_waiter **link = (lsp_diagnostics_waiter **)&waiters_entry->value;
+
+        while (*link) {
+            lsp_diagnostics_waiter *waiter = *link;
+
+            if (lsp_client_diagnostics_version_matches(waiter->version, version)) {
+                event_return(waiter->ev, json_node_ref(parameters));
+                *link = waiter->next;
+                free(waiter);
+                delivered = true;
+            } else {
+                link = &waiter->next;
+            }
         }
+
+        if (!waiters_entry->value)
+            ptr_hashmap_delete(client->diagnostics_waiters, waiters_entry->key);
+    }
+
+    ptr_hashmap_entry *results_entry = ptr_hashmap_get(client->diagnostics_results, uri_str);
+
+    if (delivered) {
+        // anything saved before is older
+        if (results_entry)
+            ptr_hashmap_delete(client->diagnostics_results, results_entry->key);
+    } else if (results_entry) {
+        // no waiters. save for later, replacing older diagnostics
+        ptr_hashmap_entry_set_value(client->diagnostics_results, results_entry, parameters);
     } else {
-        // no waiters. save for later.
-        ptr_list_append(client->diagnostics_results, parameters);
+        ptr_hashmap_insert(client->diagnostics_results, strdup(uri_str), parameters);
+    }
+}
+
+static void
+lsp_client_handle_progress(jsonrpc_server *server,
+                           const char     *method,
+                           json_node      *parameters,
+                           void           *user_data)
+{
+    assert(!user_data && "unexpected user data");
+    (void) method;
+
+    lsp_client *client = (lsp_client *)server;
+    json_node *token = parameters ? json_object_get_member(parameters, "token") : NULL;
+    json_node *value = parameters ? json_object_get_member(parameters, "value") : NULL;
+
+    // we only create string tokens, so anything else is progress we never
+    // asked for
+    if (!token || token->node_type != json_node_type_string || !value)
+        return;
+
+    ptr_hashmap_entry *handler_entry =
+        ptr_hashmap_get(client->partial_result_handlers, ((json_string *)token)->value);
+
+    if (!handler_entry) {
+        fprintf(stderr, "%s: ignoring progress for unknown token `%s'\n", __func__,
+                ((json_string *)token)->value);
+        return;
     }
+
+    closure_vinvoke((closure *)handler_entry->value, lsp_partial_result_handler, client, value);
 }
 
 static void lsp_client_server_disconnected(const event *disconnect_ev,
@@ -128,8 +225,50 @@ static void lsp_client_server_disconnected(const event *disconnect_ev,
                 disconnect_ev->process);
     }
     fprintf(stderr, "%s: disconnecting ...\n", __func__);
-    // TODO: track and cancel all outstanding LSP events
+    client->server_exited = true;
     super(client)->is_listening = false;
+
+    // no diagnostics will come anymore. requests waiting for a response are
+    // canceled once the JSON-RPC server stops reading
+    for (iterator it = ptr_hashmap_iterator_create(client->diagnostics_waiters); it.has_next; it = iterator_next(it))
+        for (lsp_diagnostics_waiter *waiter = ((ptr_hashmap_entry *)iterator_get_item(it))->value;
+                waiter; waiter = waiter->next)
+            event_cancel_with_errno(waiter->ev, ECONNRESET);
+    ptr_hashmap_clear(client->diagnostics_waiters);
+}
+
+typedef struct {
+    lsp_client    *client;
+    async_callback callback;
+    void          *callback_data;
+} lsp_client_pending_event_data;
+
+static void lsp_client_pending_event_cb(const event *ev, void *user_data)
+{
+    lsp_client_pending_event_data *data = user_data;
+    async_callback callback = data->callback;
+    void *callback_data = data->callback_data;
+
+    // the callback may destroy the client
+    data->client->pending_events--;
+    free(data);
+    callback(ev, callback_data);
+}
+
+/**
+ * Adds an event to [loop] that is counted in `pending_events` until its
+ * callback runs.
+ */
+static event *lsp_client_add_pending_event(lsp_client    *client,
+                                           eventloop     *loop,
+                                           async_callback callback,
+                                           void          *callback_data)
+{
+    lsp_client_pending_event_data *data;
+
+    box(lsp_client_pending_event_data, data, client, callback, callback_data);
+    client->pending_events++;
+    return eventloop_add(loop, lsp_client_pending_event_cb, data);
 }
 
 lsp_client *lsp_client_new(eventloop    *loop,
@@ -147,13 +286,33 @@ lsp_client *lsp_client_new(eventloop    *loop,
     jsonrpc_server_init(super(client), istream, ostream);
     array_init(&client->docs);
     client->diagnostics_results =
-        ptr_list_new((collection_item_ref_func)json_node_ref,
-                     (collection_item_unref_func)json_node_unref);
-    array_init(&client->diagnostics_waiters);
+        ptr_hashmap_new((collection_item_hash_func) strhash,
+                        NULL,
+                        (collection_item_unref_func) free,
+                        (collection_item_equality_func) strequal,
+                        (collection_item_ref_func) json_node_ref,
+                        (collection_item_unref_func) json_node_unref);
+    client->diagnostics_waiters =
+        ptr_hashmap_new((collection_item_hash_func) strhash,
+                        NULL,
+                        (collection_item_unref_func) free,
+                        (collection_item_equality_func) strequal,
+                        NULL,
+                        (collection_item_unref_func) lsp_diagnostics_waiter_destroy);
+    client->partial_result_handlers =
+        ptr_hashmap_new((collection_item_hash_func) strhash,
+                        NULL,
+                        (collection_item_unref_func) free,
+                        (collection_item_equality_func) strequal,
+                        NULL,
+                        (collection_item_unref_func) closure_destroy);
 
     jsonrpc_server_handle_notification(super(client), 
             "textDocument/publishDiagnostics",
             lsp_client_handle_publish_diagnostics, NULL, NULL);
+    jsonrpc_server_handle_notification(super(client),
+            "$/progress",
+            lsp_client_handle_progress, NULL, NULL);
 
     jsonrpc_server_listen(super(client), loop);
 
@@ -173,24 +332,91 @@ void lsp_client_destroy(lsp_client *client)
     client->initialize_params.client_info.version = NULL;
 
     assert(client->docs.nofree);
+    for (size_t i = 0; i < client->docs.length; i++)
+        lsp_document_dtor(&client->docs.elements[i]);
     array_destroy(&client->docs);
 
-    ptr_list_destroy(client->diagnostics_results);
-
-    assert(client->diagnostics_waiters.nofree);
-    array_destroy(&client->diagnostics_waiters);
+    ptr_hashmap_destroy(client->diagnostics_results);
+    ptr_hashmap_destroy(client->diagnostics_waiters);
+    ptr_hashmap_destroy(client->partial_result_handlers);
 
     jsonrpc_server_destroy((jsonrpc_server *)client);
 }
 
+bool lsp_client_reset(lsp_client *client)
+{
+    if (!lsp_client_is_initialized(client) ||
+            !jsonrpc_server_is_listening(super(client)) ||
+            !ptr_hashmap_is_empty(super(client)->response_events) ||
+            !ptr_hashmap_is_empty(client->diagnostics_waiters) ||
+            !ptr_hashmap_is_empty(client->partial_result_handlers))
+        return false;
+
+    for (size_t i = 0; i < client->docs.length; i++) {
+        lsp_textdocument *document = &client->docs.elements[i];
+
+        if (document->is_open) {
+            json_node *text_document = json_object_new();
+            json_object_set_member(text_document, "uri", json_string_new(document->uri));
+            json_node *parameters = json_object_new();
+            json_object_set_member(parameters, "textDocument", text_document);
+            jsonrpc_server_notify_remote(super(client), "textDocument/didClose", parameters);
+        }
+        lsp_document_dtor(document);
+    }
+    client->docs.length = 0;
+
+    ptr_hashmap_clear(client->diagnostics_results);
+    ptr_hashmap_delete(super(client)->notif_handlers, "window/showMessage");
+    super(client)->stats = NULL;
+    outputstream_unref(super(client)->capture_stream);
+    super(client)->capture_stream = NULL;
+
+    return true;
+}
+
+/**
+ * Gets the `TextDocumentSyncKind` for changes from the `InitializeResult`,
+ * which is `None` if the server did not say.
+ */
+static lsp_textdocumentsynckind
+lsp_client_get_text_document_sync(json_node *result)
+{
+    json_node *capabilities = result ? json_object_get_member(result, "capabilities") : NULL;
+    json_node *sync = capabilities ? json_object_get_member(capabilities, "textDocumentSync") : NULL;
+    lsp_textdocumentsynckind kind = lsp_textdocumentsynckind_none;
+
+    // this is either a TextDocumentSyncKind or TextDocumentSyncOptions
+    if (sync && sync->node_type == json_node_type_object)
+        sync = json_object_get_member(sync, "change");
+    if (sync && json_deserialize(lsp_textdocumentsynckind, &kind, sync))
+        kind = lsp_textdocumentsynckind_none;
+
+    return kind;
+}
+
+typedef struct {
+    lsp_client *client;
+    event      *initialize_server_ev;
+} lsp_client_initialize_data;
+
 static void lsp_client_initialize_jsonrpc_call_remote_cb(const event *ev, void *user_data)
 {
-    event *initialize_server_ev = user_data;
+    lsp_client_initialize_data *data = user_data;
+    lsp_client *client = data->client;
+    event *initialize_server_ev = data->initialize_server_ev;
     void *result = NULL;
 
+    free(data);
     if (event_get_result(ev, &result)) {
+        client->text_document_sync = lsp_client_get_text_document_sync(result);
         event_return(initialize_server_ev, result);
     } else {
+        // the server is not initialized after all
+        free(client->initialize_params.root_path);
+        free(client->initialize_params.client_info.name);
+        free(client->initialize_params.client_info.version);
+        client->initialize_params = (lsp_initializeparams) {0};
         event_cancel_with_errno(initialize_server_ev, event_get_errno(ev));
     }
 }
@@ -218,14 +444,15 @@ void lsp_client_initialize_server_async(lsp_client    *client,
         json_serialize(lsp_initializeparams, &client->initialize_params, &parameters);
     assert(status == json_serialization_status_continue && "failed to serialize initialize parameters");
 
-    event *initialize_server_ev = eventloop_add(loop, callback, callback_data);
+    lsp_client_initialize_data *data;
+    box(lsp_client_initialize_data, data, client, lsp_client_add_pending_event(client, loop, callback, callback_data));
 
     jsonrpc_server_call_remote_async(super(client),
                                      "initialize",
                                      parameters,
                                      loop,
                                      lsp_client_initialize_jsonrpc_call_remote_cb,
-                                     initialize_server_ev);
+                                     data);
 }
 
 json_node *lsp_client_initialize_server_finish(const event *ev, int *const error)
@@ -244,21 +471,21 @@ json_node *lsp_client_initialize_server_finish(const event *ev, int *const error
 }
 
 static void
-lsp_client_text_document_open_jsonrpc_server_notify_cb(const event *ev,
-                                                       void        *user_data) 
+lsp_client_text_document_jsonrpc_server_notify_cb(const event *ev,
+                                                  void        *user_data)
 {
-    event *td_open_sent_ev = user_data;
+    event *td_notification_sent_ev = user_data;
     int errnum = 0;
 
     if (jsonrpc_server_notify_remote_finish(ev, &errnum)) {
-        event_return(td_open_sent_ev, NULL);
+        event_return(td_notification_sent_ev, NULL);
     } else {
-        event_cancel_with_errno(td_open_sent_ev, errnum);
+        event_cancel_with_errno(td_notification_sent_ev, errnum);
     }
 }
 
 void lsp_client_text_document_open_async(lsp_client             *client,
-                                         lsp_textdocument const *text_document,
+                                         lsp_textdocument       *text_document,
                                          eventloop              *loop,
                                          async_callback          callback,
                                          void                   *callback_data)
@@ -275,12 +502,13 @@ void lsp_client_text_document_open_async(lsp_client             *client,
     json_node *parameters = json_object_new();
     json_object_set_member(parameters, "textDocument", td_json);
 
-    event *textdocument_open_ev = eventloop_add(loop, callback, callback_data);
+    text_document->is_open = true;
+    event *textdocument_open_ev = lsp_client_add_pending_event(client, loop, callback, callback_data);
     jsonrpc_server_notify_remote_async(super(client),
                                        "textDocument/didOpen",
                                        parameters,
                                        loop,
-                                       lsp_client_text_document_open_jsonrpc_server_notify_cb,
+                                       lsp_client_text_document_jsonrpc_server_notify_cb,
                                        textdocument_open_ev);
 }
 
@@ -293,7 +521,167 @@ bool lsp_client_text_document_open_finish(event const *ev, int *error)
     return false;
 }
 
+void lsp_client_text_document_change_async(lsp_client                               *client,
+                                           lsp_textdocument                         *text_document,
+                                           const lsp_textdocumentcontentchangeevent *changes,
+                                           size_t                                    num_changes,
+                                           eventloop                                *loop,
+                                           async_callback                            callback,
+                                           void                                     *callback_data)
+{
+    assert(lsp_client_is_initialized(client) &&
+           "invoking textDocument/didChange with uninitialized server!");
+
+    json_node *content_changes = json_array_new();
+
+    for (size_t i = 0; i < num_changes; i++) {
+        lsp_textdocument_apply_change(text_document, &changes[i]);
+
+        if (client->text_document_sync == lsp_textdocumentsynckind_incremental) {
+            json_node *change_json = NULL;
+            json_serialization_status status =
+                json_serialize(lsp_textdocumentcontentchangeevent, &changes[i], &change_json);
+            assert(status == json_serialization_status_continue &&
+                   "failed to serialize text document change");
+            json_array_add_element(content_changes, change_json);
+        }
+    }
+    text_document->version++;
+
+    event *textdocument_change_ev = lsp_client_add_pending_event(client, loop, callback, callback_data);
+
+    if (client->text_document_sync == lsp_textdocumentsynckind_none) {
+        // the server does not want to know
+        json_node_unref(content_changes);
+        event_return(textdocument_change_ev, NULL);
+        return;
+    }
+
+    if (client->text_document_sync == lsp_textdocumentsynckind_full) {
+        char *text = piece_table_get_text(text_document->text);
+        json_node *change_json = json_object_new();
+
+        json_object_set_member(change_json, "text", json_string_new(text));
+        json_array_add_element(content_changes, change_json);
+        free(text);
+    }
+
+    json_node *td_json = json_object_new();
+    json_object_set_member(td_json, "uri", json_string_new(text_document->uri));
+    json_object_set_member(td_json, "version", json_integer_new(text_document->version));
+
+    json_node *parameters = json_object_new();
+    json_object_set_member(parameters, "textDocument", td_json);
+    json_object_set_member(parameters, "contentChanges", content_changes);
+
+    jsonrpc_server_notify_remote_async(super(client),
+                                       "textDocument/didChange",
+                                       parameters,
+                                       loop,
+                                       lsp_client_text_document_jsonrpc_server_notify_cb,
+                                       textdocument_change_ev);
+}
+
+bool lsp_client_text_document_change_finish(event const *ev, int *error)
+{
+    if (event_get_result(ev, NULL))
+        return true;
+    if (error)
+        *error = event_get_errno(ev);
+    return false;
+}
+
+typedef struct {
+    lsp_client *client;
+
+    /**
+     * The `partialResultToken` of the request, or `NULL` if partial results
+     * were not requested.
+     */
+    char       *token;
+    event      *completion_ev;
+} lsp_client_completion_data;
+
+static void lsp_client_completion_jsonrpc_call_remote_cb(const event *ev, void *user_data)
+{
+    lsp_client_completion_data *data = user_data;
+    int errnum = 0;
+    json_node *result = jsonrpc_server_call_remote_finish(ev, &errnum);
+
+    // no more partial results can arrive after the response
+    if (data->token)
+        ptr_hashmap_delete(data->client->partial_result_handlers, data->token);
+
+    if (result)
+        event_return(data->completion_ev, result);
+    else
+        // the server responded with an error
+        event_cancel_with_errno(data->completion_ev, errnum ? errnum : EPROTO);
+
+    free(data->token);
+    free(data);
+}
+
+void lsp_client_text_document_completion_async(lsp_client                *client,
+                                               const char                *uri,
+                                               lsp_position               position,
+                                               lsp_partial_result_handler partial_result_handler,
+                                               void                      *partial_result_data,
+                                               eventloop                 *loop,
+                                               async_callback             callback,
+                                               void                      *callback_data)
+{
+    assert(lsp_client_is_initialized(client) &&
+           "invoking textDocument/completion with uninitialized server!");
+
+    json_node *td_json = json_object_new();
+    json_object_set_member(td_json, "uri", json_string_new(uri));
+
+    json_node *position_json = NULL;
+    json_serialization_status status = json_serialize(lsp_position, &position, &position_json);
+    assert(status == json_serialization_status_continue && "failed to serialize position");
+
+    json_node *parameters = json_object_new();
+    json_object_set_member(parameters, "textDocument", td_json);
+    json_object_set_member(parameters, "position", position_json);
+
+    lsp_client_completion_data *data;
+    box(lsp_client_completion_data, data, client, NULL, lsp_client_add_pending_event(client, loop, callback, callback_data));
+
+    if (partial_result_handler) {
+        char token[64];
+
+        snprintf(token, sizeof token, "lstf/partial/%u", client->next_partial_result_token++);
+        data->token = strdup(token);
+        ptr_hashmap_insert(client->partial_result_handlers, strdup(token),
+                closure_new((closure_func)partial_result_handler, partial_result_data, NULL));
+        json_object_set_member(parameters, "partialResultToken", json_string_new(token));
+    }
+
+    jsonrpc_server_call_remote_async(super(client),
+                                     "textDocument/completion",
+                                     parameters,
+                                     loop,
+                                     lsp_client_completion_jsonrpc_call_remote_cb,
+                                     data);
+}
+
+json_node *lsp_client_text_document_completion_finish(const event *ev, int *error)
+{
+    void *result = NULL;
+
+    if (!event_get_result(ev, &result)) {
+        if (error)
+            *error = event_get_errno(ev);
+        return NULL;
+    }
+
+    return result;
+}
+
 void lsp_client_wait_for_diagnostics_async(lsp_client    *client,
+                                           const char    *uri,
+                                           int64_t        version,
                                            eventloop     *loop,
                                            async_callback callback,
                                            void          *callback_data)
@@ -301,22 +689,35 @@ void lsp_client_wait_for_diagnostics_async(lsp_client    *client,
     assert(lsp_client_is_initialized(client) &&
            "waiting for diagnostic results with uninitialized server!");
 
-    event *diagnostics_ready_ev = eventloop_add(loop, callback, callback_data);
-    array_add(&client->diagnostics_waiters, diagnostics_ready_ev);
-
-    // drain container of diagnostics
-    // NOTE: can't use foreach() here because we have an extra condition check
-    for (iterator it = ptr_list_iterator_create(client->diagnostics_results);
-         it.has_next && client->diagnostics_waiters.length > 0;
-         it = iterator_next(it)) {
-        json_node *params_json = iterator_get_item(it); // FIXME: should we return ptr_list_node instead?
-        for (unsigned j = client->diagnostics_waiters.length; j > 0; --j) {
-            // return the parameter JSON
-            event_return(client->diagnostics_waiters.elements[j-1], params_json);
-            array_remove(&client->diagnostics_waiters, j-1);
-        }
-        ptr_list_node *list_node = it.data; // FIXME: this should be opaque!!!
-        ptr_list_remove_link(client->diagnostics_results, list_node);
+    event *diagnostics_ready_ev = lsp_client_add_pending_event(client, loop, callback, callback_data);
+    ptr_hashmap_entry *results_entry = ptr_hashmap_get(client->diagnostics_results, uri);
+
+    if (results_entry &&
+            lsp_client_diagnostics_version_matches(version,
+                lsp_client_diagnostics_get_version(results_entry->value))) {
+        // the diagnostics already arrived
+        event_return(diagnostics_ready_ev, json_node_ref(results_entry->value));
+        ptr_hashmap_delete(client->diagnostics_results, results_entry->key);
+        return;
+    }
+
+    lsp_diagnostics_waiter *waiter = calloc(1, sizeof *waiter);
+    if (!waiter) {
+        perror("failed to create diagnostics waiter");
+        abort();
+    }
+    waiter->ev = diagnostics_ready_ev;
+    waiter->version = version;
+
+    // append to the waiters for this document
+    ptr_hashmap_entry *waiters_entry = ptr_hashmap_get(client->diagnostics_waiters, uri);
+    if (waiters_entry) {
+        lsp_diagnostics_waiter *last = waiters_entry->value;
+        while (last->next)
+            last = last->next;
+        last->next = waiter;
+    } else {
+        ptr_hashmap_insert(client->diagnostics_waiters, strdup(uri), waiter);
     }
 }
 
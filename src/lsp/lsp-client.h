@@ -4,9 +4,11 @@
 #include "jsonrpc/jsonrpc-server.h"
 #include "io/event.h"
 #include "data-structures/array.h"
+#include "data-structures/ptr-hashmap.h"
 #include "json/json-serializable.h"
 #include "lsp-textdocument.h"
 #include "lsp-diagnostic.h"
+#include "lsp-position.h"
 #include "lsp-window.h"
 #include <stdbool.h>
 
@@ -53,6 +55,26 @@ lsp_publishdiagnosticsparams_clear(lsp_publishdiagnosticsparams *params)
     array_destroy(&params->diagnostics);
 }
 
+typedef struct _lsp_diagnostics_waiter lsp_diagnostics_waiter;
+
+/**
+ * A pending wait for the diagnostics of one text document.
+ */
+struct _lsp_diagnostics_waiter {
+    event *ev;
+
+    /**
+     * The version of the document that the diagnostics must be for, or `-1`
+     * to accept diagnostics for any version.
+     */
+    int64_t version;
+
+    /**
+     * The next waiter for the same document.
+     */
+    lsp_diagnostics_waiter *next;
+};
+
 typedef struct {
     jsonrpc_server parent_struct;
 
@@ -60,16 +82,63 @@ typedef struct {
 
     array(lsp_textdocument) docs;
 
-    // ptr_list<json_node *>
-    ptr_list *diagnostics_results;
+    /**
+     * How the server wants documents to be synchronized after they are
+     * opened, from the capabilities it responded to `initialize` with.
+     */
+    lsp_textdocumentsynckind text_document_sync;
 
     /**
-     * Waiters for `textDocument/publishDiagnostics` notification.
+     * The latest `PublishDiagnosticsParams` that nobody has waited for yet,
+     * for each document.
+     *
+     * `ptr_hashmap<char *uri, json_node *>`
+     */
+    ptr_hashmap *diagnostics_results;
+
+    /**
+     * Waiters for the `textDocument/publishDiagnostics` notification, in the
+     * order they started waiting, for each document.
+     *
+     * `ptr_hashmap<char *uri, lsp_diagnostics_waiter *>`
+     *
      * @see lsp_client_wait_for_diagnostics_async
      */
-    array(event *) diagnostics_waiters;
+    ptr_hashmap *diagnostics_waiters;
+
+    /**
+     * Handlers for the partial results that the server streams with `$/progress`
+     * for requests that are still waiting for a response.
+     *
+     * `ptr_hashmap<char *token, closure *>`
+     */
+    ptr_hashmap *partial_result_handlers;
+
+    /**
+     * Used to generate the `partialResultToken` of the next request.
+     */
+    unsigned next_partial_result_token;
+
+    /**
+     * The number of events for requests and notifications whose callbacks
+     * have not run yet.
+     */
+    unsigned pending_events;
+
+    /**
+     * Whether the server process has exited and been reaped.
+     */
+    bool server_exited;
 } lsp_client;
 
+/**
+ * Receives one batch of partial results for a request. [value] is the `value`
+ * of the `$/progress` notification and is only valid during the call.
+ */
+typedef void (*lsp_partial_result_handler)(lsp_client *client,
+                                           json_node  *value,
+                                           void       *user_data);
+
 /**
  * Creates a new JSON-RPC server listening on [istream] and sending messages
  * to [ostream] behaving as a client in the Language Server Protocol.
@@ -88,6 +157,28 @@ static inline bool lsp_client_is_initialized(const lsp_client *client)
     return client->initialize_params.process_id != 0;
 }
 
+/**
+ * Whether the event loop still has callbacks that refer to [client]. Once the
+ * server has exited, requests that are still waiting are canceled, and
+ * this eventually becomes `false`.
+ */
+static inline bool lsp_client_has_outstanding_io(const lsp_client *client)
+{
+    return !client->server_exited || client->pending_events > 0 ||
+        jsonrpc_server_has_outstanding_io(&client->parent_struct);
+}
+
+/**
+ * Closes every document and forgets what happened in the session, so that an
+ * initialized server can be used for another session without starting it
+ * again. Handlers registered with `lsp_client_on_window_show_message()` are
+ * removed, and the client stops keeping statistics and capturing messages.
+ *
+ * Returns `false` if the client cannot be reset, because the server is not
+ * initialized or has gone away, or because requests are still in flight.
+ */
+bool lsp_client_reset(lsp_client *client);
+
 /**
  * Sends the `initialize` request to the server and waits for a response.
  *
@@ -111,7 +202,7 @@ json_node *lsp_client_initialize_server_finish(const event *ev, int *error);
  * Invokes the `textDocument/didOpen` notification on the server.
  */
 void lsp_client_text_document_open_async(lsp_client             *client,
-                                         lsp_textdocument const *text_document,
+                                         lsp_textdocument       *text_document,
                                          eventloop              *loop,
                                          async_callback          callback,
                                          void                   *callback_data);
@@ -123,10 +214,66 @@ void lsp_client_text_document_open_async(lsp_client             *client,
 bool lsp_client_text_document_open_finish(event const *ev, int *error);
 
 /**
- * Waits for another notification of `textDocument/diagnostics`. One incoming
- * notification may will trigger all waiters.
+ * Applies [changes] in order to [text_document], increments its version, and
+ * invokes the `textDocument/didChange` notification on the server. If the
+ * server synchronizes documents incrementally, only the changed ranges are
+ * sent. If it wants full documents, the full text is sent, and if it does not
+ * want documents synchronized, nothing is sent.
+ */
+void lsp_client_text_document_change_async(lsp_client                               *client,
+                                           lsp_textdocument                         *text_document,
+                                           const lsp_textdocumentcontentchangeevent *changes,
+                                           size_t                                    num_changes,
+                                           eventloop                                *loop,
+                                           async_callback                            callback,
+                                           void                                     *callback_data);
+
+/**
+ * Completes the `textDocument/didChange` notification. If there was an error,
+ * `*error` will contain the appropriate value.
+ */
+bool lsp_client_text_document_change_finish(event const *ev, int *error);
+
+/**
+ * Sends the `textDocument/completion` request for [position] in the document
+ * at [uri]. If the server streams partial results, [partial_result_handler] is
+ * called with each batch of them before the response arrives. Batches are
+ * either arrays of `CompletionItem` or a `CompletionList`.
+ *
+ * @param partial_result_handler    may be `NULL`, in which case partial results
+ *                                  are not requested
+ */
+void lsp_client_text_document_completion_async(lsp_client                *client,
+                                               const char                *uri,
+                                               lsp_position               position,
+                                               lsp_partial_result_handler partial_result_handler,
+                                               void                      *partial_result_data,
+                                               eventloop                 *loop,
+                                               async_callback             callback,
+                                               void                      *callback_data);
+
+/**
+ * Gets the response to `textDocument/completion`, which is an array of
+ * `CompletionItem`, a `CompletionList`, or `null`. If the server sent partial
+ * results, the response only has the items that were not sent already. Returns
+ * a new reference, or `NULL` if there was an error.
+ */
+json_node *lsp_client_text_document_completion_finish(const event *ev, int *error);
+
+/**
+ * Waits for the next notification of `textDocument/publishDiagnostics` for
+ * the document at [uri]. If the server already published diagnostics for the
+ * document that nobody has waited for, the latest of them is returned.
+ * Otherwise, one incoming notification completes all the waiters for its
+ * document.
+ *
+ * @param version   the version of the document that the diagnostics must be
+ *                  for, or `-1` for any version. Diagnostics without a
+ *                  version are accepted by every waiter.
  */
 void lsp_client_wait_for_diagnostics_async(lsp_client    *client,
+                                           const char    *uri,
+                                           int64_t        version,
                                            eventloop     *loop,
                                            async_callback callback,
                                            void          *callback_data);
@@ -1,5 +1,6 @@
 #include "lsp-textdocument.h"
-#include "data-structures/string-builder.h"
+#include "data-structures/piece-table.h"
+#include "lsp/lsp-range.h"
 #include "json/json-serializable.h"
 #include <errno.h>
 #include <stdlib.h>
@@ -41,7 +42,7 @@ static json_serialization_status lsp_textdocument_deserialize_property(lsp_textd
         json_string *jstr = json_node_cast(property_node, string);
         if (!jstr)
             return json_serialization_status_invalid_type;
-        doc->text = string_ref(string_new_copy_data(jstr->value));
+        doc->text = piece_table_new(jstr->value, strlen(jstr->value));
     } else {
         json_serializable_fail_with_unhandled_property(property_name);
     }
@@ -59,7 +60,9 @@ static json_serialization_status lsp_textdocument_serialize_property(lsp_textdoc
     } else if (strcmp(property_name, "version") == 0) {
         *property_node = json_integer_new(doc->version);
     } else if (strcmp(property_name, "text") == 0) {
-        *property_node = json_string_new(doc->text->buffer);
+        char *text = piece_table_get_text(doc->text);
+        *property_node = json_string_new(text);
+        free(text);
     } else {
         json_serializable_fail_with_unhandled_property(property_name);
     }
@@ -75,7 +78,83 @@ void lsp_document_dtor(lsp_textdocument *doc)
 {
     free(doc->uri);
     doc->uri = NULL;
-    string_unref(doc->text);
+    if (doc->text)
+        piece_table_destroy(doc->text);
     doc->text = NULL;
-    // TODO: handle doc->language_id
+    free(doc->language_id);
+    doc->language_id = NULL;
+}
+
+json_serializable_impl_as_object(
+    lsp_textdocumentcontentchangeevent, "?range", "text");
+
+static json_serialization_status
+lsp_textdocumentcontentchangeevent_deserialize_property(lsp_textdocumentcontentchangeevent *change,
+                                                        const char                         *property_name,
+                                                        json_node                          *property_node)
+{
+    if (strcmp(property_name, "range") == 0) {
+        json_serialization_status status;
+        if ((status = json_deserialize(lsp_range, &change->range, property_node)))
+            return status;
+        change->has_range = true;
+    } else if (strcmp(property_name, "text") == 0) {
+        json_string *jstr = json_node_cast(property_node, string);
+        if (!jstr)
+            return json_serialization_status_invalid_type;
+        if (!(change->text = strdup(jstr->value))) {
+            fprintf(stderr,
+                    "error: failed to dup string for property `%s': %s\n",
+                    property_name, strerror(errno));
+            abort();
+        }
+    } else {
+        // ignore the unrecognized property, like the deprecated `rangeLength`
+    }
+    return json_serialization_status_continue;
+}
+
+static json_serialization_status
+lsp_textdocumentcontentchangeevent_serialize_property(lsp_textdocumentcontentchangeevent const *change,
+                                                      const char                               *property_name,
+                                                      json_node                               **property_node)
+{
+    if (strcmp(property_name, "range") == 0) {
+        if (change->has_range)
+            return json_serialize(lsp_range, &change->range, property_node);
+    } else if (strcmp(property_name, "text") == 0) {
+        *property_node = json_string_new(change->text);
+    } else {
+        json_serializable_fail_with_unhandled_property(property_name);
+    }
+    return json_serialization_status_continue;
+}
+
+void lsp_textdocument_apply_change(lsp_textdocument                         *doc,
+                                   const lsp_textdocumentcontentchangeevent *change)
+{
+    size_t start = 0;
+    size_t end = piece_table_get_length(doc->text);
+
+    if (change->has_range) {
+        const lsp_position *start_pos = &change->range.start;
+        const lsp_position *end_pos = &change->range.end;
+
+        start = piece_table_get_offset(doc->text,
+                start_pos->line < 0 ? 0 : (size_t)start_pos->line,
+                start_pos->character < 0 ? 0 : (size_t)start_pos->character);
+        end = piece_table_get_offset(doc->text,
+                end_pos->line < 0 ? 0 : (size_t)end_pos->line,
+                end_pos->character < 0 ? 0 : (size_t)end_pos->character);
+        if (end < start)
+            end = start;
+    }
+
+    piece_table_replace(doc->text, start, end - start, change->text, strlen(change->text));
+}
+
+void lsp_textdocumentcontentchangeevent_clear(lsp_textdocumentcontentchangeevent *change)
+{
+    free(change->text);
+    change->text = NULL;
 }
@@ -1,7 +1,9 @@
 #pragma once
 
-#include "data-structures/string-builder.h"
+#include "data-structures/piece-table.h"
 #include "json/json-serializable.h"
+#include "lsp-range.h"
+#include <stdbool.h>
 
 /**
  * `interface TextDocumentItem`
@@ -24,9 +26,16 @@ json_serializable_decl_as_object(lsp_textdocument, {
     int64_t version;
 
     /**
-     * Full content of the text document.
+     * Full content of the text document. This is kept as a piece table so that
+     * incremental changes to large documents are cheap.
      */
-    string *text;
+    piece_table *text;
+
+    /**
+     * Whether `textDocument/didOpen` has been sent for this document. This is
+     * not serialized.
+     */
+    bool is_open;
 });
 
 /**
@@ -40,4 +49,29 @@ typedef enum {
 
 json_serializable_decl_as_enum(lsp_textdocumentsynckind);
 
+/**
+ * `interface TextDocumentContentChangeEvent`
+ */
+json_serializable_decl_as_object(lsp_textdocumentcontentchangeevent, {
+    /**
+     * The range of the document that changed, if `has_range` is set.
+     * Otherwise, `text` is the full content of the document.
+     */
+    lsp_range range;
+    bool has_range;
+
+    /**
+     * The new text for the range.
+     */
+    char *text;
+});
+
+/**
+ * Applies [change] to the text of [doc]. Does not change the version.
+ */
+void lsp_textdocument_apply_change(lsp_textdocument                         *doc,
+                                   const lsp_textdocumentcontentchangeevent *change);
+
+void lsp_textdocumentcontentchangeevent_clear(lsp_textdocumentcontentchangeevent *change);
+
 void lsp_document_dtor(lsp_textdocument *doc);
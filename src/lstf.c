@@ -1,3 +1,4 @@
+#include "bytecode/lstf-bc-cache.h"
 #include "compiler/lstf-codegenerator.h"
 #include "compiler/lstf-ir-program.h"
 #include "compiler/lstf-parser.h"
@@ -8,9 +9,15 @@
 #include "compiler/lstf-semanticanalyzer.h"
 #include "data-structures/string-builder.h"
 #include "data-structures/array.h"
+#include "data-structures/histogram.h"
 #include "io/inputstream.h"
 #include "io/outputstream.h"
 #include "io/io-common.h"
+#include "io/io-socket.h"
+#include "io/io-trace.h"
+#include "jsonrpc/jsonrpc-server.h"
+#include "json/json-parser.h"
+#include "lsp/lsp-client-pool.h"
 #include "vm/lstf-virtualmachine.h"
 #include "vm/lstf-vm-loader.h"
 #include "vm/lstf-vm-program.h"
@@ -20,12 +27,18 @@
 
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
+#include <stdatomic.h>
 #include <stddef.h>
 #include <errno.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
  * Compiler options.
@@ -36,6 +49,7 @@ struct lstf_options {
     bool disable_codegen;
     bool disable_interpreter;
     bool no_lsp;
+    bool no_cache;                      // flag: --no-cache
     bool emit_ir;
     bool output_codegen;                // flag: -c
     bool disassemble;                   // flag: -d
@@ -44,6 +58,21 @@ struct lstf_options {
     const char *input_filename;
     const char *output_filename;
     const char *expected_output;
+    unsigned load_sessions;             // flag: --load
+    double load_session_rate;           // flag: --session-rate
+    double load_duration;               // flag: --duration
+    const char *stats_filename;         // flag: --stats
+    const char *capture_filename;       // flag: --capture
+    const char *profile_filename;       // flag: --profile
+    const char *trace_filename;         // flag: --trace
+    unsigned jobs;                      // flag: -j
+    array(char *) *scripts;             // with -j, the scripts to run
+    const char *junit_filename;         // flag: --junit
+    outputstream *output_stream;        // where to print instead of stdout and stderr, or NULL
+    bool daemon;                        // flag: --daemon
+    bool submit;                        // flag: --submit
+    const char *socket_path;            // flag: --socket
+    lsp_client_pool *server_pool;       // in the daemon, the language servers kept between scripts
 };
 
 static inline char *suffix(const char *str)
@@ -53,9 +82,13 @@ static inline char *suffix(const char *str)
     return ext != NULL ? (*(ext + 1) ? ext + 1 : NULL) : NULL;
 }
 
+/**
+ * Replaces the extension of [filename]. The result is only valid until the
+ * next call on the same thread, since the `-j` workers compile in parallel.
+ */
 static char *substitute_file_extension(const char *filename, const char *new_ext)
 {
-    static char bn_buffer[FILENAME_MAX];
+    static thread_local char bn_buffer[FILENAME_MAX];
     const char *suffix_ptr = suffix(filename);
     if (!suffix_ptr) {
         snprintf(bn_buffer, sizeof bn_buffer - 1, "%s.%s", filename, new_ext);
@@ -91,6 +124,15 @@ static const char usage_message[] =
 "usage: %s -d script.lstf [-o script.lstfa]\n"
 "        compiles a LSTF script to assembly code\n"
 "\n"
+"usage: %s -j N [--junit=report.xml] script.lstf|directory...\n"
+"        runs many scripts with N at a time, and reports which ones failed\n"
+"\n"
+"usage: %s --daemon [--socket=path]\n"
+"        keeps language servers running between scripts submitted with --submit\n"
+"\n"
+"usage: %s --submit [--socket=path] script.lstf|script.lstfc\n"
+"        runs a script in the daemon, reusing a language server if one is running\n"
+"\n"
 "note: you can use \"-\" with -o to output to stdout.\n"
 "\n"
 "Other Options:\n"
@@ -100,9 +142,34 @@ static const char usage_message[] =
 "  -no-lsp                  Don't error out when language server protocol\n"
 "                           requirements aren't met. (Use this when you just want\n"
 "                           to test the VM without any LSP features.)\n"
+"  --no-cache               Always compile the script, instead of loading the\n"
+"                           bytecode from the last time it was compiled. The\n"
+"                           bytecode is cached in $XDG_CACHE_HOME/lstf.\n"
 "  -emit-ir                 Output IR to a Graphviz file in the current directory.\n"
 "  -expect <string>         Test the program output against <string>.\n"
 "  -break <offset>          Enable debug mode and break at the offset (in hexadecimal).\n"
+"  --load=<sessions>        Load-test the server: run the script in <sessions>\n"
+"                           concurrent sessions, each with its own server, and\n"
+"                           report the latency of the calls to each method.\n"
+"  --session-rate=<n>       With --load, start at most <n> sessions a second.\n"
+"                           This limits how often sessions start, not calls.\n"
+"  --duration=<seconds>     With --load, keep starting new sessions for this long\n"
+"                           instead of running each session once.\n"
+"  --stats=<file.json>      Write statistics about the messages exchanged with\n"
+"                           the server to <file.json> when the script exits.\n"
+"  --capture=<file>         Record the messages exchanged with the server, with\n"
+"                           their timing, to <file> so that the session can be\n"
+"                           replayed.\n"
+"  --profile=<file>         Sample the call stacks of the script while it runs,\n"
+"                           and write them to <file> as folded stacks for a\n"
+"                           flame graph. Time spent executing and time spent\n"
+"                           blocked on I/O are kept in separate lanes.\n"
+"  --trace=<file.json>      Record when each coroutine runs and waits, the event\n"
+"                           loop's waits, and the calls to the server, and write\n"
+"                           them to <file.json> as trace events for Perfetto.\n"
+"  --junit=<file.xml>       With -j, also write the results as JUnit XML.\n"
+"  --socket=<path>          The socket of the daemon. The default is lstf.sock\n"
+"                           in $XDG_RUNTIME_DIR, or in /tmp/lstf-<uid>/.\n"
 "\n"
 "Flags:\n"
 "  -e NAME=VALUE            Set variable NAME to VALUE.\n"
@@ -112,7 +179,8 @@ static const char usage_message[] =
 static void
 print_usage(const char *progname)
 {
-    fprintf(stderr, usage_message, progname, progname, progname, progname, progname, progname, progname);
+    fprintf(stderr, usage_message, progname, progname, progname, progname, progname, progname, progname, progname,
+            progname, progname);
     fprintf(stderr, "\n");
 }
 
@@ -158,29 +226,133 @@ static void report_load_error(const char          *progname,
     case lstf_vm_loader_error_invalid_entry_point:
         lstf_report_error(NULL, "%s: VM loader: invalid entry point", filename);
         break;
+    case lstf_vm_loader_error_unterminated_data:
+        lstf_report_error(NULL, "%s: VM loader: data section is not NUL-terminated", filename);
+        break;
     case lstf_vm_loader_error_none:
         break;
     }
 }
 
+/**
+ * Writes the statistics to the file given with `--stats`. Returns whether
+ * writing the statistics succeeded.
+ */
+static bool write_stats(const jsonrpc_stats *stats, struct lstf_options options)
+{
+    outputstream *os = outputstream_new_from_path(options.stats_filename, "w");
+    bool success = false;
+
+    if (!os) {
+        lstf_report_error(NULL, "failed to open %s: %s", options.stats_filename, strerror(errno));
+        return false;
+    }
+
+    json_node *stats_json = json_node_ref(jsonrpc_stats_to_json(stats));
+    char *stats_str = json_node_to_string(stats_json, true);
+    if (!(success = outputstream_printf(os, "%s\n", stats_str) > 0))
+        lstf_report_error(NULL, "failed to write statistics to %s: %s", options.stats_filename, strerror(errno));
+
+    free(stats_str);
+    json_node_unref(stats_json);
+    outputstream_unref(os);
+    return success;
+}
+
+/**
+ * Writes the samples to the file given with `--profile`. Returns whether
+ * writing the samples succeeded.
+ */
+static bool write_profile(lstf_vm_profiler *profiler, struct lstf_options options)
+{
+    outputstream *os = outputstream_new_from_path(options.profile_filename, "w");
+    bool success = false;
+
+    if (!os) {
+        lstf_report_error(NULL, "failed to open %s: %s", options.profile_filename, strerror(errno));
+        return false;
+    }
+
+    if (!(success = lstf_vm_profiler_write_folded(profiler, os)))
+        lstf_report_error(NULL, "failed to write profile to %s: %s", options.profile_filename, strerror(errno));
+
+    outputstream_unref(os);
+    return success;
+}
+
+/**
+ * How long the daemon waits for the I/O of a finished program, in nanoseconds.
+ */
+#define LSTF_DAEMON_IO_TIMEOUT 2000000000
+
+/**
+ * How long the daemon waits for a client to send its request, or to take the
+ * result, in nanoseconds.
+ */
+#define LSTF_DAEMON_CLIENT_TIMEOUT 5000000000
+
+/**
+ * Waits for every coroutine of a finished program to stop waiting for I/O,
+ * so that nothing on the event loop refers to the virtual machine when it is
+ * destroyed. Returns false if the I/O did not finish in time.
+ */
+static bool finish_outstanding_io(lstf_virtualmachine *vm)
+{
+    const uint64_t deadline = io_get_monotonic_time() + LSTF_DAEMON_IO_TIMEOUT;
+
+    while (lstf_virtualmachine_has_outstanding_io(vm)) {
+        unsigned processed = 0;
+
+        if (io_get_monotonic_time() >= deadline)
+            return false;
+        eventloop_process(vm->event_loop, true, &processed);
+        if (processed == 0)
+            thrd_sleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+    }
+
+    return true;
+}
+
 static int run_program(lstf_vm_program *program, struct lstf_options options)
 {
     int retval = 0;
+    jsonrpc_stats *stats = options.stats_filename ? jsonrpc_stats_new() : NULL;
+    outputstream *capture_stream = NULL;
+
+    if (options.capture_filename) {
+        if (!(capture_stream = outputstream_new_from_path(options.capture_filename, "w"))) {
+            lstf_report_error(NULL, "failed to open %s: %s", options.capture_filename, strerror(errno));
+            jsonrpc_stats_destroy(stats);
+            return 99;
+        }
+        // the LSP client holds its own reference
+        outputstream_ref(capture_stream);
+    }
     lstf_virtualmachine *vm =
         lstf_virtualmachine_new(program,
-            options.expected_output ? outputstream_new_from_buffer(NULL, 0, false) : NULL,
+            options.expected_output ? outputstream_new_from_buffer(NULL, 0, false) : options.output_stream,
             false);
-    outputstream *os = outputstream_new_from_file(stdout, false);
+    if (options.server_pool)
+        lstf_virtualmachine_set_server_pool(vm, options.server_pool);
+    outputstream *os = options.output_stream ? outputstream_ref(options.output_stream)
+                                             : outputstream_new_from_file(stdout, false);
     if (options.breakpoints) {
         for (size_t i = 0; i < options.breakpoints->length; i++) {
             if (!lstf_virtualmachine_add_breakpoint(vm, options.breakpoints->elements[i])) {
                 lstf_report_error(NULL, "failed to add breakpoint %td - out of range", options.breakpoints->elements[i]);
                 lstf_virtualmachine_destroy(vm);
+                jsonrpc_stats_destroy(stats);
+                outputstream_unref(capture_stream);
                 return 1;
             }
         }
         vm->debug = true;
     }
+    vm->rpc_stats = stats;
+    vm->capture_stream = capture_stream;
+    lstf_vm_profiler *profiler =
+        options.profile_filename ? lstf_vm_profiler_new(program, LSTF_VM_PROFILER_DEFAULT_INTERVAL) : NULL;
+    vm->profiler = profiler;
     if (options.variables) {
         for (iterator it = ptr_hashmap_iterator_create(options.variables); it.has_next; it = iterator_next(it)) {
             ptr_hashmap_entry *entry = iterator_get_item(it);
@@ -334,7 +506,10 @@ static int run_program(lstf_vm_program *program, struct lstf_options options)
         }
     }
     if (vm->last_status != lstf_vm_status_exited) {
-        lstf_report_error(NULL, "VM: %s", lstf_vm_status_to_string(vm->last_status));
+        if (vm->last_status == lstf_vm_status_assertion_failed && vm->assertion_message)
+            lstf_report_error(NULL, "VM: %s: %s", lstf_vm_status_to_string(vm->last_status), vm->assertion_message);
+        else
+            lstf_report_error(NULL, "VM: %s", lstf_vm_status_to_string(vm->last_status));
         lstf_vm_program_disassemble(vm->program, os, vm->last_pc, NULL);
         retval = 1;
     } else {
@@ -359,9 +534,248 @@ static int run_program(lstf_vm_program *program, struct lstf_options options)
         }
     }
 
-    lstf_virtualmachine_destroy(vm);
+    if (vm->server_pool && !finish_outstanding_io(vm)) {
+        // the event loop outlives the virtual machine and still has callbacks
+        // for it, so it has to be kept until the daemon exits
+        if (vm->client) {
+            lstf_report_warning(NULL, "VM: gave up waiting for I/O to finish; the language server will be restarted");
+            lsp_client_pool_retire(vm->server_pool, vm->client);
+        } else {
+            lstf_report_warning(NULL, "VM: gave up waiting for I/O to finish");
+        }
+    } else {
+        lstf_virtualmachine_destroy(vm);
+    }
     outputstream_unref(os);
     ptr_list_destroy(pc_offsets);
+    if (stats && !write_stats(stats, options) && retval == 0)
+        retval = 99;
+    jsonrpc_stats_destroy(stats);
+    outputstream_unref(capture_stream);
+    if (profiler && !write_profile(profiler, options) && retval == 0)
+        retval = 99;
+    lstf_vm_profiler_destroy(profiler);
+    return retval;
+}
+
+static lstf_virtualmachine *start_load_session(lstf_vm_program *program,
+                                               struct lstf_options options,
+                                               jsonrpc_stats *stats,
+                                               lsp_client_pool *pool)
+{
+    lstf_virtualmachine *vm = lstf_virtualmachine_new(program, NULL, false);
+
+    // the sessions take turns on this thread, and share one event loop so
+    // that replies are read as soon as they arrive
+    vm->nonblocking = true;
+    vm->rpc_stats = stats;
+    lstf_virtualmachine_set_server_pool(vm, pool);
+    if (options.variables) {
+        for (iterator it = ptr_hashmap_iterator_create(options.variables); it.has_next; it = iterator_next(it)) {
+            ptr_hashmap_entry *entry = iterator_get_item(it);
+            lstf_virtualmachine_set_variable(vm, entry->key, entry->value);
+        }
+    }
+
+    return vm;
+}
+
+/**
+ * Ends a session. Its server is stopped instead of being given to the next
+ * session, so that every session starts its own.
+ */
+static void end_load_session(lstf_virtualmachine *vm)
+{
+    if (vm->client) {
+        lsp_client_pool_retire(vm->server_pool, vm->client);
+        vm->client = NULL;
+    }
+    lstf_virtualmachine_destroy(vm);
+}
+
+static int compare_method_names(const void *entry1, const void *entry2)
+{
+    return strcmp((*(const ptr_hashmap_entry *const *)entry1)->key,
+                  (*(const ptr_hashmap_entry *const *)entry2)->key);
+}
+
+static void print_latency(const char *method, const histogram *latencies, double elapsed)
+{
+    printf("%-32s %8llu %10.2f %10.3f %10.3f %10.3f %10.3f\n",
+           method,
+           (unsigned long long)latencies->total_count,
+           (double)latencies->total_count / elapsed,
+           (double)histogram_get_percentile(latencies, 50) / 1e6,
+           (double)histogram_get_percentile(latencies, 90) / 1e6,
+           (double)histogram_get_percentile(latencies, 99) / 1e6,
+           (double)latencies->max / 1e6);
+}
+
+/**
+ * How often `--load` checks on the servers of finished sessions while it has
+ * nothing else to do, in nanoseconds.
+ */
+#define LSTF_LOAD_COLLECT_INTERVAL 10000000
+
+/**
+ * Runs the program in many sessions at once, each with its own connection to
+ * the server, and reports the latencies of the calls made to the server.
+ */
+static int run_load(lstf_vm_program *program, struct lstf_options options)
+{
+    jsonrpc_stats *stats = jsonrpc_stats_new();
+    lsp_client_pool *pool = lsp_client_pool_new();
+    lstf_virtualmachine **sessions = calloc(options.load_sessions, sizeof *sessions);
+    // sessions that are over, but whose calls to the server are still on the
+    // event loop
+    array(lstf_virtualmachine *) ending;
+    unsigned num_started = 0;
+    unsigned num_running = 0;
+    unsigned num_failed = 0;
+
+    if (!sessions) {
+        perror("failed to create sessions");
+        abort();
+    }
+    array_init(&ending);
+
+    // every session holds a reference, but the program must outlive them all
+    lstf_vm_program_ref(program);
+
+    const uint64_t start_time = io_get_monotonic_time();
+    const uint64_t end_time = start_time + (uint64_t)(options.load_duration * 1e9);
+    const uint64_t start_interval = options.load_session_rate > 0 ? (uint64_t)(1e9 / options.load_session_rate) : 0;
+    uint64_t next_start_time = start_time;
+    bool may_start = true;
+
+    while (may_start || num_running > 0 || ending.length > 0) {
+        uint64_t now = io_get_monotonic_time();
+
+        if (options.load_duration > 0)
+            may_start = now < end_time;
+        else
+            may_start = num_started < options.load_sessions;
+
+        for (unsigned i = 0; i < options.load_sessions; i++) {
+            if (!sessions[i] && may_start && now >= next_start_time) {
+                sessions[i] = start_load_session(program, options, stats, pool);
+                num_started++;
+                num_running++;
+                next_start_time = now + start_interval;
+                if (options.load_duration <= 0 && num_started == options.load_sessions)
+                    may_start = false;
+            }
+
+            lstf_virtualmachine *vm = sessions[i];
+            if (!vm || lstf_virtualmachine_run(vm))
+                continue;
+
+            // the session is over
+            if (vm->last_status != lstf_vm_status_exited) {
+                if (vm->last_status == lstf_vm_status_assertion_failed && vm->assertion_message)
+                    lstf_report_error(NULL, "session %u: VM: %s: %s", i,
+                                      lstf_vm_status_to_string(vm->last_status), vm->assertion_message);
+                else
+                    lstf_report_error(NULL, "session %u: VM: %s", i,
+                                      lstf_vm_status_to_string(vm->last_status));
+                num_failed++;
+            } else if (vm->return_code != 0) {
+                num_failed++;
+            }
+            sessions[i] = NULL;
+            num_running--;
+            if (vm->client && lstf_virtualmachine_has_outstanding_io(vm)) {
+                // stopping its server cancels the calls it was waiting for
+                lsp_client_pool_retire(pool, vm->client);
+                array_add(&ending, vm);
+            } else {
+                end_load_session(vm);
+            }
+        }
+
+        // this must come before the pool frees the clients of these sessions
+        for (size_t i = 0; i < ending.length; ) {
+            lstf_virtualmachine *vm = ending.elements[i];
+
+            if (lsp_client_has_outstanding_io(vm->client)) {
+                i++;
+                continue;
+            }
+            vm->client = NULL;
+            lstf_virtualmachine_destroy(vm);
+            array_remove(&ending, i);
+        }
+        // keep checking on retired servers until they are gone, since one
+        // that doesn't exit in time has to be killed
+        const bool collecting = lsp_client_pool_collect(pool);
+
+        // events processed while one session ran may have woken up another
+        bool is_idle = true;
+        for (unsigned i = 0; i < options.load_sessions && is_idle; i++)
+            is_idle = !sessions[i] || !lstf_virtualmachine_is_runnable(sessions[i]);
+        if (!is_idle)
+            continue;
+
+        // wait for the servers, but no longer than until the next session
+        // can start or the retired servers have to be checked on
+        uint64_t timeout = UINT64_MAX;
+        unsigned processed = 0;
+
+        now = io_get_monotonic_time();
+        if (may_start && num_running < options.load_sessions)
+            timeout = next_start_time > now ? next_start_time - now : 0;
+        if (collecting && timeout > LSTF_LOAD_COLLECT_INTERVAL)
+            timeout = LSTF_LOAD_COLLECT_INTERVAL;
+        if (timeout == UINT64_MAX)
+            eventloop_process(pool->loop, false, &processed);
+        else if (timeout > 0 && !eventloop_process_timeout(pool->loop, timeout, &processed) && processed == 0)
+            // there was nothing to wait for
+            thrd_sleep(&(struct timespec){.tv_sec = (time_t)(timeout / 1000000000),
+                                          .tv_nsec = (long)(timeout % 1000000000)}, NULL);
+    }
+
+    double elapsed = (double)(io_get_monotonic_time() - start_time) / 1e9;
+
+    // print the methods in order
+    ptr_hashmap_entry **entries = calloc(ptr_hashmap_num_elements(stats->methods) + 1, sizeof *entries);
+    size_t num_entries = 0;
+    histogram *total = histogram_new();
+
+    if (!entries) {
+        perror("failed to sort latencies");
+        abort();
+    }
+
+    for (iterator it = ptr_hashmap_iterator_create(stats->methods); it.has_next; it = iterator_next(it)) {
+        ptr_hashmap_entry *entry = iterator_get_item(it);
+        const jsonrpc_method_stats *method_stats = entry->value;
+
+        // notifications have no latencies
+        if (!method_stats->latencies->total_count)
+            continue;
+        entries[num_entries++] = entry;
+        histogram_add(total, method_stats->latencies);
+    }
+    qsort(entries, num_entries, sizeof *entries, compare_method_names);
+
+    printf("%u session(s), %u failed, in %.3f s\n", num_started, num_failed, elapsed);
+    printf("%-32s %8s %10s %10s %10s %10s %10s\n",
+           "method", "calls", "calls/s", "p50 (ms)", "p90 (ms)", "p99 (ms)", "max (ms)");
+    for (size_t i = 0; i < num_entries; i++)
+        print_latency(entries[i]->key, ((const jsonrpc_method_stats *)entries[i]->value)->latencies, elapsed);
+    print_latency("(all)", total, elapsed);
+
+    histogram_destroy(total);
+    free(entries);
+    free(sessions);
+    array_destroy(&ending);
+    lsp_client_pool_destroy(pool);
+    lstf_vm_program_unref(program);
+
+    int retval = num_failed > 0;
+    if (options.stats_filename && !write_stats(stats, options) && retval == 0)
+        retval = 99;
+    jsonrpc_stats_destroy(stats);
     return retval;
 }
 
@@ -387,14 +801,46 @@ static int disassemble_program(lstf_vm_program *program, struct lstf_options opt
     return retval;
 }
 
+/**
+ * Gets the path where the bytecode compiled from [script] is cached, or
+ * returns `NULL` if there is nowhere to cache it. Besides the source, the
+ * bytecode depends on `-no-lsp` and on the compiler. The compiler is
+ * identified by its version and by the size and modification time of the
+ * executable, so that a rebuilt compiler doesn't use stale bytecode.
+ */
+static char *get_cache_path(const char *progname, struct lstf_options options, const lstf_file *script)
+{
+    char *cache_dir = lstf_bc_cache_get_directory();
+    struct stat executable_stat = {0};
+
+    if (!cache_dir)
+        return NULL;
+
+    if (stat("/proc/self/exe", &executable_stat) != 0 && stat(progname, &executable_stat) != 0)
+        memset(&executable_stat, 0, sizeof executable_stat);
+
+    // the bytecode's debug info records where the script is
+    string *salt = string_new();
+    string_appendf(salt, "%s %jd %jd %s%s", LSTF_VERSION,
+            (intmax_t) executable_stat.st_size, (intmax_t) executable_stat.st_mtime,
+            script->filename, options.no_lsp ? " -no-lsp" : "");
+    char *cache_path = lstf_bc_cache_get_path(cache_dir, salt->buffer, script->content, strlen(script->content));
+
+    free(string_destroy(salt));
+    free(cache_dir);
+    return cache_path;
+}
+
 static int
 compile_lstf_script(const char *progname, struct lstf_options options)
 {
-    (void) progname;
     lstf_file *script = lstf_file_load(options.input_filename);
     if (!script) {
         lstf_report_error(NULL, "%s: %s", options.input_filename, strerror(errno));
-        fprintf(stderr, "compilation terminated.\n");
+        if (options.output_stream)
+            outputstream_printf(options.output_stream, "compilation terminated.\n");
+        else
+            fprintf(stderr, "compilation terminated.\n");
         return 1;
     }
 
@@ -408,6 +854,16 @@ compile_lstf_script(const char *progname, struct lstf_options options)
     const uint8_t *bytecode = NULL;
     lstf_vm_loader_error loader_error = 0;
     lstf_vm_program *program = NULL;
+    char *cache_path = NULL;
+
+    // a script that is only going to be run can be loaded from the cache
+    if (!options.no_cache && !options.output_codegen && !options.emit_ir &&
+            !options.disable_resolver && !options.disable_analyzer && !options.disable_codegen &&
+            (cache_path = get_cache_path(progname, options, script)) &&
+            (program = lstf_vm_loader_load_from_path(cache_path, &loader_error))) {
+        lstf_file_unref(script);
+        goto cleanup;
+    }
 
     parser = lstf_parser_new(script);
     lstf_parser_parse(parser);
@@ -465,6 +921,9 @@ compile_lstf_script(const char *progname, struct lstf_options options)
         }
         outputstream_unref(os);
     } else {
+        // failing to cache the bytecode only means that it will be compiled again
+        if (cache_path)
+            lstf_bc_cache_store(cache_path, bytecode, bytecode_length);
         if (!(program = lstf_vm_loader_load_from_buffer(bytecode, bytecode_length, &loader_error))) {
             report_load_error(progname, options.input_filename, loader_error);
             retval = 99;
@@ -477,9 +936,13 @@ cleanup:
     lstf_symbolresolver_unref(resolver);
     lstf_semanticanalyzer_unref(analyzer);
     lstf_codegenerator_unref(generator);
+    free(cache_path);
 
     if (num_errors > 0) {
-        fprintf(stderr, "%u error(s) generated.\n", num_errors);
+        if (options.output_stream)
+            outputstream_printf(options.output_stream, "%u error(s) generated.\n", num_errors);
+        else
+            fprintf(stderr, "%u error(s) generated.\n", num_errors);
         retval = 1;
     } else if (program) {
         // all clear. we can use the program
@@ -487,7 +950,7 @@ cleanup:
             retval = disassemble_program(program, options);
             lstf_vm_program_unref(program);
         } else if (!options.disable_interpreter) {
-            retval = run_program(program, options);
+            retval = options.load_sessions ? run_load(program, options) : run_program(program, options);
         }
     }
     return retval;
@@ -512,7 +975,7 @@ static int load_and_run_file(const char *progname, struct lstf_options options)
 
     if (!(program = load_file(progname, options.input_filename)))
         return 99;
-    return run_program(program, options);
+    return options.load_sessions ? run_load(program, options) : run_program(program, options);
 }
 
 static int load_and_disassemble_file(const char *progname, struct lstf_options options)
@@ -528,6 +991,662 @@ static int load_and_disassemble_file(const char *progname, struct lstf_options o
     return retval;
 }
 
+static int compare_filenames(const void *filename1, const void *filename2)
+{
+    return strcmp(*(char *const *)filename1, *(char *const *)filename2);
+}
+
+/**
+ * Adds the scripts under [path] to the scripts to run, or [path] itself if it
+ * is not a directory. Returns false if [path] could not be read.
+ */
+static bool add_scripts(struct lstf_options *options, const char *path)
+{
+    struct stat path_stat;
+
+    if (stat(path, &path_stat) != 0) {
+        lstf_report_error(NULL, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    if (!S_ISDIR(path_stat.st_mode)) {
+        char *filename = strdup(path);
+        if (!filename) {
+            perror("failed to add script");
+            abort();
+        }
+        array_add(options->scripts, filename);
+        return true;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        lstf_report_error(NULL, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    const size_t first_script = options->scripts->length;
+    bool success = true;
+    for (struct dirent *entry; success && (entry = readdir(dir));) {
+        if (entry->d_name[0] == '.')
+            continue;
+
+        char *entry_path = string_destroy(string_newf("%s/%s", path, entry->d_name));
+        const char *suffix_ptr = suffix(entry_path);
+
+        if (stat(entry_path, &path_stat) != 0) {
+            lstf_report_error(NULL, "%s: %s", entry_path, strerror(errno));
+            success = false;
+        } else if (S_ISDIR(path_stat.st_mode) ||
+                   (suffix_ptr && (strcmp(suffix_ptr, "lstf") == 0 || strcmp(suffix_ptr, "lstfc") == 0))) {
+            success = add_scripts(options, entry_path);
+        }
+        free(entry_path);
+    }
+    closedir(dir);
+
+    // run the scripts in a predictable order
+    qsort(&options->scripts->elements[first_script], options->scripts->length - first_script,
+          sizeof options->scripts->elements[0], compare_filenames);
+
+    return success;
+}
+
+/**
+ * The outcome of running one script with `-j`.
+ */
+struct script_result {
+    char *output;                       // what the script and the compiler printed
+    int retval;
+    uint64_t elapsed;                   // in nanoseconds
+};
+
+struct script_runner {
+    const char *progname;
+    struct lstf_options options;
+    struct script_result *results;      // one for each script
+    atomic_size_t next_script;          // the next script that a worker should run
+};
+
+/**
+ * Compiles and runs (or just runs) the script at [options.input_filename],
+ * saving everything that the script and the compiler printed to [output].
+ */
+static int run_captured(const char *progname, struct lstf_options options, char **output)
+{
+    outputstream *os = outputstream_new_from_buffer(NULL, 0, false);
+    int retval = 0;
+
+    if (!os) {
+        perror("failed to create script output");
+        abort();
+    }
+    outputstream_ref(os);
+
+    options.output_stream = os;
+    lstf_report_set_output(os);
+
+    const char *suffix_ptr = suffix(options.input_filename);
+    if (suffix_ptr && strcmp(suffix_ptr, "lstfc") == 0) {
+        retval = load_and_run_file(progname, options);
+    } else if (suffix_ptr && strcmp(suffix_ptr, "lstf") == 0) {
+        retval = compile_lstf_script(progname, options);
+    } else {
+        lstf_report_error(NULL, "%s: filename must be LSTF or LSTF bytecode (.lstf/.lstfc)", options.input_filename);
+        retval = 1;
+    }
+
+    lstf_report_set_output(NULL);
+    if (!(*output = calloc(1, os->buffer_offset + 1))) {
+        perror("failed to save script output");
+        abort();
+    }
+    memcpy(*output, os->buffer, os->buffer_offset);
+    outputstream_unref(os);
+    return retval;
+}
+
+static void run_script(struct script_runner *runner, size_t index)
+{
+    struct script_result *result = &runner->results[index];
+    struct lstf_options options = runner->options;
+
+    options.input_filename = runner->options.scripts->elements[index];
+
+    const uint64_t start_time = io_get_monotonic_time();
+    result->retval = run_captured(runner->progname, options, &result->output);
+    result->elapsed = io_get_monotonic_time() - start_time;
+}
+
+static int run_scripts_worker(void *user_data)
+{
+    struct script_runner *runner = user_data;
+
+    for (size_t index; (index = atomic_fetch_add(&runner->next_script, 1)) < runner->options.scripts->length;)
+        run_script(runner, index);
+
+    return 0;
+}
+
+/**
+ * Writes [text] to [os] so that it can be the content of an XML element.
+ */
+static void write_xml_escaped(outputstream *os, const char *text)
+{
+    for (const char *p = text; *p; p++) {
+        switch (*p) {
+        case '&':
+            outputstream_write_string(os, "&amp;");
+            break;
+        case '<':
+            outputstream_write_string(os, "&lt;");
+            break;
+        case '>':
+            outputstream_write_string(os, "&gt;");
+            break;
+        case '"':
+            outputstream_write_string(os, "&quot;");
+            break;
+        default:
+            // other control characters are not allowed in XML
+            if ((unsigned char)*p >= ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+                outputstream_write_byte(os, (uint8_t)*p);
+            break;
+        }
+    }
+}
+
+static bool write_junit_report(const struct script_runner *runner, unsigned num_failed, double elapsed)
+{
+    const char *filename = runner->options.junit_filename;
+    outputstream *os = outputstream_new_from_path(filename, "w");
+
+    if (!os) {
+        lstf_report_error(NULL, "failed to open %s: %s", filename, strerror(errno));
+        return false;
+    }
+
+    outputstream_printf(os, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    outputstream_printf(os, "<testsuites>\n");
+    outputstream_printf(os, "  <testsuite name=\"lstf\" tests=\"%zu\" failures=\"%u\" time=\"%.3f\">\n",
+                        (size_t)runner->options.scripts->length, num_failed, elapsed);
+    for (size_t i = 0; i < runner->options.scripts->length; i++) {
+        const struct script_result *result = &runner->results[i];
+
+        outputstream_printf(os, "    <testcase classname=\"lstf\" name=\"");
+        write_xml_escaped(os, runner->options.scripts->elements[i]);
+        outputstream_printf(os, "\" time=\"%.3f\">\n", (double)result->elapsed / 1e9);
+        if (result->retval != 0)
+            outputstream_printf(os, "      <failure message=\"exited with status %d\"/>\n", result->retval);
+        if (*result->output) {
+            outputstream_printf(os, "      <system-out>");
+            write_xml_escaped(os, result->output);
+            outputstream_printf(os, "</system-out>\n");
+        }
+        outputstream_printf(os, "    </testcase>\n");
+    }
+    outputstream_printf(os, "  </testsuite>\n");
+    outputstream_printf(os, "</testsuites>\n");
+
+    bool success = true;
+    // the stream is backed by a file
+    if (fflush(os->file) != 0 || ferror(os->file)) {
+        lstf_report_error(NULL, "failed to write JUnit report to %s: %s", filename, strerror(errno));
+        success = false;
+    }
+    outputstream_unref(os);
+    return success;
+}
+
+/**
+ * Compiles and runs many scripts, [options.jobs] at a time, each on its own
+ * thread with its own virtual machine and server. Prints the output of the
+ * scripts that failed, and a summary of all of them.
+ */
+static int run_scripts(const char *progname, struct lstf_options options)
+{
+    struct script_runner runner = { .progname = progname, .options = options };
+    const size_t num_scripts = options.scripts->length;
+    const unsigned num_workers = options.jobs < num_scripts ? options.jobs : (unsigned) num_scripts;
+    thrd_t *workers = calloc(num_workers, sizeof *workers);
+    unsigned num_started = 0;
+    unsigned num_failed = 0;
+
+    if (!(runner.results = calloc(num_scripts, sizeof *runner.results)) || !workers) {
+        perror("failed to create workers");
+        abort();
+    }
+    atomic_init(&runner.next_script, 0);
+
+    const uint64_t start_time = io_get_monotonic_time();
+    for (; num_started < num_workers; num_started++) {
+        if (thrd_create(&workers[num_started], run_scripts_worker, &runner) != thrd_success) {
+            // the workers that did start will run the rest
+            if (num_started == 0)
+                run_scripts_worker(&runner);
+            break;
+        }
+    }
+    for (unsigned i = 0; i < num_started; i++)
+        thrd_join(workers[i], NULL);
+    double elapsed = (double)(io_get_monotonic_time() - start_time) / 1e9;
+
+    // print the output of the scripts that failed
+    for (size_t i = 0; i < num_scripts; i++) {
+        const struct script_result *result = &runner.results[i];
+
+        if (result->retval == 0)
+            continue;
+        num_failed++;
+        printf("--- %s (exited with status %d) ---\n%s", options.scripts->elements[i], result->retval, result->output);
+        if (*result->output && result->output[strlen(result->output) - 1] != '\n')
+            printf("\n");
+    }
+
+    printf("%-60s %6s %10s\n", "script", "result", "time (s)");
+    for (size_t i = 0; i < num_scripts; i++)
+        printf("%-60s %6s %10.3f\n", options.scripts->elements[i],
+               runner.results[i].retval == 0 ? "PASS" : "FAIL",
+               (double)runner.results[i].elapsed / 1e9);
+    printf("%zu script(s), %u failed, in %.3f s with %u job(s)\n",
+           num_scripts, num_failed, elapsed, num_started ? num_started : 1);
+
+    int retval = num_failed > 0;
+    if (options.junit_filename && !write_junit_report(&runner, num_failed, elapsed) && retval == 0)
+        retval = 99;
+
+    for (size_t i = 0; i < num_scripts; i++)
+        free(runner.results[i].output);
+    free(runner.results);
+    free(workers);
+    return retval;
+}
+
+/**
+ * Gets the socket of the daemon, which is either given with `--socket` or
+ * the default for this user. The directory of the default socket is created
+ * if [create_dir] is set.
+ *
+ * @return a new string, or `NULL` if the default directory isn't safe to use
+ */
+static char *get_socket_path(struct lstf_options options, bool create_dir)
+{
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+
+    if (options.socket_path)
+        return string_destroy(string_new_copy_data(options.socket_path));
+    if (runtime_dir && *runtime_dir)
+        return string_destroy(string_newf("%s/lstf.sock", runtime_dir));
+
+    // every user can write to /tmp, so the socket goes in a directory that
+    // only we can use. otherwise, another user could create it before us
+    char *socket_dir = string_destroy(string_newf("/tmp/lstf-%u", (unsigned) getuid()));
+    struct stat dir_stat;
+
+    if (create_dir && mkdir(socket_dir, 0700) != 0 && errno != EEXIST) {
+        lstf_report_error(NULL, "could not create %s: %s", socket_dir, strerror(errno));
+        free(socket_dir);
+        return NULL;
+    }
+    if (lstat(socket_dir, &dir_stat) != 0) {
+        lstf_report_error(NULL, "%s: %s", socket_dir, strerror(errno));
+        free(socket_dir);
+        return NULL;
+    }
+    if (!S_ISDIR(dir_stat.st_mode) || dir_stat.st_uid != getuid() || (dir_stat.st_mode & 077)) {
+        lstf_report_error(NULL, "%s is not a directory that only you can access", socket_dir);
+        free(socket_dir);
+        return NULL;
+    }
+
+    char *socket_path = string_destroy(string_newf("%s/lstf.sock", socket_dir));
+    free(socket_dir);
+    return socket_path;
+}
+
+/**
+ * Returns whether the process on the other end of [fd] is run by this user.
+ */
+static bool is_peer_same_user(int fd)
+{
+    unsigned peer_uid;
+
+    return io_socket_get_peer_uid(fd, &peer_uid) && peer_uid == (unsigned) getuid();
+}
+
+/**
+ * Reads everything from [fd] until the other end stops writing. Gives up if
+ * that takes longer than [timeout] nanoseconds, unless [timeout] is 0.
+ *
+ * @return a new string, or `NULL` if the read timed out
+ */
+static char *read_until_shutdown(int fd, uint64_t timeout)
+{
+    const uint64_t deadline = io_get_monotonic_time() + timeout;
+    inputstream *is = inputstream_ref(inputstream_new_from_fd(fd, false));
+    string *content = string_new();
+    char buffer[BUFSIZ];
+    size_t length;
+    bool timed_out = false;
+
+    for (;;) {
+        if (timeout) {
+            uint64_t now = io_get_monotonic_time();
+            if ((timed_out = now >= deadline) || !io_socket_set_timeout(fd, deadline - now))
+                break;
+        }
+        errno = 0;
+        if ((length = inputstream_read(is, buffer, sizeof buffer)) == 0) {
+            timed_out = timeout && errno == EAGAIN;
+            break;
+        }
+        string_appendf(content, "%.*s", (int) length, buffer);
+    }
+
+    inputstream_unref(is);
+    if (timed_out) {
+        string_unref(content);
+        return NULL;
+    }
+    return string_destroy(content);
+}
+
+/**
+ * Writes [message] to [fd] and tells the other end that nothing more is
+ * coming. Returns whether the message was written.
+ */
+static bool write_message(int fd, json_node *message)
+{
+    outputstream *os = outputstream_ref(outputstream_new_from_fd(fd, false));
+    char *message_str = json_node_to_string(message, false);
+    bool success = outputstream_write_string(os, message_str) == strlen(message_str) &&
+        io_socket_shutdown_write(fd);
+
+    free(message_str);
+    outputstream_unref(os);
+    return success;
+}
+
+/**
+ * Gets the member [name] of [message] if it has the type [member_type], or
+ * returns `NULL`.
+ */
+static json_node *get_message_member(json_node *message, const char *name, json_node_type member_type)
+{
+    json_node *member = NULL;
+
+    if (!message || message->node_type != json_node_type_object ||
+            !(member = json_object_get_member(message, name)) ||
+            member->node_type != member_type)
+        return NULL;
+    return member;
+}
+
+/**
+ * Asks the daemon to run the script, and prints what it printed.
+ */
+static int submit_script(struct lstf_options options)
+{
+    char *socket_path = get_socket_path(options, false);
+
+    if (!socket_path)
+        return 99;
+
+    int fd = io_socket_connect(socket_path);
+
+    if (fd == -1) {
+        lstf_report_error(NULL, "could not connect to the daemon at %s: %s", socket_path, strerror(errno));
+        free(socket_path);
+        return 99;
+    }
+
+    // don't send the script to a daemon that someone else is running
+    if (!is_peer_same_user(fd)) {
+        lstf_report_error(NULL, "the daemon at %s is not run by you", socket_path);
+        close(fd);
+        free(socket_path);
+        return 99;
+    }
+
+    json_node *request = json_node_ref(json_object_new());
+    json_object_set_member(request, "script", json_string_new(options.input_filename));
+    json_object_set_member(request, "cwd", json_string_new(io_get_current_dir()));
+    json_object_set_member(request, "noLsp", json_boolean_new(options.no_lsp));
+    if (options.expected_output)
+        json_object_set_member(request, "expect", json_string_new(options.expected_output));
+    if (options.variables) {
+        json_node *variables = json_object_new();
+        for (iterator it = ptr_hashmap_iterator_create(options.variables); it.has_next; it = iterator_next(it)) {
+            ptr_hashmap_entry *entry = iterator_get_item(it);
+            json_object_set_member(variables, entry->key, json_string_new(entry->value));
+        }
+        json_object_set_member(request, "variables", variables);
+    }
+
+    int retval = 99;
+    if (!write_message(fd, request)) {
+        lstf_report_error(NULL, "could not send the script to the daemon: %s", strerror(errno));
+    } else {
+        char *response_str = read_until_shutdown(fd, 0);
+        json_node *response = json_parser_parse_string(response_str);
+        json_node *status = get_message_member(response, "status", json_node_type_integer);
+        json_node *output = get_message_member(response, "output", json_node_type_string);
+
+        if (!status || !output) {
+            lstf_report_error(NULL, "the daemon at %s did not run the script", socket_path);
+        } else {
+            fputs(((json_string *)output)->value, stdout);
+            retval = (int)((json_integer *)status)->value;
+        }
+        json_node_unref(response);
+        free(response_str);
+    }
+
+    json_node_unref(request);
+    close(fd);
+    free(socket_path);
+    return retval;
+}
+
+struct lstf_daemon {
+    const char *progname;
+    struct lstf_options options;
+    int listen_fd;
+    const char *root_dir;               // where the daemon was started
+    bool has_connection;                // a client is waiting to be accepted
+    bool stopping;
+};
+
+/**
+ * Written to by the signal handler to stop the daemon.
+ */
+static int daemon_stop_pipe[2] = {-1, -1};
+
+static void daemon_handle_signal(int signum)
+{
+    (void) signum;
+    ssize_t written = write(daemon_stop_pipe[1], "", 1);
+    (void) written;
+}
+
+static void daemon_stop_cb(const event *ev, void *user_data)
+{
+    (void) ev;
+    struct lstf_daemon *daemon = user_data;
+
+    daemon->stopping = true;
+}
+
+static void daemon_connection_cb(const event *ev, void *user_data)
+{
+    struct lstf_daemon *daemon = user_data;
+
+    if (event_get_result(ev, NULL)) {
+        daemon->has_connection = true;
+    } else {
+        lstf_report_error(NULL, "daemon: stopped listening: %s", strerror(event_get_errno(ev)));
+        daemon->stopping = true;
+    }
+}
+
+/**
+ * Runs the script that a client submitted with `--submit`, one at a time.
+ */
+static void serve_client(struct lstf_daemon *daemon)
+{
+    int fd = io_socket_accept(daemon->listen_fd);
+
+    if (fd == -1) {
+        lstf_report_error(NULL, "daemon: could not accept a connection: %s", strerror(errno));
+        return;
+    }
+
+    // scripts run as us, so only we may submit them
+    if (!is_peer_same_user(fd)) {
+        lstf_report_warning(NULL, "daemon: refused a connection from another user");
+        close(fd);
+        return;
+    }
+
+    // the daemon runs one script at a time, so a client that never finishes
+    // sending its request must not keep everyone else waiting
+    char *request_str = read_until_shutdown(fd, LSTF_DAEMON_CLIENT_TIMEOUT);
+
+    if (!request_str) {
+        lstf_report_warning(NULL, "daemon: timed out waiting for a client's request");
+        close(fd);
+        return;
+    }
+
+    json_node *request = json_node_ref(json_parser_parse_string(request_str));
+    json_string *script = (json_string *)get_message_member(request, "script", json_node_type_string);
+    json_string *cwd = (json_string *)get_message_member(request, "cwd", json_node_type_string);
+    json_boolean *no_lsp = (json_boolean *)get_message_member(request, "noLsp", json_node_type_boolean);
+    json_string *expect = (json_string *)get_message_member(request, "expect", json_node_type_string);
+    json_node *variables = get_message_member(request, "variables", json_node_type_object);
+    struct lstf_options options = daemon->options;
+    char *output = NULL;
+    int retval = 1;
+
+    if (!script || !cwd) {
+        output = string_destroy(string_new_copy_data("lstf: error: invalid request\n"));
+    } else if (chdir(cwd->value) != 0) {
+        output = string_destroy(string_newf("lstf: error: %s: %s\n", cwd->value, strerror(errno)));
+    } else {
+        options.input_filename = script->value;
+        options.no_lsp = no_lsp && no_lsp->value;
+        options.expected_output = expect ? expect->value : NULL;
+        if (variables) {
+            options.variables = ptr_hashmap_new((collection_item_hash_func)strhash, NULL, free,
+                    (collection_item_equality_func)strequal, NULL, free);
+            json_object_foreach(variables, variable, {
+                json_string *value = json_node_cast(variable_value, string);
+                if (value)
+                    ptr_hashmap_insert(options.variables,
+                            string_destroy(string_new_copy_data(variable_name)),
+                            string_destroy(string_new_copy_data(value->value)));
+            });
+        }
+
+        retval = run_captured(daemon->progname, options, &output);
+
+        if (options.variables)
+            ptr_hashmap_destroy(options.variables);
+        if (chdir(daemon->root_dir) != 0)
+            lstf_report_warning(NULL, "daemon: could not return to %s: %s", daemon->root_dir, strerror(errno));
+    }
+
+    json_node *response = json_node_ref(json_object_new());
+    json_object_set_member(response, "status", json_integer_new(retval));
+    json_object_set_member(response, "output", json_string_new(output));
+    if (!io_socket_set_timeout(fd, LSTF_DAEMON_CLIENT_TIMEOUT) || !write_message(fd, response))
+        lstf_report_warning(NULL, "daemon: could not send the result of %s: %s",
+                script ? script->value : "a script", strerror(errno));
+
+    json_node_unref(response);
+    json_node_unref(request);
+    free(request_str);
+    free(output);
+    close(fd);
+}
+
+/**
+ * Listens for scripts submitted with `--submit` and runs them, keeping the
+ * language servers that they start running for the scripts after them. Stops
+ * on SIGINT or SIGTERM.
+ */
+static int run_daemon(const char *progname, struct lstf_options options)
+{
+    char *socket_path = get_socket_path(options, true);
+
+    if (!socket_path)
+        return 1;
+
+    struct lstf_daemon daemon = {
+        .progname = progname,
+        .options = options,
+        .listen_fd = io_socket_listen(socket_path),
+        .root_dir = io_get_current_dir()
+    };
+
+    if (daemon.listen_fd == -1) {
+        lstf_report_error(NULL, "daemon: could not listen on %s: %s", socket_path, strerror(errno));
+        free(socket_path);
+        return 1;
+    }
+
+    if (pipe(daemon_stop_pipe) != 0) {
+        lstf_report_error(NULL, "daemon: could not create pipe: %s", strerror(errno));
+        close(daemon.listen_fd);
+        unlink(socket_path);
+        free(socket_path);
+        return 1;
+    }
+
+    char *root_dir = string_destroy(string_new_copy_data(daemon.root_dir));
+    daemon.root_dir = root_dir;
+    daemon.options.server_pool = lsp_client_pool_new();
+
+    struct sigaction action = { .sa_handler = daemon_handle_signal };
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // a client that goes away should not take the daemon with it
+    signal(SIGPIPE, SIG_IGN);
+
+    eventloop *loop = daemon.options.server_pool->loop;
+    eventloop_add_fd(loop, daemon_stop_pipe[0], true, daemon_stop_cb, &daemon);
+    eventloop_add_fd(loop, daemon.listen_fd, true, daemon_connection_cb, &daemon);
+    fprintf(stderr, "lstf: daemon listening on %s\n", socket_path);
+
+    while (!daemon.stopping) {
+        // keep checking on retired servers until they are gone, since one
+        // that doesn't exit in time has to be killed
+        bool collecting = lsp_client_pool_collect(daemon.options.server_pool);
+        unsigned processed = 0;
+
+        eventloop_process(loop, collecting, &processed);
+        if (collecting && processed == 0)
+            thrd_sleep(&(struct timespec){.tv_nsec = 10000000}, NULL);
+        if (daemon.has_connection) {
+            daemon.has_connection = false;
+            serve_client(&daemon);
+            if (!daemon.stopping)
+                eventloop_add_fd(loop, daemon.listen_fd, true, daemon_connection_cb, &daemon);
+        }
+    }
+
+    fprintf(stderr, "lstf: daemon stopping\n");
+    lsp_client_pool_destroy(daemon.options.server_pool);
+    close(daemon.listen_fd);
+    unlink(socket_path);
+    close(daemon_stop_pipe[0]);
+    close(daemon_stop_pipe[1]);
+    free(root_dir);
+    free(socket_path);
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     (void) argc;
@@ -570,8 +1689,74 @@ int main(int argc, char *argv[])
                             " `resolver`, `analyzer`, `codegen` or `interpreter`", option);
                 return 1;
             }
+        } else if (strncmp(option, "--load", sizeof "--load" - 1) == 0 ||
+                   strncmp(option, "--session-rate", sizeof "--session-rate" - 1) == 0 ||
+                   strncmp(option, "--duration", sizeof "--duration" - 1) == 0 ||
+                   strncmp(option, "--stats", sizeof "--stats" - 1) == 0 ||
+                   strncmp(option, "--capture", sizeof "--capture" - 1) == 0 ||
+                   strncmp(option, "--profile", sizeof "--profile" - 1) == 0 ||
+                   strncmp(option, "--trace", sizeof "--trace" - 1) == 0 ||
+                   strncmp(option, "--junit", sizeof "--junit" - 1) == 0 ||
+                   strncmp(option, "--socket", sizeof "--socket" - 1) == 0) {
+            char *eqc = strchr(option, '=');
+            char *argument = NULL;
+            char *endptr = NULL;
+
+            if (eqc) {
+                *eqc = '\0';
+                argument = eqc + 1;
+            } else if (*(argp + 1)) {
+                argument = *++argp;
+            }
+
+            if (!argument) {
+                lstf_report_error(NULL, "missing argument to `%s`", option);
+                return 1;
+            }
+
+            if (strcmp(option, "--load") == 0) {
+                unsigned long sessions = strtoul(argument, &endptr, 10);
+                if (*endptr || sessions == 0 || sessions > UINT16_MAX) {
+                    lstf_report_error(NULL, "`%s` must be a number of sessions between 1 and %u", option, (unsigned) UINT16_MAX);
+                    return 1;
+                }
+                options.load_sessions = (unsigned) sessions;
+            } else if (strcmp(option, "--session-rate") == 0) {
+                options.load_session_rate = strtod(argument, &endptr);
+                if (*endptr || !(options.load_session_rate > 0)) {
+                    lstf_report_error(NULL, "`%s` must be a positive number of sessions per second", option);
+                    return 1;
+                }
+            } else if (strcmp(option, "--duration") == 0) {
+                options.load_duration = strtod(argument, &endptr);
+                if (*endptr || !(options.load_duration > 0)) {
+                    lstf_report_error(NULL, "`%s` must be a positive number of seconds", option);
+                    return 1;
+                }
+            } else if (strcmp(option, "--stats") == 0) {
+                options.stats_filename = argument;
+            } else if (strcmp(option, "--capture") == 0) {
+                options.capture_filename = argument;
+            } else if (strcmp(option, "--profile") == 0) {
+                options.profile_filename = argument;
+            } else if (strcmp(option, "--trace") == 0) {
+                options.trace_filename = argument;
+            } else if (strcmp(option, "--junit") == 0) {
+                options.junit_filename = argument;
+            } else if (strcmp(option, "--socket") == 0) {
+                options.socket_path = argument;
+            } else {
+                lstf_report_error(NULL, "unrecognized command line option `%s`", option);
+                return 1;
+            }
+        } else if (strcmp(option, "--daemon") == 0) {
+            options.daemon = true;
+        } else if (strcmp(option, "--submit") == 0) {
+            options.submit = true;
         } else if (strcmp(option, "-no-lsp") == 0) {
             options.no_lsp = true;
+        } else if (strcmp(option, "--no-cache") == 0) {
+            options.no_cache = true;
         } else if (strcmp(option, "-emit-ir") == 0) {
             options.emit_ir = true;
         } else if (strncmp(option, "-a", sizeof "-a" - 1) == 0) {
@@ -584,6 +1769,31 @@ int main(int argc, char *argv[])
             is_compiling = true;
         } else if (strcmp(option, "-d") == 0) {
             options.disassemble = true;
+        } else if (strncmp(option, "-j", sizeof "-j" - 1) == 0) {
+            const char *argument = option[2] ? &option[2 + (option[2] == '=')] : *(argp + 1) ? *++argp : NULL;
+            char *endptr = NULL;
+
+            if (!argument) {
+                lstf_report_error(NULL, "missing argument to `-j`");
+                return 1;
+            }
+
+            unsigned long jobs = strtoul(argument, &endptr, 10);
+            if (*endptr || jobs == 0 || jobs > UINT16_MAX) {
+                lstf_report_error(NULL, "`-j` must be a number of jobs between 1 and %u", (unsigned) UINT16_MAX);
+                return 1;
+            }
+            options.jobs = (unsigned) jobs;
+
+            if (!options.scripts) {
+                options.scripts = array_new();
+                // a script given before -j is the first one to run
+                if (options.input_filename && !add_scripts(&options, options.input_filename))
+                    return 1;
+                options.input_filename = NULL;
+                is_compiling = false;
+                is_interpreting = false;
+            }
         } else if (strcmp(option, "-break") == 0) {
             if (!*(argp + 1)) {
                 lstf_report_error(NULL, "argument required for `%s'", option);
@@ -661,6 +1871,10 @@ int main(int argc, char *argv[])
         } else if (option[0] == '-') {
             lstf_report_error(NULL, "unrecognized command line option `%s`", option);
             break;
+        } else if (options.jobs) {
+            // with -j, every input is a script (or a directory of them) to run
+            if (!add_scripts(&options, option))
+                return 1;
         } else if (*argp) {
             is_input_arg = true;
         }
@@ -744,7 +1958,57 @@ int main(int argc, char *argv[])
         }
     }
 
-    if (is_compiling) {
+    if (options.jobs && (options.output_codegen || options.disassemble || options.output_filename ||
+                         options.expected_output || options.breakpoints || options.load_sessions ||
+                         options.stats_filename || options.capture_filename || options.profile_filename ||
+                         options.trace_filename)) {
+        lstf_report_error(NULL, "`-c`, `-d`, `-o`, `-expect`, `-break`, `--load`, `--stats`, `--capture`, `--profile` "
+                "and `--trace` cannot be used with `-j`");
+        retval = 1;
+    } else if (options.daemon && options.submit) {
+        lstf_report_error(NULL, "only one of `--daemon` and `--submit` may be used");
+        retval = 1;
+    } else if ((options.daemon || options.submit) &&
+               (options.jobs || options.output_codegen || options.disassemble || options.output_filename ||
+                options.breakpoints || options.load_sessions || options.stats_filename || options.capture_filename ||
+                options.profile_filename || options.trace_filename ||
+                options.disable_resolver || options.disable_analyzer || options.disable_codegen ||
+                options.disable_interpreter || options.emit_ir)) {
+        lstf_report_error(NULL, "`-j`, `-c`, `-d`, `-o`, `-break`, `-emit-ir`, `--disable`, `--load`, `--stats`, `--capture`, "
+                "`--profile` and `--trace` cannot be used with `--daemon` or `--submit`");
+        retval = 1;
+    } else if (options.daemon && (options.input_filename || options.expected_output || options.variables || options.no_lsp)) {
+        lstf_report_error(NULL, "scripts and their options are given to `--submit`, not `--daemon`");
+        retval = 1;
+    } else if (options.daemon) {
+        retval = run_daemon(argv[0], options);
+    } else if (options.submit && !options.input_filename) {
+        lstf_report_error(NULL, "no script to submit");
+        retval = 1;
+    } else if (options.submit) {
+        retval = submit_script(options);
+    } else if (options.socket_path) {
+        lstf_report_error(NULL, "`--socket` can only be used with `--daemon` or `--submit`");
+        retval = 1;
+    } else if (options.jobs && options.scripts->length == 0) {
+        lstf_report_error(NULL, "no scripts to run");
+        retval = 1;
+    } else if (options.jobs) {
+        retval = run_scripts(argv[0], options);
+    } else if (options.junit_filename) {
+        lstf_report_error(NULL, "`--junit` can only be used with `-j`");
+        retval = 1;
+    } else if (!options.load_sessions && (options.load_session_rate > 0 || options.load_duration > 0)) {
+        lstf_report_error(NULL, "`--session-rate` and `--duration` can only be used with `--load`");
+        retval = 1;
+    } else if (options.load_sessions && (options.expected_output || options.breakpoints || options.capture_filename ||
+                                         options.profile_filename)) {
+        lstf_report_error(NULL, "`-expect`, `-break`, `--capture` and `--profile` cannot be used with `--load`");
+        retval = 1;
+    } else if (options.trace_filename && !io_trace_start(options.trace_filename)) {
+        lstf_report_error(NULL, "failed to open %s: %s", options.trace_filename, strerror(errno));
+        retval = 1;
+    } else if (is_compiling) {
         retval = compile_lstf_script(argv[0], options);
     } else if (is_interpreting) {
         retval = load_and_run_file(argv[0], options);
@@ -757,6 +2021,11 @@ int main(int argc, char *argv[])
 
     if (options.breakpoints)
         array_destroy(options.breakpoints);
+    if (options.scripts) {
+        for (size_t i = 0; i < options.scripts->length; i++)
+            free(options.scripts->elements[i]);
+        array_destroy(options.scripts);
+    }
     if (options.variables)
         ptr_hashmap_destroy(options.variables);
 
@@ -4,6 +4,8 @@
 #include "data-structures/ptr-list.h"
 #include "data-structures/string-builder.h"
 #include "io/event.h"
+#include "io/io-common.h"
+#include "io/io-trace.h"
 #include "io/outputstream.h"
 #include "lsp/lsp-client.h"
 #include "lstf-common.h"
@@ -14,8 +16,10 @@
 #include "lstf-vm-value.h"
 #include "lstf-vm-coroutine.h"
 #include "lstf-vm-lsp.h"
+#include "lstf-vm-time.h"
 #include "util.h"
 #include "json/json.h"
+#include "json/json-matcher.h"
 #include "json/json-parser.h"
 #include <assert.h>
 #include <math.h>
@@ -62,22 +66,63 @@ lstf_virtualmachine_new(lstf_vm_program *program,
             NULL, free);
     vm->breakpoints = ptr_hashset_new(ptrhash, NULL, NULL, NULL);
     vm->debug = debug;
+    vm->collector = lstf_vm_collector_get_thread_default();
 
     return vm;
 }
 
+static void
+lstf_vm_inlinecache_clear_shapes(lstf_vm_inlinecache *cache)
+{
+    for (unsigned i = 0; i < LSTF_VM_INLINECACHE_ENTRIES; i++) {
+        if (cache->entries[i].shape)
+            json_shape_unref(cache->entries[i].shape);
+    }
+    memset(cache->entries, 0, sizeof cache->entries);
+    cache->next_entry = 0;
+}
+
 void lstf_virtualmachine_destroy(lstf_virtualmachine *vm)
 {
+#ifdef LSTF_VM_STATS
+    lstf_vm_stats_report(&vm->stats);
+#endif
+    if (vm->inline_caches) {
+        for (size_t i = 0; i < vm->program->code_size; i++) {
+            lstf_vm_inlinecache *cache = vm->inline_caches[i];
+
+            if (!cache)
+                continue;
+            if (cache->key)
+                string_unref(cache->key);
+            lstf_vm_inlinecache_clear_shapes(cache);
+            if (cache->member_name)
+                json_member_name_unref(cache->member_name);
+            if (cache->has_constant)
+                lstf_vm_value_clear(&cache->constant);
+            json_matcher_destroy(cache->matcher);
+            free(cache);
+        }
+        free(vm->inline_caches);
+    }
     lstf_vm_program_unref(vm->program);
     outputstream_unref(vm->ostream);
     ptr_list_destroy(vm->run_queue);
     ptr_list_destroy(vm->suspended_list);
     lstf_vm_coroutine_unref(vm->main_coroutine);
-    eventloop_destroy(vm->event_loop);
+    if (!vm->server_pool)
+        eventloop_destroy(vm->event_loop);
     ptr_hashmap_destroy(vm->command_line_options);
     ptr_hashset_destroy(vm->breakpoints);
-    if (vm->client)
-        lsp_client_destroy(vm->client);
+    if (vm->client) {
+        if (vm->server_pool)
+            lsp_client_pool_release(vm->server_pool, vm->client);
+        else
+            lsp_client_destroy(vm->client);
+    }
+    // free whatever the program left in cycles
+    lstf_vm_collector_collect(vm->collector);
+    lstf_vm_collector_unref(vm->collector);
     free(vm);
 }
 
@@ -181,6 +226,71 @@ lstf_virtualmachine_read_string(lstf_virtualmachine *vm,
     return status;
 }
 
+/**
+ * Returns the inline cache for the instruction at [pc], creating it if it
+ * doesn't exist yet.
+ */
+static lstf_vm_inlinecache *
+lstf_virtualmachine_get_inlinecache(lstf_virtualmachine *vm, const uint8_t *pc)
+{
+    const size_t code_offset = (size_t)(pc - vm->program->code);
+
+    assert(code_offset < vm->program->code_size && "instruction out of range");
+    if (!vm->inline_caches) {
+        if (!(vm->inline_caches = calloc(vm->program->code_size, sizeof *vm->inline_caches))) {
+            perror("failed to create inline caches");
+            abort();
+        }
+    }
+
+    if (!vm->inline_caches[code_offset]) {
+        if (!(vm->inline_caches[code_offset] = calloc(1, sizeof *vm->inline_caches[code_offset]))) {
+            perror("failed to create inline cache");
+            abort();
+        }
+    }
+
+    return vm->inline_caches[code_offset];
+}
+
+/**
+ * Pushes the string or scalar value of a JSON expression, parsing it only the
+ * first time the instruction is executed.
+ */
+static lstf_vm_status
+lstf_virtualmachine_push_expression(lstf_virtualmachine *vm,
+                                    lstf_vm_coroutine   *cr,
+                                    const uint8_t       *pc,
+                                    const char          *expression_string)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    lstf_vm_inlinecache *cache = lstf_virtualmachine_get_inlinecache(vm, pc);
+    json_node *node = NULL;
+    lstf_vm_value value;
+
+    if (!cache->has_constant) {
+        if (!(node = json_parser_parse_string(expression_string)))
+            return lstf_vm_status_invalid_expression;
+
+        value = lstf_vm_value_from_json_node(node);
+        if (lstf_vm_value_type_is_json(value.value_type)) {
+            // objects and arrays are mutable, so each execution must create
+            // a new one
+            if ((status = lstf_vm_stack_push_value(cr->stack, &value)))
+                lstf_vm_value_clear(&value);
+            return status;
+        }
+
+        cache->constant = lstf_vm_value_take_ownership(&value);
+        cache->has_constant = true;
+    }
+
+    // the stack gets its own reference
+    value = cache->constant;
+    value.takes_ownership = false;
+    return lstf_vm_stack_push_value(cr->stack, &value);
+}
+
 static lstf_vm_status
 lstf_vm_op_jump_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
 
@@ -206,11 +316,10 @@ lstf_vm_op_load_frameoffset_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 static lstf_vm_status
 lstf_vm_op_load_dataoffset_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
+    const uint8_t *const pc = cr->pc - 1;
     lstf_vm_status status = lstf_vm_status_continue;
     uint64_t data_offset;
     char *expression_string = NULL;
-    json_node *node = NULL;
-    lstf_vm_value value;
 
     if ((status = lstf_virtualmachine_read_integer(vm, cr, &data_offset)))
         return status;
@@ -220,14 +329,7 @@ lstf_vm_op_load_dataoffset_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 
     expression_string = (char *)vm->program->data + data_offset;
 
-    if (!(node = json_parser_parse_string(expression_string)))
-        return lstf_vm_status_invalid_expression;
-
-    value = lstf_vm_value_from_json_node(node);
-    if ((status = lstf_vm_stack_push_value(cr->stack, &value)))
-        lstf_vm_value_clear(&value);
-
-    return status;
+    return lstf_virtualmachine_push_expression(vm, cr, pc, expression_string);
 }
 
 static lstf_vm_status
@@ -250,25 +352,16 @@ lstf_vm_op_load_codeoffset_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 static lstf_vm_status
 lstf_vm_op_load_expression_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
+    const uint8_t *const pc = cr->pc - 1;
     lstf_vm_status status = lstf_vm_status_continue;
     // the expression string is part of the code section, and doesn't need to
     // be free()'d
     char *expression_string = NULL;
-    json_node *node = NULL;
-    lstf_vm_value value;
 
     if ((status = lstf_virtualmachine_read_string(vm, cr, &expression_string)))
         return status;
 
-    // parse JSON expression
-    if (!(node = json_parser_parse_string(expression_string)))
-        return lstf_vm_status_invalid_expression;
-
-    value = lstf_vm_value_from_json_node(node);
-    if ((status = lstf_vm_stack_push_value(cr->stack, &value)))
-        lstf_vm_value_clear(&value);
-
-    return status;
+    return lstf_virtualmachine_push_expression(vm, cr, pc, expression_string);
 }
 
 static lstf_vm_status
@@ -307,10 +400,60 @@ lstf_vm_op_pop_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
     return status;
 }
 
+/**
+ * Finds the position of the member named [key] in the shape of [object],
+ * using and updating the inline cache. Returns -1 if the object has no shape
+ * or doesn't have the member.
+ */
+static int
+lstf_vm_inlinecache_find_member(lstf_vm_inlinecache *cache,
+                                json_node           *object,
+                                string              *key)
+{
+    const json_shape *shape = json_object_get_shape(object);
+
+    if (!shape)
+        return -1;
+
+    if (cache->key != key) {
+        const char *interned_member_name = json_member_name_intern(key->buffer);
+
+        if (cache->member_name != interned_member_name) {
+            // the instruction is accessing a different member now
+            lstf_vm_inlinecache_clear_shapes(cache);
+            if (cache->member_name)
+                json_member_name_unref(cache->member_name);
+            cache->member_name = interned_member_name;
+        } else {
+            json_member_name_unref(interned_member_name);
+        }
+        if (cache->key)
+            string_unref(cache->key);
+        cache->key = string_ref(key);
+    }
+
+    for (unsigned i = 0; i < LSTF_VM_INLINECACHE_ENTRIES; i++) {
+        if (cache->entries[i].shape == shape)
+            return (int)cache->entries[i].slot;
+    }
+
+    int slot = json_shape_find_member(shape, cache->member_name);
+
+    if (slot >= 0) {
+        if (cache->entries[cache->next_entry].shape)
+            json_shape_unref(cache->entries[cache->next_entry].shape);
+        cache->entries[cache->next_entry].shape = json_shape_ref(shape);
+        cache->entries[cache->next_entry].slot = (unsigned)slot;
+        cache->next_entry = (cache->next_entry + 1) % LSTF_VM_INLINECACHE_ENTRIES;
+    }
+
+    return slot;
+}
+
 static lstf_vm_status
 lstf_vm_op_get_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
-    (void) vm;
+    uint8_t *const pc = cr->pc - 1;
     lstf_vm_status status = lstf_vm_status_continue;
     json_node *node;
     lstf_vm_value index;
@@ -322,7 +465,15 @@ lstf_vm_op_get_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
     if ((status = lstf_vm_stack_pop_object(cr->stack, &node)) == lstf_vm_status_continue) {
         if (index.value_type == lstf_vm_value_type_string) {
             json_node *member_value = NULL;
-            if ((member_value = json_object_get_member(node, index.data.string->buffer))) {
+            int slot = lstf_vm_inlinecache_find_member(lstf_virtualmachine_get_inlinecache(vm, pc),
+                                                       node, index.data.string);
+
+            if (slot >= 0)
+                member_value = json_object_get_member_at(node, (unsigned)slot);
+            else
+                member_value = json_object_get_member(node, index.data.string->buffer);
+
+            if (member_value) {
                 lstf_vm_value value = lstf_vm_value_from_json_node(member_value);
                 if ((status = lstf_vm_stack_push_value(cr->stack, &value)))
                     lstf_vm_value_clear(&value);
@@ -361,7 +512,7 @@ lstf_vm_op_get_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 static lstf_vm_status
 lstf_vm_op_set_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
-    (void) vm;
+    uint8_t *const pc = cr->pc - 1;
     lstf_vm_status status = lstf_vm_status_continue;
     json_node *node;
     lstf_vm_value index;
@@ -379,7 +530,13 @@ lstf_vm_op_set_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 
     if ((status = lstf_vm_stack_pop_object(cr->stack, &node)) == lstf_vm_status_continue) {
         if (index.value_type == lstf_vm_value_type_string) {
-            json_object_set_member(node, index.data.string->buffer, lstf_vm_value_to_json_node(value));
+            int slot = lstf_vm_inlinecache_find_member(lstf_virtualmachine_get_inlinecache(vm, pc),
+                                                       node, index.data.string);
+
+            if (slot >= 0)
+                json_object_set_member_at(node, (unsigned)slot, lstf_vm_value_to_json_node(value));
+            else
+                json_object_set_member(node, index.data.string->buffer, lstf_vm_value_to_json_node(value));
         } else {
             status = lstf_vm_status_invalid_operand_type;
         }
@@ -513,12 +670,13 @@ lstf_vm_op_calli_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
     return status;
 }
 
-static lstf_vm_status
-lstf_vm_schedule_new_coroutine(lstf_virtualmachine *vm,
-                               lstf_vm_coroutine   *cr,
-                               uint8_t              num_params,
-                               uint8_t             *code_address,
-                               lstf_vm_closure     *closure)
+lstf_vm_status
+lstf_virtualmachine_schedule_call(lstf_virtualmachine *vm,
+                                  uint8_t             *code_address,
+                                  lstf_vm_closure     *closure,
+                                  lstf_vm_value       *arguments,
+                                  uint8_t              num_arguments,
+                                  lstf_vm_coroutine  **coroutine)
 {
     lstf_vm_status status = lstf_vm_status_continue;
     // create a new coroutine
@@ -527,23 +685,48 @@ lstf_vm_schedule_new_coroutine(lstf_virtualmachine *vm,
     // the saved return address is NULL, because when the coroutine returns it exits
     if ((status = lstf_vm_stack_setup_frame(new_cr->stack, NULL, closure)))
         goto cleanup_coroutine;
-    // pass parameters to the new coroutine, loaded from the current stack frame
-    lstf_vm_value parameters[1u << (CHAR_BIT * sizeof num_params)] = { 0 };
-    for (uint8_t i = 0; i < num_params; i++)
-        if ((status = lstf_vm_stack_pop_value(cr->stack, &parameters[num_params - i - 1])))
-            goto cleanup_coroutine;
-    for (uint8_t i = 0; i < num_params; i++)
-        if ((status = lstf_vm_stack_push_value(new_cr->stack, &parameters[i])))
+    // pass the arguments to the new coroutine
+    for (uint8_t i = 0; i < num_arguments; i++)
+        if ((status = lstf_vm_stack_push_value(new_cr->stack, &arguments[i])))
             goto cleanup_coroutine;
     // queue the coroutine for execution at a later point
     new_cr->node = ptr_list_append(vm->run_queue, new_cr);
+    if (coroutine)
+        *coroutine = new_cr;
     return status;
 
 cleanup_coroutine:
+    for (uint8_t i = 0; i < num_arguments; i++)
+        lstf_vm_value_clear(&arguments[i]);
     lstf_vm_coroutine_unref(new_cr);
     return status;
 }
 
+static lstf_vm_status
+lstf_vm_schedule_new_coroutine(lstf_virtualmachine *vm,
+                               lstf_vm_coroutine   *cr,
+                               uint8_t              num_params,
+                               uint8_t             *code_address,
+                               lstf_vm_closure     *closure)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    // pass parameters to the new coroutine, loaded from the current stack frame
+    lstf_vm_value parameters[1u << (CHAR_BIT * sizeof num_params)] = { 0 };
+    for (uint8_t i = 0; i < num_params; i++) {
+        if ((status = lstf_vm_stack_pop_value(cr->stack, &parameters[num_params - i - 1]))) {
+            for (uint8_t j = 0; j < i; j++)
+                lstf_vm_value_clear(&parameters[num_params - j - 1]);
+            goto cleanup;
+        }
+    }
+    status = lstf_virtualmachine_schedule_call(vm, code_address, closure, parameters, num_params, NULL);
+
+cleanup:
+    if (closure)
+        lstf_vm_closure_unref(closure);
+    return status;
+}
+
 static lstf_vm_status
 lstf_vm_op_schedule_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
@@ -746,6 +929,23 @@ lstf_vm_op_upset_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
     return status;
 }
 
+/**
+ * Routines accessible with the `vmcall` instruction.
+ */
+static lstf_vm_status (*const vmcall_table[256])(lstf_virtualmachine *, lstf_vm_coroutine *) = {
+    [lstf_vm_vmcall_memory]         = lstf_vm_vmcall_memory_exec,
+    [lstf_vm_vmcall_connect]        = lstf_vm_vmcall_connect_exec,
+    [lstf_vm_vmcall_td_open]        = lstf_vm_vmcall_td_open_exec,
+    [lstf_vm_vmcall_diagnostics]    = lstf_vm_vmcall_diagnostics_exec,
+    [lstf_vm_vmcall_change]         = lstf_vm_vmcall_change_exec,
+    [lstf_vm_vmcall_completion]     = lstf_vm_vmcall_completion_exec,
+    [lstf_vm_vmcall_request]        = lstf_vm_vmcall_request_exec,
+    [lstf_vm_vmcall_notify]         = lstf_vm_vmcall_notify_exec,
+    [lstf_vm_vmcall_now]            = lstf_vm_vmcall_now_exec,
+    [lstf_vm_vmcall_elapsed]        = lstf_vm_vmcall_elapsed_exec,
+    [lstf_vm_vmcall_bench]          = lstf_vm_vmcall_bench_exec,
+};
+
 static lstf_vm_status
 lstf_vm_op_vmcall_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
@@ -1265,16 +1465,59 @@ lstf_vm_op_exit_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 static lstf_vm_status
 lstf_vm_op_assert_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
-    (void) vm;
     lstf_vm_status status = lstf_vm_status_continue;
     bool previous_result;
 
     if ((status = lstf_vm_stack_pop_boolean(cr->stack, &previous_result)))
         return status;
 
-    if (!previous_result)
+    if (!previous_result) {
+        // the result came straight from a failed `match`
+        vm->assertion_message = vm->match_trace_pc == cr->pc - 1 ? vm->match_trace.message : NULL;
         status = lstf_vm_status_assertion_failed;
+    }
+
+    return status;
+}
+
+static lstf_vm_status
+lstf_vm_op_match_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    const uint8_t *const pc = cr->pc - 1;
+    lstf_vm_status status = lstf_vm_status_continue;
+    uint64_t program_size;
+    const uint8_t *program = NULL;
+    lstf_vm_inlinecache *cache = NULL;
+    lstf_vm_value candidate;
+
+    if ((status = lstf_virtualmachine_read_integer(vm, cr, &program_size)))
+        return status;
+
+    if (program_size > (uint64_t)(vm->program->code + vm->program->code_size - cr->pc))
+        return lstf_vm_status_invalid_code_offset;
+
+    program = cr->pc;
+    cr->pc += program_size;
+
+    // the program is only loaded the first time the instruction is executed
+    cache = lstf_virtualmachine_get_inlinecache(vm, pc);
+    if (!cache->matcher && !(cache->matcher = json_matcher_new(program, program_size)))
+        return lstf_vm_status_invalid_expression;
+
+    if ((status = lstf_vm_stack_pop_value(cr->stack, &candidate)))
+        return status;
+
+    if (lstf_vm_value_type_is_json(candidate.value_type)) {
+        bool matched = json_matcher_match(cache->matcher, candidate.data.json_node_ref, &vm->match_trace);
 
+        if (!matched)
+            vm->match_trace_pc = cr->pc;
+        status = lstf_vm_stack_push_boolean(cr->stack, matched);
+    } else {
+        status = lstf_vm_status_invalid_operand_type;
+    }
+
+    lstf_vm_value_clear(&candidate);
     return status;
 }
 
@@ -1342,11 +1585,51 @@ static lstf_vm_status (*const instruction_table[256])(lstf_virtualmachine *, lst
     [lstf_vm_op_exit]               = lstf_vm_op_exit_exec,
     
     // --- miscellaneous
-    [lstf_vm_op_assert]             = lstf_vm_op_assert_exec
+    [lstf_vm_op_assert]             = lstf_vm_op_assert_exec,
+    [lstf_vm_op_match]              = lstf_vm_op_match_exec
 };
 
-bool
-lstf_virtualmachine_run(lstf_virtualmachine *vm)
+/**
+ * Ends the current run slice in the trace, if there is one.
+ */
+static void lstf_virtualmachine_trace_end_slice(lstf_virtualmachine *vm)
+{
+    if (!vm->trace_coroutine)
+        return;
+    io_trace_complete("vm", "run", vm->trace_slice_start, io_get_monotonic_time(), "coroutine", vm->trace_coroutine);
+    vm->trace_coroutine = 0;
+}
+
+/**
+ * Starts a new run slice in the trace if [cr] is not the coroutine that ran
+ * last.
+ */
+static void lstf_virtualmachine_trace_switch_to(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    if (!cr->trace_id)
+        cr->trace_id = io_trace_new_id();
+    if (vm->trace_coroutine == cr->trace_id)
+        return;
+    lstf_virtualmachine_trace_end_slice(vm);
+    vm->trace_coroutine = cr->trace_id;
+    vm->trace_slice_start = io_get_monotonic_time();
+}
+
+/**
+ * Records in the trace that [cr] was moved to or from the suspended list.
+ */
+static void lstf_virtualmachine_trace_suspend(lstf_vm_coroutine *cr, bool suspended)
+{
+    if (!cr->trace_id)
+        cr->trace_id = io_trace_new_id();
+    if (suspended)
+        io_trace_async_begin("vm", "outstanding I/O", cr->trace_id);
+    else
+        io_trace_async_end("vm", "outstanding I/O", cr->trace_id);
+}
+
+static bool
+lstf_virtualmachine_run_coroutines(lstf_virtualmachine *vm)
 {
     while (true) {
         if (!(vm->last_status == lstf_vm_status_continue ||
@@ -1377,11 +1660,23 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
             // run one iteration of the event loop on every context switch, and
             // allow blocking if the run queue is empty
             vm->instructions_executed = 0;      // reset instruction counter
-            eventloop_process(vm->event_loop,
-                              !ptr_list_is_empty(vm->run_queue), NULL);
+            // every value in use is referenced in between instructions, so
+            // this is a safe point to look for cycles
+            if (lstf_vm_collector_should_collect(vm->collector))
+                lstf_vm_collector_collect(vm->collector);
+            if (io_trace_is_enabled())
+                lstf_virtualmachine_trace_end_slice(vm);
+            const bool may_block = !vm->nonblocking && ptr_list_is_empty(vm->run_queue);
+            const uint64_t wait_start = vm->profiler && may_block ? io_get_monotonic_time() : 0;
+            eventloop_process(vm->event_loop, !may_block, NULL);
+            if (wait_start)
+                lstf_vm_profiler_add_wait(vm->profiler, vm->suspended_list, wait_start);
             // errors can be raised inside event handlers
             if (vm->last_status != lstf_vm_status_continue)
                 return vm->last_status == lstf_vm_status_hit_breakpoint;
+            // give the other virtual machines a turn
+            if (vm->nonblocking)
+                return true;
         } else if (ptr_list_is_empty(vm->run_queue)) {
             // We don't want to run the event loop every cycle, since that will
             // involve a number of system calls (poll() on POSIX and
@@ -1389,17 +1684,28 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
             // Windows). However, since the run queue is empty (all coroutines
             // are blocked on I/O) we want to make as much progress as possible.
             unsigned processed = 0;
+            unsigned last_processed = 0;
             bool have_ready_cr = false;
+            const uint64_t wait_start = vm->profiler ? io_get_monotonic_time() : 0;
             while (!have_ready_cr &&
-                   eventloop_process(vm->event_loop, false, &processed)) {
+                   eventloop_process(vm->event_loop, vm->nonblocking, &processed)) {
                 // errors can be raised inside event handlers
                 if (vm->last_status != lstf_vm_status_continue)
                     return vm->last_status == lstf_vm_status_hit_breakpoint;
 
+                // the caller decides how to wait
+                if (vm->nonblocking && processed == last_processed) {
+                    if (wait_start)
+                        lstf_vm_profiler_add_wait(vm->profiler, vm->suspended_list, wait_start);
+                    return true;
+                }
+                last_processed = processed;
                 // avoid busy waiting if nothing was processed. sleep for .2s
                 if (processed == 0)
                     thrd_sleep(&(struct timespec){.tv_nsec = 200000000}, NULL);
                 else {
+                    // an event handler may have scheduled a new coroutine
+                    have_ready_cr = !ptr_list_is_empty(vm->run_queue);
                     // check if any coroutines were unblocked
                     ptr_list_foreach(vm->suspended_list, sus_cr, lstf_vm_coroutine *, {
                         if (sus_cr->outstanding_io == 0) {
@@ -1409,6 +1715,8 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
                     });
                 }
             }
+            if (wait_start)
+                lstf_vm_profiler_add_wait(vm->profiler, vm->suspended_list, wait_start);
         }
 
         // after running eventloop_process(), we need to resynchronize the
@@ -1426,6 +1734,8 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
                     ptr_list_node *node = ptr_list_append(vm->suspended_list, run_cr);
                     ptr_list_remove_link(vm->run_queue, run_cr->node);
                     run_cr->node = node;
+                    if (io_trace_is_enabled())
+                        lstf_virtualmachine_trace_suspend(run_cr, true);
                 }
             } 
             if (sus_it.has_next) {
@@ -1437,6 +1747,8 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
                     ptr_list_node *node = ptr_list_append(vm->run_queue, sus_cr);
                     ptr_list_remove_link(vm->suspended_list, sus_cr->node);
                     sus_cr->node = node;
+                    if (io_trace_is_enabled())
+                        lstf_virtualmachine_trace_suspend(sus_cr, false);
                 }
             }
         }
@@ -1470,6 +1782,9 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
         ptr_list_remove_first_link(vm->run_queue);
         cr->node = NULL;
 
+        if (io_trace_is_enabled())
+            lstf_virtualmachine_trace_switch_to(vm, cr);
+
         // fetch the instruction
         uint8_t opcode;
         if ((vm->last_status = lstf_virtualmachine_read_byte(vm, cr, &opcode))) {
@@ -1478,6 +1793,13 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
             return false;
         }
 
+#ifdef LSTF_VM_STATS
+        const uint64_t stats_start_allocations = lstf_vm_stats_allocations;
+        const uint8_t stats_vmcall_code =
+            opcode == lstf_vm_op_vmcall && cr->pc < vm->program->code + vm->program->code_size ? *cr->pc : 0;
+        const uint64_t stats_start_cycles = lstf_vm_stats_get_cycles();
+#endif
+
         // execute the instruction
         if (instruction_table[opcode]) {
             vm->last_status = instruction_table[opcode](vm, cr);
@@ -1486,6 +1808,16 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
         }
         vm->instructions_executed++;
 
+#ifdef LSTF_VM_STATS
+        const uint64_t stats_cycles = lstf_vm_stats_get_cycles() - stats_start_cycles;
+        const uint64_t stats_allocations = lstf_vm_stats_allocations - stats_start_allocations;
+        lstf_vm_stats_counter_add(&vm->stats.opcodes[opcode], stats_cycles, stats_allocations);
+        if (opcode == lstf_vm_op_vmcall)
+            lstf_vm_stats_counter_add(&vm->stats.vmcalls[stats_vmcall_code], stats_cycles, stats_allocations);
+#endif
+        if (vm->profiler)
+            lstf_vm_profiler_tick(vm->profiler, cr);
+
         // decide what to do with the current coroutine: keep it or throw it away?
         if (cr->pc && !cr->node) {
             // only keep the coroutine if it has not completed (and it hasn't
@@ -1502,12 +1834,62 @@ lstf_virtualmachine_run(lstf_virtualmachine *vm)
             } else {
                 // suspend the coroutine if it has outstanding I/O
                 cr->node = ptr_list_append(vm->suspended_list, cr);
+                if (io_trace_is_enabled()) {
+                    lstf_virtualmachine_trace_end_slice(vm);
+                    lstf_virtualmachine_trace_suspend(cr, true);
+                }
             }
+        } else if (!cr->pc) {
+            // the coroutine has completed
+            if (io_trace_is_enabled())
+                lstf_virtualmachine_trace_end_slice(vm);
+            if (cr->on_exit)
+                cr->on_exit(cr, cr->on_exit_data);
         }
         lstf_vm_coroutine_unref(cr);
     }
 }
 
+bool lstf_virtualmachine_run(lstf_virtualmachine *vm)
+{
+    const bool result = lstf_virtualmachine_run_coroutines(vm);
+
+    // the VM may not resume for a while, or at all
+    if (io_trace_is_enabled())
+        lstf_virtualmachine_trace_end_slice(vm);
+    return result;
+}
+
+void lstf_virtualmachine_set_server_pool(lstf_virtualmachine *vm, lsp_client_pool *pool)
+{
+    assert(!vm->main_coroutine && !vm->server_pool && "server pool must be set before running the VM");
+    eventloop_destroy(vm->event_loop);
+    vm->event_loop = pool->loop;
+    vm->server_pool = pool;
+}
+
+bool lstf_virtualmachine_has_outstanding_io(const lstf_virtualmachine *vm)
+{
+    for (iterator it = ptr_list_iterator_create(vm->suspended_list); it.has_next; it = iterator_next(it))
+        if (((lstf_vm_coroutine *)iterator_get_item(it))->outstanding_io)
+            return true;
+    for (iterator it = ptr_list_iterator_create(vm->run_queue); it.has_next; it = iterator_next(it))
+        if (((lstf_vm_coroutine *)iterator_get_item(it))->outstanding_io)
+            return true;
+    return false;
+}
+
+bool lstf_virtualmachine_is_runnable(const lstf_virtualmachine *vm)
+{
+    if (!vm->main_coroutine || vm->last_status != lstf_vm_status_continue ||
+            !ptr_list_is_empty(vm->run_queue))
+        return true;
+    for (iterator it = ptr_list_iterator_create(vm->suspended_list); it.has_next; it = iterator_next(it))
+        if (((lstf_vm_coroutine *)iterator_get_item(it))->outstanding_io == 0)
+            return true;
+    return false;
+}
+
 void lstf_virtualmachine_raise(lstf_virtualmachine *vm, lstf_vm_status status)
 {
     // don't change the status unless 
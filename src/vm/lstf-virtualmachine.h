@@ -5,17 +5,52 @@
 #include "data-structures/ptr-hashset.h"
 #include "io/event.h"
 #include "io/outputstream.h"
+#include "json/json-matcher.h"
 #include "lsp/lsp-client.h"
+#include "lsp/lsp-client-pool.h"
+#include "lstf-vm-collector.h"
 #include "lstf-vm-status.h"
 #include "lstf-vm-stack.h"
 #include "lstf-vm-program.h"
 #include "lstf-vm-value.h"
 #include "lstf-vm-coroutine.h"
+#include "lstf-vm-profiler.h"
+#include "lstf-vm-stats.h"
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdatomic.h>
 
+/**
+ * The number of object shapes remembered by each inline cache.
+ */
+#define LSTF_VM_INLINECACHE_ENTRIES 4
+
+/**
+ * A cache attached to an instruction.
+ *
+ * For `get` and `set`, remembers the position of the member for each object
+ * shape seen by the instruction, so that repeated accesses skip the hash table
+ * lookup.
+ *
+ * For `loadexpr` and `loaddata`, remembers the parsed value if it is a string
+ * or a scalar, so that it doesn't have to be parsed again.
+ *
+ * For `match`, holds the loaded match program.
+ */
+typedef struct {
+    string *key;                        // (ref) the key last used by `get` or `set`
+    const char *member_name;            // (ref) the interned member name for [key]
+    struct {
+        const json_shape *shape;        // (ref)
+        unsigned slot;
+    } entries[LSTF_VM_INLINECACHE_ENTRIES];
+    unsigned next_entry;                // the entry to replace on the next miss
+    bool has_constant;                  // whether [constant] is valid
+    lstf_vm_value constant;             // (ref) the value loaded by `loadexpr` or `loaddata`
+    json_matcher *matcher;              // (owned) the program run by `match`
+} lstf_vm_inlinecache;
+
 typedef struct {
     lstf_vm_program *program;           // the code and data of the program
     lstf_vm_status last_status;         // status of the last-executed instruction
@@ -32,6 +67,21 @@ typedef struct {
     bool debug;                         // whether the virtual machine is in debug mode
     uint8_t *next_stop;                 // where the virtual machine should stop on the next iteration
     lsp_client *client;                 // a handle to the LSP client communicating with the remote server
+    lstf_vm_inlinecache **inline_caches;// instruction caches, indexed by code offset
+    json_matcher_trace match_trace;     // why the last failed `match` failed
+    const uint8_t *match_trace_pc;      // the instruction following the `match` that wrote [match_trace]
+    const char *assertion_message;      // details about the last failed assertion, or `NULL`
+    lstf_vm_collector *collector;       // frees values that are only referenced by cycles
+    bool nonblocking;                   // whether to return instead of waiting for I/O
+    jsonrpc_stats *rpc_stats;           // (optional) where the LSP client keeps statistics, see jsonrpc_server
+    outputstream *capture_stream;       // (optional) where the LSP client captures its messages, see jsonrpc_server_capture()
+    lsp_client_pool *server_pool;       // (optional) where the LSP client is taken from and given back to, see lstf_virtualmachine_set_server_pool()
+    lstf_vm_profiler *profiler;         // (optional) samples the call stacks of the coroutines, see lstf_vm_profiler
+    uint64_t trace_coroutine;           // when tracing, the coroutine in the current run slice, or 0
+    uint64_t trace_slice_start;         // when tracing, the time that the current run slice started
+#ifdef LSTF_VM_STATS
+    lstf_vm_stats stats;                // counters for each instruction, reported when destroyed
+#endif
 } lstf_virtualmachine;
 
 /**
@@ -48,15 +98,56 @@ void lstf_virtualmachine_destroy(lstf_virtualmachine *vm);
 /**
  * Runs the virtual machine until termination or interruption.
  *
+ * If [vm->nonblocking] is set, this also returns when every coroutine is
+ * waiting for I/O and after each context switch, so that the caller can run
+ * several virtual machines on one thread.
+ *
  * Returns `true` if interrupted but should continue, `false` if should not continue.
  */
 bool lstf_virtualmachine_run(lstf_virtualmachine *vm);
 
+/**
+ * Makes the virtual machine take an already-running language server from
+ * [pool] when the program connects, and give it back when the virtual machine
+ * is destroyed. The virtual machine then runs on the pool's event loop. Must
+ * be called before running the virtual machine.
+ */
+void lstf_virtualmachine_set_server_pool(lstf_virtualmachine *vm, lsp_client_pool *pool);
+
+/**
+ * Whether any coroutine is still waiting for I/O. This can happen if the
+ * program exits or fails while other coroutines are waiting.
+ */
+bool lstf_virtualmachine_has_outstanding_io(const lstf_virtualmachine *vm);
+
+/**
+ * Whether running the virtual machine would make progress: it hasn't started,
+ * it has stopped with an error that it hasn't returned yet, or a coroutine is
+ * ready to run. Events processed on a shared event loop can make another
+ * virtual machine's coroutines ready.
+ */
+bool lstf_virtualmachine_is_runnable(const lstf_virtualmachine *vm);
+
 /**
  * Queues an exceptional state for virtual machine.
  */
 void lstf_virtualmachine_raise(lstf_virtualmachine *vm, lstf_vm_status status);
 
+/**
+ * Calls the function at [code_address] in a new coroutine, which will run
+ * the next time the virtual machine switches coroutines. The arguments are
+ * moved into the new coroutine.
+ *
+ * @param closure       the closure being called, or `NULL`
+ * @param coroutine     (optional) set to the new coroutine
+ */
+lstf_vm_status lstf_virtualmachine_schedule_call(lstf_virtualmachine *vm,
+                                                 uint8_t             *code_address,
+                                                 lstf_vm_closure     *closure,
+                                                 lstf_vm_value       *arguments,
+                                                 uint8_t              num_arguments,
+                                                 lstf_vm_coroutine  **coroutine);
+
 // --- debugging
 
 /**
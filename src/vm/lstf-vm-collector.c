@@ -0,0 +1,610 @@
+#include "lstf-vm-collector.h"
+#include "data-structures/array.h"
+#include "data-structures/ptr-hashset.h"
+#include "json/json.h"
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+/**
+ * The colors of objects during a collection.
+ */
+enum _lstf_vm_collector_color {
+    /**
+     * In use, or not yet visited. New objects start out black.
+     */
+    lstf_vm_collector_color_black,
+
+    /**
+     * Possibly a member of a garbage cycle. The references it holds have
+     * been subtracted.
+     */
+    lstf_vm_collector_color_gray,
+
+    /**
+     * A member of a garbage cycle.
+     */
+    lstf_vm_collector_color_white,
+
+    /**
+     * A possible root of a garbage cycle.
+     */
+    lstf_vm_collector_color_purple
+};
+typedef enum _lstf_vm_collector_color lstf_vm_collector_color;
+
+/**
+ * An object tracked by the collector: a pointer to the object, with the
+ * object's `lstf_vm_collector_object_type` in the low bits.
+ */
+typedef uintptr_t lstf_vm_collector_ref;
+
+#define LSTF_VM_COLLECTOR_TYPE_MASK ((uintptr_t)3)
+
+typedef array(lstf_vm_collector_ref) lstf_vm_collector_refs;
+
+struct _lstf_vm_collector {
+    unsigned long refcount;
+
+    /**
+     * The possible roots of garbage cycles, as `lstf_vm_collector_ref`s
+     */
+    ptr_hashset *roots;
+
+    unsigned long threshold;
+    lstf_vm_collector_stats stats;
+};
+
+static thread_local lstf_vm_collector *lstf_vm_collector_thread_default;
+
+static lstf_vm_collector_ref lstf_vm_collector_ref_new(lstf_vm_collector_object_type type, void *object)
+{
+    assert(((uintptr_t)object & LSTF_VM_COLLECTOR_TYPE_MASK) == 0 && "object is not aligned");
+    return (uintptr_t)object | type;
+}
+
+static inline lstf_vm_collector_object_type lstf_vm_collector_ref_get_type(lstf_vm_collector_ref ref)
+{
+    return (lstf_vm_collector_object_type)(ref & LSTF_VM_COLLECTOR_TYPE_MASK);
+}
+
+static inline void *lstf_vm_collector_ref_get_object(lstf_vm_collector_ref ref)
+{
+    return (void *)(ref & ~LSTF_VM_COLLECTOR_TYPE_MASK);
+}
+
+// --- accessing the collector state of objects
+
+static lstf_vm_collector_color lstf_vm_collector_get_color(lstf_vm_collector_ref ref)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        return ((json_node *)object)->gc_color;
+    case lstf_vm_collector_object_type_closure:
+        return ((lstf_vm_closure *)object)->gc_color;
+    case lstf_vm_collector_object_type_upvalue:
+        return ((lstf_vm_upvalue *)object)->gc_color;
+    }
+
+    return lstf_vm_collector_color_black;
+}
+
+static void lstf_vm_collector_set_color(lstf_vm_collector_ref ref, lstf_vm_collector_color color)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        ((json_node *)object)->gc_color = color;
+        break;
+    case lstf_vm_collector_object_type_closure:
+        ((lstf_vm_closure *)object)->gc_color = color;
+        break;
+    case lstf_vm_collector_object_type_upvalue:
+        ((lstf_vm_upvalue *)object)->gc_color = color;
+        break;
+    }
+}
+
+static bool lstf_vm_collector_is_buffered(lstf_vm_collector_ref ref)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        return ((json_node *)object)->gc_buffered;
+    case lstf_vm_collector_object_type_closure:
+        return ((lstf_vm_closure *)object)->gc_buffered;
+    case lstf_vm_collector_object_type_upvalue:
+        return ((lstf_vm_upvalue *)object)->gc_buffered;
+    }
+
+    return false;
+}
+
+static void lstf_vm_collector_set_buffered(lstf_vm_collector_ref ref, bool buffered)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        ((json_node *)object)->gc_buffered = buffered;
+        break;
+    case lstf_vm_collector_object_type_closure:
+        ((lstf_vm_closure *)object)->gc_buffered = buffered;
+        break;
+    case lstf_vm_collector_object_type_upvalue:
+        ((lstf_vm_upvalue *)object)->gc_buffered = buffered;
+        break;
+    }
+}
+
+static unsigned lstf_vm_collector_get_refcount(lstf_vm_collector_ref ref)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        return ((json_node *)object)->refcount;
+    case lstf_vm_collector_object_type_closure:
+        return ((lstf_vm_closure *)object)->refcount;
+    case lstf_vm_collector_object_type_upvalue:
+        return ((lstf_vm_upvalue *)object)->refcount;
+    }
+
+    return 0;
+}
+
+/**
+ * Adds `delta` to the reference count of the object, without freeing it or
+ * treating it as a possible root.
+ */
+static void lstf_vm_collector_adjust_refcount(lstf_vm_collector_ref ref, int delta)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        ((json_node *)object)->refcount += (unsigned)delta;
+        break;
+    case lstf_vm_collector_object_type_closure:
+        ((lstf_vm_closure *)object)->refcount += (unsigned)delta;
+        break;
+    case lstf_vm_collector_object_type_upvalue:
+        ((lstf_vm_upvalue *)object)->refcount += (unsigned)delta;
+        break;
+    }
+}
+
+/**
+ * Appends the objects that `ref` holds a reference to onto `children`. There
+ * is one entry for each reference, so an object can appear more than once.
+ */
+static void lstf_vm_collector_get_children(lstf_vm_collector_ref ref, lstf_vm_collector_refs *children)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+    {
+        json_node *node = object;
+
+        if (node->node_type == json_node_type_array) {
+            json_array_foreach(node, element, {
+                if (json_node_is_container(element))
+                    array_add(children, lstf_vm_collector_ref_new(lstf_vm_collector_object_type_json, element));
+            });
+        } else if (node->node_type == json_node_type_object) {
+            json_object_foreach(node, member, {
+                (void) member_name;
+                if (json_node_is_container(member_value))
+                    array_add(children, lstf_vm_collector_ref_new(lstf_vm_collector_object_type_json, member_value));
+            });
+        } else if (node->node_type == json_node_type_pointer) {
+            json_pointer *pointer = (json_pointer *)node;
+
+            if (pointer->value && pointer->ref_func == (collection_item_ref_func) lstf_vm_closure_ref)
+                array_add(children, lstf_vm_collector_ref_new(lstf_vm_collector_object_type_closure, pointer->value));
+        }
+    }   break;
+    case lstf_vm_collector_object_type_closure:
+    {
+        lstf_vm_closure *closure = object;
+
+        for (unsigned i = 0; i < closure->num_upvalues; i++)
+            array_add(children, lstf_vm_collector_ref_new(lstf_vm_collector_object_type_upvalue, closure->upvalues[i]));
+    }   break;
+    case lstf_vm_collector_object_type_upvalue:
+    {
+        lstf_vm_upvalue *upvalue = object;
+
+        // a local up-value refers to a stack slot, which the stack owns
+        if (upvalue->is_local)
+            break;
+
+        if (lstf_vm_value_type_is_json(upvalue->value.value_type) &&
+                json_node_is_container(upvalue->value.data.json_node_ref))
+            array_add(children, lstf_vm_collector_ref_new(lstf_vm_collector_object_type_json,
+                                                          upvalue->value.data.json_node_ref));
+        else if (upvalue->value.value_type == lstf_vm_value_type_closure)
+            array_add(children, lstf_vm_collector_ref_new(lstf_vm_collector_object_type_closure,
+                                                          upvalue->value.data.closure));
+    }   break;
+    }
+}
+
+static void lstf_vm_collector_object_ref(lstf_vm_collector_ref ref)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        json_node_ref(object);
+        break;
+    case lstf_vm_collector_object_type_closure:
+        lstf_vm_closure_ref(object);
+        break;
+    case lstf_vm_collector_object_type_upvalue:
+        lstf_vm_upvalue_ref(object);
+        break;
+    }
+}
+
+static void lstf_vm_collector_object_unref(lstf_vm_collector_ref ref)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        json_node_unref(object);
+        break;
+    case lstf_vm_collector_object_type_closure:
+        lstf_vm_closure_unref(object);
+        break;
+    case lstf_vm_collector_object_type_upvalue:
+        lstf_vm_upvalue_unref(object);
+        break;
+    }
+}
+
+/**
+ * Releases every reference that the object holds.
+ */
+static void lstf_vm_collector_object_clear(lstf_vm_collector_ref ref)
+{
+    void *object = lstf_vm_collector_ref_get_object(ref);
+
+    switch (lstf_vm_collector_ref_get_type(ref)) {
+    case lstf_vm_collector_object_type_json:
+        json_node_clear(object);
+        break;
+    case lstf_vm_collector_object_type_closure:
+    {
+        lstf_vm_closure *closure = object;
+        unsigned num_upvalues = closure->num_upvalues;
+
+        closure->num_upvalues = 0;
+        for (unsigned i = 0; i < num_upvalues; i++) {
+            lstf_vm_upvalue_unref(closure->upvalues[i]);
+            closure->upvalues[i] = NULL;
+        }
+    }   break;
+    case lstf_vm_collector_object_type_upvalue:
+    {
+        lstf_vm_upvalue *upvalue = object;
+
+        if (!upvalue->is_local)
+            lstf_vm_value_clear(&upvalue->value);
+    }   break;
+    }
+}
+
+// --- the collector
+
+static void lstf_vm_collector_json_allocated(json_node *node)
+{
+    (void) node;
+    lstf_vm_collector_allocated();
+}
+
+static void lstf_vm_collector_json_possible_root(json_node *node)
+{
+    lstf_vm_collector_possible_root(lstf_vm_collector_object_type_json, node);
+}
+
+static void lstf_vm_collector_json_destroyed(json_node *node)
+{
+    lstf_vm_collector_forget(lstf_vm_collector_object_type_json, node);
+}
+
+static const json_collector_hooks lstf_vm_collector_json_hooks = {
+    .allocated = lstf_vm_collector_json_allocated,
+    .possible_root = lstf_vm_collector_json_possible_root,
+    .destroyed = lstf_vm_collector_json_destroyed
+};
+
+lstf_vm_collector *lstf_vm_collector_get_thread_default(void)
+{
+    lstf_vm_collector *collector = lstf_vm_collector_thread_default;
+
+    if (collector) {
+        collector->refcount++;
+        return collector;
+    }
+
+    if (!(collector = calloc(1, sizeof *collector))) {
+        perror("failed to create VM cycle collector");
+        abort();
+    }
+
+    collector->refcount = 1;
+    collector->roots = ptr_hashset_new(ptrhash, NULL, NULL, NULL);
+    collector->threshold = LSTF_VM_COLLECTOR_THRESHOLD;
+
+    lstf_vm_collector_thread_default = collector;
+    json_set_collector_hooks(&lstf_vm_collector_json_hooks);
+
+    return collector;
+}
+
+void lstf_vm_collector_unref(lstf_vm_collector *collector)
+{
+    if (!collector)
+        return;
+
+    assert(collector->refcount > 0);
+    if (--collector->refcount > 0)
+        return;
+
+    // the remaining possible roots are still alive, so just forget about them
+    ptr_hashset_foreach(collector->roots, root, void *, {
+        lstf_vm_collector_set_buffered((lstf_vm_collector_ref)root, false);
+    });
+    ptr_hashset_destroy(collector->roots);
+
+    if (lstf_vm_collector_thread_default == collector) {
+        lstf_vm_collector_thread_default = NULL;
+        json_set_collector_hooks(NULL);
+    }
+    free(collector);
+}
+
+void lstf_vm_collector_set_threshold(lstf_vm_collector *collector, unsigned long threshold)
+{
+    collector->threshold = threshold;
+}
+
+bool lstf_vm_collector_should_collect(const lstf_vm_collector *collector)
+{
+    return collector->stats.allocations >= collector->threshold;
+}
+
+const lstf_vm_collector_stats *lstf_vm_collector_get_stats(const lstf_vm_collector *collector)
+{
+    return &collector->stats;
+}
+
+void lstf_vm_collector_allocated(void)
+{
+    if (lstf_vm_collector_thread_default)
+        lstf_vm_collector_thread_default->stats.allocations++;
+}
+
+void lstf_vm_collector_possible_root(lstf_vm_collector_object_type type, void *object)
+{
+    lstf_vm_collector *collector = lstf_vm_collector_thread_default;
+    lstf_vm_collector_ref ref = lstf_vm_collector_ref_new(type, object);
+
+    if (!collector)
+        return;
+
+    lstf_vm_collector_set_color(ref, lstf_vm_collector_color_purple);
+    if (!lstf_vm_collector_is_buffered(ref)) {
+        lstf_vm_collector_set_buffered(ref, true);
+        ptr_hashset_insert(collector->roots, (void *)ref);
+    }
+}
+
+void lstf_vm_collector_forget(lstf_vm_collector_object_type type, void *object)
+{
+    lstf_vm_collector *collector = lstf_vm_collector_thread_default;
+    lstf_vm_collector_ref ref = lstf_vm_collector_ref_new(type, object);
+
+    lstf_vm_collector_set_buffered(ref, false);
+    if (collector)
+        ptr_hashset_delete(collector->roots, (void *)ref);
+}
+
+/**
+ * Subtracts the references held by `root` and everything reachable from it,
+ * coloring them gray.
+ */
+static void lstf_vm_collector_mark_gray(lstf_vm_collector_ref  root,
+                                        lstf_vm_collector_refs *worklist,
+                                        lstf_vm_collector_refs *children)
+{
+    if (lstf_vm_collector_get_color(root) == lstf_vm_collector_color_gray)
+        return;
+
+    lstf_vm_collector_set_color(root, lstf_vm_collector_color_gray);
+    array_add(worklist, root);
+    while (worklist->length > 0) {
+        lstf_vm_collector_ref ref = worklist->elements[--worklist->length];
+
+        children->length = 0;
+        lstf_vm_collector_get_children(ref, children);
+        for (size_t i = 0; i < children->length; i++) {
+            lstf_vm_collector_ref child = children->elements[i];
+
+            lstf_vm_collector_adjust_refcount(child, -1);
+            if (lstf_vm_collector_get_color(child) != lstf_vm_collector_color_gray) {
+                lstf_vm_collector_set_color(child, lstf_vm_collector_color_gray);
+                array_add(worklist, child);
+            }
+        }
+    }
+}
+
+/**
+ * `root` is referenced from outside of the gray objects, so restores the
+ * references held by it and everything reachable from it, coloring them
+ * black.
+ */
+static void lstf_vm_collector_scan_black(lstf_vm_collector_ref  root,
+                                         lstf_vm_collector_refs *worklist,
+                                         lstf_vm_collector_refs *children)
+{
+    size_t base = worklist->length;
+
+    lstf_vm_collector_set_color(root, lstf_vm_collector_color_black);
+    array_add(worklist, root);
+    while (worklist->length > base) {
+        lstf_vm_collector_ref ref = worklist->elements[--worklist->length];
+        size_t first_child = children->length;
+
+        lstf_vm_collector_get_children(ref, children);
+        for (size_t i = first_child; i < children->length; i++) {
+            lstf_vm_collector_ref child = children->elements[i];
+
+            lstf_vm_collector_adjust_refcount(child, 1);
+            if (lstf_vm_collector_get_color(child) != lstf_vm_collector_color_black) {
+                lstf_vm_collector_set_color(child, lstf_vm_collector_color_black);
+                array_add(worklist, child);
+            }
+        }
+        children->length = first_child;
+    }
+}
+
+/**
+ * Colors the gray objects reachable from `root` white if nothing outside of
+ * them references them, or black otherwise.
+ */
+static void lstf_vm_collector_scan(lstf_vm_collector_ref  root,
+                                   lstf_vm_collector_refs *worklist,
+                                   lstf_vm_collector_refs *children)
+{
+    array_add(worklist, root);
+    while (worklist->length > 0) {
+        lstf_vm_collector_ref ref = worklist->elements[--worklist->length];
+
+        if (lstf_vm_collector_get_color(ref) != lstf_vm_collector_color_gray)
+            continue;
+
+        if (lstf_vm_collector_get_refcount(ref) > 0) {
+            lstf_vm_collector_scan_black(ref, worklist, children);
+        } else {
+            lstf_vm_collector_set_color(ref, lstf_vm_collector_color_white);
+            children->length = 0;
+            lstf_vm_collector_get_children(ref, children);
+            for (size_t i = 0; i < children->length; i++)
+                array_add(worklist, children->elements[i]);
+        }
+    }
+}
+
+/**
+ * Moves the white objects reachable from `root` into `garbage`, unless they
+ * are still to be visited as possible roots themselves.
+ */
+static void lstf_vm_collector_collect_white(lstf_vm_collector_ref  root,
+                                            lstf_vm_collector_refs *garbage,
+                                            lstf_vm_collector_refs *worklist,
+                                            lstf_vm_collector_refs *children)
+{
+    if (lstf_vm_collector_get_color(root) != lstf_vm_collector_color_white ||
+            lstf_vm_collector_is_buffered(root))
+        return;
+
+    lstf_vm_collector_set_color(root, lstf_vm_collector_color_black);
+    array_add(garbage, root);
+    array_add(worklist, root);
+    while (worklist->length > 0) {
+        lstf_vm_collector_ref ref = worklist->elements[--worklist->length];
+
+        children->length = 0;
+        lstf_vm_collector_get_children(ref, children);
+        for (size_t i = 0; i < children->length; i++) {
+            lstf_vm_collector_ref child = children->elements[i];
+
+            if (lstf_vm_collector_get_color(child) == lstf_vm_collector_color_white &&
+                    !lstf_vm_collector_is_buffered(child)) {
+                lstf_vm_collector_set_color(child, lstf_vm_collector_color_black);
+                array_add(garbage, child);
+                array_add(worklist, child);
+            }
+        }
+    }
+}
+
+void lstf_vm_collector_collect(lstf_vm_collector *collector)
+{
+    lstf_vm_collector_refs roots;
+    lstf_vm_collector_refs garbage;
+    lstf_vm_collector_refs worklist;
+    lstf_vm_collector_refs children;
+
+    array_init(&roots);
+    array_init(&garbage);
+    array_init(&worklist);
+    array_init(&children);
+
+    collector->stats.collections++;
+    collector->stats.allocations = 0;
+
+    // take the possible roots. the ones that were referenced again since
+    // they were added are no longer candidates
+    ptr_hashset_foreach(collector->roots, root, void *, {
+        lstf_vm_collector_ref ref = (lstf_vm_collector_ref)root;
+
+        if (lstf_vm_collector_get_color(ref) == lstf_vm_collector_color_purple)
+            array_add(&roots, ref);
+        else
+            lstf_vm_collector_set_buffered(ref, false);
+    });
+    ptr_hashset_destroy(collector->roots);
+    collector->roots = ptr_hashset_new(ptrhash, NULL, NULL, NULL);
+    collector->stats.roots_scanned += roots.length;
+
+    for (size_t i = 0; i < roots.length; i++)
+        lstf_vm_collector_mark_gray(roots.elements[i], &worklist, &children);
+
+    for (size_t i = 0; i < roots.length; i++)
+        lstf_vm_collector_scan(roots.elements[i], &worklist, &children);
+
+    for (size_t i = 0; i < roots.length; i++) {
+        lstf_vm_collector_set_buffered(roots.elements[i], false);
+        lstf_vm_collector_collect_white(roots.elements[i], &garbage, &worklist, &children);
+    }
+
+    // The garbage is only referenced by other garbage. Put back the
+    // references it holds, then break the cycles by having every object
+    // release its references. The extra reference taken here keeps each
+    // object alive until all of them have been cleared.
+    for (size_t i = 0; i < garbage.length; i++) {
+        children.length = 0;
+        lstf_vm_collector_get_children(garbage.elements[i], &children);
+        for (size_t j = 0; j < children.length; j++)
+            lstf_vm_collector_adjust_refcount(children.elements[j], 1);
+    }
+
+    for (size_t i = 0; i < garbage.length; i++)
+        lstf_vm_collector_object_ref(garbage.elements[i]);
+
+    for (size_t i = 0; i < garbage.length; i++)
+        lstf_vm_collector_object_clear(garbage.elements[i]);
+
+    for (size_t i = 0; i < garbage.length; i++)
+        lstf_vm_collector_object_unref(garbage.elements[i]);
+
+    collector->stats.objects_collected += garbage.length;
+
+    array_destroy(&roots);
+    array_destroy(&garbage);
+    array_destroy(&worklist);
+    array_destroy(&children);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "lstf-vm-value.h"
+#include <stdbool.h>
+
+/**
+ * The number of allocations of arrays, objects, closures, and up-values after
+ * which the cycle collector runs.
+ */
+#define LSTF_VM_COLLECTOR_THRESHOLD 10000
+
+/**
+ * The things that the cycle collector keeps track of.
+ */
+enum _lstf_vm_collector_object_type {
+    /**
+     * An array, object, or pointer `json_node`
+     */
+    lstf_vm_collector_object_type_json,
+
+    /**
+     * A `lstf_vm_closure`
+     */
+    lstf_vm_collector_object_type_closure,
+
+    /**
+     * A `lstf_vm_upvalue`
+     */
+    lstf_vm_collector_object_type_upvalue
+};
+typedef enum _lstf_vm_collector_object_type lstf_vm_collector_object_type;
+
+typedef struct {
+    unsigned long collections;          // number of times the collector has run
+    unsigned long roots_scanned;        // number of possible roots of cycles examined
+    unsigned long objects_collected;    // number of objects freed because they were only referenced by cycles
+    unsigned long allocations;          // number of allocations since the last collection
+} lstf_vm_collector_stats;
+
+/**
+ * A cycle collector for the values of the virtual machine, which are
+ * reference-counted. Values that refer to each other in a cycle, such as an
+ * object storing a closure that captures the object, are never freed by
+ * reference counting alone.
+ *
+ * This is a synchronous trial-deletion collector (Bacon and Rajan, 2001).
+ * Whenever a reference to a container is released and the container survives,
+ * the container is remembered as a possible root of a garbage cycle. When the
+ * collector runs, it subtracts the references that the possible roots and
+ * everything reachable from them hold on each other. What is left with no
+ * references is only kept alive by cycles, and is freed.
+ *
+ * There is one collector per thread, shared by all virtual machines running on
+ * that thread.
+ */
+struct _lstf_vm_collector;
+typedef struct _lstf_vm_collector lstf_vm_collector;
+
+/**
+ * Returns a new reference to the collector for the current thread, creating
+ * it if it does not exist.
+ */
+lstf_vm_collector *lstf_vm_collector_get_thread_default(void);
+
+void lstf_vm_collector_unref(lstf_vm_collector *collector);
+
+/**
+ * Sets the number of allocations after which `lstf_vm_collector_should_collect()`
+ * returns `true`. The default is `LSTF_VM_COLLECTOR_THRESHOLD`.
+ */
+void lstf_vm_collector_set_threshold(lstf_vm_collector *collector, unsigned long threshold);
+
+/**
+ * Whether enough allocations have happened since the last collection that
+ * the collector should run again.
+ */
+bool lstf_vm_collector_should_collect(const lstf_vm_collector *collector);
+
+/**
+ * Frees all values that are only referenced by cycles. This must only be
+ * called when every value that is in use is referenced, such as in between
+ * instructions.
+ */
+void lstf_vm_collector_collect(lstf_vm_collector *collector);
+
+const lstf_vm_collector_stats *lstf_vm_collector_get_stats(const lstf_vm_collector *collector);
+
+// --- used by closures and up-values
+
+/**
+ * Counts the allocation of a closure or an up-value.
+ */
+void lstf_vm_collector_allocated(void);
+
+/**
+ * Called when a reference to `object` is released but `object` is still
+ * referenced.
+ */
+void lstf_vm_collector_possible_root(lstf_vm_collector_object_type type, void *object);
+
+/**
+ * Called when `object` is destroyed while it is remembered as a possible root.
+ */
+void lstf_vm_collector_forget(lstf_vm_collector_object_type type, void *object);
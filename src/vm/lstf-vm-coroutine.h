@@ -6,6 +6,13 @@
 #include <limits.h>
 #include <stdint.h>
 
+typedef struct _lstf_vm_coroutine lstf_vm_coroutine;
+
+/**
+ * Called when a coroutine returns from its first stack frame.
+ */
+typedef void (*lstf_vm_coroutine_exit_func)(lstf_vm_coroutine *cr, void *user_data);
+
 struct _lstf_vm_coroutine {
     unsigned refcount : sizeof(unsigned) * CHAR_BIT - 1;
     bool floating : 1;
@@ -13,8 +20,10 @@ struct _lstf_vm_coroutine {
     lstf_vm_stack *stack;               // the coroutine's stack
     uint8_t *pc;                        // program counter
     ptr_list_node *node;                // reference to node in run queue/suspend list
+    uint64_t trace_id;                  // identifies the coroutine in the trace, or 0 if it was never traced
+    lstf_vm_coroutine_exit_func on_exit;    // called when the coroutine completes, or NULL
+    void *on_exit_data;
 };
-typedef struct _lstf_vm_coroutine lstf_vm_coroutine;
 
 /**
  * Create a coroutine starting at [pc]
@@ -1,9 +1,6 @@
 #include "lstf-vm-loader.h"
 #include "lstf-vm-program.h"
-#include "data-structures/iterator.h"
 #include "data-structures/ptr-hashmap.h"
-#include "data-structures/ptr-list.h"
-#include "data-structures/string-builder.h"
 #include "io/inputstream.h"
 #include "lstf-vm-debug.h"
 #include <assert.h>
@@ -15,20 +12,26 @@
 #include <errno.h>
 #include <stdalign.h>
 #include "util.h"
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 static_assert(alignof(uint64_t) == alignof(lstf_vm_debugentry),
         "alignment of n_debug_entries must equal alignment of lstf_vm_debugentry");
 
-static inline void *aligned(void *ptr, size_t alignment)
+static inline size_t aligned(size_t offset, size_t alignment)
 {
     if (alignment < 2)
-        return ptr;
+        return offset;
 
-    size_t modulo = (uintptr_t)ptr % alignment;
+    size_t modulo = offset % alignment;
     if (modulo)
-        return (void *)((uintptr_t)ptr + (alignment - modulo));
-    
-    return ptr;
+        return offset + (alignment - modulo);
+
+    return offset;
 }
 
 static lstf_vm_program *lstf_vm_program_create(void)
@@ -58,94 +61,96 @@ static lstf_vm_program *lstf_vm_program_create(void)
     return program;
 }
 
-static lstf_vm_program *lstf_vm_loader_load_from_stream(inputstream *istream, lstf_vm_loader_error *error)
+/**
+ * Reads an integer in network byte order at [*offset] in [buffer] and
+ * advances the offset past it. Returns false if the integer runs past the end
+ * of the buffer.
+ */
+static bool lstf_vm_loader_read_uint64(const uint8_t *buffer,
+                                       size_t         buffer_size,
+                                       size_t        *offset,
+                                       uint64_t      *integer)
 {
-    lstf_vm_program *program = NULL;
+    uint64_t value = 0;
+
+    if (*offset > buffer_size || buffer_size - *offset < sizeof value)
+        return false;
+
+    for (unsigned i = 0; i < sizeof value; i++)
+        value = (value << CHAR_BIT) | buffer[(*offset)++];
+
+    *integer = value;
+    return true;
+}
+
+/**
+ * Loads a program whose sections point into [image], without copying them.
+ * The program takes ownership of [image], even if loading fails.
+ */
+static lstf_vm_program *lstf_vm_loader_load_from_image(uint8_t              *image,
+                                                       size_t                image_size,
+                                                       bool                  image_is_mapped,
+                                                       lstf_vm_loader_error *error)
+{
+    lstf_vm_program *program = lstf_vm_program_create();
+    lstf_vm_loader_error status = lstf_vm_loader_error_none;
+    size_t offset = 0;
     uint64_t entry_point_offset = 0;
-    char byte = 0;
-    ptr_list *debug_entries = NULL;
-    ptr_list *debug_symbols = NULL;
     uint64_t comments_size = 0;
 
-    if (!istream) {
-        if (error)
-            *error = lstf_vm_loader_error_read;
-        return NULL;
-    }
-
-    if (error)
-        *error = lstf_vm_loader_error_none;
+    program->image = image;
+    program->image_size = image_size;
+    program->image_is_mapped = image_is_mapped;
 
-    // load magic header
-    for (unsigned i = 0; i < sizeof LSTFC_MAGIC_HEADER; i++) {
-        if (!inputstream_read_char(istream, &byte)) {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
+    // check the magic header
+    for (offset = 0; offset < sizeof LSTFC_MAGIC_HEADER; offset++) {
+        if (offset >= image_size) {
+            status = lstf_vm_loader_error_invalid_section_size;
             goto error_cleanup;
-        } else if (byte != LSTFC_MAGIC_HEADER[i]) {
-            if (error)
-                *error = lstf_vm_loader_error_invalid_magic_value;
+        } else if (image[offset] != (uint8_t) LSTFC_MAGIC_HEADER[offset]) {
+            status = lstf_vm_loader_error_invalid_magic_value;
             goto error_cleanup;
         }
     }
 
     // load entry point offset
-    if (!inputstream_read_uint64(istream, &entry_point_offset)) {
-        if (error)
-            *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
+    if (!lstf_vm_loader_read_uint64(image, image_size, &offset, &entry_point_offset)) {
+        status = lstf_vm_loader_error_invalid_section_size;
         goto error_cleanup;
     }
 
     // read the rest of the program header
-    if (!inputstream_read_char(istream, &byte) || byte == '\0') {
+    if (offset >= image_size || image[offset] == '\0') {
         // a list of sections was not found
-        if (error)
-            *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
+        status = lstf_vm_loader_error_invalid_section_size;
         goto error_cleanup;
     }
 
     // read the section names and sizes
     do {
-        char section_name[128];
-        unsigned sn_length = 0;
+        const char *section_name = (const char *) &image[offset];
+        const size_t max_length = image_size - offset < 128 ? image_size - offset : 128;
+        const uint8_t *terminator = memchr(section_name, '\0', max_length);
         uint64_t section_size = 0;
 
-        section_name[sn_length++] = byte;
-
-        // read section name until we encounter a NUL terminator
-        while (inputstream_read_char(istream, &byte)) {
-            if (sn_length >= sizeof section_name) {
-                if (error)
-                    *error = lstf_vm_loader_error_too_long_section_name;
-                goto error_cleanup;
-            }
-
-            section_name[sn_length++] = byte;
-            if (byte == '\0')
-                break;
-        }
-        if (byte != '\0') {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
+        if (!terminator) {
+            status = max_length == 128 ? lstf_vm_loader_error_too_long_section_name :
+                lstf_vm_loader_error_invalid_section_size;
             goto error_cleanup;
         }
+        offset = (size_t)(terminator - image) + 1;
 
         // read section length
-        if (!inputstream_read_uint64(istream, &section_size)) {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
+        if (!lstf_vm_loader_read_uint64(image, image_size, &offset, &section_size)) {
+            status = lstf_vm_loader_error_invalid_section_size;
             goto error_cleanup;
         }
 
         if (section_size == 0) {
-            if (error)
-                *error = lstf_vm_loader_error_zero_section_size;
+            status = lstf_vm_loader_error_zero_section_size;
             goto error_cleanup;
         }
 
-        if (!program)
-            program = lstf_vm_program_create();
-
         if (strcmp(section_name, "debuginfo") == 0) {
             program->debuginfo_size = section_size;
         } else if (strcmp(section_name, "comments") == 0) {
@@ -155,222 +160,265 @@ static lstf_vm_program *lstf_vm_loader_load_from_stream(inputstream *istream, ls
         } else if (strcmp(section_name, "code") == 0) {
             program->code_size = section_size;
             if (entry_point_offset >= program->code_size) {
-                if (error)
-                    *error = lstf_vm_loader_error_invalid_entry_point;
+                status = lstf_vm_loader_error_invalid_entry_point;
                 goto error_cleanup;
             }
         } else {
-            if (error)
-                *error = lstf_vm_loader_error_invalid_section_name;
+            status = lstf_vm_loader_error_invalid_section_name;
             goto error_cleanup;
         }
-    } while (inputstream_read_char(istream, &byte) && byte != '\0');
-    if (byte != '\0') {
-        if (error)
-            *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
+    } while (offset < image_size && image[offset] != '\0');
+    if (offset >= image_size) {
+        status = lstf_vm_loader_error_invalid_section_size;
         goto error_cleanup;
     }
+    offset++;
 
-    // parse optional debug section
+    // the sections follow the header in this order, and must all fit in the
+    // image. the debug section is parsed later, if at all
     if (program->debuginfo_size > 0) {
-        program->debuginfo = calloc(program->debuginfo_size, sizeof *program->debuginfo);
-
-        if (!program->debuginfo) {
-            if (error)
-                *error = lstf_vm_loader_error_out_of_memory;
+        if (program->debuginfo_size > image_size - offset) {
+            status = lstf_vm_loader_error_invalid_section_size;
             goto error_cleanup;
         }
+        program->debuginfo_section = &image[offset];
+        offset += program->debuginfo_size;
+    }
 
-        if (inputstream_read(istream, program->debuginfo, program->debuginfo_size) != program->debuginfo_size) {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
-            goto error_cleanup;
-        }
+    // skip over comments section
+    if (comments_size > image_size - offset) {
+        status = lstf_vm_loader_error_invalid_section_size;
+        goto error_cleanup;
+    }
+    offset += comments_size;
 
-        // read source filename
-        program->source_filename = (char *) program->debuginfo;
-        char *nb_ptr = memchr(program->debuginfo, '\0', program->debuginfo_size);
-        if (!nb_ptr || nb_ptr - (char *)program->debuginfo > FILENAME_MAX) {
-            if (error)
-                *error = lstf_vm_loader_error_source_filename_too_long;
+    // the data section (if it exists)
+    if (program->data_size > 0) {
+        if (program->data_size > image_size - offset) {
+            status = lstf_vm_loader_error_invalid_section_size;
             goto error_cleanup;
         }
+        program->data = &image[offset];
+        offset += program->data_size;
 
-        // current offset
-        size_t source_filename_sz = nb_ptr - program->source_filename;
-        uint64_t *offset = aligned(program->debuginfo + source_filename_sz, alignof(lstf_vm_debugentry));
-
-        assert((uintptr_t)offset % alignof(lstf_vm_debugentry) == 0 && "offset must be aligned to lstf_vm_debugentry");
-
-        if ((uint64_t)((uint8_t *)offset + sizeof(uint64_t) - program->debuginfo) > program->debuginfo_size) {
-            if (error)
-                *error = lstf_vm_loader_error_invalid_debug_size;
+        // strings are read from the data section up to their terminator
+        if (program->data[program->data_size - 1] != '\0') {
+            status = lstf_vm_loader_error_unterminated_data;
             goto error_cleanup;
         }
+    }
 
-        // read n_debug_entries
-        uint64_t n_debug_entries = htonll(*(uint64_t *)offset);
+    // the code section, which is mandatory
+    if (program->code_size == 0) {
+        status = lstf_vm_loader_error_no_code_section;
+        goto error_cleanup;
+    }
+    if (program->code_size > image_size - offset) {
+        status = lstf_vm_loader_error_invalid_section_size;
+        goto error_cleanup;
+    }
+    program->code = &image[offset];
+    program->entry_point = program->code + entry_point_offset;
 
-        debug_entries = ptr_list_new(NULL, NULL);
+    if (error)
+        *error = lstf_vm_loader_error_none;
+    return program;
 
-        while (n_debug_entries > 0 && (uint64_t)((uint8_t *)offset - program->debuginfo) < program->debuginfo_size) {
-            lstf_vm_debugentry *entry = (lstf_vm_debugentry *)offset;
+//  -------------------------------------------
+error_cleanup:
+    if (error)
+        *error = status;
+    lstf_vm_program_unref(program);
+    return NULL;
+}
 
-            // aliasing memory means we have to convert the byte order to host byte order
-            entry->instruction_offset = ntohll(entry->instruction_offset);
-            entry->source_column = ntohl(entry->source_column);
-            entry->source_line = ntohl(entry->source_line);
+lstf_vm_program *lstf_vm_loader_load_from_path(const char *path, lstf_vm_loader_error *error)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat file_stat;
 
-            ptr_list_append(debug_entries, entry);
+    if (fd == -1) {
+        if (error)
+            *error = lstf_vm_loader_error_read;
+        return NULL;
+    }
 
-            offset = (uint64_t *)&entry[1];
-            n_debug_entries--;
-        }
-        
-        if (n_debug_entries > 0) {
-            // debug entries remain
-            if (error)
-                *error = lstf_vm_loader_error_invalid_debug_size;
-            goto error_cleanup;
-        }
+    // map the file if we can. this fails for empty files and for things
+    // like pipes, which are read instead
+    if (fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+            file_stat.st_size > 0 && (uintmax_t) file_stat.st_size <= SIZE_MAX) {
+        void *mapping = mmap(NULL, (size_t) file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-        // parse debug symbols
-        uint64_t n_debug_symbols = 0;
-        if (!inputstream_read_uint64(istream, &n_debug_symbols)) {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
-            goto error_cleanup;
+        if (mapping != MAP_FAILED) {
+            close(fd);
+            return lstf_vm_loader_load_from_image(mapping, (size_t) file_stat.st_size, true, error);
         }
+    }
+    close(fd);
+#endif
 
-        debug_symbols = ptr_list_new(NULL, NULL);
+    inputstream *istream = inputstream_ref(inputstream_new_from_path(path, "rb"));
+    size_t image_capacity = 4096;
+    size_t image_size = 0;
+    uint8_t *image = NULL;
+    size_t length = 0;
 
-        offset = aligned((uint8_t *)offset + sizeof n_debug_symbols, alignof(lstf_vm_debugsym));
-        while (n_debug_symbols > 0 && (uint64_t)((uint8_t *)offset - program->debuginfo) < program->debuginfo_size) {
-            lstf_vm_debugsym *symbol = (lstf_vm_debugsym *)offset;
-            nb_ptr = memchr(offset, '\0', program->debuginfo_size - ((uint8_t *)offset - program->debuginfo));
+    if (!istream) {
+        if (error)
+            *error = lstf_vm_loader_error_read;
+        return NULL;
+    }
+
+    if (!(image = malloc(image_capacity))) {
+        inputstream_unref(istream);
+        if (error)
+            *error = lstf_vm_loader_error_out_of_memory;
+        return NULL;
+    }
 
-            if (!nb_ptr) {
+    errno = 0;
+    while ((length = inputstream_read(istream, image + image_size, image_capacity - image_size)) > 0) {
+        image_size += length;
+        if (image_size == image_capacity) {
+            uint8_t *resized = realloc(image, image_capacity *= 2);
+            if (!resized) {
+                free(image);
+                inputstream_unref(istream);
                 if (error)
-                    *error = lstf_vm_loader_error_invalid_debug_info;
-                goto error_cleanup;
+                    *error = lstf_vm_loader_error_out_of_memory;
+                return NULL;
             }
-
-            // aliasing memory means we have to convert the byte order to host byte order
-            symbol->instruction_offset = ntohll(symbol->instruction_offset);
-            ptr_list_append(debug_symbols, symbol);
-
-            offset = aligned(nb_ptr, alignof(lstf_vm_debugsym));
-            n_debug_symbols--;
-        }
-
-        if (n_debug_symbols > 0) {
-            // debug symbols remain
-            if (error)
-                *error = lstf_vm_loader_error_invalid_debug_size;
-            goto error_cleanup;
+            image = resized;
         }
     }
+    inputstream_unref(istream);
 
-    // skip over comments section
-    if (comments_size > 0) {
-        if (!inputstream_skip(istream, comments_size)) {
-            if (error)
-                *error = lstf_vm_loader_error_read;
-            goto error_cleanup;
-        }
+    if (errno) {
+        free(image);
+        if (error)
+            *error = lstf_vm_loader_error_read;
+        return NULL;
     }
 
-    // now load the data section (if it exists)
-    if (program->data_size > 0) {
-        program->data = calloc(program->data_size, sizeof *program->data);
+    return lstf_vm_loader_load_from_image(image, image_size, false, error);
+}
 
-        if (!program->data) {
-            if (error)
-                *error = lstf_vm_loader_error_out_of_memory;
-            goto error_cleanup;
-        }
+lstf_vm_program *lstf_vm_loader_load_from_buffer(const void           *buffer,
+                                                 size_t                buffer_size,
+                                                 lstf_vm_loader_error *error)
+{
+    uint8_t *image = malloc(buffer_size ? buffer_size : 1);
 
-        if (inputstream_read(istream, program->data, program->data_size) != program->data_size) {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
-            goto error_cleanup;
-        }
+    if (!image) {
+        if (error)
+            *error = lstf_vm_loader_error_out_of_memory;
+        return NULL;
     }
+    memcpy(image, buffer, buffer_size);
 
-    // now load the code section, which is mandatory
-    if (program->code_size > 0) {
-        program->code = calloc(program->code_size, sizeof *program->code);
+    return lstf_vm_loader_load_from_image(image, buffer_size, false, error);
+}
 
-        if (!program->code) {
-            if (error)
-                *error = lstf_vm_loader_error_out_of_memory;
-            goto error_cleanup;
-        }
+bool lstf_vm_loader_load_debuginfo(lstf_vm_program *program, lstf_vm_loader_error *error)
+{
+    lstf_vm_loader_error status = lstf_vm_loader_error_none;
+    const size_t debuginfo_size = program->debuginfo_size;
+    uint8_t *debuginfo = NULL;
+    size_t offset = 0;
+    uint64_t n_debug_entries = 0;
+    uint64_t n_debug_symbols = 0;
 
-        if (inputstream_read(istream, program->code, program->code_size) != program->code_size) {
-            if (error)
-                *error = errno ? lstf_vm_loader_error_read : lstf_vm_loader_error_invalid_section_size;
-            goto error_cleanup;
-        }
+    if (error)
+        *error = lstf_vm_loader_error_none;
 
-        program->entry_point = program->code + entry_point_offset;
-    } else {
+    if (program->debuginfo_loaded || !program->debuginfo_section)
+        return true;
+
+    // the entries are converted to host byte order in place, which the image
+    // may not allow. a copy also keeps them aligned
+    if (!(debuginfo = malloc(debuginfo_size))) {
         if (error)
-            *error = lstf_vm_loader_error_no_code_section;
+            *error = lstf_vm_loader_error_out_of_memory;
+        return false;
+    }
+    memcpy(debuginfo, program->debuginfo_section, debuginfo_size);
+
+    // read source filename
+    const uint8_t *nb_ptr = memchr(debuginfo, '\0', debuginfo_size);
+    if (!nb_ptr || nb_ptr - debuginfo > FILENAME_MAX) {
+        status = lstf_vm_loader_error_source_filename_too_long;
         goto error_cleanup;
     }
+    offset = aligned((size_t)(nb_ptr - debuginfo) + 1, alignof(lstf_vm_debugentry));
+
+    // read n_debug_entries and the entries
+    if (!lstf_vm_loader_read_uint64(debuginfo, debuginfo_size, &offset, &n_debug_entries) ||
+            n_debug_entries > (debuginfo_size - offset) / sizeof(lstf_vm_debugentry)) {
+        status = lstf_vm_loader_error_invalid_debug_size;
+        goto error_cleanup;
+    }
+
+    for (; n_debug_entries > 0; n_debug_entries--) {
+        lstf_vm_debugentry *entry = (void *)&debuginfo[offset];
 
-    if (debug_entries) {
-        // now write the debug entries
-        for (iterator it = ptr_list_iterator_create(debug_entries);
-                it.has_next; it = iterator_next(it)) {
-            lstf_vm_debugentry *entry = iterator_get_item(it);
+        // aliasing memory means we have to convert the byte order to host byte order
+        entry->instruction_offset = ntohll(entry->instruction_offset);
+        entry->source_column = ntohl(entry->source_column);
+        entry->source_line = ntohl(entry->source_line);
 
-            ptr_hashmap_insert(program->debug_entries,
-                    program->code + entry->instruction_offset, entry);
+        if (entry->instruction_offset >= program->code_size) {
+            status = lstf_vm_loader_error_invalid_debug_info;
+            goto error_cleanup;
         }
+        ptr_hashmap_insert(program->debug_entries, program->code + entry->instruction_offset, entry);
+        offset += sizeof *entry;
     }
 
-    if (debug_symbols) {
-        // now write the debug symbols
-        for (iterator it = ptr_list_iterator_create(debug_symbols);
-                it.has_next; it = iterator_next(it)) {
-            lstf_vm_debugsym *symbol = iterator_get_item(it);
+    // parse debug symbols
+    if (!lstf_vm_loader_read_uint64(debuginfo, debuginfo_size, &offset, &n_debug_symbols)) {
+        status = lstf_vm_loader_error_invalid_debug_size;
+        goto error_cleanup;
+    }
 
-            ptr_hashmap_insert(program->debug_symbols,
-                    program->code + symbol->instruction_offset, symbol);
+    offset = aligned(offset, alignof(lstf_vm_debugsym));
+    for (; n_debug_symbols > 0; n_debug_symbols--) {
+        if (offset > debuginfo_size || debuginfo_size - offset <= sizeof(lstf_vm_debugsym)) {
+            // debug symbols remain
+            status = lstf_vm_loader_error_invalid_debug_size;
+            goto error_cleanup;
         }
-    }
 
-    if (debug_entries)
-        ptr_list_destroy(debug_entries);
-    if (debug_symbols)
-        ptr_list_destroy(debug_symbols);
-    inputstream_unref(istream);
-    return program;
+        lstf_vm_debugsym *symbol = (void *)&debuginfo[offset];
+        nb_ptr = memchr(symbol->name, '\0', debuginfo_size - offset - sizeof *symbol);
 
-//  -------------------------------------------
-error_cleanup:
-    if (debug_entries)
-        ptr_list_destroy(debug_entries);
-    if (debug_symbols)
-        ptr_list_destroy(debug_symbols);
-    inputstream_unref(istream);
-    if (program) {
-        lstf_vm_program_unref(program);
-        program = NULL;
+        if (!nb_ptr) {
+            status = lstf_vm_loader_error_invalid_debug_info;
+            goto error_cleanup;
+        }
+
+        // aliasing memory means we have to convert the byte order to host byte order
+        symbol->instruction_offset = ntohll(symbol->instruction_offset);
+        if (symbol->instruction_offset >= program->code_size) {
+            status = lstf_vm_loader_error_invalid_debug_info;
+            goto error_cleanup;
+        }
+        ptr_hashmap_insert(program->debug_symbols, program->code + symbol->instruction_offset, symbol);
+
+        offset = aligned((size_t)(nb_ptr - debuginfo) + 1, alignof(lstf_vm_debugsym));
     }
-    return NULL;
-}
 
-lstf_vm_program *lstf_vm_loader_load_from_path(const char *path, lstf_vm_loader_error *error)
-{
-    return lstf_vm_loader_load_from_stream(inputstream_new_from_path(path, "rb"), error);
-}
+    program->debuginfo = debuginfo;
+    program->source_filename = (char *) debuginfo;
+    program->debuginfo_loaded = true;
+    return true;
 
-lstf_vm_program *lstf_vm_loader_load_from_buffer(const void           *buffer,
-                                                 size_t                buffer_size,
-                                                 lstf_vm_loader_error *error)
-{
-    return lstf_vm_loader_load_from_stream(inputstream_new_from_static_buffer(buffer, buffer_size), error);
+//  -------------------------------------------
+error_cleanup:
+    if (error)
+        *error = status;
+    ptr_hashmap_clear(program->debug_entries);
+    ptr_hashmap_clear(program->debug_symbols);
+    free(debuginfo);
+    return false;
 }
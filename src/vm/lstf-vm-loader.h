@@ -1,6 +1,7 @@
 #pragma once
 
 #include "lstf-vm-program.h"
+#include <stdbool.h>
 #include <stddef.h>
 
 #define LSTFC_MAGIC_HEADER_BYTE0 '\x89'
@@ -79,13 +80,39 @@ enum _lstf_vm_loader_error {
     /**
      * The entry point is at an invalid location (offset within `code` section)
      */
-    lstf_vm_loader_error_invalid_entry_point
+    lstf_vm_loader_error_invalid_entry_point,
+
+    /**
+     * The `data` section does not end with a NUL terminator, so the last
+     * string in it would run past the end of the section.
+     */
+    lstf_vm_loader_error_unterminated_data
 };
 typedef enum _lstf_vm_loader_error lstf_vm_loader_error;
 
+/**
+ * Loads the program at [path]. Where possible, the file is mapped read-only
+ * instead of being read, and the code and data of the program point into
+ * the mapping. Then nothing is copied and the pages are shared with other
+ * processes running the same program. The file must not be modified in
+ * place while the program is loaded. Replacing it with `rename()` is fine.
+ */
 lstf_vm_program *lstf_vm_loader_load_from_path(const char           *path,
                                                lstf_vm_loader_error *error);
 
+/**
+ * Loads a program from a copy of [buffer].
+ */
 lstf_vm_program *lstf_vm_loader_load_from_buffer(const void           *buffer,
                                                  size_t                buffer_size,
                                                  lstf_vm_loader_error *error);
+
+/**
+ * Parses the debug info of [program] into `source_filename`, `debug_entries`
+ * and `debug_symbols`, unless that was done already. Loading a program does
+ * not parse its debug info, since only debuggers and profilers need it.
+ *
+ * @return `true` if the debug info was parsed or there is none
+ */
+bool lstf_vm_loader_load_debuginfo(lstf_vm_program      *program,
+                                   lstf_vm_loader_error *error);
@@ -10,6 +10,22 @@
 // https://github.com/microsoft/language-server-protocol/issues/1676
 #define LSTF_VM_CONTENT_URI_FMT "untitled:///buffer%zu"
 
+/**
+ * Finds the document created by `memory()` with the given URI, or `NULL`.
+ */
+static lsp_textdocument *
+lstf_vm_lsp_find_document(lstf_virtualmachine *vm, const char *uri)
+{
+    size_t doc_idx = 0;
+
+    if (sscanf(uri, LSTF_VM_CONTENT_URI_FMT, &doc_idx) != 1 ||
+            doc_idx >= vm->client->docs.length ||
+            strcmp(vm->client->docs.elements[doc_idx].uri, uri) != 0)
+        return NULL;
+
+    return &vm->client->docs.elements[doc_idx];
+}
+
 // handlers for server notifications
 static void lstf_vm_handle_window_show_message(
     lsp_client *client, const lsp_showmessageparams *params, void *user_data)
@@ -43,7 +59,7 @@ static void lstf_vm_handle_window_show_message(
 
 // handlers for server calls and VM calls
 
-static lstf_vm_status
+lstf_vm_status
 lstf_vm_vmcall_memory_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
     lstf_vm_status status = lstf_vm_status_continue;
@@ -66,7 +82,7 @@ lstf_vm_vmcall_memory_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
                     (size_t)vm->client->docs.length, filetype->buffer);
     lsp_textdocument document = {.uri  = strdup(uri->buffer),
                                  .language_id = strdup(filetype->buffer),
-                                 .text = string_ref(content)};
+                                 .text = piece_table_new(content->buffer, content->length)};
 
     array_add(&vm->client->docs, document);
     if ((status = lstf_vm_stack_push_string(cr->stack, uri)))
@@ -84,7 +100,7 @@ typedef struct {
     union {
         // for initialize_server_cb()
         string *server_path;
-        // for td_open_cb(), diagnostics_exec_cb()
+        // for td_open_cb(), diagnostics_exec_cb(), change_exec_cb()
         string *text_document_uri;
     };
 } server_data;
@@ -129,7 +145,7 @@ lstf_vm_vmcall_connect_exec_initialize_server_cb(const event *ev, void *user_dat
     string_unref(server_path);
 }
 
-static lstf_vm_status
+lstf_vm_status
 lstf_vm_vmcall_connect_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
     lstf_vm_status status = lstf_vm_status_continue;
@@ -149,6 +165,18 @@ lstf_vm_vmcall_connect_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
         goto cleanup_on_error;
     }
 
+    // reuse a server that is already running and initialized
+    if (vm->server_pool &&
+            (vm->client = lsp_client_pool_take(vm->server_pool, path->buffer, io_get_current_dir()))) {
+        super(vm->client)->stats = vm->rpc_stats;
+        if (vm->capture_stream)
+            jsonrpc_server_capture(super(vm->client), vm->capture_stream);
+        lsp_client_on_window_show_message(
+            vm->client, lstf_vm_handle_window_show_message, vm, NULL);
+        string_unref(path);
+        return status;
+    }
+
     // start the server and connect
     if (!io_communicate(path->buffer, (const char *[]){path->buffer, NULL},
                         &stdin_os, &stdout_is, &stderr_is, &process)) {
@@ -169,6 +197,11 @@ lstf_vm_vmcall_connect_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 
     // now create the language client
     vm->client = lsp_client_new(vm->event_loop, stdout_is, stdin_os, process);
+    if (vm->server_pool)
+        lsp_client_pool_add(vm->server_pool, path->buffer, io_get_current_dir(), vm->client, process);
+    super(vm->client)->stats = vm->rpc_stats;
+    if (vm->capture_stream)
+        jsonrpc_server_capture(super(vm->client), vm->capture_stream);
 
     // setup notification handlers
     lsp_client_on_window_show_message(
@@ -228,7 +261,7 @@ static void lstf_vm_vmcall_td_open_exec_cb(const event *ev, void *user_data)
     string_unref(text_document_uri);
 }
 
-static lstf_vm_status
+lstf_vm_status
 lstf_vm_vmcall_td_open_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
     lstf_vm_status status = lstf_vm_status_continue;
@@ -251,9 +284,8 @@ lstf_vm_vmcall_td_open_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
         }
 
         // communicate with server...
-        size_t doc_idx = -1;
-        if (sscanf(uri->value, LSTF_VM_CONTENT_URI_FMT, &doc_idx) != 1 ||
-            doc_idx >= json_node_cast(uri_array, array)->num_elements) {
+        lsp_textdocument *document = lstf_vm_lsp_find_document(vm, uri->value);
+        if (!document) {
             status = lstf_vm_status_invalid_document_id;
             goto cleanup_on_error;
         }
@@ -268,12 +300,13 @@ lstf_vm_vmcall_td_open_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 
         // 3. send notification
         lsp_client_text_document_open_async(vm->client,
-                                            &vm->client->docs.elements[doc_idx],
+                                            document,
                                             vm->event_loop,
                                             lstf_vm_vmcall_td_open_exec_cb,
                                             data);
     });
 
+    json_node_unref(uri_array);
     return status;
 
 cleanup_on_error:
@@ -289,33 +322,31 @@ static void lstf_vm_vmcall_diagnostics_exec_cb(const event *ev, void *user_data)
     string *text_document_uri = data->text_document_uri;
     int errnum = 0;
 
+    free(data);
+    data = NULL;
+
+    // the client only completes this with diagnostics for our text document
     json_node *params = lsp_client_wait_for_diagnostics_finish(ev, &errnum);
-    json_node *uri = params ? json_object_get_member(params, "uri") : NULL;
-    if (errnum) {
-        fprintf(stderr, "error: could not deserialize diagnostics: %s\n",
-                strerror(errnum));
+    if (!params) {
+        fprintf(stderr, "error: could not get diagnostics for `%s': %s\n",
+                text_document_uri->const_buffer, strerror(errnum));
         lstf_virtualmachine_raise(vm, lstf_vm_status_could_not_communicate);
-    } else if (string_equal_to(text_document_uri,
-                               json_node_cast(uri, string)->value)) {
+    } else {
         // success. now add the result to the stack
         lstf_vm_status status = lstf_vm_status_continue;
         if ((status = lstf_vm_stack_push_json(cr->stack, params)))
             lstf_virtualmachine_raise(vm, status);
+        json_node_unref(params);
+    }
 
-        // resume the coroutine
-        --cr->outstanding_io;
+    // resume the coroutine
+    --cr->outstanding_io;
 
-        // cleanup
-        string_unref(text_document_uri);
-    } else {
-        // continue waiting for diagnostics for our text document
-        lsp_client_wait_for_diagnostics_async(
-            vm->client, vm->event_loop, lstf_vm_vmcall_diagnostics_exec_cb,
-            data);
-    }
+    // cleanup
+    string_unref(text_document_uri);
 }
 
-static lstf_vm_status
+lstf_vm_status
 lstf_vm_vmcall_diagnostics_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
 {
     lstf_vm_status status = lstf_vm_status_continue;
@@ -329,6 +360,9 @@ lstf_vm_vmcall_diagnostics_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
         goto cleanup;
     }
 
+    // wait for diagnostics of the current version of the document, if we
+    // know about it
+    lsp_textdocument *document = lstf_vm_lsp_find_document(vm, text_document_uri->buffer);
 
     // 1. save server data
     server_data *data;
@@ -339,7 +373,10 @@ lstf_vm_vmcall_diagnostics_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
     ++cr->outstanding_io;
 
     // 3. wait for diagnostics
-    lsp_client_wait_for_diagnostics_async(vm->client, vm->event_loop,
+    lsp_client_wait_for_diagnostics_async(vm->client,
+                                          text_document_uri->buffer,
+                                          document ? document->version : -1,
+                                          vm->event_loop,
                                           lstf_vm_vmcall_diagnostics_exec_cb, data);
 
 cleanup:
@@ -347,11 +384,440 @@ cleanup:
     return status;
 }
 
-lstf_vm_status (*const vmcall_table[256])(lstf_virtualmachine *, lstf_vm_coroutine *) = {
-    [lstf_vm_vmcall_memory]         = lstf_vm_vmcall_memory_exec,
-    [lstf_vm_vmcall_connect]        = lstf_vm_vmcall_connect_exec,
-    [lstf_vm_vmcall_td_open]        = lstf_vm_vmcall_td_open_exec,
-    [lstf_vm_vmcall_diagnostics]    = lstf_vm_vmcall_diagnostics_exec,
-    [lstf_vm_vmcall_change]         = NULL /* TODO */,
-    [lstf_vm_vmcall_completion]     = NULL /* TODO */,
-};
+static void lstf_vm_vmcall_change_exec_cb(const event *ev, void *user_data)
+{
+    server_data *data = user_data;
+    lstf_virtualmachine *vm = data->vm;
+    lstf_vm_coroutine *cr = data->cr;
+    string *text_document_uri = data->text_document_uri;
+    int errnum = 0;
+
+    free(data);
+    data = NULL;
+
+    if (!lsp_client_text_document_change_finish(ev, &errnum)) {
+        fprintf(stderr, "error: could not change text document `%s': %s\n",
+                text_document_uri->const_buffer, strerror(errnum));
+        lstf_virtualmachine_raise(vm, lstf_vm_status_could_not_communicate);
+    }
+
+    // resume the coroutine
+    --cr->outstanding_io;
+
+    // cleanup
+    string_unref(text_document_uri);
+}
+
+lstf_vm_status
+lstf_vm_vmcall_change_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    json_node *changes_array = NULL;
+    string *text_document_uri = NULL;
+    array(lsp_textdocumentcontentchangeevent) changes;
+
+    array_init(&changes);
+
+    if ((status = lstf_vm_stack_pop_array(cr->stack, &changes_array)))
+        goto cleanup;
+
+    if ((status = lstf_vm_stack_pop_string(cr->stack, &text_document_uri)))
+        goto cleanup;
+
+    if (!vm->client) {
+        status = lstf_vm_status_not_connected;
+        goto cleanup;
+    }
+
+    lsp_textdocument *document = lstf_vm_lsp_find_document(vm, text_document_uri->buffer);
+    if (!document) {
+        status = lstf_vm_status_invalid_document_id;
+        goto cleanup;
+    }
+
+    json_array_foreach(changes_array, element, {
+        lsp_textdocumentcontentchangeevent change = {0};
+
+        if (json_deserialize(lsp_textdocumentcontentchangeevent, &change, element)) {
+            lsp_textdocumentcontentchangeevent_clear(&change);
+            status = lstf_vm_status_invalid_operand_type;
+            goto cleanup;
+        }
+        array_add(&changes, change);
+    });
+
+    // 1. save server data
+    server_data *data;
+    box(server_data, data, .vm = vm, .cr = cr,
+        .text_document_uri = string_ref(text_document_uri));
+
+    // 2. set outstanding I/O to suspend the coroutine
+    ++cr->outstanding_io;
+
+    // 3. apply the changes and send the notification
+    lsp_client_text_document_change_async(vm->client,
+                                          document,
+                                          changes.elements,
+                                          changes.length,
+                                          vm->event_loop,
+                                          lstf_vm_vmcall_change_exec_cb,
+                                          data);
+
+cleanup:
+    for (size_t i = 0; i < changes.length; i++)
+        lsp_textdocumentcontentchangeevent_clear(&changes.elements[i]);
+    array_destroy(&changes);
+    if (changes_array)
+        json_node_unref(changes_array);
+    if (text_document_uri)
+        string_unref(text_document_uri);
+    return status;
+}
+
+typedef struct {
+    lstf_virtualmachine *vm;
+    lstf_vm_coroutine   *cr;
+    string              *text_document_uri;
+
+    /**
+     * The function that receives each batch of items, which is either a
+     * code address or a closure.
+     */
+    uint8_t             *on_items_address;
+    lstf_vm_closure     *on_items_closure;
+
+    /**
+     * All of the items received so far.
+     */
+    json_node           *items;
+    bool                 is_incomplete;
+    unsigned             partial_results;
+
+    uint64_t             start_time;
+
+    /**
+     * When the first item arrived, or `0` if none have arrived yet.
+     */
+    uint64_t             first_item_time;
+} completion_data;
+
+/**
+ * Gets the items from a batch of completion results, which is either an
+ * array of `CompletionItem`, a `CompletionList`, or `null`. Returns `NULL`
+ * if there are no items.
+ */
+static json_node *lstf_vm_lsp_get_completion_items(json_node *result, bool *is_incomplete)
+{
+    if (result->node_type == json_node_type_object) {
+        json_node *incomplete = json_object_get_member(result, "isIncomplete");
+
+        if (incomplete && incomplete->node_type == json_node_type_boolean)
+            *is_incomplete = ((json_boolean *)incomplete)->value;
+        result = json_object_get_member(result, "items");
+    }
+
+    if (!result || result->node_type != json_node_type_array)
+        return NULL;
+    return result;
+}
+
+/**
+ * Adds a batch of completion results to the items received so far. Returns
+ * a new array with only the items in this batch.
+ */
+static json_node *lstf_vm_lsp_add_completion_items(completion_data *data, json_node *result)
+{
+    json_node *batch = json_array_new();
+    json_node *items = lstf_vm_lsp_get_completion_items(result, &data->is_incomplete);
+
+    if (items) {
+        json_array_foreach(items, item, {
+            json_array_add_element(batch, item);
+            json_array_add_element(data->items, item);
+        });
+    }
+
+    if (!data->first_item_time && ((json_array *)batch)->num_elements > 0)
+        data->first_item_time = io_get_monotonic_time();
+
+    return batch;
+}
+
+static void lstf_vm_vmcall_completion_partial_result_cb(lsp_client *client,
+                                                        json_node  *value,
+                                                        void       *user_data)
+{
+    (void) client;
+    completion_data *data = user_data;
+    lstf_vm_value batch = lstf_vm_value_from_json_node(lstf_vm_lsp_add_completion_items(data, value));
+    lstf_vm_status status = lstf_vm_status_continue;
+
+    data->partial_results++;
+
+    // let the script consume the batch while the rest is on its way
+    if ((status = lstf_virtualmachine_schedule_call(data->vm,
+                    data->on_items_address, data->on_items_closure, &batch, 1, NULL)))
+        lstf_virtualmachine_raise(data->vm, status);
+}
+
+static void lstf_vm_vmcall_completion_exec_cb(const event *ev, void *user_data)
+{
+    completion_data *data = user_data;
+    lstf_virtualmachine *vm = data->vm;
+    lstf_vm_coroutine *cr = data->cr;
+    int errnum = 0;
+
+    json_node *result = lsp_client_text_document_completion_finish(ev, &errnum);
+    if (!result) {
+        fprintf(stderr, "error: could not get completions for `%s': %s\n",
+                data->text_document_uri->const_buffer, strerror(errnum));
+        lstf_virtualmachine_raise(vm, lstf_vm_status_could_not_communicate);
+    } else {
+        uint64_t end_time = io_get_monotonic_time();
+
+        // the response has the items that were not sent as partial results
+        json_node_unref(lstf_vm_lsp_add_completion_items(data, result));
+        json_node_unref(result);
+        if (!data->first_item_time)
+            data->first_item_time = end_time;
+
+        json_node *completion_result = json_object_new();
+        json_object_set_member(completion_result, "isIncomplete", json_boolean_new(data->is_incomplete));
+        json_object_set_member(completion_result, "items", data->items);
+        json_object_set_member(completion_result, "partialResults", json_integer_new(data->partial_results));
+        json_object_set_member(completion_result, "timeToFirstItem",
+                json_double_new((double)(data->first_item_time - data->start_time) / 1e6));
+        json_object_set_member(completion_result, "timeToComplete",
+                json_double_new((double)(end_time - data->start_time) / 1e6));
+
+        // success. now add the result to the stack
+        lstf_vm_status status = lstf_vm_status_continue;
+        if ((status = lstf_vm_stack_push_json(cr->stack, completion_result)))
+            lstf_virtualmachine_raise(vm, status);
+    }
+
+    // resume the coroutine
+    --cr->outstanding_io;
+
+    // cleanup
+    json_node_unref(data->items);
+    if (data->on_items_closure)
+        lstf_vm_closure_unref(data->on_items_closure);
+    string_unref(data->text_document_uri);
+    free(data);
+}
+
+lstf_vm_status
+lstf_vm_vmcall_completion_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    uint8_t *on_items_address = NULL;
+    lstf_vm_closure *on_items_closure = NULL;
+    int64_t character = 0;
+    int64_t line = 0;
+    string *text_document_uri = NULL;
+
+    // the callback is either a function address or a closure
+    if ((status = lstf_vm_stack_pop_code_address(cr->stack, &on_items_address))) {
+        if (status != lstf_vm_status_invalid_operand_type)
+            return status;
+        if ((status = lstf_vm_stack_pop_closure(cr->stack, &on_items_closure)))
+            return status;
+        on_items_address = on_items_closure->code_address;
+    }
+
+    if ((status = lstf_vm_stack_pop_integer(cr->stack, &character)))
+        goto cleanup;
+
+    if ((status = lstf_vm_stack_pop_integer(cr->stack, &line)))
+        goto cleanup;
+
+    if ((status = lstf_vm_stack_pop_string(cr->stack, &text_document_uri)))
+        goto cleanup;
+
+    if (!vm->client) {
+        status = lstf_vm_status_not_connected;
+        goto cleanup;
+    }
+
+    // 1. save server data
+    completion_data *data;
+    box(completion_data, data, .vm = vm, .cr = cr,
+        .text_document_uri = string_ref(text_document_uri),
+        .on_items_address = on_items_address,
+        .on_items_closure = on_items_closure,
+        .items = json_node_ref(json_array_new()),
+        .start_time = io_get_monotonic_time());
+    on_items_closure = NULL;
+
+    // 2. set outstanding I/O to suspend the coroutine
+    ++cr->outstanding_io;
+
+    // 3. request completions, streaming partial results to the callback
+    lsp_client_text_document_completion_async(vm->client,
+                                              text_document_uri->buffer,
+                                              (lsp_position) { .line = line, .character = character },
+                                              lstf_vm_vmcall_completion_partial_result_cb,
+                                              data,
+                                              vm->event_loop,
+                                              lstf_vm_vmcall_completion_exec_cb,
+                                              data);
+
+cleanup:
+    if (on_items_closure)
+        lstf_vm_closure_unref(on_items_closure);
+    if (text_document_uri)
+        string_unref(text_document_uri);
+    return status;
+}
+
+typedef struct {
+    lstf_virtualmachine *vm;
+    lstf_vm_coroutine   *cr;
+    string              *method;
+    jsonrpc_call_timing  timing;
+} request_data;
+
+static void lstf_vm_vmcall_request_exec_cb(const event *ev, void *user_data)
+{
+    request_data *data = user_data;
+    lstf_virtualmachine *vm = data->vm;
+    lstf_vm_coroutine *cr = data->cr;
+    int errnum = 0;
+
+    json_node *result = jsonrpc_server_call_remote_finish(ev, &errnum);
+    if (errnum) {
+        fprintf(stderr, "error: could not call `%s': %s\n",
+                data->method->const_buffer, strerror(errnum));
+        lstf_virtualmachine_raise(vm, lstf_vm_status_could_not_communicate);
+    } else {
+        json_node *response = json_object_new();
+
+        // the result is missing if the server responded with an error
+        json_object_set_member(response, "result", result ? result : json_null_new());
+        json_object_set_member(response, "sent", json_double_new((double)data->timing.sent_time / 1e6));
+        json_object_set_member(response, "received", json_double_new((double)data->timing.received_time / 1e6));
+        json_object_set_member(response, "latency",
+                json_double_new((double)(data->timing.received_time - data->timing.sent_time) / 1e6));
+        if (result)
+            json_node_unref(result);
+
+        // success. now add the result to the stack
+        lstf_vm_status status = lstf_vm_status_continue;
+        if ((status = lstf_vm_stack_push_json(cr->stack, response)))
+            lstf_virtualmachine_raise(vm, status);
+    }
+
+    // resume the coroutine
+    --cr->outstanding_io;
+
+    // cleanup
+    string_unref(data->method);
+    free(data);
+}
+
+lstf_vm_status
+lstf_vm_vmcall_request_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    lstf_vm_value params = {0};
+    string *method = NULL;
+
+    if ((status = lstf_vm_stack_pop_value(cr->stack, &params)))
+        return status;
+
+    if ((status = lstf_vm_stack_pop_string(cr->stack, &method)))
+        goto cleanup;
+
+    if (!vm->client) {
+        status = lstf_vm_status_not_connected;
+        goto cleanup;
+    }
+
+    // 1. save server data
+    request_data *data;
+    box(request_data, data, .vm = vm, .cr = cr, .method = string_ref(method));
+
+    // 2. set outstanding I/O to suspend the coroutine
+    ++cr->outstanding_io;
+
+    // 3. call the method, timing it
+    json_node *params_json = json_node_ref(lstf_vm_value_to_json_node(params));
+    jsonrpc_server_call_remote_timed_async(super(vm->client),
+                                           method->buffer,
+                                           params_json,
+                                           &data->timing,
+                                           vm->event_loop,
+                                           lstf_vm_vmcall_request_exec_cb,
+                                           data);
+    json_node_unref(params_json);
+
+cleanup:
+    lstf_vm_value_clear(&params);
+    if (method)
+        string_unref(method);
+    return status;
+}
+
+static void lstf_vm_vmcall_notify_exec_cb(const event *ev, void *user_data)
+{
+    request_data *data = user_data;
+    lstf_virtualmachine *vm = data->vm;
+    lstf_vm_coroutine *cr = data->cr;
+    int errnum = 0;
+
+    if (!jsonrpc_server_notify_remote_finish(ev, &errnum)) {
+        fprintf(stderr, "error: could not notify `%s': %s\n",
+                data->method->const_buffer, strerror(errnum));
+        lstf_virtualmachine_raise(vm, lstf_vm_status_could_not_communicate);
+    }
+
+    // resume the coroutine
+    --cr->outstanding_io;
+
+    // cleanup
+    string_unref(data->method);
+    free(data);
+}
+
+lstf_vm_status
+lstf_vm_vmcall_notify_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    lstf_vm_value params = {0};
+    string *method = NULL;
+
+    if ((status = lstf_vm_stack_pop_value(cr->stack, &params)))
+        return status;
+
+    if ((status = lstf_vm_stack_pop_string(cr->stack, &method)))
+        goto cleanup;
+
+    if (!vm->client) {
+        status = lstf_vm_status_not_connected;
+        goto cleanup;
+    }
+
+    // 1. save server data
+    request_data *data;
+    box(request_data, data, .vm = vm, .cr = cr, .method = string_ref(method));
+
+    // 2. set outstanding I/O to suspend the coroutine
+    ++cr->outstanding_io;
+
+    // 3. send the notification
+    json_node *params_json = json_node_ref(lstf_vm_value_to_json_node(params));
+    jsonrpc_server_notify_remote_async(super(vm->client),
+                                       method->buffer,
+                                       params_json,
+                                       vm->event_loop,
+                                       lstf_vm_vmcall_notify_exec_cb,
+                                       data);
+    json_node_unref(params_json);
+
+cleanup:
+    lstf_vm_value_clear(&params);
+    if (method)
+        string_unref(method);
+    return status;
+}
@@ -3,7 +3,28 @@
 #include "lstf-virtualmachine.h"
 #include "lstf-vm-status.h"
 
-/**
- * Routines accessible with the `vmcall` instruction.
- */
-extern lstf_vm_status (*const vmcall_table[256])(lstf_virtualmachine *, lstf_vm_coroutine *);
+// VM calls that talk to the language server
+
+lstf_vm_status
+lstf_vm_vmcall_memory_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_connect_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_td_open_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_diagnostics_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_change_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_completion_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_request_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+lstf_vm_status
+lstf_vm_vmcall_notify_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
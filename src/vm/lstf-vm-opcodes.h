@@ -197,6 +197,13 @@ enum _lstf_vm_opcode {
      */
     lstf_vm_op_assert,
 
+    /**
+     * `match <n: u64> <program: n bytes>` - pops an item and checks whether it
+     *     matches a constant pattern, using a match program compiled by
+     *     `json_matcher_compile()`. Pushes the result.
+     */
+    lstf_vm_op_match,
+
     lstf_vm_op_N
 } __attribute__((packed));
 typedef enum _lstf_vm_opcode lstf_vm_opcode;
@@ -232,15 +239,58 @@ enum _lstf_vm_vmcallcode {
     lstf_vm_vmcall_diagnostics,
 
     /**
-     * `async fun change(file: DocumentUri, change: TextDocumentContentChangeEvent[]): future<void>`
+     * Applies the changes to a document created with `memory()` and calls
+     * `textDocument/didChange`. Only the changed ranges are sent if the server
+     * synchronizes documents incrementally.
+     * `async fun change(file: DocumentUri, changes: TextDocumentContentChangeEvent[]): future<void>`
      */
     lstf_vm_vmcall_change,
 
     /**
-     * `async fun completion(file: DocumentUri, line: int, char: int)`
+     * Calls `textDocument/completion` with a `partialResultToken`. Each batch
+     * of partial results is passed to `on_items` in a new coroutine as soon
+     * as it arrives, and the result has all of the items along with the time
+     * in milliseconds until the first item and until the response.
+     * `async fun completion(file: DocumentUri, line: int, char: int, on_items: (items: CompletionItem[]) => void): future<CompletionResult>`
      */
     lstf_vm_vmcall_completion,
 
+    /**
+     * Calls any method on the server. The result has when the request was
+     * sent and when the response arrived, in milliseconds on a monotonic
+     * clock, and the latency between them.
+     * `async fun request(method: string, params: any): future<Response>`
+     */
+    lstf_vm_vmcall_request,
+
+    /**
+     * Sends any notification to the server.
+     * `async fun notify(method: string, params: any): future<void>`
+     */
+    lstf_vm_vmcall_notify,
+
+    /**
+     * Reads the monotonic clock, in milliseconds. The clock is the same one
+     * that the `sent` and `received` times of a response are taken from.
+     * `fun now(): double`
+     */
+    lstf_vm_vmcall_now,
+
+    /**
+     * Gets the milliseconds that have passed since [start], a time returned
+     * by `now()`.
+     * `fun elapsed(start: double): double`
+     */
+    lstf_vm_vmcall_elapsed,
+
+    /**
+     * Calls [fn] [n] times, one after another, in a new coroutine each time.
+     * The result has the distribution of the times in milliseconds that each
+     * call took, including any time spent waiting for the server.
+     * `async fun bench(n: int, fn: async () => future<void>): future<BenchResult>`
+     */
+    lstf_vm_vmcall_bench,
+
     lstf_vm_vmcall_N
 };
 typedef enum _lstf_vm_vmcallcode lstf_vm_vmcallcode;
@@ -344,6 +394,8 @@ static inline const char *lstf_vm_opcode_to_string(lstf_vm_opcode opcode)
             return "exit";
         case lstf_vm_op_assert:
             return "assert";
+        case lstf_vm_op_match:
+            return "match";
         case lstf_vm_op_N:
             break;
     }
@@ -374,6 +426,16 @@ static inline const char *lstf_vm_vmcallcode_to_string(lstf_vm_vmcallcode callco
             return "lsp.textDocument.didChange";
         case lstf_vm_vmcall_completion:
             return "lsp.textDocument.completion";
+        case lstf_vm_vmcall_request:
+            return "lsp.request";
+        case lstf_vm_vmcall_notify:
+            return "lsp.notify";
+        case lstf_vm_vmcall_now:
+            return "now";
+        case lstf_vm_vmcall_elapsed:
+            return "elapsed";
+        case lstf_vm_vmcall_bench:
+            return "bench";
         case lstf_vm_vmcall_N:
             break;
     }
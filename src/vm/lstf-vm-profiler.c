@@ -0,0 +1,191 @@
+#include "lstf-vm-profiler.h"
+#include "lstf-vm-loader.h"
+#include "lstf-vm-debug.h"
+#include "lstf-vm-stack.h"
+#include "data-structures/collection.h"
+#include "data-structures/iterator.h"
+#include "data-structures/string-builder.h"
+#include "io/io-common.h"
+#include "util.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+lstf_vm_profiler *lstf_vm_profiler_new(lstf_vm_program *program, uint64_t interval)
+{
+    lstf_vm_profiler *profiler = calloc(1, sizeof *profiler);
+
+    if (!profiler) {
+        perror("failed to create profiler");
+        abort();
+    }
+
+    profiler->program = lstf_vm_program_ref(program);
+    profiler->interval = interval;
+    profiler->last_sample_time = io_get_monotonic_time();
+    profiler->stacks = ptr_hashmap_new((collection_item_hash_func) strhash,
+            NULL,
+            (collection_item_unref_func) free,
+            (collection_item_equality_func) strequal,
+            NULL,
+            (collection_item_unref_func) free);
+
+    return profiler;
+}
+
+void lstf_vm_profiler_destroy(lstf_vm_profiler *profiler)
+{
+    if (!profiler)
+        return;
+    lstf_vm_program_unref(profiler->program);
+    ptr_hashmap_destroy(profiler->stacks);
+    free(profiler);
+}
+
+static void lstf_vm_profiler_add_time(lstf_vm_profiler *profiler, string *stack, uint64_t time)
+{
+    ptr_hashmap_entry *entry = ptr_hashmap_get(profiler->stacks, stack->buffer);
+
+    if (entry) {
+        *(uint64_t *)entry->value += time;
+        string_unref(stack);
+        return;
+    }
+
+    uint64_t *total = malloc(sizeof *total);
+    if (!total) {
+        perror("failed to add profiler sample");
+        abort();
+    }
+    *total = time;
+    ptr_hashmap_insert(profiler->stacks, string_destroy(stack), total);
+}
+
+/**
+ * Appends the code offset that each frame of [cr] is at, from the outermost.
+ */
+static string *lstf_vm_profiler_append_stack(const lstf_vm_profiler  *profiler,
+                                             string                  *stack,
+                                             const lstf_vm_coroutine *cr)
+{
+    const lstf_vm_stack *cr_stack = cr->stack;
+
+    for (unsigned i = 0; i < cr_stack->n_frames; i++) {
+        // the innermost frame is at the PC, and the others are at the call
+        // that made the next frame
+        const uint8_t *location = i + 1 < cr_stack->n_frames ? cr_stack->frames[i + 1].return_address - 1 : cr->pc;
+
+        if (location < profiler->program->code)
+            continue;
+        string_appendf(stack, ";%" PRIx64, (uint64_t)(location - profiler->program->code));
+    }
+
+    return stack;
+}
+
+void lstf_vm_profiler_sample(lstf_vm_profiler *profiler, const lstf_vm_coroutine *cr)
+{
+    const uint64_t now = io_get_monotonic_time();
+
+    if (now - profiler->last_sample_time < profiler->interval || !cr->pc)
+        return;
+
+    lstf_vm_profiler_add_time(profiler,
+            lstf_vm_profiler_append_stack(profiler, string_appendf(string_new(), "executing"), cr),
+            now - profiler->last_sample_time);
+    profiler->last_sample_time = now;
+}
+
+void lstf_vm_profiler_add_wait(lstf_vm_profiler *profiler,
+                               ptr_list         *suspended_list,
+                               uint64_t          wait_start)
+{
+    const uint64_t now = io_get_monotonic_time();
+    const uint64_t waited = now - wait_start;
+
+    if (ptr_list_is_empty(suspended_list)) {
+        lstf_vm_profiler_add_time(profiler, string_appendf(string_new(), "blocked-on-io"), waited);
+    } else {
+        // every blocked coroutine gets an equal share, so that the lane adds
+        // up to the time that was spent waiting
+        for (iterator it = ptr_list_iterator_create(suspended_list); it.has_next; it = iterator_next(it))
+            lstf_vm_profiler_add_time(profiler,
+                    lstf_vm_profiler_append_stack(profiler, string_appendf(string_new(), "blocked-on-io"),
+                        iterator_get_item(it)),
+                    waited / suspended_list->length);
+    }
+
+    // the time before the wait was spent executing, but the coroutine that
+    // ran then is not known anymore
+    profiler->last_sample_time = now;
+}
+
+/**
+ * Gets the name of the function that [offset] is in, and the line if it is
+ * known. The function is the nearest symbol at or before [offset], and the
+ * line is the nearest debug entry in between.
+ */
+static char *lstf_vm_profiler_get_frame_name(const lstf_vm_program *program, uint64_t offset)
+{
+    const lstf_vm_debugsym *symbol = NULL;
+    const lstf_vm_debugentry *entry = NULL;
+
+    for (uint64_t o = offset + 1; !symbol && o-- > 0;) {
+        const ptr_hashmap_entry *map_entry = NULL;
+
+        if (!entry && (map_entry = ptr_hashmap_get(program->debug_entries, program->code + o)))
+            entry = map_entry->value;
+        if ((map_entry = ptr_hashmap_get(program->debug_symbols, program->code + o)))
+            symbol = map_entry->value;
+    }
+
+    string *name = string_new();
+    if (symbol)
+        string_appendf(name, "%s", symbol->name);
+    else
+        string_appendf(name, "0x%" PRIx64, offset);
+    if (entry)
+        string_appendf(name, ":%" PRIu32, entry->source_line);
+
+    return string_destroy(name);
+}
+
+bool lstf_vm_profiler_write_folded(lstf_vm_profiler *profiler, outputstream *ostream)
+{
+    // maps (offset: uintptr_t coerced to (void *)) -> (name: char *)
+    ptr_hashmap *frame_names = ptr_hashmap_new(ptrhash, NULL, NULL, NULL, NULL, free);
+    bool success = true;
+
+    // without debug info, each frame is shown as a code offset
+    lstf_vm_loader_load_debuginfo(profiler->program, NULL);
+
+    for (iterator it = ptr_hashmap_iterator_create(profiler->stacks); success && it.has_next; it = iterator_next(it)) {
+        const ptr_hashmap_entry *entry = iterator_get_item(it);
+        const char *stack = entry->key;
+        const uint64_t microseconds = *(uint64_t *)entry->value / 1000;
+
+        if (microseconds == 0)
+            continue;
+
+        const char *frame = strchr(stack, ';');
+        string *line = string_appendf(string_new(), "%.*s", (int)(frame ? frame - stack : (ptrdiff_t)strlen(stack)), stack);
+
+        for (; frame; frame = strchr(frame + 1, ';')) {
+            const uint64_t offset = strtoull(frame + 1, NULL, 16);
+            const ptr_hashmap_entry *name_entry = ptr_hashmap_get(frame_names, (void *)(uintptr_t)offset);
+
+            if (!name_entry)
+                name_entry = ptr_hashmap_insert(frame_names, (void *)(uintptr_t)offset,
+                        lstf_vm_profiler_get_frame_name(profiler->program, offset));
+            string_appendf(line, ";%s", (const char *)name_entry->value);
+        }
+        string_appendf(line, " %" PRIu64 "\n", microseconds);
+
+        success = outputstream_write_string(ostream, line->buffer) == line->length;
+        string_unref(line);
+    }
+
+    ptr_hashmap_destroy(frame_names);
+    return success;
+}
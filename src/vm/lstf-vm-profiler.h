@@ -0,0 +1,91 @@
+#pragma once
+
+#include "data-structures/ptr-hashmap.h"
+#include "data-structures/ptr-list.h"
+#include "io/outputstream.h"
+#include "lstf-vm-coroutine.h"
+#include "lstf-vm-program.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The default time between samples, in nanoseconds.
+ */
+#define LSTF_VM_PROFILER_DEFAULT_INTERVAL 1000000
+
+/**
+ * How many instructions to execute between reading the clock.
+ */
+#define LSTF_VM_PROFILER_CHECK_CYCLES 256
+
+/**
+ * A sampling profiler for the virtual machine.
+ *
+ * While the virtual machine executes instructions, the call stack of the
+ * running coroutine is sampled about once every [interval], and each sample
+ * is charged the time since the previous one. While the virtual machine waits
+ * for I/O because every coroutine is blocked, the time spent waiting is
+ * charged to the call stacks of the blocked coroutines instead. Samples are
+ * taken in between instructions rather than from a timer signal, since that is
+ * the only time the stacks are consistent.
+ */
+typedef struct {
+    lstf_vm_program *program;           // the program being profiled
+    uint64_t interval;                  // nanoseconds between samples
+    unsigned cycles;                    // instructions executed since the clock was last read
+    uint64_t last_sample_time;          // from io_get_monotonic_time()
+
+    /**
+     * Maps `(stack: char *) -> (nanoseconds: uint64_t *)`. A stack is the
+     * lane followed by the code offset in each frame, from the outermost.
+     */
+    ptr_hashmap *stacks;
+} lstf_vm_profiler;
+
+/**
+ * Creates a profiler for [program] that samples every [interval] nanoseconds.
+ */
+lstf_vm_profiler *lstf_vm_profiler_new(lstf_vm_program *program, uint64_t interval);
+
+void lstf_vm_profiler_destroy(lstf_vm_profiler *profiler);
+
+/**
+ * Samples the call stack of [cr] if it has been at least [profiler->interval]
+ * since the last sample. Use `lstf_vm_profiler_tick()` instead to only read
+ * the clock every few instructions.
+ */
+void lstf_vm_profiler_sample(lstf_vm_profiler *profiler, const lstf_vm_coroutine *cr);
+
+/**
+ * Should be called after [cr] executed an instruction.
+ */
+static inline void lstf_vm_profiler_tick(lstf_vm_profiler *profiler, const lstf_vm_coroutine *cr)
+{
+    if (++profiler->cycles >= LSTF_VM_PROFILER_CHECK_CYCLES) {
+        profiler->cycles = 0;
+        lstf_vm_profiler_sample(profiler, cr);
+    }
+}
+
+/**
+ * Charges the time since [wait_start] to the coroutines in [suspended_list],
+ * which were all blocked on I/O since then.
+ */
+void lstf_vm_profiler_add_wait(lstf_vm_profiler *profiler,
+                               ptr_list         *suspended_list,
+                               uint64_t          wait_start);
+
+/**
+ * Writes the samples as folded stacks, the input of flame graph tools such as
+ * `flamegraph.pl` and speedscope. There is one line for each distinct stack,
+ * with its frames separated by semicolons and the microseconds spent in it:
+ *
+ * ```
+ * executing;main:3;fibonacci:12 1520
+ * blocked-on-io;main:5 30211
+ * ```
+ *
+ * Each frame is the name of a function and the line that it was at, if the
+ * program has debug info, or a code offset if it does not.
+ */
+bool lstf_vm_profiler_write_folded(lstf_vm_profiler *profiler, outputstream *ostream);
@@ -1,6 +1,7 @@
 #include "lstf-vm-program.h"
 #include "data-structures/ptr-hashmap.h"
 #include "io/outputstream.h"
+#include "json/json-matcher.h"
 #include "lstf-vm-opcodes.h"
 #include <assert.h>
 #include <errno.h>
@@ -8,6 +9,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/mman.h>
+#endif
 
 lstf_vm_program *lstf_vm_program_ref(lstf_vm_program *prog)
 {
@@ -36,8 +40,12 @@ static void lstf_vm_program_destroy(lstf_vm_program *prog)
     free(prog->debuginfo);
     ptr_hashmap_destroy(prog->debug_entries);
     ptr_hashmap_destroy(prog->debug_symbols);
-    free(prog->data);
-    free(prog->code);
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (prog->image_is_mapped)
+        munmap(prog->image, prog->image_size);
+    else
+#endif
+        free(prog->image);
     free(prog);
 }
 
@@ -404,6 +412,20 @@ bool lstf_vm_program_disassemble(lstf_vm_program *prog, outputstream *ostream, u
                 if (!outputstream_printf(ostream, "exit %hhu\n", retcode))
                     goto err_write;
             }   break;
+
+            case lstf_vm_op_match:
+            {
+                uint64_t program_size;
+                const char *pattern_string = NULL;
+
+                if (!lstf_vm_program_read_imm_u64(prog, &offset, &program_size) ||
+                        program_size > prog->code_size - offset)
+                    goto err_read;
+                pattern_string = json_matcher_program_get_pattern_string(prog->code + offset, program_size);
+                offset += program_size;
+                if (!outputstream_printf(ostream, "match %s\n", pattern_string ? pattern_string : "<invalid program>"))
+                    goto err_write;
+            }   break;
             }
         }
     }
@@ -14,10 +14,26 @@ struct _lstf_vm_program {
     unsigned long refcount : sizeof(unsigned long)*CHAR_BIT - 1;
     bool floating : 1;
 
+    // --- the program image
+    /**
+     * The whole program as it was loaded, which the sections point into. If
+     * [image_is_mapped] is set, this is a read-only mapping of the file that
+     * the program was loaded from. Otherwise it is owned by the program.
+     */
+    uint8_t *image;
+    size_t image_size;
+    bool image_is_mapped;
+
     // --- important sections
     // --- debug info fields (optional)
-    uint8_t *debuginfo;                 // mapped debug section (optional)
+    /**
+     * The debug section in the image, which is only parsed once
+     * `lstf_vm_loader_load_debuginfo()` is called.
+     */
+    const uint8_t *debuginfo_section;
     uint64_t debuginfo_size;
+    bool debuginfo_loaded;
+    uint8_t *debuginfo;                 // parsed copy of the debug section
     char *source_filename;
     /**
      * maps `(uint8_t *) -> (lstf_vm_debugentry *)`
@@ -29,11 +45,11 @@ struct _lstf_vm_program {
     ptr_hashmap *debug_symbols;
 
     // --- data
-    uint8_t *data;                      // mapped data section
+    uint8_t *data;                      // data section in the image
     uint64_t data_size;
 
     // --- code
-    uint8_t *code;                      // mapped code section
+    uint8_t *code;                      // code section in the image
     uint8_t *entry_point;               // offset in `code` to begin execution
     uint64_t code_size;
 };
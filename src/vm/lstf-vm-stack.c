@@ -906,6 +906,9 @@ lstf_vm_status lstf_vm_stack_teardown_frame(lstf_vm_stack *stack,
                 return status;
             }
         }
+    } else if (has_return_value) {
+        // there is no caller to receive the return value
+        lstf_vm_value_clear(&return_value);
     }
 
     // ignore if we fail to shrink the stack space
@@ -0,0 +1,143 @@
+#include "lstf-vm-stats.h"
+#include "lstf-vm-opcodes.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+thread_local uint64_t lstf_vm_stats_allocations;
+
+#ifdef LSTF_VM_STATS_ALLOCATIONS
+// the program is linked with `--wrap` for each of these, so that every call
+// to the allocator in our own code comes here first
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    lstf_vm_stats_allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    lstf_vm_stats_allocations++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    lstf_vm_stats_allocations++;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+static lstf_vm_stats totals;
+static mtx_t totals_mutex;
+static once_flag totals_once = ONCE_FLAG_INIT;
+
+typedef struct {
+    char name[32];
+    const lstf_vm_stats_counter *counter;
+} lstf_vm_stats_row;
+
+static int lstf_vm_stats_row_compare(const void *a, const void *b)
+{
+    const lstf_vm_stats_counter *counter1 = ((const lstf_vm_stats_row *)a)->counter;
+    const lstf_vm_stats_counter *counter2 = ((const lstf_vm_stats_row *)b)->counter;
+
+    // most cycles first
+    return (counter1->cycles < counter2->cycles) - (counter1->cycles > counter2->cycles);
+}
+
+static void lstf_vm_stats_print_table(const char *heading, lstf_vm_stats_row *rows, unsigned num_rows)
+{
+    uint64_t total_cycles = 0;
+
+    if (num_rows == 0)
+        return;
+
+    for (unsigned i = 0; i < num_rows; i++)
+        total_cycles += rows[i].counter->cycles;
+    qsort(rows, num_rows, sizeof *rows, lstf_vm_stats_row_compare);
+
+    fprintf(stderr, "%-28s %14s %16s %12s %7s %12s %10s\n",
+            heading, "count", LSTF_VM_STATS_CYCLES_UNIT, LSTF_VM_STATS_CYCLES_UNIT "/op", "%",
+            "allocs", "allocs/op");
+    for (unsigned i = 0; i < num_rows; i++) {
+        const lstf_vm_stats_counter *counter = rows[i].counter;
+
+        fprintf(stderr, "%-28s %14" PRIu64 " %16" PRIu64 " %12.1f %6.2f%% %12" PRIu64 " %10.3f\n",
+                rows[i].name, counter->executions, counter->cycles,
+                (double)counter->cycles / (double)counter->executions,
+                total_cycles ? 100.0 * (double)counter->cycles / (double)total_cycles : 0.0,
+                counter->allocations,
+                (double)counter->allocations / (double)counter->executions);
+    }
+    fprintf(stderr, "\n");
+}
+
+static void lstf_vm_stats_print_totals(void)
+{
+    lstf_vm_stats_row rows[UINT8_MAX + 1];
+    unsigned num_rows = 0;
+
+    mtx_lock(&totals_mutex);
+
+    for (unsigned opcode = 0; opcode <= UINT8_MAX; opcode++) {
+        if (!totals.opcodes[opcode].executions)
+            continue;
+        if (lstf_vm_opcode_can_cast((uint8_t)opcode))
+            snprintf(rows[num_rows].name, sizeof rows[num_rows].name, "%s", lstf_vm_opcode_to_string(opcode));
+        else
+            snprintf(rows[num_rows].name, sizeof rows[num_rows].name, "(invalid 0x%02x)", opcode);
+        rows[num_rows++].counter = &totals.opcodes[opcode];
+    }
+    lstf_vm_stats_print_table("opcode", rows, num_rows);
+
+    num_rows = 0;
+    for (unsigned callcode = 0; callcode <= UINT8_MAX; callcode++) {
+        if (!totals.vmcalls[callcode].executions)
+            continue;
+        if (lstf_vm_vmcallcode_can_cast((uint8_t)callcode))
+            snprintf(rows[num_rows].name, sizeof rows[num_rows].name, "%s", lstf_vm_vmcallcode_to_string(callcode));
+        else
+            snprintf(rows[num_rows].name, sizeof rows[num_rows].name, "(invalid 0x%02x)", callcode);
+        rows[num_rows++].counter = &totals.vmcalls[callcode];
+    }
+    lstf_vm_stats_print_table("vmcall", rows, num_rows);
+
+    mtx_unlock(&totals_mutex);
+}
+
+static void lstf_vm_stats_init_totals(void)
+{
+    if (mtx_init(&totals_mutex, mtx_plain) != thrd_success) {
+        fprintf(stderr, "%s: failed to create mutex\n", __func__);
+        abort();
+    }
+    atexit(lstf_vm_stats_print_totals);
+}
+
+void lstf_vm_stats_report(const lstf_vm_stats *stats)
+{
+    call_once(&totals_once, lstf_vm_stats_init_totals);
+    mtx_lock(&totals_mutex);
+
+    for (unsigned i = 0; i <= UINT8_MAX; i++) {
+        totals.opcodes[i].executions += stats->opcodes[i].executions;
+        totals.opcodes[i].cycles += stats->opcodes[i].cycles;
+        totals.opcodes[i].allocations += stats->opcodes[i].allocations;
+        totals.vmcalls[i].executions += stats->vmcalls[i].executions;
+        totals.vmcalls[i].cycles += stats->vmcalls[i].cycles;
+        totals.vmcalls[i].allocations += stats->vmcalls[i].allocations;
+    }
+
+    mtx_unlock(&totals_mutex);
+}
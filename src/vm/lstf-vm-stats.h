@@ -0,0 +1,76 @@
+#pragma once
+
+// Instruction counters for the virtual machine, built with the `vm_stats`
+// option. Nothing here exists otherwise, so that the interpreter loop pays
+// nothing for it.
+#ifdef LSTF_VM_STATS
+
+#include "io/io-common.h"
+#include <stdint.h>
+#include <threads.h>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+typedef struct {
+    uint64_t executions;
+    uint64_t cycles;                    // see lstf_vm_stats_get_cycles()
+    uint64_t allocations;               // calls to malloc(), calloc() and realloc()
+} lstf_vm_stats_counter;
+
+/**
+ * Counters for each opcode and for each VM call. The time and allocations of
+ * a `vmcall` are counted both for the opcode and for the VM call.
+ */
+typedef struct {
+    lstf_vm_stats_counter opcodes[UINT8_MAX + 1];
+    lstf_vm_stats_counter vmcalls[UINT8_MAX + 1];
+} lstf_vm_stats;
+
+/**
+ * The number of allocations made by the current thread. This only counts up
+ * if the linker can wrap the allocator (see `src/meson.build`).
+ */
+extern thread_local uint64_t lstf_vm_stats_allocations;
+
+#if ((defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))) || \
+    (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86)))
+#define LSTF_VM_STATS_HAVE_TSC 1
+#define LSTF_VM_STATS_CYCLES_UNIT "cycles"
+#else
+#define LSTF_VM_STATS_CYCLES_UNIT "ns"
+#endif
+
+/**
+ * Reads the time stamp counter where there is one, and the monotonic clock
+ * in nanoseconds otherwise.
+ */
+static inline uint64_t lstf_vm_stats_get_cycles(void)
+{
+#if defined(LSTF_VM_STATS_HAVE_TSC) && defined(_MSC_VER)
+    return __rdtsc();
+#elif defined(LSTF_VM_STATS_HAVE_TSC)
+    return __builtin_ia32_rdtsc();
+#else
+    return io_get_monotonic_time();
+#endif
+}
+
+static inline void lstf_vm_stats_counter_add(lstf_vm_stats_counter *counter,
+                                             uint64_t               cycles,
+                                             uint64_t               allocations)
+{
+    counter->executions++;
+    counter->cycles += cycles;
+    counter->allocations += allocations;
+}
+
+/**
+ * Adds [stats] to the totals for the process. The first time this is called,
+ * the totals are set up to be printed to `stderr` when the process exits,
+ * ranked by the cycles spent in each opcode and VM call.
+ */
+void lstf_vm_stats_report(const lstf_vm_stats *stats);
+
+#endif
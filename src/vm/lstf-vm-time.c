@@ -0,0 +1,169 @@
+#include "data-structures/histogram.h"
+#include "io/io-common.h"
+#include "lstf-vm-time.h"
+#include "vm/lstf-vm-stack.h"
+#include "json/json.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+lstf_vm_status
+lstf_vm_vmcall_now_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    (void) vm;
+    return lstf_vm_stack_push_double(cr->stack, (double)io_get_monotonic_time() / 1e6);
+}
+
+lstf_vm_status
+lstf_vm_vmcall_elapsed_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    (void) vm;
+    lstf_vm_status status = lstf_vm_status_continue;
+    double start = 0;
+
+    if ((status = lstf_vm_stack_pop_double(cr->stack, &start)))
+        return status;
+
+    return lstf_vm_stack_push_double(cr->stack, (double)io_get_monotonic_time() / 1e6 - start);
+}
+
+typedef struct {
+    lstf_virtualmachine *vm;
+    lstf_vm_coroutine   *cr;
+
+    /**
+     * The function being measured, which is either a code address or a
+     * closure.
+     */
+    uint8_t             *fn_address;
+    lstf_vm_closure     *fn_closure;
+
+    int64_t              iterations;
+
+    /**
+     * When the call that is running was scheduled.
+     */
+    uint64_t             start_time;
+
+    /**
+     * The time that each call took, in nanoseconds.
+     */
+    histogram           *times;
+} bench_data;
+
+static void lstf_vm_vmcall_bench_exit_cb(lstf_vm_coroutine *fn_cr, void *user_data);
+
+/**
+ * Calls the function being measured in a new coroutine.
+ */
+static lstf_vm_status lstf_vm_bench_schedule(bench_data *data)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    lstf_vm_coroutine *fn_cr = NULL;
+
+    if ((status = lstf_virtualmachine_schedule_call(data->vm,
+                    data->fn_address, data->fn_closure, NULL, 0, &fn_cr)))
+        return status;
+
+    fn_cr->on_exit = lstf_vm_vmcall_bench_exit_cb;
+    fn_cr->on_exit_data = data;
+    data->start_time = io_get_monotonic_time();
+    return status;
+}
+
+/**
+ * Creates a `BenchResult` with the times in milliseconds.
+ */
+static json_node *lstf_vm_bench_get_result(const bench_data *data)
+{
+    const histogram *times = data->times;
+    json_node *result = json_object_new();
+
+    json_object_set_member(result, "iterations", json_integer_new((int64_t)times->total_count));
+    json_object_set_member(result, "min",
+            json_double_new(times->total_count ? (double)times->min / 1e6 : 0));
+    json_object_set_member(result, "mean", json_double_new(histogram_get_mean(times) / 1e6));
+    json_object_set_member(result, "p50", json_double_new((double)histogram_get_percentile(times, 50) / 1e6));
+    json_object_set_member(result, "p90", json_double_new((double)histogram_get_percentile(times, 90) / 1e6));
+    json_object_set_member(result, "p99", json_double_new((double)histogram_get_percentile(times, 99) / 1e6));
+    json_object_set_member(result, "max", json_double_new((double)times->max / 1e6));
+
+    return result;
+}
+
+static void lstf_vm_bench_finish(bench_data *data)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+
+    if ((status = lstf_vm_stack_push_json(data->cr->stack, lstf_vm_bench_get_result(data))))
+        lstf_virtualmachine_raise(data->vm, status);
+
+    // resume the coroutine
+    --data->cr->outstanding_io;
+
+    // cleanup
+    if (data->fn_closure)
+        lstf_vm_closure_unref(data->fn_closure);
+    histogram_destroy(data->times);
+    free(data);
+}
+
+static void lstf_vm_vmcall_bench_exit_cb(lstf_vm_coroutine *fn_cr, void *user_data)
+{
+    (void) fn_cr;
+    bench_data *data = user_data;
+    lstf_vm_status status = lstf_vm_status_continue;
+
+    histogram_record(data->times, io_get_monotonic_time() - data->start_time);
+
+    if ((int64_t)data->times->total_count < data->iterations) {
+        if ((status = lstf_vm_bench_schedule(data)))
+            lstf_virtualmachine_raise(data->vm, status);
+        return;
+    }
+
+    lstf_vm_bench_finish(data);
+}
+
+lstf_vm_status
+lstf_vm_vmcall_bench_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr)
+{
+    lstf_vm_status status = lstf_vm_status_continue;
+    uint8_t *fn_address = NULL;
+    lstf_vm_closure *fn_closure = NULL;
+    int64_t iterations = 0;
+
+    // the function is either a function address or a closure
+    if ((status = lstf_vm_stack_pop_code_address(cr->stack, &fn_address))) {
+        if (status != lstf_vm_status_invalid_operand_type)
+            return status;
+        if ((status = lstf_vm_stack_pop_closure(cr->stack, &fn_closure)))
+            return status;
+        fn_address = fn_closure->code_address;
+    }
+
+    if ((status = lstf_vm_stack_pop_integer(cr->stack, &iterations)))
+        goto cleanup;
+
+    // 1. save the function
+    bench_data *data;
+    box(bench_data, data, .vm = vm, .cr = cr,
+        .fn_address = fn_address,
+        .fn_closure = fn_closure,
+        .iterations = iterations,
+        .times = histogram_new());
+    fn_closure = NULL;
+
+    // 2. suspend the coroutine until the last call returns
+    ++cr->outstanding_io;
+
+    // 3. make the first call, which makes the next call when it returns
+    if (iterations <= 0)
+        lstf_vm_bench_finish(data);
+    else
+        status = lstf_vm_bench_schedule(data);
+
+cleanup:
+    if (fn_closure)
+        lstf_vm_closure_unref(fn_closure);
+    return status;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "lstf-virtualmachine.h"
+#include "lstf-vm-status.h"
+
+// VM calls for measuring time, which scripts use to time language server
+// responses and their own code
+
+/**
+ * `now()`: pushes the monotonic time in milliseconds.
+ */
+lstf_vm_status
+lstf_vm_vmcall_now_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+/**
+ * `elapsed(start)`: pushes the milliseconds since [start], a time from
+ * `now()`.
+ */
+lstf_vm_status
+lstf_vm_vmcall_elapsed_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
+
+/**
+ * `bench(n, fn)`: calls [fn] [n] times, one call after another, and pushes a
+ * `BenchResult` with the distribution of the times in milliseconds. Suspends
+ * the coroutine until the last call returns.
+ */
+lstf_vm_status
+lstf_vm_vmcall_bench_exec(lstf_virtualmachine *vm, lstf_vm_coroutine *cr);
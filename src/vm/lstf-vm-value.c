@@ -1,4 +1,5 @@
 #include "lstf-vm-value.h"
+#include "lstf-vm-collector.h"
 #include "lstf-vm-coroutine.h"
 #include "lstf-vm-program.h"
 #include <assert.h>
@@ -61,6 +62,7 @@ lstf_vm_upvalue *lstf_vm_upvalue_new(int64_t stack_offset, lstf_vm_coroutine *cr
     upvalue->is_local = true;
     upvalue->stack_offset = stack_offset;
     upvalue->cr = cr;
+    lstf_vm_collector_allocated();
 
     return upvalue;
 }
@@ -102,7 +104,11 @@ void lstf_vm_upvalue_unref(lstf_vm_upvalue *upvalue)
             // aliases a stack value
             upvalue->cr->stack->values[upvalue->stack_offset].is_captured = false;
         }
+        if (upvalue->gc_buffered)
+            lstf_vm_collector_forget(lstf_vm_collector_object_type_upvalue, upvalue);
         free(upvalue);
+    } else {
+        lstf_vm_collector_possible_root(lstf_vm_collector_object_type_upvalue, upvalue);
     }
 }
 
@@ -122,6 +128,7 @@ lstf_vm_closure *lstf_vm_closure_new(uint8_t         *code_address,
     closure->num_upvalues = num_upvalues;
     for (unsigned i = 0; i < num_upvalues; i++)
         closure->upvalues[i] = lstf_vm_upvalue_ref(upvalues[i]);
+    lstf_vm_collector_allocated();
 
     return closure;
 }
@@ -153,6 +160,10 @@ void lstf_vm_closure_unref(lstf_vm_closure *closure)
     if (closure->floating || --closure->refcount == 0) {
         for (unsigned i = 0; i < closure->num_upvalues; i++)
             lstf_vm_upvalue_unref(closure->upvalues[i]);
+        if (closure->gc_buffered)
+            lstf_vm_collector_forget(lstf_vm_collector_object_type_closure, closure);
         free(closure);
+    } else {
+        lstf_vm_collector_possible_root(lstf_vm_collector_object_type_closure, closure);
     }
 }
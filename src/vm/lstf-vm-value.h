@@ -138,6 +138,9 @@ struct _lstf_vm_upvalue {
      */
     bool is_local;
 
+    unsigned gc_color : 2;              // see lstf-vm-collector.h
+    bool gc_buffered : 1;               // see lstf-vm-collector.h
+
     union {
         struct {
             /**
@@ -170,6 +173,8 @@ struct _lstf_vm_closure {
     unsigned refcount : sizeof(unsigned) * CHAR_BIT - 1;
     bool floating : 1;
     uint8_t num_upvalues;
+    unsigned gc_color : 2;              // see lstf-vm-collector.h
+    bool gc_buffered : 1;               // see lstf-vm-collector.h
     uint8_t *code_address;
     lstf_vm_upvalue *upvalues[];
 };
@@ -224,22 +229,11 @@ lstf_vm_value_to_json_node(lstf_vm_value value)
     case lstf_vm_value_type_pattern_ref:
         return value.data.json_node_ref;
     case lstf_vm_value_type_closure:
-    {
-        /**
-         * a closure in JSON form should be
-         * {
-         *  "code-address": int64,
-         *  "up-values": int64[]    // pointer
-         * }
-         */
-        json_node *object = json_object_new();
-        json_object_set_member(object, "code-address", json_integer_new((intptr_t) value.data.closure->code_address));
-        json_node *up_values = json_array_new();
-        json_object_set_member(object, "up-values", up_values);
-        for (unsigned i = 0; i < value.data.closure->num_upvalues; i++)
-            json_array_add_element(up_values, json_integer_new((intptr_t) value.data.closure->upvalues[i]));
-        return object;
-    }   break;
+        // the node holds a reference to the closure, so that it can be called
+        // after it is read back with `lstf_vm_value_from_json_node()`
+        return json_pointer_new(value.data.closure,
+                                (collection_item_ref_func) lstf_vm_closure_ref,
+                                (collection_item_unref_func) lstf_vm_closure_unref);
     }
 
     fprintf(stderr, "%s: unexpected value type `%u'\n", __func__, value.value_type); 
@@ -280,7 +274,7 @@ static inline bool json_boolean_destroy(json_node *node)
 static inline char *json_string_destroy(json_node *node)
 {
     assert(node->node_type == json_node_type_string &&
-            node->floating && node->refcount == 0);
+            node->floating && node->refcount == 0 && !node->in_arena);
 
     char *buffer = ((json_string *)node)->value;
     ((json_string *)node)->value = NULL;
@@ -310,10 +304,12 @@ string_new_from_json_string(json_node *node)
 
     string *sb = NULL;
 
-    if (node->floating) {
+    if (node->floating && !node->in_arena) {
         sb = string_new_take_data(json_string_destroy(node));
     } else {
         sb = string_new_copy_data(json_node_cast(node, string)->value);
+        if (node->floating)
+            json_node_unref(node);
     }
 
     return sb;
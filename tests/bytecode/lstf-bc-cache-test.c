@@ -0,0 +1,106 @@
+#include "bytecode/lstf-bc-cache.h"
+#include "io/inputstream.h"
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+// stores bytecode in the cache from several threads at once and checks that
+// the entry is complete afterwards, with no temporary files left behind
+
+#define NUM_THREADS 8
+#define BYTECODE_LENGTH 65536
+
+static uint8_t bytecode[BYTECODE_LENGTH];
+
+static int store_thread(void *user_data)
+{
+    const char *path = user_data;
+
+    for (int i = 0; i < 16; i++)
+        if (!lstf_bc_cache_store(path, bytecode, sizeof bytecode))
+            return 1;
+    return 0;
+}
+
+int main(void)
+{
+    char directory[256];
+    const char source[] = "fun main() { print('hello'); }";
+    int retval = 0;
+
+    snprintf(directory, sizeof directory, "lstf-bc-cache-test-%ld/lstf", (long) getpid());
+    for (size_t i = 0; i < sizeof bytecode; i++)
+        bytecode[i] = (uint8_t) (i * 31);
+
+    char *path = lstf_bc_cache_get_path(directory, "0.0.1", source, sizeof source - 1);
+    char *same_path = lstf_bc_cache_get_path(directory, "0.0.1", source, sizeof source - 1);
+    char *other_salt_path = lstf_bc_cache_get_path(directory, "0.0.1 -no-lsp", source, sizeof source - 1);
+    char *other_source_path = lstf_bc_cache_get_path(directory, "0.0.1", source, sizeof source - 2);
+
+    if (strcmp(path, same_path) != 0) {
+        fprintf(stderr, "expected the same path for the same script, got %s and %s\n", path, same_path);
+        retval = 1;
+    }
+    if (strcmp(path, other_salt_path) == 0 || strcmp(path, other_source_path) == 0) {
+        fprintf(stderr, "expected a different path when the salt or the source differ\n");
+        retval = 1;
+    }
+
+    thrd_t threads[NUM_THREADS];
+    for (int i = 0; i < NUM_THREADS; i++)
+        thrd_create(&threads[i], store_thread, path);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        int thread_retval = 0;
+        thrd_join(threads[i], &thread_retval);
+        if (thread_retval != 0) {
+            fprintf(stderr, "failed to store the bytecode: %s\n", strerror(errno));
+            retval = 1;
+        }
+    }
+
+    // read back the bytecode
+    inputstream *stream = inputstream_new_from_path(path, "rb");
+    if (!stream) {
+        fprintf(stderr, "failed to open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    stream = inputstream_ref(stream);
+    uint8_t stored[BYTECODE_LENGTH + 1];
+    size_t stored_length = inputstream_read(stream, stored, sizeof stored);
+    inputstream_unref(stream);
+    if (stored_length != sizeof bytecode || memcmp(stored, bytecode, sizeof bytecode) != 0) {
+        fprintf(stderr, "stored bytecode differs (got %zu bytes; expected %zu bytes)\n", stored_length, sizeof bytecode);
+        retval = 1;
+    }
+
+    // only the entry should be left
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    unsigned num_entries = 0;
+    while (dir && (entry = readdir(dir))) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        num_entries++;
+    }
+    if (dir)
+        closedir(dir);
+    if (num_entries != 1) {
+        fprintf(stderr, "expected one file in %s, found %u\n", directory, num_entries);
+        retval = 1;
+    }
+
+    unlink(path);
+    rmdir(directory);
+    *strrchr(directory, '/') = '\0';
+    rmdir(directory);
+
+    free(path);
+    free(same_path);
+    free(other_salt_path);
+    free(other_source_path);
+    return retval;
+}
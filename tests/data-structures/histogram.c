@@ -0,0 +1,65 @@
+#include "data-structures/histogram.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// checks that percentiles are within the precision of the histogram
+
+static bool check_percentile(const histogram *hist, double percentile, uint64_t expected)
+{
+    uint64_t value = histogram_get_percentile(hist, percentile);
+
+    // the histogram promises less than 1% error
+    if (value < expected || value - expected > expected / 100) {
+        fprintf(stderr, "p%g: expected %llu, got %llu\n", percentile,
+                (unsigned long long)expected, (unsigned long long)value);
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    histogram *hist = histogram_new();
+    int retval = 0;
+
+    // 1us, 2us, ..., 10ms in nanoseconds
+    for (uint64_t i = 1; i <= 10000; i++)
+        histogram_record(hist, i * 1000);
+
+    if (hist->total_count != 10000 || hist->min != 1000 || hist->max != 10000000) {
+        fprintf(stderr, "wrong count, min, or max\n");
+        retval = 1;
+    }
+
+    if (!check_percentile(hist, 50, 5000000) ||
+            !check_percentile(hist, 90, 9000000) ||
+            !check_percentile(hist, 99, 9900000) ||
+            !check_percentile(hist, 100, 10000000))
+        retval = 1;
+
+    // small values are counted exactly
+    histogram *small = histogram_new();
+    for (uint64_t i = 0; i < 100; i++)
+        histogram_record(small, i);
+    if (histogram_get_percentile(small, 50) != 49 || histogram_get_percentile(small, 100) != 99) {
+        fprintf(stderr, "small values were not counted exactly\n");
+        retval = 1;
+    }
+
+    // the largest values still fit
+    histogram_record(small, UINT64_MAX);
+    if (histogram_get_percentile(small, 100) != UINT64_MAX) {
+        fprintf(stderr, "could not record the largest value\n");
+        retval = 1;
+    }
+
+    histogram_add(hist, small);
+    if (hist->total_count != 10101 || hist->min != 0 || hist->max != UINT64_MAX) {
+        fprintf(stderr, "wrong count, min, or max after adding\n");
+        retval = 1;
+    }
+
+    histogram_destroy(small);
+    histogram_destroy(hist);
+    return retval;
+}
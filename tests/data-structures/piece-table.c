@@ -0,0 +1,116 @@
+#include "data-structures/piece-table.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// applies the same edits to a piece table and to a plain string
+
+static size_t reference_get_offset(const char *text, size_t line, size_t character)
+{
+    size_t offset = 0;
+
+    for (; line > 0; line--) {
+        const char *newline = strchr(text + offset, '\n');
+        if (!newline)
+            return strlen(text);
+        offset = (size_t)(newline - text) + 1;
+    }
+
+    for (; character > 0 && text[offset] && text[offset] != '\n'; character--)
+        offset++;
+
+    return offset;
+}
+
+static char *reference_replace(char *text, size_t offset, size_t length, const char *insertion)
+{
+    size_t text_length = strlen(text);
+    size_t insertion_length = strlen(insertion);
+    char *result = malloc(text_length - length + insertion_length + 1);
+
+    if (!result) {
+        perror("failed to allocate string");
+        abort();
+    }
+
+    memcpy(result, text, offset);
+    memcpy(result + offset, insertion, insertion_length);
+    memcpy(result + offset + insertion_length, text + offset + length, text_length - offset - length + 1);
+    free(text);
+    return result;
+}
+
+static bool node_is_heap_ordered(const piece_table_node *node)
+{
+    if (!node)
+        return true;
+    if (node->left && node->left->priority > node->priority)
+        return false;
+    if (node->right && node->right->priority > node->priority)
+        return false;
+    return node_is_heap_ordered(node->left) && node_is_heap_ordered(node->right);
+}
+
+int main(void)
+{
+    static const char *insertions[] = { "", "a", "\n", "hello", "x\ny\n", "\n\n\n", "line\nbreak" };
+    const char *original = "fun main() {\n    print(42);\n}\n";
+    piece_table *table = piece_table_new(original, strlen(original));
+    char *reference = strdup(original);
+    int retval = 0;
+
+    srand(1);
+    for (int i = 0; i < 20000 && retval == 0; i++) {
+        size_t length = strlen(reference);
+        size_t offset = (size_t)rand() % (length + 1);
+        size_t removed = (size_t)rand() % 8;
+        const char *insertion = insertions[(size_t)rand() % (sizeof insertions / sizeof insertions[0])];
+
+        if (removed > length - offset)
+            removed = length - offset;
+
+        // sometimes type characters one after the other
+        if (i % 5 == 0) {
+            offset = length;
+            removed = 0;
+        }
+
+        piece_table_replace(table, offset, removed, insertion, strlen(insertion));
+        reference = reference_replace(reference, offset, removed, insertion);
+
+        if (piece_table_get_length(table) != strlen(reference)) {
+            fprintf(stderr, "edit %d: expected length %zu, got %zu\n",
+                    i, strlen(reference), piece_table_get_length(table));
+            retval = 1;
+        }
+
+        if (!node_is_heap_ordered(table->root)) {
+            fprintf(stderr, "edit %d: a piece has a higher priority than its parent\n", i);
+            retval = 1;
+        }
+
+        size_t line = (size_t)rand() % (piece_table_get_line_count(table) + 1);
+        size_t character = (size_t)rand() % 12;
+        size_t expected = reference_get_offset(reference, line, character);
+        size_t actual = piece_table_get_offset(table, line, character);
+        if (expected != actual) {
+            fprintf(stderr, "edit %d: expected offset %zu for %zu:%zu, got %zu\n",
+                    i, expected, line, character, actual);
+            retval = 1;
+        }
+
+        if (i % 1000 == 0 || retval) {
+            char *text = piece_table_get_text(table);
+            if (strcmp(text, reference) != 0) {
+                fprintf(stderr, "edit %d: expected text:\n%s\ngot:\n%s\n", i, reference, text);
+                retval = 1;
+            }
+            free(text);
+        }
+    }
+
+    piece_table_destroy(table);
+    free(reference);
+    return retval;
+}
@@ -0,0 +1,78 @@
+#include "io/io-socket.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// sends a message over a local socket and checks that a second listener
+// refuses to take over a live socket but replaces one that was left behind
+
+static const char message[] = "hello from the client";
+
+int main(void)
+{
+    char path[256];
+    snprintf(path, sizeof path, "lstf-socket-test-%ld.sock", (long) getpid());
+
+    int listen_fd = io_socket_listen(path);
+    if (listen_fd == -1) {
+        fprintf(stderr, "failed to listen on %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    int client_fd = io_socket_connect(path);
+    if (client_fd == -1) {
+        fprintf(stderr, "failed to connect to %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    int server_fd = io_socket_accept(listen_fd);
+    if (server_fd == -1) {
+        fprintf(stderr, "failed to accept a connection: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (write(client_fd, message, sizeof message - 1) != (ssize_t)(sizeof message - 1) ||
+            !io_socket_shutdown_write(client_fd)) {
+        fprintf(stderr, "failed to send the message: %s\n", strerror(errno));
+        return 1;
+    }
+
+    char buffer[sizeof message] = {0};
+    size_t received = 0;
+    ssize_t length;
+    while ((length = read(server_fd, buffer + received, sizeof buffer - 1 - received)) > 0)
+        received += (size_t) length;
+
+    if (length == -1 || strcmp(buffer, message) != 0) {
+        fprintf(stderr, "expected to receive `%s', got `%s'\n", message, buffer);
+        return 1;
+    }
+
+    // the server can still answer after the client stopped writing
+    if (write(server_fd, "ok", 2) != 2 || read(client_fd, buffer, sizeof buffer) != 2) {
+        fprintf(stderr, "failed to send a reply: %s\n", strerror(errno));
+        return 1;
+    }
+
+    close(server_fd);
+    close(client_fd);
+
+    if (io_socket_listen(path) != -1 || errno != EADDRINUSE) {
+        fprintf(stderr, "expected a second listener to fail with EADDRINUSE\n");
+        return 1;
+    }
+
+    // leave the socket behind, as a process that crashed would
+    close(listen_fd);
+    if ((listen_fd = io_socket_listen(path)) == -1) {
+        fprintf(stderr, "failed to replace the stale socket: %s\n", strerror(errno));
+        return 1;
+    }
+
+    close(listen_fd);
+    unlink(path);
+
+    return 0;
+}
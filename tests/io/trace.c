@@ -0,0 +1,89 @@
+#include "io/io-common.h"
+#include "io/io-trace.h"
+#include "io/outputstream.h"
+#include "json/json-parser.h"
+#include "json/json.h"
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+// records events on two threads, overflows one thread's buffer, and checks
+// that the written trace is valid JSON with the newest events of each thread
+
+#define NUM_OVERFLOWING 10
+
+static int record_on_other_thread(void *data)
+{
+    (void) data;
+    const uint64_t start = io_get_monotonic_time();
+    const uint64_t id = io_trace_new_id();
+
+    io_trace_async_begin("test", "textDocument/\"quoted\"", id);
+    io_trace_complete("test", "other thread", start, io_get_monotonic_time(), "bytes", 42);
+    io_trace_async_end("test", "textDocument/\"quoted\"", id);
+    return 0;
+}
+
+int main(void)
+{
+    thrd_t thread;
+    int retval = 0;
+
+    io_trace_start(NULL);
+
+    if (thrd_create(&thread, record_on_other_thread, NULL) != thrd_success || thrd_join(thread, NULL) != thrd_success) {
+        fprintf(stderr, "failed to record on another thread\n");
+        return 1;
+    }
+
+    // the first events are overwritten by the last ones
+    for (unsigned i = 0; i < IO_TRACE_BUFFER_EVENTS + NUM_OVERFLOWING; i++)
+        io_trace_instant("test", i < NUM_OVERFLOWING ? "dropped" : "kept", "i", i);
+
+    outputstream *ostream = outputstream_new_from_buffer(NULL, 0, true);
+    if (!io_trace_write(ostream) || !outputstream_write_byte(ostream, '\0')) {
+        fprintf(stderr, "failed to write trace\n");
+        outputstream_unref(ostream);
+        return 1;
+    }
+
+    json_node *trace = json_parser_parse_string((const char *)ostream->buffer);
+    if (!trace || trace->node_type != json_node_type_object) {
+        fprintf(stderr, "trace is not a JSON object:\n%s\n", (const char *)ostream->buffer);
+        outputstream_unref(ostream);
+        return 1;
+    }
+
+    json_node *events = json_object_get_member(trace, "traceEvents");
+    json_node *dropped = json_object_get_member(json_object_get_member(trace, "otherData"), "dropped_events");
+    unsigned num_kept = 0, num_dropped = 0, num_other_thread = 0;
+    json_array_foreach(events, event, {
+        const char *name = json_node_cast(json_object_get_member(event, "name"), string)->value;
+
+        if (strcmp(name, "kept") == 0)
+            num_kept++;
+        else if (strcmp(name, "dropped") == 0)
+            num_dropped++;
+        else if (strcmp(name, "other thread") == 0 || strcmp(name, "textDocument/\"quoted\"") == 0)
+            num_other_thread++;
+    });
+
+    if (num_kept != IO_TRACE_BUFFER_EVENTS || num_dropped != 0) {
+        fprintf(stderr, "expected %u events to be kept and none dropped, but %u were kept and %u dropped\n",
+                (unsigned) IO_TRACE_BUFFER_EVENTS, num_kept, num_dropped);
+        retval = 1;
+    }
+    if (num_other_thread != 3) {
+        fprintf(stderr, "expected 3 events from the other thread, but got %u\n", num_other_thread);
+        retval = 1;
+    }
+    if (!dropped || dropped->node_type != json_node_type_string ||
+            strcmp(json_node_cast(dropped, string)->value, "10") != 0) {
+        fprintf(stderr, "expected the dropped events to be counted\n");
+        retval = 1;
+    }
+
+    json_node_unref(trace);
+    outputstream_unref(ostream);
+    return retval;
+}
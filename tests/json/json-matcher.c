@@ -0,0 +1,152 @@
+#include "json/json.h"
+#include "json/json-matcher.h"
+#include "json/json-parser.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct {
+    const char *pattern;
+    const char *candidate;
+    bool expected;
+} tests[] = {
+    { "{\"severity\": 1, \"message\": ...}",        "{\"severity\": 1, \"message\": \"hi\", \"code\": 3}", true },
+    { "{\"severity\": 1, \"message\": ...}",        "{\"severity\": 2, \"message\": \"hi\"}",             false },
+    { "{\"severity\": 1, \"message\": ...}",        "{\"severity\": 1}",                                  false },
+    { "{\"severity\": 1, \"message\": ...}",        "{\"severity\": 1.0, \"message\": \"hi\"}",           false },
+    { "{\"severity\": 1, \"message\": ...}",        "[1]",                                                false },
+    { "{\"version\"?: 3, \"uri\": ...}",            "{\"uri\": \"file:///a\"}",                           true },
+    { "{\"version\"?: 3, \"uri\": ...}",            "{\"uri\": \"file:///a\", \"version\": 3}",           true },
+    { "{\"version\"?: 3, \"uri\": ...}",            "{\"uri\": \"file:///a\", \"version\": 4}",           false },
+    { "{\"version\"?: ..., \"uri\": ...}",          "{\"uri\": \"file:///a\", \"version\": null}",        true },
+    { "{\"line\": 3, \"character\": 5}",            "{\"line\": 3, \"character\": 5}",                    true },
+    { "{\"line\": 3, \"character\": 5}",            "{\"line\": 3, \"character\": 5, \"extra\": 0}",      false },
+    { "{\"line\": 3, \"character\": 5}",            "{\"character\": 5, \"line\": 3}",                    true },
+    { "{\"a\": {\"b\": [true, null, \"c\"], \"d\": ...}}",
+                                                    "{\"a\": {\"b\": [true, null, \"c\"], \"d\": {}}}",   true },
+    { "{\"a\": {\"b\": [true, null, \"c\"], \"d\": ...}}",
+                                                    "{\"a\": {\"b\": [true, null, \"d\"], \"d\": {}}}",   false },
+    { "{\"a\": {\"b\": [true, null, \"c\"], \"d\": ...}}",
+                                                    "{\"a\": {\"b\": [true, null], \"d\": {}}}",          false },
+    { "[1, 2, {\"name\": \"three\"}]",              "[1, 2, {\"name\": \"three\"}]",                      true },
+    { "[1, 2, {\"name\": \"three\"}]",              "[1, 2, {\"name\": \"four\"}]",                       false },
+    { "[1, ..., 4]",                                "[1, 2, 3, 4]",                                       true },
+    { "[1, ..., 4]",                                "[1, 2, 3]",                                          false },
+    { "{\"items\": [..., {\"label\": \"x\"}, ...]}", "{\"items\": [{\"label\": \"y\"}, {\"label\": \"x\"}]}", true },
+    { "[..., 3]",                                   "[1, 2, 3]",                                          true },
+    { "[..., 3]",                                   "[3, 1]",                                             false },
+    { "[1, 2, ...]",                                "[1, 2]",                                             true },
+    { "[1, 2, ...]",                                "[1]",                                                false },
+    { "[1, ..., 1]",                                "[1]",                                                false },
+    { "[...]",                                      "[]",                                                 true },
+    { "[...]",                                      "{}",                                                 false },
+    // the first place where [2, 3] could start doesn't match
+    { "[..., 2, 3, ..., 5]",                        "[2, 2, 3, 4, 5]",                                    true },
+    { "[..., 2, 3, ..., 5]",                        "[2, 5, 3]",                                          false },
+    { "[..., {\"a\": 1, \"b\": ...}, ...]",       "[{\"a\": 2, \"b\": 0}, {\"a\": 1, \"b\": 0}]",        true },
+    { "[..., [1, ...], ...]",                       "[[2], [1, 5]]",                                      true },
+    { "[..., [1, ...], ...]",                       "[[2], [5, 1]]",                                      false },
+    { "[2.5, -7, false]",                           "[2.5, -7, false]",                                   true },
+    { "[2.5, -7, false]",                           "[2.5, -7, true]",                                    false },
+    // a candidate that is itself a pattern is compared generically
+    { "{\"a\": 1, \"b\": ...}",                     "{\"a\": ..., \"b\": 2}",                             true },
+};
+
+static const struct {
+    const char *pattern;
+    const char *candidate;
+    const char *trace;
+} traces[] = {
+    { "{\"range\": {\"start\": {\"line\": 3, \"character\": ...}}, \"message\": ...}",
+      "{\"range\": {\"start\": {\"line\": 4, \"character\": 0}}, \"message\": \"\"}",
+      "$.range.start.line: expected 3, got 4" },
+    { "{\"severity\": 1, \"message\": ...}",    "{\"severity\": 1}",        "$: missing member \"message\"" },
+    { "{\"line\": 3, \"character\": 5}",        "{\"line\": 3}",            "$: expected 2 members, got 1" },
+    { "{\"items\": [true, {\"label\": \"x\"}]}", "{\"items\": [true, {\"label\": [\"x\"]}]}",
+      "$.items[1].label: expected \"x\", got an array" },
+    { "{\"items\": [1, ...]}",                   "{\"items\": [2]}",         "$.items: expected [1, ...], got [2]" },
+    { "[1, 2]",                                   "{}",                         "$: expected an array, got an object" },
+    { "{\"items\": [..., 3]}",                  "{\"items\": [1, 2]}",    "$.items: expected [..., 3], got [1, 2]" },
+    { "[1, ...]",                                 "{}",                         "$: expected an array, got an object" },
+};
+
+/**
+ * Checks that match programs give the same result as `json_node_equal_to()`.
+ */
+int main(void)
+{
+    int retval = 0;
+
+    for (size_t i = 0; i < sizeof tests / sizeof tests[0]; i++) {
+        json_node *pattern = json_node_ref(json_parser_parse_string(tests[i].pattern));
+        json_node *candidate = json_node_ref(json_parser_parse_string(tests[i].candidate));
+        size_t program_size = 0;
+        uint8_t *program = json_matcher_compile(pattern, &program_size);
+        json_matcher *matcher = json_matcher_new(program, program_size);
+
+        if (!matcher) {
+            fprintf(stderr, "failed to load match program for %s\n", tests[i].pattern);
+            retval = 1;
+        } else {
+            bool matched = json_matcher_match(matcher, candidate, NULL);
+            bool equal = json_node_equal_to(pattern, candidate);
+
+            if (matched != tests[i].expected || equal != tests[i].expected) {
+                fprintf(stderr, "%s <=> %s: expected %s, but matcher returned %s and json_node_equal_to() returned %s\n",
+                        tests[i].pattern, tests[i].candidate,
+                        tests[i].expected ? "true" : "false",
+                        matched ? "true" : "false",
+                        equal ? "true" : "false");
+                retval = 1;
+            }
+        }
+
+        // truncated programs must be rejected
+        for (size_t size = 0; size < program_size; size++) {
+            json_matcher *truncated = json_matcher_new(program, size);
+
+            if (truncated) {
+                fprintf(stderr, "loaded match program for %s truncated to %zu bytes\n", tests[i].pattern, size);
+                json_matcher_destroy(truncated);
+                retval = 1;
+                break;
+            }
+        }
+
+        json_matcher_destroy(matcher);
+        free(program);
+        json_node_unref(pattern);
+        json_node_unref(candidate);
+    }
+
+    // check the description of the first mismatch
+    for (size_t i = 0; i < sizeof traces / sizeof traces[0]; i++) {
+        json_node *pattern = json_node_ref(json_parser_parse_string(traces[i].pattern));
+        json_node *candidate = json_node_ref(json_parser_parse_string(traces[i].candidate));
+        size_t program_size = 0;
+        uint8_t *program = json_matcher_compile(pattern, &program_size);
+        json_matcher *matcher = json_matcher_new(program, program_size);
+        json_matcher_trace trace = { .length = 0 };
+
+        if (!matcher) {
+            fprintf(stderr, "failed to load match program for %s\n", traces[i].pattern);
+            retval = 1;
+        } else if (json_matcher_match(matcher, candidate, &trace)) {
+            fprintf(stderr, "%s <=> %s: expected mismatch\n", traces[i].pattern, traces[i].candidate);
+            retval = 1;
+        } else if (strcmp(trace.message, traces[i].trace) != 0 || strlen(trace.message) != trace.length) {
+            fprintf(stderr, "%s <=> %s: expected trace `%s', got `%s'\n",
+                    traces[i].pattern, traces[i].candidate, traces[i].trace, trace.message);
+            retval = 1;
+        }
+
+        json_matcher_destroy(matcher);
+        free(program);
+        json_node_unref(pattern);
+        json_node_unref(candidate);
+    }
+
+    return retval;
+}
@@ -0,0 +1,58 @@
+#include "json/json.h"
+#include <stdbool.h>
+#include <string.h>
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    bool success = true;
+
+    // all spellings of a member name intern to the same canonical string
+    const char *interned = json_member_name_intern("text_document");
+    const char *spellings[] = {
+        json_member_name_intern("text-document"),
+        json_member_name_intern("textDocument"),
+        json_member_name_intern("textDocuments")
+    };
+    success = success && strcmp(interned, "textDocument") == 0;
+    success = success && spellings[0] == interned;
+    success = success && spellings[1] == interned;
+    success = success && spellings[2] != interned;
+    success = success && json_member_name_lookup("text-document") == interned;
+    for (unsigned i = 0; i < sizeof spellings / sizeof spellings[0]; i++)
+        json_member_name_unref(spellings[i]);
+    success = success && !json_member_name_lookup("textDocuments");
+
+    json_node *object = json_object_new();
+    json_object_set_member(object, "text-document", json_integer_new(1));
+    json_object_set_member(object, "uri", json_string_new("file:///a"));
+
+    success = success && json_object_get_member(object, "textDocument") &&
+        json_object_get_member(object, "text_document") ==
+        json_object_get_member(object, "textDocument");
+    success = success && !json_object_get_member(object, "version");
+
+    // setting another spelling replaces the existing member
+    json_object_set_member(object, "text_document", json_integer_new(2));
+    success = success && ((json_integer *)json_object_get_member(object, "textDocument"))->value == 2;
+
+    json_object_delete_member(object, "text-document");
+    success = success && !json_object_get_member(object, "textDocument");
+
+    json_node_unref(object);
+    json_member_name_unref(interned);
+
+    // names are released along with the objects that have them
+    object = json_object_new();
+    json_object_set_member(object, "server_capabilities", json_object_new());
+    json_object_set_member(json_object_get_member(object, "serverCapabilities"), "hoverProvider", json_boolean_new(true));
+    success = success && json_member_name_lookup("server-capabilities");
+    json_node_unref(object);
+    success = success && !json_member_name_lookup("serverCapabilities");
+    success = success && !json_member_name_lookup("server_capabilities");
+    success = success && !json_member_name_lookup("hoverProvider");
+    success = success && !json_member_name_lookup("textDocument");
+
+    return !success;
+}
@@ -0,0 +1,58 @@
+#include "json/json.h"
+#include <stdbool.h>
+
+static json_node *create_diagnostic(bool reversed)
+{
+    json_node *diagnostic = json_object_new();
+    json_node *tags = json_array_new();
+
+    json_array_add_element(tags, json_integer_new(1));
+    json_array_add_element(tags, json_integer_new(2));
+    if (reversed) {
+        json_object_set_member(diagnostic, "tags", tags);
+        json_object_set_member(diagnostic, "message", json_string_new("unused variable"));
+        json_object_set_member(diagnostic, "severity", json_double_new(-0.0));
+    } else {
+        json_object_set_member(diagnostic, "severity", json_double_new(0.0));
+        json_object_set_member(diagnostic, "message", json_string_new("unused variable"));
+        json_object_set_member(diagnostic, "tags", tags);
+    }
+
+    return diagnostic;
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    bool success = true;
+
+    // equal nodes hash the same, regardless of member order
+    json_node *diagnostic1 = json_node_ref(create_diagnostic(false));
+    json_node *diagnostic2 = json_node_ref(create_diagnostic(true));
+
+    success = success && json_node_equal_to(diagnostic1, diagnostic2);
+    success = success && json_node_hash(diagnostic1) == json_node_hash(diagnostic2);
+
+    json_node *array1 = json_node_ref(json_array_new());
+    json_node *array2 = json_node_ref(json_array_new());
+    json_array_add_element(array1, json_integer_new(1));
+    json_array_add_element(array1, json_integer_new(2));
+    json_array_add_element(array2, json_integer_new(2));
+    json_array_add_element(array2, json_integer_new(1));
+
+    // element order matters for arrays
+    success = success && json_node_hash(array1) != json_node_hash(array2);
+
+    // hashing a cyclic node terminates, and is repeatable
+    json_object_set_member(diagnostic1, "self", diagnostic1);
+    unsigned cyclic_hash = json_node_hash(diagnostic1);
+    success = success && cyclic_hash == json_node_hash(diagnostic1);
+    json_object_delete_member(diagnostic1, "self");
+
+    json_node_unref(diagnostic1);
+    json_node_unref(diagnostic2);
+    json_node_unref(array1);
+    json_node_unref(array2);
+    return !success;
+}
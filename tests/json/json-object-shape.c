@@ -0,0 +1,54 @@
+#include "json/json.h"
+#include <stdbool.h>
+
+static json_node *create_position(int64_t line, int64_t character)
+{
+    json_node *position = json_object_new();
+
+    json_object_set_member(position, "line", json_integer_new(line));
+    json_object_set_member(position, "character", json_integer_new(character));
+
+    return position;
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    bool success = true;
+
+    json_node *start = create_position(1, 2);
+    json_node *end = create_position(3, 4);
+
+    // objects with the same members added in the same order share a shape
+    success = success && json_object_get_shape(start) &&
+        json_object_get_shape(start) == json_object_get_shape(end);
+
+    int slot = json_shape_find_member(json_object_get_shape(start), json_member_name_lookup("character"));
+    success = success && slot == 1;
+    success = success && json_shape_find_member(json_object_get_shape(start), json_member_name_lookup("uri")) == -1;
+    success = success && ((json_integer *)json_object_get_member_at(end, (unsigned)slot))->value == 4;
+
+    json_object_set_member_at(end, (unsigned)slot, json_integer_new(5));
+    success = success && ((json_integer *)json_object_get_member(end, "character"))->value == 5;
+
+    // replacing a member does not change the shape
+    json_object_set_member(start, "line", json_integer_new(10));
+    success = success && json_object_get_shape(start) == json_object_get_shape(end);
+
+    // a different order is a different shape
+    json_node *reversed = json_object_new();
+    json_object_set_member(reversed, "character", json_integer_new(2));
+    json_object_set_member(reversed, "line", json_integer_new(1));
+    success = success && json_object_get_shape(reversed) != json_object_get_shape(start);
+
+    // deleting a member gives up on the layout
+    json_object_delete_member(reversed, "line");
+    success = success && !json_object_get_shape(reversed);
+    success = success && ((json_integer *)json_object_get_member(reversed, "character"))->value == 2;
+
+    json_node_unref(start);
+    json_node_unref(end);
+    json_node_unref(reversed);
+    return !success;
+}
@@ -0,0 +1,88 @@
+#include "io/inputstream.h"
+#include "json/json-parser.h"
+#include "json/json.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char messages[] =
+    "{\"jsonrpc\": \"2.0\", \"method\": \"textDocument/publishDiagnostics\", \"params\": {"
+    "  \"uri\": \"file:///main.c\","
+    "  \"diagnostics\": ["
+    "    {\"range\": {\"start\": {\"line\": 1, \"character\": 4}, \"end\": {\"line\": 1, \"character\": 9}},"
+    "     \"severity\": 2, \"message\": \"unused variable\", \"deprecated\": false, \"data\": null},"
+    "    {\"range\": {\"start\": {\"line\": 7, \"character\": 0}, \"end\": {\"line\": 7, \"character\": 3}},"
+    "     \"severity\": 1, \"message\": \"expected ';'\", \"score\": 0.5}"
+    "  ]"
+    "}}\n"
+    "[1, 2, 3]\n";
+
+int main(void)
+{
+    bool success = true;
+    json_parser *parser = json_parser_create_from_stream(inputstream_new_from_static_string(messages));
+    json_parser *arena_parser = json_parser_create_from_stream(inputstream_new_from_static_string(messages));
+
+    arena_parser->use_arenas = true;
+
+    json_node *message = json_node_ref(json_parser_parse_node(parser));
+    json_node *arena_message = json_node_ref(json_parser_parse_node(arena_parser));
+
+    success = success && message && arena_message;
+    success = success && !message->in_arena && arena_message->in_arena;
+    success = success && json_node_equal_to(message, arena_message);
+
+    json_node *array = json_parser_parse_node(parser);
+    json_node *arena_array = json_parser_parse_node(arena_parser);
+
+    success = success && json_node_equal_to(array, arena_array);
+    json_node_unref(array);
+    json_node_unref(arena_array);
+
+    // storing a node somewhere else keeps its arena alive
+    json_node *saved = json_object_new();
+    json_node *params = json_object_get_member(arena_message, "params");
+    json_node *diagnostics = success ? json_object_get_member(params, "diagnostics") : NULL;
+    json_node *diagnostics_copy = success ? json_node_copy(diagnostics) : NULL;
+
+    if (success) {
+        json_object_set_member(saved, "diagnostics", diagnostics);
+        json_object_set_member(saved, "copy", diagnostics_copy);
+        success = !diagnostics_copy->in_arena;
+    }
+    json_node_unref(arena_message);
+
+    if (success) {
+        json_node *first = json_array_get_element(json_object_get_member(saved, "diagnostics"), 0);
+        json_node *text = json_object_get_member(first, "message");
+
+        success = json_node_equal_to(json_object_get_member(saved, "diagnostics"), diagnostics_copy);
+        success = success && strcmp(((json_string *)text)->value, "unused variable") == 0;
+    }
+    json_node_unref(saved);
+    json_node_unref(message);
+
+    // nodes can be allocated from an arena directly, including strings too
+    // large to share a chunk with other nodes
+    json_arena *arena = json_arena_new();
+    char *long_text = malloc(64 * 1024);
+
+    memset(long_text, 'x', 64 * 1024 - 1);
+    long_text[64 * 1024 - 1] = '\0';
+    json_node *object = json_node_ref(json_object_new_in_arena(arena));
+    json_object_set_member(object, "text", json_string_new_in_arena(arena, long_text));
+    json_object_set_member(object, "count", json_integer_new_in_arena(arena, 3));
+    json_object_set_member(object, "heap", json_string_new("not in the arena"));
+    json_arena_unref(arena);
+
+    success = success && json_arena_get_size(arena) > 64 * 1024;
+    success = success && strcmp(((json_string *)json_object_get_member(object, "text"))->value, long_text) == 0;
+    success = success && ((json_integer *)json_object_get_member(object, "count"))->value == 3;
+    json_node_unref(object);
+    free(long_text);
+
+    json_parser_destroy(parser);
+    json_parser_destroy(arena_parser);
+    return success ? 0 : 1;
+}
@@ -22,7 +22,25 @@ int main(int argc, char *argv[])
     matches = json_node_equal_to(pattern, expression) &&
         json_node_equal_to(expression, pattern);
 
+    // [1, ..., 10, ...] <=> [1, 2, 3, 4, 5, 6, 7, 8, 9, 10]
+    json_node *trailing_pattern = json_array_pattern_new();
+    json_array_add_element(trailing_pattern, json_integer_new(1));
+    json_array_add_element(trailing_pattern, json_ellipsis_new());
+    json_array_add_element(trailing_pattern, json_integer_new(10));
+    json_array_add_element(trailing_pattern, json_ellipsis_new());
+    matches = matches && json_node_equal_to(trailing_pattern, expression);
+
+    // [...] <=> [], but not [1, ...] <=> []
+    json_node *ellipsis_pattern = json_array_pattern_new();
+    json_node *empty_array = json_array_new();
+    json_array_add_element(ellipsis_pattern, json_ellipsis_new());
+    matches = matches && json_node_equal_to(ellipsis_pattern, empty_array);
+    matches = matches && !json_node_equal_to(trailing_pattern, empty_array);
+
     json_node_unref(pattern);
     json_node_unref(expression);
+    json_node_unref(trailing_pattern);
+    json_node_unref(ellipsis_pattern);
+    json_node_unref(empty_array);
     return !matches;
 }
@@ -0,0 +1,68 @@
+#include "json/json-parser.h"
+#include "json/json.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#define NUM_THREADS 8
+#define NUM_ITERATIONS 20000
+
+static const char expected_string[] = "[1, 2, 3, null, true, {\"a\": 5}]";
+
+/**
+ * Prints and compares nodes that share null, true, and small integers with
+ * the nodes of every other thread.
+ */
+static int print_and_compare_shared_nodes(void *arg)
+{
+    (void) arg;
+    json_node *node1 = json_node_ref(json_parser_parse_string(expected_string));
+    json_node *node2 = json_node_ref(json_parser_parse_string(expected_string));
+    bool success = node1 && node2;
+
+    for (unsigned i = 0; success && i < NUM_ITERATIONS; i++) {
+        char *string = json_node_to_string(node1, false);
+
+        if (strcmp(string, expected_string) != 0) {
+            fprintf(stderr, "expected %s, got %s\n", expected_string, string);
+            success = false;
+        } else if (!json_node_equal_to(node1, node2)) {
+            fprintf(stderr, "expected %s to equal itself\n", expected_string);
+            success = false;
+        } else if (json_node_hash(node1) != json_node_hash(node2)) {
+            fprintf(stderr, "expected equal nodes to hash the same\n");
+            success = false;
+        }
+        free(string);
+    }
+
+    json_node_unref(node1);
+    json_node_unref(node2);
+    return success ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    thrd_t threads[NUM_THREADS];
+    bool success = true;
+
+    for (unsigned i = 0; i < NUM_THREADS; i++) {
+        if (thrd_create(&threads[i], print_and_compare_shared_nodes, NULL) != thrd_success) {
+            fprintf(stderr, "failed to create thread\n");
+            abort();
+        }
+    }
+
+    for (unsigned i = 0; i < NUM_THREADS; i++) {
+        int result = 1;
+
+        thrd_join(threads[i], &result);
+        success = success && result == 0;
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,58 @@
+#include "json/json-parser.h"
+#include "json/json.h"
+#include <stdbool.h>
+
+int main(int argc, char *argv[])
+{
+    (void) argc;
+    (void) argv;
+    bool success = true;
+
+    // null, booleans, and small integers are shared
+    success = success && json_null_new() == json_null_new();
+    success = success && json_boolean_new(true) == json_boolean_new(true);
+    success = success && json_boolean_new(false) != json_boolean_new(true);
+    success = success && json_integer_new(JSON_SMALL_INTEGER_MIN) == json_integer_new(JSON_SMALL_INTEGER_MIN);
+    success = success && json_integer_new(JSON_SMALL_INTEGER_MAX) == json_integer_new(JSON_SMALL_INTEGER_MAX);
+    success = success && ((json_integer *)json_integer_new(-1))->value == -1;
+
+    // ... and are unaffected by references
+    json_node *zero = json_integer_new(0);
+    for (unsigned i = 0; i < 3; i++)
+        json_node_unref(json_node_ref(zero));
+    json_node_unref(zero);
+    success = success && zero->immutable && ((json_integer *)zero)->value == 0;
+
+    // other integers are not
+    json_node *big1 = json_node_ref(json_integer_new(JSON_SMALL_INTEGER_MAX + 1));
+    json_node *big2 = json_node_ref(json_integer_new(JSON_SMALL_INTEGER_MAX + 1));
+    success = success && big1 != big2 && !big1->immutable;
+    success = success && json_node_equal_to(big1, big2);
+    json_node_unref(big1);
+    json_node_unref(big2);
+
+    // shared nodes are copied instead of modified
+    json_node *optional_seven = json_node_ref(json_node_set_optional(json_integer_new(7)));
+    success = success && optional_seven != json_integer_new(7) && optional_seven->optional;
+    success = success && !json_integer_new(7)->optional;
+    json_node_unref(optional_seven);
+
+    json_node *pattern = json_node_ref(json_parser_parse_string("[true, 2, null, ...]"));
+    success = success && pattern && pattern->is_pattern;
+    if (success) {
+        success = json_array_get_element(pattern, 0)->is_pattern &&
+            json_array_get_element(pattern, 1)->is_pattern &&
+            json_array_get_element(pattern, 2)->is_pattern;
+    }
+    success = success && !json_boolean_new(true)->is_pattern;
+    success = success && !json_integer_new(2)->is_pattern && !json_null_new()->is_pattern;
+    json_node_unref(pattern);
+
+    json_node *object_pattern = json_node_ref(json_object_pattern_new());
+    json_object_set_member(object_pattern, "severity", json_integer_new(1));
+    success = success && json_object_get_member(object_pattern, "severity")->is_pattern;
+    success = success && !json_integer_new(1)->is_pattern;
+    json_node_unref(object_pattern);
+
+    return success ? 0 : 1;
+}
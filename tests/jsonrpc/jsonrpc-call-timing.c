@@ -0,0 +1,115 @@
+#include "jsonrpc/jsonrpc-server.h"
+#include "json/json.h"
+#include "io/io-common.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "io/inputstream.h"
+#include "io/event.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <threads.h>
+
+// `cat` echoes back whatever we write to it, so it plays a remote that
+// responds to our calls
+
+typedef struct {
+    jsonrpc_call_timing timing;
+    json_node *result;
+    int errnum;
+    bool done;
+} call_data;
+
+static void call_cb(const event *ev, void *user_data)
+{
+    call_data *data = user_data;
+
+    data->result = jsonrpc_server_call_remote_finish(ev, &data->errnum);
+    data->done = true;
+}
+
+static void respond(outputstream *remote_stdin, const char *message)
+{
+    char framed[256];
+    int framed_length = snprintf(framed, sizeof framed, "Content-Length: %zu\r\n\r\n%s", strlen(message), message);
+
+    outputstream_write(remote_stdin, framed, framed_length);
+}
+
+int main(void)
+{
+    outputstream *remote_stdin = NULL;
+    inputstream *remote_stdout = NULL;
+    io_process process = {0};
+
+    if (!io_communicate("cat", (const char *[]){"cat", NULL}, &remote_stdin,
+                        &remote_stdout, NULL, &process)) {
+        perror("failed to launch cat");
+        return 1;
+    }
+
+    eventloop *loop = eventloop_new();
+    // the remote only sees what we write to it ourselves
+    jsonrpc_server *server = jsonrpc_server_new(remote_stdout, outputstream_new_from_path("/dev/null", "w"));
+    int retval = 0;
+
+    jsonrpc_server_listen(server, loop);
+
+    call_data call = {0};
+    jsonrpc_server_call_remote_timed_async(server, "test/slow", json_object_new(), &call.timing,
+                                           loop, call_cb, &call);
+
+    // wait for the call to be sent, then take a while to respond
+    while (!call.timing.sent_time && eventloop_process(loop, false, NULL))
+        ;
+    thrd_sleep(&(struct timespec){.tv_nsec = 50000000}, NULL);
+    uint64_t responded_time = io_get_monotonic_time();
+    respond(remote_stdin, "{\"jsonrpc\":\"2.0\",\"id\":0,\"result\":{\"answer\":42}}");
+
+    while (!call.done && eventloop_process(loop, false, NULL))
+        ;
+
+    if (!call.result || !json_object_get_member(call.result, "answer")) {
+        fprintf(stderr, "expected a result from the call\n");
+        retval = 1;
+    }
+
+    // the response cannot arrive before we wrote it
+    if (call.timing.received_time < responded_time ||
+            call.timing.received_time - call.timing.sent_time < 50000000) {
+        fprintf(stderr, "wrong timing: sent at %llu, received at %llu, responded at %llu\n",
+                (unsigned long long)call.timing.sent_time,
+                (unsigned long long)call.timing.received_time,
+                (unsigned long long)responded_time);
+        retval = 1;
+    }
+
+    // an error response has no result
+    call_data failed_call = {0};
+    jsonrpc_server_call_remote_timed_async(server, "test/missing", json_object_new(), &failed_call.timing,
+                                           loop, call_cb, &failed_call);
+    respond(remote_stdin, "{\"jsonrpc\":\"2.0\",\"id\":1,\"error\":{\"code\":-32601,\"message\":\"not found\"}}");
+
+    while (!failed_call.done && eventloop_process(loop, false, NULL))
+        ;
+
+    if (failed_call.result || failed_call.errnum || !failed_call.timing.received_time) {
+        fprintf(stderr, "expected an error response\n");
+        retval = 1;
+    }
+
+    if (call.result)
+        json_node_unref(call.result);
+    if (failed_call.result)
+        json_node_unref(failed_call.result);
+
+    // let the remote exit and the server stop listening
+    outputstream_unref(remote_stdin);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    jsonrpc_server_destroy(server);
+    eventloop_destroy(loop);
+
+    return retval;
+}
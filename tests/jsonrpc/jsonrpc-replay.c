@@ -0,0 +1,167 @@
+#include "jsonrpc/jsonrpc-server.h"
+#include "json/json.h"
+#include "io/io-common.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "io/inputstream.h"
+#include "io/event.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <threads.h>
+
+// captures a session with `cat` playing the remote, then replays the session
+// with the replay server and checks that it gives the same answers with the
+// same timing
+
+#define RESPONSE_DELAY 50000000
+
+typedef struct {
+    jsonrpc_call_timing timing;
+    json_node *result;
+    int errnum;
+    bool done;
+} call_data;
+
+static void call_cb(const event *ev, void *user_data)
+{
+    call_data *data = user_data;
+
+    data->result = jsonrpc_server_call_remote_finish(ev, &data->errnum);
+    data->done = true;
+}
+
+static void handle_notification(jsonrpc_server *server,
+                                const char     *method,
+                                json_node      *parameters,
+                                void           *user_data)
+{
+    (void) server;
+    (void) method;
+    (void) parameters;
+    *(bool *)user_data = true;
+}
+
+static void respond(outputstream *remote_stdin, const char *message)
+{
+    char framed[256];
+    int framed_length = snprintf(framed, sizeof framed, "Content-Length: %zu\r\n\r\n%s", strlen(message), message);
+
+    outputstream_write(remote_stdin, framed, framed_length);
+}
+
+/**
+ * Makes a call to the remote and waits for the answer and a notification.
+ * If [remote_stdin] is set, the remote is `cat` and we answer for it.
+ */
+static bool run_session(jsonrpc_server *server, eventloop *loop, outputstream *remote_stdin)
+{
+    bool notified = false;
+    bool success = true;
+
+    jsonrpc_server_handle_notification(server, "test/remote", handle_notification, &notified, NULL);
+    jsonrpc_server_listen(server, loop);
+
+    call_data call = {0};
+    jsonrpc_server_call_remote_timed_async(server, "test/call", json_object_new(), &call.timing,
+                                           loop, call_cb, &call);
+
+    if (remote_stdin) {
+        while (!call.timing.sent_time && eventloop_process(loop, false, NULL))
+            ;
+        thrd_sleep(&(struct timespec){.tv_nsec = RESPONSE_DELAY}, NULL);
+        respond(remote_stdin, "{\"jsonrpc\":\"2.0\",\"id\":0,\"result\":{\"answer\":42}}");
+        respond(remote_stdin, "{\"jsonrpc\":\"2.0\",\"method\":\"test/remote\"}");
+    }
+
+    while (!(call.done && notified) && eventloop_process(loop, false, NULL))
+        ;
+
+    json_node *answer = call.result ? json_object_get_member(call.result, "answer") : NULL;
+    if (!answer || !json_node_cast(answer, integer) || ((json_integer *)answer)->value != 42) {
+        fprintf(stderr, "expected the answer to be 42\n");
+        success = false;
+    }
+
+    if (!notified) {
+        fprintf(stderr, "expected a notification from the remote\n");
+        success = false;
+    }
+
+    if (call.timing.received_time - call.timing.sent_time < RESPONSE_DELAY) {
+        fprintf(stderr, "expected the response to take at least %d ns, took %llu ns\n",
+                RESPONSE_DELAY, (unsigned long long)(call.timing.received_time - call.timing.sent_time));
+        success = false;
+    }
+
+    if (call.result)
+        json_node_unref(call.result);
+
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s replay-server trace-file\n", argv[0]);
+        return 1;
+    }
+
+    const char *replay_server = argv[1];
+    const char *trace_filename = argv[2];
+    outputstream *remote_stdin = NULL;
+    inputstream *remote_stdout = NULL;
+    io_process process = {0};
+    eventloop *loop = eventloop_new();
+    jsonrpc_server *server = NULL;
+    bool success = true;
+
+    // capture a session with `cat`
+    if (!io_communicate("cat", (const char *[]){"cat", NULL}, &remote_stdin,
+                        &remote_stdout, NULL, &process)) {
+        perror("failed to launch cat");
+        return 1;
+    }
+
+    outputstream *trace = outputstream_new_from_path(trace_filename, "w");
+    if (!trace) {
+        fprintf(stderr, "failed to open %s: %s\n", trace_filename, strerror(errno));
+        return 1;
+    }
+
+    // the remote only sees what we write to it ourselves
+    server = jsonrpc_server_new(remote_stdout, outputstream_new_from_path("/dev/null", "w"));
+    jsonrpc_server_capture(server, trace);
+    success &= run_session(server, loop, remote_stdin);
+
+    // let the remote exit and the server stop listening
+    outputstream_unref(remote_stdin);
+    while (eventloop_process(loop, false, NULL))
+        ;
+    // flushes the trace
+    jsonrpc_server_destroy(server);
+
+    // now replay the session
+    remote_stdin = NULL;
+    remote_stdout = NULL;
+    if (!io_communicate(replay_server, (const char *[]){replay_server, trace_filename, NULL},
+                        &remote_stdin, &remote_stdout, NULL, &process)) {
+        fprintf(stderr, "failed to launch %s: %s\n", replay_server, strerror(errno));
+        return 1;
+    }
+
+    server = jsonrpc_server_new(remote_stdout, remote_stdin);
+    success &= run_session(server, loop, NULL);
+
+    // let the replay server exit and the server stop listening
+    kill(process, SIGTERM);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    jsonrpc_server_destroy(server);
+    eventloop_destroy(loop);
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include "jsonrpc/jsonrpc-server.h"
+#include "jsonrpc/jsonrpc-stats.h"
+#include "json/json.h"
+#include "io/io-common.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "io/inputstream.h"
+#include "io/event.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+// `cat` echoes back whatever we write to it, so it plays a remote that
+// responds to our calls
+
+typedef struct {
+    json_node *result;
+    int errnum;
+    bool done;
+} call_data;
+
+static void call_cb(const event *ev, void *user_data)
+{
+    call_data *data = user_data;
+
+    data->result = jsonrpc_server_call_remote_finish(ev, &data->errnum);
+    data->done = true;
+}
+
+static void notify_cb(const event *ev, void *user_data)
+{
+    call_data *data = user_data;
+
+    jsonrpc_server_notify_remote_finish(ev, &data->errnum);
+    data->done = true;
+}
+
+static void handle_notification(jsonrpc_server *server,
+                                const char     *method,
+                                json_node      *parameters,
+                                void           *user_data)
+{
+    (void) server;
+    (void) method;
+    (void) parameters;
+    *(bool *)user_data = true;
+}
+
+/**
+ * Writes [message] to the remote, and returns the number of bytes written.
+ */
+static size_t respond(outputstream *remote_stdin, const char *message)
+{
+    char framed[256];
+    int framed_length = snprintf(framed, sizeof framed, "Content-Length: %zu\r\n\r\n%s", strlen(message), message);
+
+    outputstream_write(remote_stdin, framed, framed_length);
+    return (size_t) framed_length;
+}
+
+static bool expect_count(const char *method, const char *what, uint64_t count, uint64_t expected)
+{
+    if (count != expected) {
+        fprintf(stderr, "%s: expected %s to be %llu, got %llu\n",
+                method, what, (unsigned long long)expected, (unsigned long long)count);
+        return false;
+    }
+    return true;
+}
+
+int main(void)
+{
+    outputstream *remote_stdin = NULL;
+    inputstream *remote_stdout = NULL;
+    io_process process = {0};
+
+    if (!io_communicate("cat", (const char *[]){"cat", NULL}, &remote_stdin,
+                        &remote_stdout, NULL, &process)) {
+        perror("failed to launch cat");
+        return 1;
+    }
+
+    eventloop *loop = eventloop_new();
+    // the remote only sees what we write to it ourselves
+    jsonrpc_server *server = jsonrpc_server_new(remote_stdout, outputstream_new_from_path("/dev/null", "w"));
+    jsonrpc_stats *stats = jsonrpc_stats_new();
+    bool notified = false;
+    bool success = true;
+
+    server->stats = stats;
+    jsonrpc_server_handle_notification(server, "test/remote", handle_notification, &notified, NULL);
+    jsonrpc_server_listen(server, loop);
+
+    call_data call = {0};
+    jsonrpc_server_call_remote_async(server, "test/call", json_object_new(), loop, call_cb, &call);
+    call_data notification = {0};
+    jsonrpc_server_notify_remote_async(server, "test/notify", json_object_new(), loop, notify_cb, &notification);
+
+    // wait for both messages to be sent before responding
+    while (!notification.done && eventloop_process(loop, false, NULL))
+        ;
+    size_t response_size = respond(remote_stdin, "{\"jsonrpc\":\"2.0\",\"id\":0,\"result\":{\"answer\":42}}");
+    size_t notification_size = respond(remote_stdin, "{\"jsonrpc\":\"2.0\",\"method\":\"test/remote\"}");
+
+    while (!(call.done && notified) && eventloop_process(loop, false, NULL))
+        ;
+
+    const jsonrpc_method_stats *call_stats = jsonrpc_stats_get_method(stats, "test/call");
+    success &= expect_count("test/call", "messages sent", call_stats->messages_sent, 1);
+    success &= expect_count("test/call", "messages received", call_stats->messages_received, 1);
+    success &= expect_count("test/call", "bytes received", call_stats->bytes_received, response_size);
+    success &= expect_count("test/call", "latencies", call_stats->latencies->total_count, 1);
+    success &= expect_count("test/call", "parse times", call_stats->parse_times->total_count, 1);
+    success &= expect_count("test/call", "queueing delays", call_stats->queueing_delays->total_count, 1);
+    if (!call_stats->bytes_sent) {
+        fprintf(stderr, "test/call: expected bytes to be sent\n");
+        success = false;
+    }
+
+    const jsonrpc_method_stats *notify_stats = jsonrpc_stats_get_method(stats, "test/notify");
+    success &= expect_count("test/notify", "messages sent", notify_stats->messages_sent, 1);
+    success &= expect_count("test/notify", "messages received", notify_stats->messages_received, 0);
+    success &= expect_count("test/notify", "latencies", notify_stats->latencies->total_count, 0);
+
+    const jsonrpc_method_stats *remote_stats = jsonrpc_stats_get_method(stats, "test/remote");
+    success &= expect_count("test/remote", "messages sent", remote_stats->messages_sent, 0);
+    success &= expect_count("test/remote", "messages received", remote_stats->messages_received, 1);
+    success &= expect_count("test/remote", "bytes received", remote_stats->bytes_received, notification_size);
+
+    json_node *stats_json = json_node_ref(jsonrpc_stats_to_json(stats));
+    json_node *call_json = json_object_get_member(stats_json, "test/call");
+    if (!call_json || !json_object_get_member(call_json, "latency")) {
+        fprintf(stderr, "expected latencies for test/call in the JSON output\n");
+        success = false;
+    }
+    json_node_unref(stats_json);
+
+    if (call.result)
+        json_node_unref(call.result);
+
+    // let the remote exit and the server stop listening
+    outputstream_unref(remote_stdin);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    jsonrpc_server_destroy(server);
+    jsonrpc_stats_destroy(stats);
+    eventloop_destroy(loop);
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// stand-in language server for testing and benchmarking: replays a session
+// captured with `lstf --capture`, answering the client with the messages the
+// real server sent, in the same order and with the same timing.
+//
+// since lstf launches the server without arguments, the trace and the scale
+// can also be given with LSTF_REPLAY_TRACE and LSTF_REPLAY_SCALE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <time.h>
+
+typedef struct {
+  char direction;       // '>' from the client, '<' from the server
+  uint64_t time;        // nanoseconds since capturing began
+  size_t length;
+  char *content;
+} record;
+
+static uint64_t get_time(void) {
+  struct timespec ts;
+
+  timespec_get(&ts, TIME_UTC);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline) {
+  uint64_t now;
+
+  while ((now = get_time()) < deadline) {
+    uint64_t remaining = deadline - now;
+    thrd_sleep(&(struct timespec){.tv_sec = (time_t)(remaining / 1000000000),
+                                  .tv_nsec = (long)(remaining % 1000000000)},
+               NULL);
+  }
+}
+
+static void free_records(record *records, size_t num_records) {
+  for (size_t i = 0; i < num_records; i++)
+    free(records[i].content);
+  free(records);
+}
+
+/**
+ * Reads the trace into [records]. Returns the number of records, or -1 on
+ * error.
+ */
+static long read_trace(FILE *trace_file, record **records) {
+  size_t capacity = 16;
+  size_t num_records = 0;
+  record current;
+
+  *records = malloc(capacity * sizeof **records);
+  if (!*records) {
+    perror("failed to read trace");
+    abort();
+  }
+
+  while (fscanf(trace_file, " %c %" SCNu64 " %zu", &current.direction,
+                &current.time, &current.length) == 3) {
+    if ((current.direction != '>' && current.direction != '<') ||
+        current.length == 0 || fgetc(trace_file) != '\n') {
+      fprintf(stderr, "record %zu: invalid record header\n", num_records);
+      free_records(*records, num_records);
+      return -1;
+    }
+
+    if (!(current.content = malloc(current.length))) {
+      perror("failed to read trace");
+      abort();
+    }
+    if (fread(current.content, 1, current.length, trace_file) != current.length) {
+      fprintf(stderr, "record %zu: message is truncated\n", num_records);
+      free(current.content);
+      free_records(*records, num_records);
+      return -1;
+    }
+
+    if (num_records == capacity) {
+      record *resized = realloc(*records, (capacity *= 2) * sizeof **records);
+      if (!resized) {
+        perror("failed to read trace");
+        abort();
+      }
+      *records = resized;
+    }
+    (*records)[num_records++] = current;
+  }
+
+  if (!feof(trace_file)) {
+    fprintf(stderr, "record %zu: invalid record header\n", num_records);
+    free_records(*records, num_records);
+    return -1;
+  }
+
+  return (long)num_records;
+}
+
+/**
+ * Reads one message from the client and discards it. Returns false on EOF.
+ */
+static bool skip_message(FILE *input) {
+  char line[256];
+  size_t content_length = 0;
+  bool has_content_length = false;
+
+  // read the header fields up to the empty line
+  while (fgets(line, sizeof line, input)) {
+    if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) {
+      if (!has_content_length) {
+        fprintf(stderr, "message from client has no Content-Length\n");
+        return false;
+      }
+      for (size_t i = 0; i < content_length; i++)
+        if (fgetc(input) == EOF)
+          return false;
+      return true;
+    }
+    if (sscanf(line, "Content-Length: %zu", &content_length) == 1)
+      has_content_length = true;
+  }
+
+  return false;
+}
+
+static bool parse_scale(const char *str, double *scale) {
+  char *endptr = NULL;
+
+  *scale = strtod(str, &endptr);
+  return *str && !*endptr && *scale >= 0;
+}
+
+int main(int argc, char *argv[]) {
+  double scale = 1;
+  const char *trace_filename = getenv("LSTF_REPLAY_TRACE");
+  const char *scale_str = getenv("LSTF_REPLAY_SCALE");
+
+  if (scale_str && !parse_scale(scale_str, &scale)) {
+    fprintf(stderr, "%s: LSTF_REPLAY_SCALE must be a non-negative number\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-scale") == 0 && i + 1 < argc) {
+      if (!parse_scale(argv[++i], &scale)) {
+        fprintf(stderr, "%s: -scale must be a non-negative number\n", argv[0]);
+        return 1;
+      }
+    } else if (i == argc - 1) {
+      trace_filename = argv[i];
+    } else {
+      trace_filename = NULL;
+      break;
+    }
+  }
+
+  if (!trace_filename) {
+    fprintf(stderr, "usage: %s [-scale factor] trace-file\n"
+                    "\n"
+                    "The time between a message from the client and each\n"
+                    "response is multiplied by the scale factor. 0 responds\n"
+                    "immediately, and 1 (the default) keeps the original timing.\n",
+            argv[0]);
+    return 1;
+  }
+
+  FILE *trace_file = fopen(trace_filename, "rb");
+  if (!trace_file) {
+    fprintf(stderr, "failed to open `%s' for reading: %s\n", trace_filename,
+            strerror(errno));
+    return 1;
+  }
+
+  record *records = NULL;
+  long num_records = read_trace(trace_file, &records);
+  fclose(trace_file);
+  if (num_records < 0) {
+    fprintf(stderr, "%s: invalid trace\n", trace_filename);
+    return 1;
+  }
+
+  // responses are timed from the last message that we got from the client,
+  // since the client may be slower or faster than it was when capturing
+  uint64_t last_received_time = get_time();
+  uint64_t last_received_trace_time = 0;
+  int retval = 0;
+
+  for (long i = 0; i < num_records; i++) {
+    const record *current = &records[i];
+
+    if (current->direction == '>') {
+      if (!skip_message(stdin)) {
+        fprintf(stderr, "client went away before record %ld\n", i);
+        retval = 1;
+        break;
+      }
+      last_received_time = get_time();
+      last_received_trace_time = current->time;
+    } else {
+      uint64_t delay = current->time > last_received_trace_time
+                           ? current->time - last_received_trace_time
+                           : 0;
+      sleep_until(last_received_time + (uint64_t)((double)delay * scale));
+      printf("Content-Length: %zu\r\n\r\n", current->length);
+      fwrite(current->content, 1, current->length, stdout);
+      fflush(stdout);
+    }
+  }
+
+  // wait for the client to hang up
+  while (retval == 0 && skip_message(stdin))
+    ;
+
+  free_records(records, (size_t)num_records);
+  return retval;
+}
@@ -0,0 +1,135 @@
+#include "data-structures/piece-table.h"
+#include "io/event.h"
+#include "io/inputstream.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "jsonrpc/jsonrpc-server.h"
+#include "lsp/lsp-client.h"
+#include "json/json-parser.h"
+#include "json/json.h"
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// `cat` echoes back the notifications we send to it, so we can see what went
+// over the wire
+
+typedef struct {
+    json_node *params;
+    bool sent;
+} change_data;
+
+static void did_change_handler(jsonrpc_server *server,
+                               const char     *method,
+                               json_node      *parameters,
+                               void           *user_data)
+{
+    (void) server;
+    (void) method;
+    change_data *data = user_data;
+
+    data->params = json_node_ref(parameters);
+}
+
+static void change_cb(const event *ev, void *user_data)
+{
+    change_data *data = user_data;
+    int errnum = 0;
+
+    if (!lsp_client_text_document_change_finish(ev, &errnum))
+        fprintf(stderr, "failed to send textDocument/didChange: %s\n", strerror(errnum));
+    data->sent = true;
+}
+
+static bool change(lsp_client                               *client,
+                   eventloop                                *loop,
+                   change_data                              *data,
+                   const lsp_textdocumentcontentchangeevent *changes,
+                   size_t                                    num_changes,
+                   const char                               *expected_params)
+{
+    bool passed = true;
+
+    lsp_client_text_document_change_async(client, &client->docs.elements[0],
+                                          changes, num_changes, loop, change_cb, data);
+    while (!(data->sent && data->params) && eventloop_process(loop, false, NULL))
+        ;
+
+    json_node *expected = json_parser_parse_string(expected_params);
+    if (!data->params || !json_node_equal_to(data->params, expected)) {
+        char *params_str = data->params ? json_node_to_string(data->params, false) : NULL;
+        fprintf(stderr, "expected textDocument/didChange with\n%s\ngot\n%s\n",
+                expected_params, params_str ? params_str : "(nothing)");
+        free(params_str);
+        passed = false;
+    }
+
+    json_node_unref(expected);
+    if (data->params)
+        json_node_unref(data->params);
+    *data = (change_data) {0};
+    return passed;
+}
+
+int main(void)
+{
+    outputstream *server_stdin = NULL;
+    inputstream *server_stdout = NULL;
+    io_process process = {0};
+
+    if (!io_communicate("cat", (const char *[]){"cat", NULL}, &server_stdin,
+                        &server_stdout, NULL, &process)) {
+        perror("failed to launch cat");
+        return 1;
+    }
+
+    eventloop *loop = eventloop_new();
+    lsp_client *client = lsp_client_new(loop, server_stdout, server_stdin, process);
+    change_data data = {0};
+    int retval = 0;
+
+    // pretend that the server was initialized
+    client->initialize_params.process_id = io_getpid();
+    client->text_document_sync = lsp_textdocumentsynckind_incremental;
+    jsonrpc_server_handle_notification(super(client), "textDocument/didChange",
+                                       did_change_handler, &data, NULL);
+
+    const char *text = "fun main() {\n}\n";
+    lsp_textdocument document = {
+        .uri = strdup("untitled:///buffer0.lstf"),
+        .language_id = strdup("lstf"),
+        .text = piece_table_new(text, strlen(text))
+    };
+    array_add(&client->docs, document);
+
+    // only the changed ranges are sent
+    if (!change(client, loop, &data, (lsp_textdocumentcontentchangeevent[]) {
+                    { .range = { {1, 0}, {1, 0} }, .has_range = true, .text = "    print(42);\n" },
+                    { .range = { {0, 4}, {0, 8} }, .has_range = true, .text = "start" }
+                }, 2,
+                "{\"textDocument\":{\"uri\":\"untitled:///buffer0.lstf\",\"version\":1},\"contentChanges\":["
+                "{\"range\":{\"start\":{\"line\":1,\"character\":0},\"end\":{\"line\":1,\"character\":0}},\"text\":\"    print(42);\\n\"},"
+                "{\"range\":{\"start\":{\"line\":0,\"character\":4},\"end\":{\"line\":0,\"character\":8}},\"text\":\"start\"}]}"))
+        retval = 1;
+
+    // a server that wants the full text gets it
+    client->text_document_sync = lsp_textdocumentsynckind_full;
+    if (!change(client, loop, &data, (lsp_textdocumentcontentchangeevent[]) {
+                    { .range = { {2, 0}, {2, 1} }, .has_range = true, .text = "} // start" }
+                }, 1,
+                "{\"textDocument\":{\"uri\":\"untitled:///buffer0.lstf\",\"version\":2},\"contentChanges\":["
+                "{\"text\":\"fun start() {\\n    print(42);\\n} // start\\n\"}]}"))
+        retval = 1;
+
+    // let the server exit and the client stop listening
+    kill(process, SIGTERM);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    lsp_client_destroy(client);
+    eventloop_destroy(loop);
+
+    return retval;
+}
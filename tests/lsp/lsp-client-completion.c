@@ -0,0 +1,146 @@
+#include "io/event.h"
+#include "io/inputstream.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "lsp/lsp-client.h"
+#include "json/json.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// `cat` echoes back whatever we write to it, so it plays a server that
+// streams partial results for our request
+
+typedef struct {
+    // the labels of the partial results, in the order they arrived
+    char labels[64];
+    unsigned batches;
+    json_node *result;
+    bool done;
+} completion_data;
+
+static void append_labels(char *labels, size_t size, json_node *items)
+{
+    json_array_foreach(items, item, {
+        json_node *label = json_object_get_member(item, "label");
+        size_t length = strlen(labels);
+        snprintf(labels + length, size - length, "%s;", json_node_cast(label, string)->value);
+    });
+}
+
+static void partial_result_cb(lsp_client *client, json_node *value, void *user_data)
+{
+    (void) client;
+    completion_data *data = user_data;
+
+    if (data->done) {
+        fprintf(stderr, "got partial results after the response\n");
+        return;
+    }
+
+    if (value->node_type == json_node_type_object)
+        value = json_object_get_member(value, "items");
+    append_labels(data->labels, sizeof data->labels, value);
+    data->batches++;
+}
+
+static void completion_cb(const event *ev, void *user_data)
+{
+    completion_data *data = user_data;
+    int errnum = 0;
+
+    data->result = lsp_client_text_document_completion_finish(ev, &errnum);
+    data->done = true;
+    if (!data->result)
+        fprintf(stderr, "completion failed: %s\n", strerror(errnum));
+}
+
+static void send(outputstream *server_stdin, const char *message)
+{
+    char framed[512];
+    int framed_length = snprintf(framed, sizeof framed, "Content-Length: %zu\r\n\r\n%s", strlen(message), message);
+
+    outputstream_write(server_stdin, framed, framed_length);
+}
+
+int main(void)
+{
+    outputstream *server_stdin = NULL;
+    inputstream *server_stdout = NULL;
+    io_process process = {0};
+
+    if (!io_communicate("cat", (const char *[]){"cat", NULL}, &server_stdin,
+                        &server_stdout, NULL, &process)) {
+        perror("failed to launch cat");
+        return 1;
+    }
+
+    eventloop *loop = eventloop_new();
+    // the server only sees what we write to it ourselves. the request must
+    // still be sent somewhere before the client waits for a response.
+    lsp_client *client = lsp_client_new(loop, server_stdout,
+                                        outputstream_new_from_path("/dev/null", "w"), process);
+    int retval = 0;
+
+    // pretend that the server was initialized
+    client->initialize_params.process_id = io_getpid();
+
+    completion_data data = {0};
+    lsp_client_text_document_completion_async(client, "test:///a",
+                                              (lsp_position) { .line = 1, .character = 2 },
+                                              partial_result_cb, &data,
+                                              loop, completion_cb, &data);
+
+    // this is the first request, so it has the first ID and token. progress
+    // for other tokens and progress after the response must be ignored.
+    send(server_stdin, "{\"jsonrpc\":\"2.0\",\"method\":\"$/progress\","
+            "\"params\":{\"token\":\"lstf/partial/0\",\"value\":[{\"label\":\"a\"},{\"label\":\"b\"}]}}");
+    send(server_stdin, "{\"jsonrpc\":\"2.0\",\"method\":\"$/progress\","
+            "\"params\":{\"token\":\"other\",\"value\":[{\"label\":\"x\"}]}}");
+    send(server_stdin, "{\"jsonrpc\":\"2.0\",\"method\":\"$/progress\","
+            "\"params\":{\"token\":\"lstf/partial/0\",\"value\":{\"isIncomplete\":false,\"items\":[{\"label\":\"c\"}]}}}");
+    send(server_stdin, "{\"jsonrpc\":\"2.0\",\"id\":0,\"result\":[{\"label\":\"d\"}]}");
+    send(server_stdin, "{\"jsonrpc\":\"2.0\",\"method\":\"$/progress\","
+            "\"params\":{\"token\":\"lstf/partial/0\",\"value\":[{\"label\":\"y\"}]}}");
+
+    while (!data.done && eventloop_process(loop, false, NULL))
+        ;
+
+    if (data.batches != 2 || strcmp(data.labels, "a;b;c;") != 0) {
+        fprintf(stderr, "expected 2 batches of partial results (a;b;c;), got %u (%s)\n",
+                data.batches, data.labels);
+        retval = 1;
+    }
+
+    if (!data.result || data.result->node_type != json_node_type_array) {
+        fprintf(stderr, "expected the rest of the items in the response\n");
+        retval = 1;
+    } else {
+        char labels[64] = "";
+
+        append_labels(labels, sizeof labels, data.result);
+        if (strcmp(labels, "d;") != 0) {
+            fprintf(stderr, "expected the response to have d;, got %s\n", labels);
+            retval = 1;
+        }
+    }
+
+    if (!ptr_hashmap_is_empty(client->partial_result_handlers)) {
+        fprintf(stderr, "partial result handler was left behind\n");
+        retval = 1;
+    }
+
+    if (data.result)
+        json_node_unref(data.result);
+
+    // let the server exit and the client stop listening
+    outputstream_unref(server_stdin);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    lsp_client_destroy(client);
+    eventloop_destroy(loop);
+
+    return retval;
+}
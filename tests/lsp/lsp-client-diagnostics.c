@@ -0,0 +1,158 @@
+#include "io/event.h"
+#include "io/inputstream.h"
+#include "io/io-process.h"
+#include "io/outputstream.h"
+#include "lsp/lsp-client.h"
+#include "json/json.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// `cat` echoes back whatever we write to it, so it plays a server that
+// publishes the diagnostics we want
+
+typedef struct {
+    const char *uri;
+    int64_t version;
+    json_node *params;
+    bool done;
+} waiter_data;
+
+static void diagnostics_cb(const event *ev, void *user_data)
+{
+    waiter_data *data = user_data;
+    int errnum = 0;
+
+    data->params = lsp_client_wait_for_diagnostics_finish(ev, &errnum);
+    data->done = true;
+    if (!data->params)
+        fprintf(stderr, "waiting for diagnostics of %s failed: %s\n", data->uri, strerror(errnum));
+}
+
+static void publish(outputstream *server_stdin, const char *uri, int64_t version)
+{
+    char message[256];
+    char framed[320];
+    int length = snprintf(message, sizeof message,
+            "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\","
+            "\"params\":{\"uri\":\"%s\",\"version\":%" PRIi64 ",\"diagnostics\":[]}}",
+            uri, version);
+    int framed_length = snprintf(framed, sizeof framed, "Content-Length: %d\r\n\r\n%s", length, message);
+
+    outputstream_write(server_stdin, framed, framed_length);
+}
+
+static bool check_result(const waiter_data *data, int64_t expected_version)
+{
+    if (!data->done || !data->params) {
+        fprintf(stderr, "no diagnostics for %s\n", data->uri);
+        return false;
+    }
+
+    json_node *uri = json_object_get_member(data->params, "uri");
+    json_node *version = json_object_get_member(data->params, "version");
+
+    if (strcmp(json_node_cast(uri, string)->value, data->uri) != 0 ||
+            json_node_cast(version, integer)->value != expected_version) {
+        char *params_str = json_node_to_string(data->params, false);
+        fprintf(stderr, "wrong diagnostics for %s (version %" PRIi64 "): %s\n",
+                data->uri, expected_version, params_str);
+        free(params_str);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Returns the version of the diagnostics saved for [uri], or `-1`.
+ */
+static int64_t saved_version(lsp_client *client, const char *uri)
+{
+    ptr_hashmap_entry *entry = ptr_hashmap_get(client->diagnostics_results, uri);
+
+    if (!entry)
+        return -1;
+    return json_node_cast(json_object_get_member(entry->value, "version"), integer)->value;
+}
+
+int main(void)
+{
+    outputstream *server_stdin = NULL;
+    inputstream *server_stdout = NULL;
+    io_process process = {0};
+
+    if (!io_communicate("cat", (const char *[]){"cat", NULL}, &server_stdin,
+                        &server_stdout, NULL, &process)) {
+        perror("failed to launch cat");
+        return 1;
+    }
+
+    eventloop *loop = eventloop_new();
+    // the client has nothing to send, so keep the server's stdin to ourselves
+    lsp_client *client = lsp_client_new(loop, server_stdout,
+                                        outputstream_new_from_buffer(NULL, 0, true), process);
+    int retval = 0;
+
+    // pretend that the server was initialized
+    client->initialize_params.process_id = io_getpid();
+
+    waiter_data b = { .uri = "test:///b", .version = 2 };
+    waiter_data a = { .uri = "test:///a", .version = -1 };
+    lsp_client_wait_for_diagnostics_async(client, b.uri, b.version, loop, diagnostics_cb, &b);
+    lsp_client_wait_for_diagnostics_async(client, a.uri, a.version, loop, diagnostics_cb, &a);
+
+    // an old version of B must not complete the waiter for B, and the
+    // diagnostics for C are kept for later
+    publish(server_stdin, "test:///b", 1);
+    publish(server_stdin, "test:///c", 1);
+    publish(server_stdin, "test:///a", 1);
+    publish(server_stdin, "test:///c", 2);
+    publish(server_stdin, "test:///b", 2);
+    publish(server_stdin, "test:///c", 3);
+
+    while (!(a.done && b.done && saved_version(client, "test:///c") == 3) &&
+            eventloop_process(loop, false, NULL))
+        ;
+
+    if (ptr_hashmap_num_elements(client->diagnostics_results) != 1) {
+        fprintf(stderr, "expected only the diagnostics for C to be saved\n");
+        retval = 1;
+    }
+
+    if (!check_result(&a, 1) || !check_result(&b, 2))
+        retval = 1;
+
+    // only the latest diagnostics for C are kept, and it is returned at once
+    waiter_data c = { .uri = "test:///c", .version = -1 };
+    lsp_client_wait_for_diagnostics_async(client, c.uri, c.version, loop, diagnostics_cb, &c);
+    while (!c.done && eventloop_process(loop, false, NULL))
+        ;
+
+    if (!check_result(&c, 3))
+        retval = 1;
+
+    if (!ptr_hashmap_is_empty(client->diagnostics_results) ||
+            !ptr_hashmap_is_empty(client->diagnostics_waiters)) {
+        fprintf(stderr, "diagnostics were left behind\n");
+        retval = 1;
+    }
+
+    if (a.params)
+        json_node_unref(a.params);
+    if (b.params)
+        json_node_unref(b.params);
+    if (c.params)
+        json_node_unref(c.params);
+
+    // let the server exit and the client stop listening
+    outputstream_unref(server_stdin);
+    while (eventloop_process(loop, false, NULL))
+        ;
+
+    lsp_client_destroy(client);
+    eventloop_destroy(loop);
+
+    return retval;
+}
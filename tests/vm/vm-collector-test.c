@@ -0,0 +1,103 @@
+#include "json/json.h"
+#include "vm/lstf-vm-collector.h"
+#include "vm/lstf-vm-value.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int retval = 0;
+
+static void check(bool condition, const char *message)
+{
+    if (!condition) {
+        fprintf(stderr, "%s\n", message);
+        retval = 1;
+    }
+}
+
+int main(void)
+{
+    lstf_vm_collector *collector = lstf_vm_collector_get_thread_default();
+    const lstf_vm_collector_stats *stats = lstf_vm_collector_get_stats(collector);
+
+    // an object and an array that refer to each other
+    {
+        json_node *object = json_node_ref(json_object_new());
+        json_node *array = json_node_ref(json_array_new());
+
+        json_object_set_member(object, "array", array);
+        json_array_add_element(array, object);
+        json_array_add_element(array, json_string_new("leaf"));
+        json_node_unref(object);
+        json_node_unref(array);
+
+        lstf_vm_collector_collect(collector);
+        check(stats->objects_collected == 2, "JSON cycle was not collected");
+    }
+
+    // a cycle that is still referenced from outside must survive, with its
+    // reference counts intact
+    {
+        json_node *object = json_node_ref(json_object_new());
+        json_node *array = json_node_ref(json_array_new());
+
+        json_object_set_member(object, "array", array);
+        json_array_add_element(array, object);
+        json_array_add_element(array, object);
+        json_node_unref(array);
+
+        unsigned long objects_collected = stats->objects_collected;
+        lstf_vm_collector_collect(collector);
+        check(stats->objects_collected == objects_collected, "referenced cycle was collected");
+        check(object->refcount == 3 && array->refcount == 1, "reference counts were not restored");
+        check(json_object_get_member(object, "array") == array &&
+                json_array_get_element(array, 1) == object, "referenced cycle was modified");
+
+        json_node_unref(object);
+        lstf_vm_collector_collect(collector);
+        check(stats->objects_collected == objects_collected + 2, "JSON cycle was not collected");
+    }
+
+    // an object holding a closure that captures the object:
+    // object -> pointer -> closure -> up-value -> object
+    {
+        json_node *object = json_node_ref(json_object_new());
+        lstf_vm_upvalue *upvalue = lstf_vm_upvalue_ref(lstf_vm_upvalue_new(0, NULL));
+
+        upvalue->is_local = false;
+        upvalue->value = (lstf_vm_value) {
+            .value_type = lstf_vm_value_type_object_ref,
+            .takes_ownership = true,
+            .data = { .json_node_ref = json_node_ref(object) }
+        };
+
+        lstf_vm_closure *closure = lstf_vm_closure_ref(lstf_vm_closure_new(NULL, 1, &upvalue));
+        json_object_set_member(object, "next", lstf_vm_value_to_json_node((lstf_vm_value) {
+            .value_type = lstf_vm_value_type_closure,
+            .data = { .closure = closure }
+        }));
+
+        lstf_vm_closure_unref(closure);
+        lstf_vm_upvalue_unref(upvalue);
+        json_node_unref(object);
+
+        unsigned long objects_collected = stats->objects_collected;
+        lstf_vm_collector_collect(collector);
+        check(stats->objects_collected == objects_collected + 4, "closure cycle was not collected");
+    }
+
+    // the collector asks to run after enough allocations
+    {
+        lstf_vm_collector_set_threshold(collector, 3);
+        lstf_vm_collector_collect(collector);
+        check(!lstf_vm_collector_should_collect(collector), "collector should not run after collecting");
+        for (unsigned i = 0; i < 3; i++)
+            json_node_unref(json_array_new());
+        check(lstf_vm_collector_should_collect(collector), "collector should run after 3 allocations");
+    }
+
+    check(stats->collections == 5, "wrong number of collections");
+
+    lstf_vm_collector_unref(collector);
+    return retval;
+}
@@ -0,0 +1,118 @@
+#include "io/inputstream.h"
+#include "io/outputstream.h"
+#include "vm/lstf-virtualmachine.h"
+#include "vm/lstf-vm-loader.h"
+#include "vm/lstf-vm-program.h"
+#include "vm/lstf-vm-status.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// loads a program from a file, which should be mapped, and checks that it
+// runs. then checks that every truncated copy of the program fails to load
+// instead of being read past its end
+
+static bool run_program(lstf_vm_program *program, const char *expected_output)
+{
+    outputstream *ostream = outputstream_new_from_buffer(NULL, 0, true);
+    lstf_virtualmachine *vm = lstf_virtualmachine_new(program, ostream, false);
+    bool success = true;
+
+    if (lstf_virtualmachine_run(vm) || vm->last_status != lstf_vm_status_exited) {
+        fprintf(stderr, "VM encountered a fatal error: %s.\n", lstf_vm_status_to_string(vm->last_status));
+        success = false;
+    } else if (vm->ostream->buffer_offset != strlen(expected_output) ||
+            memcmp(vm->ostream->buffer, expected_output, vm->ostream->buffer_offset) != 0) {
+        fprintf(stderr, "---expected output:\n%s---actual output:\n%.*s", expected_output,
+                (int) vm->ostream->buffer_offset, vm->ostream->buffer);
+        success = false;
+    }
+
+    lstf_virtualmachine_destroy(vm);
+    return success;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s hello-world.lstfc\n", argv[0]);
+        return 1;
+    }
+
+    lstf_vm_loader_error error = lstf_vm_loader_error_none;
+    lstf_vm_program *program = lstf_vm_loader_load_from_path(argv[1], &error);
+    int retval = 0;
+
+    if (!program) {
+        fprintf(stderr, "failed to load %s (error %u): %s\n", argv[1], error, strerror(errno));
+        return 1;
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (!program->image_is_mapped) {
+        fprintf(stderr, "expected %s to be mapped\n", argv[1]);
+        retval = 1;
+    }
+#endif
+    if (program->code < program->image || program->code + program->code_size > program->image + program->image_size) {
+        fprintf(stderr, "expected the code to point into the image\n");
+        retval = 1;
+    }
+
+    // copy the image before the program is unloaded
+    size_t image_size = program->image_size;
+    uint8_t *image = malloc(image_size);
+    if (!image) {
+        perror("failed to copy program");
+        abort();
+    }
+    memcpy(image, program->image, image_size);
+
+    if (!run_program(program, "hello, world\n\n"))
+        retval = 1;
+
+    // the whole program loads from a buffer, but no part of it does
+    if (!(program = lstf_vm_loader_load_from_buffer(image, image_size, &error))) {
+        fprintf(stderr, "failed to load program from buffer (error %u)\n", error);
+        retval = 1;
+    }
+    lstf_vm_program_unref(program);
+
+    for (size_t length = 0; length < image_size; length++) {
+        if ((program = lstf_vm_loader_load_from_buffer(image, length, &error)) || error == lstf_vm_loader_error_none) {
+            fprintf(stderr, "expected the first %zu bytes of the program to fail to load\n", length);
+            lstf_vm_program_unref(program);
+            retval = 1;
+        }
+    }
+
+    // strings in the data section must be terminated
+    uint8_t *data_end = memchr(image, '"', image_size);
+    if (data_end && (data_end = memchr(data_end + 1, '"', image_size - (size_t)(data_end + 1 - image)))) {
+        data_end[1] = 'x';
+        if ((program = lstf_vm_loader_load_from_buffer(image, image_size, &error)) ||
+                error != lstf_vm_loader_error_unterminated_data) {
+            fprintf(stderr, "expected a data section without a terminator to fail to load\n");
+            lstf_vm_program_unref(program);
+            retval = 1;
+        }
+        data_end[1] = '\0';
+    } else {
+        fprintf(stderr, "expected the program to have a string in its data section\n");
+        retval = 1;
+    }
+
+    // loading the debug info of a program without any succeeds
+    program = lstf_vm_program_ref(lstf_vm_loader_load_from_buffer(image, image_size, &error));
+    if (!program || !lstf_vm_loader_load_debuginfo(program, &error) || program->source_filename) {
+        fprintf(stderr, "expected a program without debug info to have no debug info\n");
+        retval = 1;
+    }
+    lstf_vm_program_unref(program);
+
+    free(image);
+    return retval;
+}
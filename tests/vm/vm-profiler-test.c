@@ -0,0 +1,114 @@
+#include "compiler/lstf-codegenerator.h"
+#include "compiler/lstf-file.h"
+#include "compiler/lstf-parser.h"
+#include "compiler/lstf-semanticanalyzer.h"
+#include "compiler/lstf-symbolresolver.h"
+#include "io/outputstream.h"
+#include "vm/lstf-virtualmachine.h"
+#include "vm/lstf-vm-loader.h"
+#include "vm/lstf-vm-profiler.h"
+#include "vm/lstf-vm-program.h"
+#include "vm/lstf-vm-status.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// compiles a script, which should have debug info, and profiles it with a
+// sample taken every few instructions. then checks that the folded stacks are
+// well-formed and that their frames are named after the script's functions
+
+static lstf_vm_program *compile_script(const char *filename)
+{
+    lstf_file *script = lstf_file_load(filename);
+    lstf_vm_program *program = NULL;
+
+    if (!script) {
+        fprintf(stderr, "failed to load %s: %s\n", filename, strerror(errno));
+        return NULL;
+    }
+
+    lstf_parser *parser = lstf_parser_new(script);
+    lstf_parser_parse(parser);
+    lstf_symbolresolver *resolver = lstf_symbolresolver_new(script);
+    lstf_symbolresolver_resolve(resolver);
+    lstf_semanticanalyzer *analyzer = lstf_semanticanalyzer_new(script);
+    analyzer->encountered_server_path_assignment = true;
+    analyzer->encountered_project_files_assignment = true;
+    lstf_semanticanalyzer_analyze(analyzer);
+    lstf_codegenerator *generator = lstf_codegenerator_new(script);
+    lstf_codegenerator_compile(generator);
+
+    size_t bytecode_length = 0;
+    const uint8_t *bytecode = lstf_codegenerator_get_compiled_bytecode(generator, &bytecode_length);
+    if (!bytecode)
+        fprintf(stderr, "failed to compile %s\n", filename);
+    else if (!(program = lstf_vm_loader_load_from_buffer(bytecode, bytecode_length, NULL)))
+        fprintf(stderr, "failed to load the bytecode for %s\n", filename);
+
+    lstf_parser_unref(parser);
+    lstf_symbolresolver_unref(resolver);
+    lstf_semanticanalyzer_unref(analyzer);
+    lstf_codegenerator_unref(generator);
+    return program;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s async-fibonacci.lstf\n", argv[0]);
+        return 1;
+    }
+
+    lstf_vm_program *program = compile_script(argv[1]);
+    if (!program)
+        return 1;
+
+    lstf_virtualmachine *vm = lstf_virtualmachine_new(program, outputstream_new_from_buffer(NULL, 0, true), false);
+    lstf_vm_profiler *profiler = lstf_vm_profiler_new(program, 0);
+    int retval = 0;
+
+    vm->profiler = profiler;
+    if (lstf_virtualmachine_run(vm) || vm->last_status != lstf_vm_status_exited) {
+        fprintf(stderr, "VM encountered a fatal error: %s.\n", lstf_vm_status_to_string(vm->last_status));
+        retval = 1;
+    }
+    lstf_virtualmachine_destroy(vm);
+
+    outputstream *folded = outputstream_new_from_buffer(NULL, 0, true);
+    if (!lstf_vm_profiler_write_folded(profiler, folded) || !outputstream_write_byte(folded, '\0')) {
+        fprintf(stderr, "failed to write the folded stacks\n");
+        retval = 1;
+    }
+
+    unsigned num_stacks = 0;
+    bool sampled_fibonacci = false;
+    for (char *line = (char *)folded->buffer, *saveptr = NULL; retval == 0 && (line = strtok_r(line, "\n", &saveptr)); line = NULL) {
+        char *weight = strrchr(line, ' ');
+        char *endptr = NULL;
+
+        num_stacks++;
+        if (!weight || strtoull(weight + 1, &endptr, 10) == 0 || *endptr) {
+            fprintf(stderr, "expected a stack and a weight: %s\n", line);
+            retval = 1;
+        } else if (strncmp(line, "executing;main:", sizeof "executing;main:" - 1) != 0 &&
+                   strncmp(line, "executing;task:", sizeof "executing;task:" - 1) != 0) {
+            fprintf(stderr, "expected the stack to begin in main() or task(): %s\n", line);
+            retval = 1;
+        } else if (strstr(line, ";0x")) {
+            fprintf(stderr, "expected every frame to have a name: %s\n", line);
+            retval = 1;
+        }
+        sampled_fibonacci |= strstr(line, ";fibonacci:") != NULL;
+    }
+
+    if (retval == 0 && (num_stacks == 0 || !sampled_fibonacci)) {
+        fprintf(stderr, "expected fibonacci() to be sampled\n");
+        retval = 1;
+    }
+
+    outputstream_unref(folded);
+    lstf_vm_profiler_destroy(profiler);
+    return retval;
+}